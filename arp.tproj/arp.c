@@ -95,15 +95,19 @@ static char const copyright[] =
 #include <ctype.h>
 #include <err.h>
 #include <errno.h>
+#include <ifaddrs.h>
 #include <netdb.h>
 #include <nlist.h>
 #include <paths.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 #include <unistd.h>
 
+#include "ifindex_name.h"
+
 typedef void (action_fn)(struct sockaddr_dl *sdl,
 	struct sockaddr_inarp *s_in, struct rt_msghdr *rtm);
 typedef void (action_ext_fn)(struct sockaddr_dl *sdl,
@@ -131,6 +135,8 @@ static char *sec2str(time_t);
 static int nflag;	/* no reverse dns lookups */
 static int xflag;	/* extended link-layer reachability information */
 static char *rifname;
+static unsigned int rifindex;	/* index of rifname, checked before its name */
+static struct timeval dump_time;	/* when the table was read */
 
 static int	expire_time, flags, doing_proxy, proxy_only;
 
@@ -161,7 +167,6 @@ main(int argc, char *argv[])
 	int rtn = 0;
 	int aflag = 0;	/* do it for all entries */
 	int lflag = 0;
-	uint32_t ifindex = 0;
 
 	while ((ch = getopt(argc, argv, "andflsSi:x")) != -1)
 		switch((char)ch) {
@@ -205,7 +210,7 @@ main(int argc, char *argv[])
 	if (rifname) {
 		if (func != F_GET && !(func == F_DELETE && aflag))
 			errx(1, "-i not applicable to this operation");
-		if ((ifindex = if_nametoindex(rifname)) == 0) {
+		if ((rifindex = if_nametoindex(rifname)) == 0) {
 			if (errno == ENXIO)
 				errx(1, "interface %s does not exist", rifname);
 			else
@@ -217,6 +222,8 @@ main(int argc, char *argv[])
 		if (aflag) {
 			if (argc != 0)
 				usage();
+			/* the whole table goes out in large writes */
+			setvbuf(stdout, NULL, _IOFBF, 64 * 1024);
 			if (lflag) {
 				printf("%-23s %-17s %-9.9s %-9.9s %14.14s %4s "
 				    "%4s", "Neighbor",
@@ -283,6 +290,332 @@ main(int argc, char *argv[])
 	return (rtn);
 }
 
+/*
+ * Bulk loading for -f.  The whole file is parsed first, host names are
+ * resolved by a small pool of threads, and the ARP table is fetched once
+ * so that lines which are already in place cost nothing.  The remaining
+ * entries are written to the routing socket back to back; write(2)
+ * reports the outcome, so no reply is read.  Lines that need the kernel
+ * to pick the interface (proxy entries, destinations that are not on a
+ * directly connected subnet) still go through set().
+ */
+#define FILE_RESOLVERS	16
+
+struct fentry {
+	char		*fe_argv[7];
+	int		fe_argc;
+	int		fe_lineno;
+	int		fe_slow;	/* use set() */
+	int		fe_resolved;	/* 0 pending, 1 done, -1 failed */
+	int		fe_gaierr;
+	struct in_addr	fe_addr;
+	struct ether_addr fe_ea;
+	int		fe_flags;
+	int		fe_expire;
+	unsigned int	fe_ifscope;
+};
+
+struct fsnap {
+	in_addr_t	fs_addr;
+	unsigned int	fs_scope;
+	int		fs_used;
+	int		fs_flags;
+	int32_t		fs_expire;
+	u_short		fs_index;
+	u_char		fs_alen;
+	u_char		fs_lladdr[ETHER_ADDR_LEN];
+};
+
+struct fif {
+	in_addr_t	fi_addr;
+	in_addr_t	fi_mask;
+	u_short		fi_index;
+	u_char		fi_type;
+};
+
+static struct fentry *fents;
+static int nfents, fnext;
+static pthread_mutex_t fents_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct fsnap *fsnaps;
+static size_t nfsnaps, fsnapmask;
+
+static struct fif *fifs;
+static int nfifs;
+
+static void *
+file_resolver(void *arg __unused)
+{
+	struct addrinfo hints, *res;
+	struct fentry *fe;
+	int i, error;
+
+	bzero(&hints, sizeof(hints));
+	hints.ai_family = AF_INET;
+	for (;;) {
+		pthread_mutex_lock(&fents_lock);
+		while (fnext < nfents && fents[fnext].fe_resolved != 0)
+			fnext++;
+		i = fnext++;
+		pthread_mutex_unlock(&fents_lock);
+		if (i >= nfents)
+			break;
+		fe = &fents[i];
+		error = getaddrinfo(fe->fe_argv[0], NULL, &hints, &res);
+		if (error != 0) {
+			fe->fe_gaierr = error;
+			fe->fe_resolved = -1;
+			continue;
+		}
+		fe->fe_addr = ((struct sockaddr_in *)res->ai_addr)->sin_addr;
+		fe->fe_resolved = 1;
+		freeaddrinfo(res);
+	}
+	return (NULL);
+}
+
+static void
+file_resolve(void)
+{
+	pthread_t tids[FILE_RESOLVERS];
+	int i, n, pending;
+
+	for (i = pending = 0; i < nfents; i++)
+		if (fents[i].fe_resolved == 0)
+			pending++;
+	if (pending == 0)
+		return;
+	if (pending > FILE_RESOLVERS)
+		pending = FILE_RESOLVERS;
+	for (n = 0; n < pending; n++)
+		if (pthread_create(&tids[n], NULL, file_resolver, NULL) != 0)
+			break;
+	if (n == 0)
+		file_resolver(NULL);
+	for (i = 0; i < n; i++)
+		pthread_join(tids[i], NULL);
+}
+
+static struct fsnap *
+snap_lookup(in_addr_t addr, unsigned int scope, int insert)
+{
+	struct fsnap *fs, *old;
+	size_t i, n, h;
+
+	if (insert && (nfsnaps + 1) * 2 > fsnapmask) {
+		old = fsnaps;
+		n = old != NULL ? fsnapmask + 1 : 0;
+		fsnapmask = n != 0 ? n * 2 - 1 : 255;
+		fsnaps = calloc(fsnapmask + 1, sizeof(*fsnaps));
+		if (fsnaps == NULL)
+			errx(1, "could not allocate memory");
+		nfsnaps = 0;
+		for (i = 0; i < n; i++) {
+			if (!old[i].fs_used)
+				continue;
+			fs = snap_lookup(old[i].fs_addr, old[i].fs_scope, 1);
+			*fs = old[i];
+		}
+		free(old);
+	}
+	if (fsnaps == NULL)
+		return (NULL);
+	h = ((uint32_t)addr * 2654435761U) ^ scope;
+	for (i = h & fsnapmask; fsnaps[i].fs_used; i = (i + 1) & fsnapmask)
+		if (fsnaps[i].fs_addr == addr && fsnaps[i].fs_scope == scope)
+			return (&fsnaps[i]);
+	if (!insert)
+		return (NULL);
+	fs = &fsnaps[i];
+	fs->fs_used = 1;
+	fs->fs_addr = addr;
+	fs->fs_scope = scope;
+	nfsnaps++;
+	return (fs);
+}
+
+static void
+snap_entry(struct sockaddr_dl *sdl, struct sockaddr_inarp *addr,
+    struct rt_msghdr *rtm)
+{
+	struct fsnap *fs;
+
+	if (addr->sin_other & SIN_PROXY)
+		return;
+	fs = snap_lookup(addr->sin_addr.s_addr,
+	    (rtm->rtm_flags & RTF_IFSCOPE) ? rtm->rtm_index : 0, 1);
+	fs->fs_flags = rtm->rtm_flags;
+	fs->fs_expire = rtm->rtm_rmx.rmx_expire;
+	fs->fs_index = sdl->sdl_index;
+	fs->fs_alen = sdl->sdl_alen == ETHER_ADDR_LEN ? ETHER_ADDR_LEN : 0;
+	if (fs->fs_alen != 0)
+		bcopy(LLADDR(sdl), fs->fs_lladdr, ETHER_ADDR_LEN);
+}
+
+/*
+ * Collect the broadcast interfaces that ARP runs on, so the interface
+ * index and type of a connected destination can be found without an
+ * RTM_GET per entry.
+ */
+static void
+file_interfaces(void)
+{
+	struct ifaddrs *ifap, *ifa, *lfa;
+	struct sockaddr_dl *sdl;
+	int n;
+
+	if (getifaddrs(&ifap) != 0)
+		err(1, "getifaddrs");
+	for (n = 0, ifa = ifap; ifa != NULL; ifa = ifa->ifa_next)
+		n++;
+	if ((fifs = calloc(n + 1, sizeof(*fifs))) == NULL)
+		errx(1, "could not allocate memory");
+	for (ifa = ifap; ifa != NULL; ifa = ifa->ifa_next) {
+		if (ifa->ifa_addr == NULL || ifa->ifa_netmask == NULL ||
+		    ifa->ifa_addr->sa_family != AF_INET)
+			continue;
+		if ((ifa->ifa_flags & (IFF_UP | IFF_BROADCAST)) !=
+		    (IFF_UP | IFF_BROADCAST) ||
+		    (ifa->ifa_flags & (IFF_LOOPBACK | IFF_POINTOPOINT |
+		    IFF_NOARP)))
+			continue;
+		for (lfa = ifap; lfa != NULL; lfa = lfa->ifa_next)
+			if (lfa->ifa_addr != NULL &&
+			    lfa->ifa_addr->sa_family == AF_LINK &&
+			    strcmp(lfa->ifa_name, ifa->ifa_name) == 0)
+				break;
+		if (lfa == NULL)
+			continue;
+		sdl = (struct sockaddr_dl *)lfa->ifa_addr;
+		if (!valid_type(sdl->sdl_type))
+			continue;
+		fifs[nfifs].fi_addr =
+		    ((struct sockaddr_in *)ifa->ifa_addr)->sin_addr.s_addr;
+		fifs[nfifs].fi_mask =
+		    ((struct sockaddr_in *)ifa->ifa_netmask)->sin_addr.s_addr;
+		fifs[nfifs].fi_index = sdl->sdl_index;
+		fifs[nfifs].fi_type = sdl->sdl_type;
+		nfifs++;
+	}
+	freeifaddrs(ifap);
+}
+
+static struct fif *
+file_interface(struct fentry *fe)
+{
+	int i;
+
+	for (i = 0; i < nfifs; i++) {
+		if (fe->fe_ifscope != 0 && fifs[i].fi_index != fe->fe_ifscope)
+			continue;
+		if (((fe->fe_addr.s_addr ^ fifs[i].fi_addr) &
+		    fifs[i].fi_mask) == 0)
+			return (&fifs[i]);
+	}
+	return (NULL);
+}
+
+/*
+ * Parse one line of an -f file into fe; returns -1 if it is not usable.
+ */
+static int
+file_parse(struct fentry *fe, int argc, char arg[][50], time_t now)
+{
+	static char lastif[IF_NAMESIZE];
+	static unsigned int lastscope;
+	struct ether_addr *ea;
+	int i;
+
+	for (i = 0; i < argc; i++)
+		if ((fe->fe_argv[i] = strdup(arg[i])) == NULL)
+			errx(1, "could not allocate memory");
+	fe->fe_argc = argc;
+	if (inet_aton(arg[0], &fe->fe_addr))
+		fe->fe_resolved = 1;
+	for (i = 2; i < argc; i++) {
+		if (strcmp(arg[i], "temp") == 0) {
+			fe->fe_expire = now + 20 * 60;
+		} else if (strcmp(arg[i], "pub") == 0) {
+			fe->fe_slow = 1;
+		} else if (strcmp(arg[i], "blackhole") == 0) {
+			fe->fe_flags |= RTF_BLACKHOLE;
+		} else if (strcmp(arg[i], "reject") == 0) {
+			fe->fe_flags |= RTF_REJECT;
+		} else if (strcmp(arg[i], "trail") == 0) {
+			/* set() prints the warning */
+			fe->fe_slow = 1;
+		} else if (strcmp(arg[i], "ifscope") == 0) {
+			if (++i >= argc) {
+				printf("ifscope needs an interface parameter\n");
+				return (-1);
+			}
+			if (strcmp(arg[i], lastif) != 0) {
+				if ((lastscope = if_nametoindex(arg[i])) == 0)
+					errx(1, "ifscope has bad interface name: %s",
+					    arg[i]);
+				strlcpy(lastif, arg[i], sizeof(lastif));
+			}
+			fe->fe_ifscope = lastscope;
+		}
+	}
+	if (fe->fe_slow) {
+		/* set() resolves the name itself */
+		fe->fe_resolved = 1;
+		return (0);
+	}
+	if ((ea = ether_aton(arg[1])) == NULL) {
+		warnx("invalid Ethernet address '%s'", arg[1]);
+		return (-1);
+	}
+	fe->fe_ea = *ea;
+	return (0);
+}
+
+static int
+file_write(int s, int cmd, struct fentry *fe, struct fif *fi)
+{
+	static int fseq;
+	struct {
+		struct	rt_msghdr m_rtm;
+		char	m_space[512];
+	} m_rtmsg;
+	struct rt_msghdr *rtm = &m_rtmsg.m_rtm;
+	struct sockaddr_inarp dst, *dst_ptr = &dst;
+	struct sockaddr_dl sdl_m, *sdl_ptr = &sdl_m;
+	char *cp = m_rtmsg.m_space;
+
+	bzero(&dst, sizeof(dst));
+	dst.sin_len = sizeof(dst);
+	dst.sin_family = AF_INET;
+	dst.sin_addr = fe->fe_addr;
+	bzero(&sdl_m, sizeof(sdl_m));
+	sdl_m.sdl_len = sizeof(sdl_m);
+	sdl_m.sdl_family = AF_LINK;
+	sdl_m.sdl_index = fi->fi_index;
+	sdl_m.sdl_type = fi->fi_type;
+	sdl_m.sdl_alen = ETHER_ADDR_LEN;
+	bcopy(&fe->fe_ea, LLADDR(&sdl_m), ETHER_ADDR_LEN);
+
+	bzero(&m_rtmsg, sizeof(m_rtmsg));
+	rtm->rtm_version = RTM_VERSION;
+	rtm->rtm_type = cmd;
+	rtm->rtm_flags = fe->fe_flags | RTF_HOST | RTF_STATIC;
+	if (fe->fe_ifscope) {
+		rtm->rtm_index = fe->fe_ifscope;
+		rtm->rtm_flags |= RTF_IFSCOPE;
+	}
+	rtm->rtm_addrs = RTA_DST | RTA_GATEWAY;
+	rtm->rtm_rmx.rmx_expire = fe->fe_expire;
+	rtm->rtm_inits = RTV_EXPIRE;
+	rtm->rtm_seq = ++fseq;
+	bcopy(dst_ptr, cp, sizeof(dst));
+	cp += SA_SIZE(dst_ptr);
+	bcopy(sdl_ptr, cp, sizeof(sdl_m));
+	cp += SA_SIZE(sdl_ptr);
+	rtm->rtm_msglen = cp - (char *)&m_rtmsg;
+	return (write(s, (char *)&m_rtmsg, rtm->rtm_msglen) < 0 ? -1 : 0);
+}
+
 /*
  * Process a file to set standard arp entries
  */
@@ -290,20 +623,21 @@ static int
 file(char *name)
 {
 	FILE *fp;
-	int i, retval;
-	char line[128], arg[7][50], *args[7], *p;
+	int i, s, retval;
+	char line[128], arg[7][50], *p;
+	struct fentry *fe;
+	struct fsnap *fs;
+	struct fif *fi;
+	struct timeval tv;
+	int lineno, maxfents;
 
 	if ((fp = fopen(name, "r")) == NULL)
 		err(1, "cannot open %s", name);
-	args[0] = &arg[0][0];
-	args[1] = &arg[1][0];
-	args[2] = &arg[2][0];
-	args[3] = &arg[3][0];
-	args[4] = &arg[4][0];
-	args[5] = &arg[5][0];
-	args[6] = &arg[6][0];
+	gettimeofday(&tv, 0);
 	retval = 0;
+	lineno = maxfents = 0;
 	while(fgets(line, sizeof(line), fp) != NULL) {
+		lineno++;
 		if ((p = strchr(line, '#')) != NULL)
 			*p = '\0';
 		for (p = line; isblank(*p); p++);
@@ -316,10 +650,87 @@ file(char *name)
 			retval = 1;
 			continue;
 		}
-		if (set(i, args))
+		if (nfents == maxfents) {
+			maxfents = maxfents ? maxfents * 2 : 256;
+			fents = reallocf(fents, maxfents * sizeof(*fents));
+			if (fents == NULL)
+				errx(1, "could not allocate memory");
+		}
+		fe = &fents[nfents];
+		bzero(fe, sizeof(*fe));
+		fe->fe_lineno = lineno;
+		if (file_parse(fe, i, arg, tv.tv_sec) != 0) {
 			retval = 1;
+			continue;
+		}
+		nfents++;
 	}
 	fclose(fp);
+	if (nfents == 0)
+		return (retval);
+
+	file_resolve();
+	file_interfaces();
+	search(0, snap_entry);
+
+	s = socket(PF_ROUTE, SOCK_RAW, 0);
+	if (s < 0)
+		err(1, "socket");
+	/* errors come back from write(); don't queue the replies */
+	(void) shutdown(s, SHUT_RD);
+
+	for (i = 0; i < nfents; i++) {
+		fe = &fents[i];
+		if (fe->fe_resolved < 0) {
+			warnx("%s: %s", fe->fe_argv[0], gai_strerror(fe->fe_gaierr));
+			retval = 1;
+			continue;
+		}
+		fi = NULL;
+		if (!fe->fe_slow && (fi = file_interface(fe)) == NULL)
+			fe->fe_slow = 1;
+		if (fe->fe_slow) {
+			if (set(fe->fe_argc, fe->fe_argv))
+				retval = 1;
+			continue;
+		}
+		fs = snap_lookup(fe->fe_addr.s_addr, fe->fe_ifscope, 0);
+		if (fs != NULL && fe->fe_expire == 0 && fs->fs_expire == 0 &&
+		    fs->fs_index == fi->fi_index &&
+		    fs->fs_alen == ETHER_ADDR_LEN &&
+		    bcmp(fs->fs_lladdr, &fe->fe_ea, ETHER_ADDR_LEN) == 0 &&
+		    (fs->fs_flags & (RTF_STATIC | RTF_BLACKHOLE | RTF_REJECT)) ==
+		    (fe->fe_flags | RTF_STATIC))
+			continue;
+		/*
+		 * RTM_CHANGE cannot change a route's flags, so an existing
+		 * entry is deleted and the new one added in its place.
+		 */
+		if (fs != NULL && file_write(s, RTM_DELETE, fe, fi) != 0 &&
+		    errno != ESRCH) {
+			warn("%s", fe->fe_argv[0]);
+			retval = 1;
+			continue;
+		}
+		if (file_write(s, RTM_ADD, fe, fi) != 0) {
+			/* the table moved under us; replace the entry once */
+			if (errno != EEXIST ||
+			    file_write(s, RTM_DELETE, fe, fi) != 0 ||
+			    file_write(s, RTM_ADD, fe, fi) != 0) {
+				warn("%s", fe->fe_argv[0]);
+				retval = 1;
+				continue;
+			}
+		}
+		/* later lines for the same host must see the route just added */
+		fs = snap_lookup(fe->fe_addr.s_addr, fe->fe_ifscope, 1);
+		fs->fs_flags = fe->fe_flags | RTF_HOST | RTF_STATIC;
+		fs->fs_expire = fe->fe_expire;
+		fs->fs_index = fi->fi_index;
+		fs->fs_alen = ETHER_ADDR_LEN;
+		bcopy(&fe->fe_ea, fs->fs_lladdr, ETHER_ADDR_LEN);
+	}
+	close(s);
 	return (retval);
 }
 
@@ -571,7 +982,7 @@ search(in_addr_t addr, action_fn *action)
 	struct rt_msghdr *rtm;
 	struct sockaddr_inarp *sin2;
 	struct sockaddr_dl *sdl;
-	char ifname[IF_NAMESIZE];
+	const char *ifname;
 	int st, found_entry = 0;
 
 	mib[0] = CTL_NET;
@@ -600,13 +1011,15 @@ search(in_addr_t addr, action_fn *action)
 	}
 	if (st == -1)
 		err(1, "actual retrieval of routing table");
+	gettimeofday(&dump_time, 0);
 	lim = buf + needed;
 	for (next = buf; next < lim; next += rtm->rtm_msglen) {
 		rtm = (struct rt_msghdr *)next;
 		sin2 = (struct sockaddr_inarp *)(rtm + 1);
 		sdl = (struct sockaddr_dl *)((char *)sin2 + SA_SIZE(sin2));
-		if (rifname && if_indextoname(sdl->sdl_index, ifname) &&
-		    strcmp(ifname, rifname))
+		if (rifname && sdl->sdl_index != rifindex &&
+		    (ifname = ifindex_name(sdl->sdl_index)) != NULL &&
+		    strcmp(ifname, rifname) != 0)
 			continue;
 		if (addr) {
 			if (addr != sin2->sin_addr.s_addr)
@@ -646,9 +1059,8 @@ static void
 print_entry(struct sockaddr_dl *sdl,
 	struct sockaddr_inarp *addr, struct rt_msghdr *rtm)
 {
-	const char *host;
+	const char *host, *ifname;
 	struct hostent *hp;
-	char ifname[IF_NAMESIZE];
 #if 0
 	struct iso88025_sockaddr_dl_data *trld;
 	int seg;
@@ -684,7 +1096,7 @@ print_entry(struct sockaddr_dl *sdl,
 #endif
 	} else
 		printf("(incomplete)");
-	if (if_indextoname(sdl->sdl_index, ifname) != NULL)
+	if ((ifname = ifindex_name(sdl->sdl_index)) != NULL)
 		printf(" on %s", ifname);
 	if ((rtm->rtm_flags & RTF_IFSCOPE))
 		printf(" ifscope");
@@ -1009,7 +1421,7 @@ search_ext(in_addr_t addr, action_ext_fn *action)
 	struct rt_msghdr_ext *ertm;
 	struct sockaddr_inarp *sin2;
 	struct sockaddr_dl *sdl;
-	char ifname[IF_NAMESIZE];
+	const char *ifname;
 	int st, found_entry = 0;
 
 	mib[0] = CTL_NET;
@@ -1038,13 +1450,15 @@ search_ext(in_addr_t addr, action_ext_fn *action)
 	}
 	if (st == -1)
 		err(1, "actual retrieval of routing table");
+	gettimeofday(&dump_time, 0);
 	lim = buf + needed;
 	for (next = buf; next < lim; next += ertm->rtm_msglen) {
 		ertm = (struct rt_msghdr_ext *)next;
 		sin2 = (struct sockaddr_inarp *)(ertm + 1);
 		sdl = (struct sockaddr_dl *)((char *)sin2 + SA_SIZE(sin2));
-		if (rifname && if_indextoname(sdl->sdl_index, ifname) &&
-		    strcmp(ifname, rifname))
+		if (rifname && sdl->sdl_index != rifindex &&
+		    (ifname = ifindex_name(sdl->sdl_index)) != NULL &&
+		    strcmp(ifname, rifname) != 0)
 			continue;
 		if (addr) {
 			if (addr != sin2->sin_addr.s_addr)
@@ -1061,10 +1475,9 @@ static void
 print_entry_ext(struct sockaddr_dl *sdl, struct sockaddr_inarp *addr,
     struct rt_msghdr_ext *ertm)
 {
-	const char *host;
+	const char *host, *ifname;
 	struct hostent *hp;
-	char ifname[IF_NAMESIZE];
-	struct timeval time;
+	struct timeval time = dump_time;
 
 	if (nflag == 0)
 		hp = gethostbyaddr((caddr_t)&(addr->sin_addr),
@@ -1084,8 +1497,6 @@ print_entry_ext(struct sockaddr_dl *sdl, struct sockaddr_inarp *addr,
 	else
 		printf("%-17s ", "(incomplete)");
 
-	gettimeofday(&time, 0);
-
 	if (ertm->rtm_ri.ri_refcnt == 0 || ertm->rtm_ri.ri_snd_expire == 0)
 		printf("%-9.9s ", "(none)");
 	else if (ertm->rtm_ri.ri_snd_expire > time.tv_sec)
@@ -1102,8 +1513,8 @@ print_entry_ext(struct sockaddr_dl *sdl, struct sockaddr_inarp *addr,
 	else
 		printf("%-9.9s", "expired");
 
-	if (if_indextoname(sdl->sdl_index, ifname) == NULL)
-		snprintf(ifname, sizeof (ifname), "%s", "?");
+	if ((ifname = ifindex_name(sdl->sdl_index)) == NULL)
+		ifname = "?";
 	printf(" %8.8s", ifname);
 
 	if (ertm->rtm_ri.ri_refcnt) {
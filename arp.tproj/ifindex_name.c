@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <net/if.h>
+
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "ifindex_name.h"
+
+const char *
+ifindex_name(u_short index)
+{
+	static char **names;
+	static unsigned int nnames;
+	static int loaded;
+	struct if_nameindex *ifni, *ifn;
+	char ifname[IF_NAMESIZE], **newnames;
+	unsigned int n;
+
+	if (!loaded) {
+		loaded = 1;
+		if ((ifni = if_nameindex()) == NULL)
+			goto lookup;
+		for (ifn = ifni, n = 1; ifn->if_index != 0; ifn++)
+			if (ifn->if_index >= n)
+				n = ifn->if_index + 1;
+		if ((names = calloc(n, sizeof(*names))) == NULL)
+			errx(1, "could not allocate memory");
+		nnames = n;
+		for (ifn = ifni; ifn->if_index != 0; ifn++)
+			if ((names[ifn->if_index] = strdup(ifn->if_name)) == NULL)
+				errx(1, "could not allocate memory");
+		if_freenameindex(ifni);
+	}
+	if (index < nnames && names[index] != NULL)
+		return (names[index]);
+lookup:
+	if (if_indextoname(index, ifname) == NULL)
+		return (NULL);
+	if (index >= nnames) {
+		newnames = realloc(names, (index + 1) * sizeof(*names));
+		if (newnames == NULL)
+			errx(1, "could not allocate memory");
+		bzero(newnames + nnames, (index + 1 - nnames) * sizeof(*names));
+		names = newnames;
+		nnames = index + 1;
+	}
+	if ((names[index] = strdup(ifname)) == NULL)
+		errx(1, "could not allocate memory");
+	return (names[index]);
+}
@@ -26,16 +26,21 @@
  * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
  */
 
-#include <sys/socket.h>
+// Define for XNU/BSD headers
+#define PRIVATE 1
+
+#include "../bsd/sys/socket.h"
 #include <sys/errno.h>
 #include <sys/event.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <sys/sys_domain.h>
 #include <sys/ioctl.h>
 #include <sys/kern_control.h>
 #include <sys/queue.h>
 #include <net/content_filter.h>
 #include <netinet/in.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <err.h>
 #include <string.h>
@@ -43,6 +48,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <signal.h>
 #include <sysexits.h>
 
 extern void print_filter_list(void);
@@ -70,12 +76,13 @@ uint32_t necp_control_unit = 0;
 unsigned long auto_start = 0;
 uint64_t peek_inc = 0;
 uint64_t pass_offset = 0;
-struct timeval now, deadline;
+struct timeval now;
 int sf = -1;
 int pass_loopback = 0;
 uint32_t random_drop = 0;
 uint32_t event_total = 0;
 uint32_t event_dropped = 0;
+cfil_sock_id_t last_sock_id = 0;
 
 uint64_t default_in_pass = 0;
 uint64_t default_in_peek = 0;
@@ -84,19 +91,61 @@ uint64_t default_out_peek = 0;
 
 unsigned long max_dump_len = 32;
 
-TAILQ_HEAD(sock_info_head, sock_info) sock_info_head = TAILQ_HEAD_INITIALIZER(sock_info_head);
+unsigned long bench_events = 0;
+unsigned long bench_flows = 1000;
 
+/*
+ * Sockets are found by id in a hash table that doubles when the average
+ * chain gets longer than two, and sockets with a delayed verdict sit in
+ * a binary min-heap ordered by deadline (1-based; si_heap_index 0 means
+ * "not scheduled").
+ */
+#define SOCK_INFO_HASH_MIN 1024
 
 struct sock_info {
-	TAILQ_ENTRY(sock_info)	si_link;
+	LIST_ENTRY(sock_info)	si_link;
 	cfil_sock_id_t		si_sock_id;
 	struct timeval		si_deadline;
+	uint32_t		si_heap_index;
+	uint32_t		si_batch_index;
 	uint64_t		si_in_pass;
 	uint64_t		si_in_peek;
 	uint64_t		si_out_pass;
 	uint64_t		si_out_peek;
 };
 
+LIST_HEAD(sock_info_list, sock_info);
+
+struct sock_info_list *sock_info_hash = NULL;
+uint32_t sock_info_hash_mask = 0;
+uint32_t sock_info_count = 0;
+
+struct sock_info **deadline_heap = NULL;
+uint32_t deadline_heap_count = 0;
+uint32_t deadline_heap_size = 0;
+
+/*
+ * Verdict coalescing (-c): data updates are held for up to coalesce_tv,
+ * a later update for a socket that is already waiting only refreshes its
+ * offsets, and the batch goes out with one sendmsg_x() call.  At most
+ * COALESCE_MAX sockets wait at once, so a busy filter flushes early.
+ * si_batch_index is 1-based; 0 means "not in the batch".
+ */
+#define COALESCE_MAX 64
+
+unsigned long coalesce_us = 0;
+struct timeval coalesce_tv = { 0, 0 };
+struct timeval coalesce_deadline = { 0, 0 };
+struct sock_info *coalesce_batch[COALESCE_MAX];
+uint32_t coalesce_count = 0;
+int coalesce_nosendx = 0;	/* socket does not support sendmsg_x() */
+uint64_t coalesce_updates = 0;
+uint64_t coalesce_sent = 0;
+uint64_t coalesce_syscalls = 0;
+
+void flush_coalesced(void);
+void coalesce_remove(struct sock_info *);
+
 static void
 HexDump(void *data, size_t len)
 {
@@ -225,12 +274,47 @@ print_action_msg(struct cfil_msg_action *action)
 		       action->cfa_in_pass_offset, action->cfa_in_peek_offset);
 }
 
+static struct sock_info_list *
+sock_info_bucket(cfil_sock_id_t sockid)
+{
+	uint64_t h = sockid * 0x9e3779b97f4a7c15ULL;
+	
+	return (&sock_info_hash[(uint32_t)(h >> 32) & sock_info_hash_mask]);
+}
+
+static void
+sock_info_hash_grow(void)
+{
+	struct sock_info_list *old_hash = sock_info_hash;
+	uint32_t old_size = old_hash != NULL ? sock_info_hash_mask + 1 : 0;
+	uint32_t size = old_size != 0 ? old_size * 2 : SOCK_INFO_HASH_MIN;
+	struct sock_info *sock_info;
+	uint32_t i;
+	
+	sock_info_hash = calloc(size, sizeof(struct sock_info_list));
+	if (sock_info_hash == NULL)
+		err(EX_OSERR, "calloc()");
+	sock_info_hash_mask = size - 1;
+	for (i = 0; i < size; i++)
+		LIST_INIT(&sock_info_hash[i]);
+	for (i = 0; i < old_size; i++) {
+		while ((sock_info = LIST_FIRST(&old_hash[i])) != NULL) {
+			LIST_REMOVE(sock_info, si_link);
+			LIST_INSERT_HEAD(sock_info_bucket(sock_info->si_sock_id),
+			    sock_info, si_link);
+		}
+	}
+	free(old_hash);
+}
+
 struct sock_info *
 find_sock_info(cfil_sock_id_t sockid)
 {
 	struct sock_info *sock_info;
 	
-	TAILQ_FOREACH(sock_info, &sock_info_head, si_link) {
+	if (sock_info_hash == NULL)
+		return (NULL);
+	LIST_FOREACH(sock_info, sock_info_bucket(sockid), si_link) {
 		if (sock_info->si_sock_id == sockid)
 			return (sock_info);
 	}
@@ -245,22 +329,90 @@ add_sock_info(cfil_sock_id_t sockid)
 	if (find_sock_info(sockid) != NULL)
 		return (NULL);
 	
+	if (sock_info_hash == NULL || sock_info_count > 2 * sock_info_hash_mask)
+		sock_info_hash_grow();
+	
 	sock_info = calloc(1, sizeof(struct sock_info));
 	if (sock_info == NULL)
 		err(EX_OSERR, "calloc()");
 	sock_info->si_sock_id = sockid;
-	TAILQ_INSERT_TAIL(&sock_info_head, sock_info, si_link);
+	LIST_INSERT_HEAD(sock_info_bucket(sockid), sock_info, si_link);
+	sock_info_count++;
 	
 	return (sock_info);
 }
 
+static void
+deadline_heap_set(uint32_t i, struct sock_info *sock_info)
+{
+	deadline_heap[i] = sock_info;
+	sock_info->si_heap_index = i;
+}
+
+static void
+deadline_heap_up(uint32_t i)
+{
+	struct sock_info *sock_info = deadline_heap[i];
+	
+	while (i > 1 && timercmp(&sock_info->si_deadline,
+	    &deadline_heap[i / 2]->si_deadline, <)) {
+		deadline_heap_set(i, deadline_heap[i / 2]);
+		i /= 2;
+	}
+	deadline_heap_set(i, sock_info);
+}
+
+static void
+deadline_heap_down(uint32_t i)
+{
+	struct sock_info *sock_info = deadline_heap[i];
+	uint32_t child;
+	
+	while ((child = 2 * i) <= deadline_heap_count) {
+		if (child < deadline_heap_count &&
+		    timercmp(&deadline_heap[child + 1]->si_deadline,
+		    &deadline_heap[child]->si_deadline, <))
+			child++;
+		if (!timercmp(&deadline_heap[child]->si_deadline,
+		    &sock_info->si_deadline, <))
+			break;
+		deadline_heap_set(i, deadline_heap[child]);
+		i = child;
+	}
+	deadline_heap_set(i, sock_info);
+}
+
+static void
+deadline_heap_remove(struct sock_info *sock_info)
+{
+	uint32_t i = sock_info->si_heap_index;
+	struct sock_info *last;
+	
+	if (i == 0)
+		return;
+	sock_info->si_heap_index = 0;
+	timerclear(&sock_info->si_deadline);
+	last = deadline_heap[deadline_heap_count--];
+	if (last == sock_info)
+		return;
+	deadline_heap_set(i, last);
+	if (i > 1 && timercmp(&last->si_deadline,
+	    &deadline_heap[i / 2]->si_deadline, <))
+		deadline_heap_up(i);
+	else
+		deadline_heap_down(i);
+}
+
 void
 remove_sock_info(cfil_sock_id_t sockid)
 {
 	struct sock_info *sock_info = find_sock_info(sockid);
 	
 	if (sock_info != NULL) {
-		TAILQ_REMOVE(&sock_info_head, sock_info, si_link);
+		deadline_heap_remove(sock_info);
+		coalesce_remove(sock_info);
+		LIST_REMOVE(sock_info, si_link);
+		sock_info_count--;
 		free(sock_info);
 	}
 }
@@ -269,52 +421,177 @@ remove_sock_info(cfil_sock_id_t sockid)
 int
 set_sock_info_deadline(struct sock_info *sock_info)
 {
-	if (timerisset(&sock_info->si_deadline))
+	if (sock_info->si_heap_index != 0)
 		return (0);
 	
-	timeradd(&now, &sock_info->si_deadline, &sock_info->si_deadline);
-	
-	if (!timerisset(&deadline)) {
-		timeradd(&now, &delay_tv, &deadline);
+	if (deadline_heap_count + 1 >= deadline_heap_size) {
+		deadline_heap_size = deadline_heap_size ? deadline_heap_size * 2 : SOCK_INFO_HASH_MIN;
+		deadline_heap = reallocf(deadline_heap,
+		    deadline_heap_size * sizeof(struct sock_info *));
+		if (deadline_heap == NULL)
+			err(EX_OSERR, "reallocf()");
 	}
+	timeradd(&now, &delay_tv, &sock_info->si_deadline);
+	deadline_heap[++deadline_heap_count] = sock_info;
+	deadline_heap_up(deadline_heap_count);
 	
 	return (1);
 }
 
 void
-send_action_message(uint32_t op, struct sock_info *sock_info, int nodelay)
+build_action_message(uint32_t op, struct sock_info *sock_info,
+    struct cfil_msg_action *action)
 {
-	struct cfil_msg_action action;
-
-	if (!nodelay && delay_ms) {
-		set_sock_info_deadline(sock_info);
-		return;
-	}
-	bzero(&action, sizeof(struct cfil_msg_action));
-	action.cfa_msghdr.cfm_len = sizeof(struct cfil_msg_action);
-	action.cfa_msghdr.cfm_version = CFM_VERSION_CURRENT;
-	action.cfa_msghdr.cfm_type = CFM_TYPE_ACTION;
-	action.cfa_msghdr.cfm_op = op;
-	action.cfa_msghdr.cfm_sock_id = sock_info->si_sock_id;
+	bzero(action, sizeof(struct cfil_msg_action));
+	action->cfa_msghdr.cfm_len = sizeof(struct cfil_msg_action);
+	action->cfa_msghdr.cfm_version = CFM_VERSION_CURRENT;
+	action->cfa_msghdr.cfm_type = CFM_TYPE_ACTION;
+	action->cfa_msghdr.cfm_op = op;
+	action->cfa_msghdr.cfm_sock_id = sock_info->si_sock_id;
 	switch (op) {
 		case CFM_OP_DATA_UPDATE:
-			action.cfa_out_pass_offset = sock_info->si_out_pass;
-			action.cfa_out_peek_offset = sock_info->si_out_peek;
-			action.cfa_in_pass_offset = sock_info->si_in_pass;
-			action.cfa_in_peek_offset = sock_info->si_in_peek;
+			action->cfa_out_pass_offset = sock_info->si_out_pass;
+			action->cfa_out_peek_offset = sock_info->si_out_peek;
+			action->cfa_in_pass_offset = sock_info->si_in_pass;
+			action->cfa_in_peek_offset = sock_info->si_in_peek;
 			break;
 			
 		default:
 			break;
 	}
-
+	
 	if (verbosity > -1)
-		print_action_msg(&action);
+		print_action_msg(action);
+}
+
+void
+coalesce_remove(struct sock_info *sock_info)
+{
+	uint32_t i = sock_info->si_batch_index;
+	
+	if (i == 0)
+		return;
+	sock_info->si_batch_index = 0;
+	if (i != coalesce_count) {
+		coalesce_batch[i - 1] = coalesce_batch[coalesce_count - 1];
+		coalesce_batch[i - 1]->si_batch_index = i;
+	}
+	coalesce_count--;
+}
+
+void
+coalesce_action(struct sock_info *sock_info)
+{
+	coalesce_updates++;
+	/* already waiting: the flush picks up the latest offsets */
+	if (sock_info->si_batch_index != 0)
+		return;
+	if (coalesce_count == 0)
+		timeradd(&now, &coalesce_tv, &coalesce_deadline);
+	coalesce_batch[coalesce_count++] = sock_info;
+	sock_info->si_batch_index = coalesce_count;
+	if (coalesce_count == COALESCE_MAX)
+		flush_coalesced();
+}
+
+void
+flush_coalesced(void)
+{
+	struct cfil_msg_action actions[COALESCE_MAX];
+	struct iovec iovs[COALESCE_MAX];
+	struct msghdr_x msgs[COALESCE_MAX];
+	uint32_t i, n = coalesce_count;
+	ssize_t sent = 0;
+	
+	if (n == 0)
+		return;
+	bzero(msgs, n * sizeof(struct msghdr_x));
+	for (i = 0; i < n; i++) {
+		build_action_message(CFM_OP_DATA_UPDATE, coalesce_batch[i], &actions[i]);
+		coalesce_batch[i]->si_batch_index = 0;
+		iovs[i].iov_base = &actions[i];
+		iovs[i].iov_len = sizeof(struct cfil_msg_action);
+		msgs[i].msg_iov = &iovs[i];
+		msgs[i].msg_iovlen = 1;
+	}
+	coalesce_count = 0;
+	
+	if (n > 1 && !coalesce_nosendx) {
+		coalesce_syscalls++;
+		sent = sendmsg_x(sf, msgs, n, 0);
+		if (sent == -1) {
+			/*
+			 * These are refused before anything is sent; after
+			 * any other error it is not known how much of the
+			 * batch went out, and sending it again could
+			 * deliver verdicts twice.
+			 */
+			if (errno == EOPNOTSUPP || errno == ENOTSUP) {
+				coalesce_nosendx = 1;
+				sent = 0;
+			} else if (errno == EMSGSIZE) {
+				sent = 0;
+			} else {
+				warn("sendmsg_x()");
+				sent = n;
+			}
+		}
+	}
+	/* whatever sendmsg_x() did not take goes one at a time */
+	for (i = (uint32_t)sent; i < n; i++) {
+		coalesce_syscalls++;
+		if (send(sf, &actions[i], sizeof(struct cfil_msg_action), 0) == -1)
+			warn("send()");
+	}
+	coalesce_sent += n;
+}
+
+/*
+ * Flush the coalesced verdicts once the oldest has waited its window
+ */
+void
+process_coalesced(void)
+{
+	if (coalesce_count > 0 && !timercmp(&now, &coalesce_deadline, <))
+		flush_coalesced();
+}
+
+void
+print_coalesce_stats(void)
+{
+	if (coalesce_us == 0)
+		return;
+	flush_coalesced();
+	printf("coalesced %llu updates into %llu messages (%llu saved) "
+	       "and %llu syscalls (%llu saved)\n",
+	       coalesce_updates, coalesce_sent, coalesce_updates - coalesce_sent,
+	       coalesce_syscalls, coalesce_updates - coalesce_syscalls);
+}
+
+void
+send_action_message(uint32_t op, struct sock_info *sock_info, int nodelay)
+{
+	struct cfil_msg_action action;
+
+	if (!nodelay && delay_ms) {
+		set_sock_info_deadline(sock_info);
+		return;
+	}
+	deadline_heap_remove(sock_info);
+	
+	if (coalesce_us != 0) {
+		if (op == CFM_OP_DATA_UPDATE) {
+			coalesce_action(sock_info);
+			return;
+		}
+		/* a drop makes any waiting update moot */
+		coalesce_remove(sock_info);
+	}
+	
+	build_action_message(op, sock_info, &action);
 	
 	if (send(sf, &action, sizeof(struct cfil_msg_action), 0) == -1)
 		warn("send()");
-	
-	timerclear(&sock_info->si_deadline);
 }
 
 void
@@ -322,10 +599,11 @@ process_delayed_actions()
 {
 	struct sock_info *sock_info;
 	
-	TAILQ_FOREACH(sock_info, &sock_info_head, si_link) {
-		if (timerisset(&sock_info->si_deadline) &&
-		    timercmp(&sock_info->si_deadline, &now, >=))
-		    send_action_message(CFM_OP_DATA_UPDATE, sock_info, 1);
+	while (deadline_heap_count > 0) {
+		sock_info = deadline_heap[1];
+		if (timercmp(&sock_info->si_deadline, &now, >))
+			break;
+		send_action_message(CFM_OP_DATA_UPDATE, sock_info, 1);
 	}
 }
 
@@ -418,6 +696,151 @@ drop(struct sock_info *sock_info)
 	return (0);
 }
 
+/*
+ * Act on one event from the kernel (or from the benchmark generator)
+ */
+void
+process_event(struct cfil_msg_hdr *hdr)
+{
+	struct sock_info *sock_info = NULL;
+	
+	if (hdr->cfm_type != CFM_TYPE_EVENT) {
+		warnx("not a content filter event type %u", hdr->cfm_type);
+		return;
+	}
+	switch (hdr->cfm_op) {
+		case CFM_OP_SOCKET_ATTACHED: {
+			struct cfil_msg_sock_attached *msg_attached = (struct cfil_msg_sock_attached *)hdr;
+			
+			if (verbosity > -2)
+				print_hdr(hdr);
+			if (verbosity > -1)
+				printf(" fam %d type %d proto %d pid %u epid %u\n",
+				       msg_attached->cfs_sock_family,
+				       msg_attached->cfs_sock_type,
+				       msg_attached->cfs_sock_protocol,
+				       msg_attached->cfs_pid,
+			       msg_attached->cfs_e_pid);
+			break;
+		}
+		case CFM_OP_SOCKET_CLOSED:
+		case CFM_OP_DISCONNECT_IN:
+		case CFM_OP_DISCONNECT_OUT:
+			if (verbosity > -2)
+				print_hdr(hdr);
+			break;
+		case CFM_OP_DATA_OUT:
+		case CFM_OP_DATA_IN:
+			if (verbosity > -3)
+				print_data_req((struct cfil_msg_data_event *)hdr);
+			break;
+		default:
+			warnx("unknown content filter event op %u", hdr->cfm_op);
+			return;
+	}
+	switch (hdr->cfm_op) {
+		case CFM_OP_SOCKET_ATTACHED:
+			sock_info = add_sock_info(hdr->cfm_sock_id);
+			if (sock_info == NULL) {
+				warnx("sock_id %llx already exists", hdr->cfm_sock_id);
+				return;
+			}
+			break;
+		case CFM_OP_DATA_OUT:
+		case CFM_OP_DATA_IN:
+		case CFM_OP_DISCONNECT_IN:
+		case CFM_OP_DISCONNECT_OUT:
+		case CFM_OP_SOCKET_CLOSED:
+			sock_info = find_sock_info(hdr->cfm_sock_id);
+			
+			if (sock_info == NULL) {
+				warnx("unexpected data message, sock_info is NULL");
+				return;
+			}
+			break;
+		default:
+			warnx("unknown content filter event op %u", hdr->cfm_op);
+			return;
+	}
+	
+
+	switch (hdr->cfm_op) {
+		case CFM_OP_SOCKET_ATTACHED: {
+			if ((mode & MODE_PASS) || (mode & MODE_PEEK) || auto_start) {
+				sock_info->si_out_pass = default_out_pass;
+				sock_info->si_out_peek = (mode & MODE_PEEK) ? peek_inc : (mode & MODE_PASS) ? CFM_MAX_OFFSET : default_out_peek;
+				sock_info->si_in_pass = default_in_pass;
+				sock_info->si_in_peek = (mode & MODE_PEEK) ? peek_inc : (mode & MODE_PASS) ? CFM_MAX_OFFSET : default_in_peek;
+				
+				send_action_message(CFM_OP_DATA_UPDATE, sock_info, 0);
+			}
+			break;
+		}
+		case CFM_OP_SOCKET_CLOSED: {
+			remove_sock_info(hdr->cfm_sock_id);
+			sock_info = NULL;
+			break;
+		}
+		case CFM_OP_DATA_OUT:
+		case CFM_OP_DATA_IN: {
+			struct cfil_msg_data_event *data_req = (struct cfil_msg_data_event *)hdr;
+									
+			if (pass_loopback && is_loopback(data_req)) {
+				sock_info->si_out_pass = CFM_MAX_OFFSET;
+				sock_info->si_in_pass = CFM_MAX_OFFSET;
+			} else {
+				if (drop(sock_info))
+					return;
+				
+				if ((mode & MODE_PASS)) {
+					if (data_req->cfd_msghdr.cfm_op == CFM_OP_DATA_OUT) {
+						if (pass_offset == 0 || pass_offset == CFM_MAX_OFFSET)
+							sock_info->si_out_pass = data_req->cfd_end_offset;
+						else if (data_req->cfd_end_offset > pass_offset) {
+							sock_info->si_out_pass = CFM_MAX_OFFSET;
+							sock_info->si_in_pass = CFM_MAX_OFFSET;
+						}
+						sock_info->si_out_peek = (mode & MODE_PEEK) ?
+						data_req->cfd_end_offset + peek_inc : 0;
+					} else {
+						if (pass_offset == 0 || pass_offset == CFM_MAX_OFFSET)
+							sock_info->si_in_pass = data_req->cfd_end_offset;
+						else if (data_req->cfd_end_offset > pass_offset) {
+							sock_info->si_out_pass = CFM_MAX_OFFSET;
+							sock_info->si_in_pass = CFM_MAX_OFFSET;
+						}
+						sock_info->si_in_peek = (mode & MODE_PEEK) ?
+						data_req->cfd_end_offset + peek_inc : 0;
+					}
+				} else {
+					break;
+				}
+			}
+			send_action_message(CFM_OP_DATA_UPDATE, sock_info, 0);
+			
+			break;
+		}
+		case CFM_OP_DISCONNECT_IN:
+		case CFM_OP_DISCONNECT_OUT: {
+			if (drop(sock_info))
+				return;
+			
+			if ((mode & MODE_PASS)) {
+				sock_info->si_out_pass = CFM_MAX_OFFSET;
+				sock_info->si_in_pass = CFM_MAX_OFFSET;
+				
+				send_action_message(CFM_OP_DATA_UPDATE, sock_info, 0);
+			}
+			break;
+		}
+		default:
+			warnx("unkown message op %u", hdr->cfm_op);
+			break;
+	}
+	if (sock_info)
+		last_sock_id = sock_info->si_sock_id;
+}
+
 int
 doit()
 {
@@ -434,10 +857,9 @@ doit()
 	char *argptr = NULL;
 	size_t cmdlen = 0;
 	struct cfil_msg_action action;
-	cfil_sock_id_t last_sock_id = 0;
-	struct sock_info *sock_info = NULL;
-	struct timeval last_time, elapsed, delta;
+	struct timeval last_time, elapsed, delta, next;
 	struct timespec interval, *timeout = NULL;
+	int nev, nmsgs;
 	
 	kq = kqueue();
 	if (kq == -1)
@@ -494,34 +916,60 @@ doit()
 	if (buffer == NULL)
 		err(1, "malloc()");
 
+	/*
+	 * Report the coalescing savings on the way out: the signals are
+	 * taken from the kqueue, so one arriving while events are being
+	 * processed is seen by the next kevent() call.
+	 */
+	bzero(&kv, sizeof(struct kevent));
+	kv.ident = SIGINT;
+	kv.filter = EVFILT_SIGNAL;
+	kv.flags = EV_ADD;
+	if (kevent(kq, &kv, 1, NULL, 0, NULL) == -1)
+		err(1, "kevent(SIGINT)");
+	kv.ident = SIGTERM;
+	if (kevent(kq, &kv, 1, NULL, 0, NULL) == -1)
+		err(1, "kevent(SIGTERM)");
+	signal(SIGINT, SIG_IGN);
+	signal(SIGTERM, SIG_IGN);
+	
 	gettimeofday(&now, NULL);
 	
 	while (1) {
 		last_time = now;
-		if (delay_ms && timerisset(&deadline)) {
-			timersub(&deadline, &now, &delta);
+		timeout = NULL;
+		if (deadline_heap_count > 0 || coalesce_count > 0) {
+			if (deadline_heap_count > 0)
+				next = deadline_heap[1]->si_deadline;
+			if (coalesce_count > 0 && (deadline_heap_count == 0 ||
+			    timercmp(&coalesce_deadline, &next, <)))
+				next = coalesce_deadline;
+			if (timercmp(&next, &now, >))
+				timersub(&next, &now, &delta);
+			else
+				timerclear(&delta);
 			TIMEVAL_TO_TIMESPEC(&delta, &interval);
 			timeout = &interval;
-		} else {
-			timeout = NULL;
 		}
 		
-		if (kevent(kq, NULL, 0, &kv, 1, timeout) == -1) {
+		nev = kevent(kq, NULL, 0, &kv, 1, timeout);
+		if (nev == -1) {
 			if (errno == EINTR)
 				continue;
 			err(1, "kevent()");
 		}
+		if (nev > 0 && kv.filter == EVFILT_SIGNAL)
+			break;
 		gettimeofday(&now, NULL);
 		timersub(&now, &last_time, &elapsed);
-		if (delay_ms && timerisset(&deadline)) {
-			if (timercmp(&now, &deadline, >=)) {
-				process_delayed_actions();
-				interval.tv_sec = 0;
-				interval.tv_nsec = 0;
-			}
-		}
+		if (deadline_heap_count > 0)
+			process_delayed_actions();
+		process_coalesced();
+		if (nev == 0)
+			continue;
 		
 		if (kv.ident == sf && kv.filter == EVFILT_READ) {
+			nmsgs = 0;
 			while (1) {
 				ssize_t nread;
 				
@@ -541,143 +989,13 @@ doit()
 				if (nread < sizeof(struct cfil_msg_hdr))
 					errx(1, "too small");
 				hdr = (struct cfil_msg_hdr *)buffer;
+				process_event(hdr);
 				
-				
-				if (hdr->cfm_type != CFM_TYPE_EVENT) {
-					warnx("not a content filter event type %u", hdr->cfm_type);
-					continue;
-				}
-				switch (hdr->cfm_op) {
-					case CFM_OP_SOCKET_ATTACHED: {
-						struct cfil_msg_sock_attached *msg_attached = (struct cfil_msg_sock_attached *)hdr;
-						
-						if (verbosity > -2)
-							print_hdr(hdr);
-						if (verbosity > -1)
-							printf(" fam %d type %d proto %d pid %u epid %u\n",
-							       msg_attached->cfs_sock_family,
-							       msg_attached->cfs_sock_type,
-							       msg_attached->cfs_sock_protocol,
-							       msg_attached->cfs_pid,
-						       msg_attached->cfs_e_pid);
-						break;
-					}
-					case CFM_OP_SOCKET_CLOSED:
-					case CFM_OP_DISCONNECT_IN:
-					case CFM_OP_DISCONNECT_OUT:
-						if (verbosity > -2)
-							print_hdr(hdr);
-						break;
-					case CFM_OP_DATA_OUT:
-					case CFM_OP_DATA_IN:
-						if (verbosity > -3)
-							print_data_req((struct cfil_msg_data_event *)hdr);
-						break;
-					default:
-						warnx("unknown content filter event op %u", hdr->cfm_op);
-						continue;
+				/* a long burst must not hold verdicts past their window */
+				if (coalesce_count > 0 && (++nmsgs % 64) == 0) {
+					gettimeofday(&now, NULL);
+					process_coalesced();
 				}
-				switch (hdr->cfm_op) {
-					case CFM_OP_SOCKET_ATTACHED:
-						sock_info = add_sock_info(hdr->cfm_sock_id);
-						if (sock_info == NULL) {
-							warnx("sock_id %llx already exists", hdr->cfm_sock_id);
-							continue;
-						}
-						break;
-					case CFM_OP_DATA_OUT:
-					case CFM_OP_DATA_IN:
-					case CFM_OP_DISCONNECT_IN:
-					case CFM_OP_DISCONNECT_OUT:
-					case CFM_OP_SOCKET_CLOSED:
-						sock_info = find_sock_info(hdr->cfm_sock_id);
-						
-						if (sock_info == NULL) {
-							warnx("unexpected data message, sock_info is NULL");
-							continue;
-						}
-						break;
-					default:
-						warnx("unknown content filter event op %u", hdr->cfm_op);
-						continue;
-				}
-				
-
-				switch (hdr->cfm_op) {
-					case CFM_OP_SOCKET_ATTACHED: {
-						if ((mode & MODE_PASS) || (mode & MODE_PEEK) || auto_start) {
-							sock_info->si_out_pass = default_out_pass;
-							sock_info->si_out_peek = (mode & MODE_PEEK) ? peek_inc : (mode & MODE_PASS) ? CFM_MAX_OFFSET : default_out_peek;
-							sock_info->si_in_pass = default_in_pass;
-							sock_info->si_in_peek = (mode & MODE_PEEK) ? peek_inc : (mode & MODE_PASS) ? CFM_MAX_OFFSET : default_in_peek;
-							
-							send_action_message(CFM_OP_DATA_UPDATE, sock_info, 0);
-						}
-						break;
-					}
-					case CFM_OP_SOCKET_CLOSED: {
-						remove_sock_info(hdr->cfm_sock_id);
-						sock_info = NULL;
-						break;
-					}
-					case CFM_OP_DATA_OUT:
-					case CFM_OP_DATA_IN: {
-						struct cfil_msg_data_event *data_req = (struct cfil_msg_data_event *)hdr;
-												
-						if (pass_loopback && is_loopback(data_req)) {
-							sock_info->si_out_pass = CFM_MAX_OFFSET;
-							sock_info->si_in_pass = CFM_MAX_OFFSET;
-						} else {
-							if (drop(sock_info))
-								continue;
-							
-							if ((mode & MODE_PASS)) {
-								if (data_req->cfd_msghdr.cfm_op == CFM_OP_DATA_OUT) {
-									if (pass_offset == 0 || pass_offset == CFM_MAX_OFFSET)
-										sock_info->si_out_pass = data_req->cfd_end_offset;
-									else if (data_req->cfd_end_offset > pass_offset) {
-										sock_info->si_out_pass = CFM_MAX_OFFSET;
-										sock_info->si_in_pass = CFM_MAX_OFFSET;
-									}
-									sock_info->si_out_peek = (mode & MODE_PEEK) ?
-									data_req->cfd_end_offset + peek_inc : 0;
-								} else {
-									if (pass_offset == 0 || pass_offset == CFM_MAX_OFFSET)
-										sock_info->si_in_pass = data_req->cfd_end_offset;
-									else if (data_req->cfd_end_offset > pass_offset) {
-										sock_info->si_out_pass = CFM_MAX_OFFSET;
-										sock_info->si_in_pass = CFM_MAX_OFFSET;
-									}
-									sock_info->si_in_peek = (mode & MODE_PEEK) ?
-									data_req->cfd_end_offset + peek_inc : 0;
-								}
-							} else {
-								break;
-							}
-						}
-						send_action_message(CFM_OP_DATA_UPDATE, sock_info, 0);
-						
-						break;
-					}
-					case CFM_OP_DISCONNECT_IN:
-					case CFM_OP_DISCONNECT_OUT: {
-						if (drop(sock_info))
-							continue;
-						
-						if ((mode & MODE_PASS)) {
-							sock_info->si_out_pass = CFM_MAX_OFFSET;
-							sock_info->si_in_pass = CFM_MAX_OFFSET;
-							
-							send_action_message(CFM_OP_DATA_UPDATE, sock_info, 0);
-						}
-						break;
-					}
-					default:
-						warnx("unkown message op %u", hdr->cfm_op);
-						break;
-				}
-				if (sock_info)
-					last_sock_id = sock_info->si_sock_id;
 			}
 		}
 		if (kv.ident == fdin && kv.filter == EVFILT_READ) {
@@ -784,9 +1102,134 @@ doit()
 		}
 	}
 	
+	print_coalesce_stats();
 	return 0;
 }
 
+/*
+ * Benchmark mode: feed process_event() a synthetic stream of data events
+ * spread over bench_flows sockets, without the kernel.  Actions are sent
+ * on one end of a datagram socket pair that a thread drains, so that
+ * sending costs about what it does on a real filter socket.
+ */
+#define BENCH_DATA_LEN 1024
+
+static void *
+bench_sink(void *arg)
+{
+	int fd = *(int *)arg;
+	char buf[1024];
+	
+	/* a zero length datagram marks the end */
+	while (recv(fd, buf, sizeof(buf), 0) > 0)
+		;
+	return (NULL);
+}
+
+static cfil_sock_id_t
+bench_sock_id(unsigned long flow)
+{
+	/* same shape as the kernel's: generation count, flow hash */
+	return (((cfil_sock_id_t)(flow + 1) << 32) |
+	    (uint32_t)((flow + 1) * 2654435761U));
+}
+
+int
+bench()
+{
+	struct cfil_msg_sock_attached attached;
+	struct cfil_msg_hdr closed;
+	struct cfil_msg_data_event *data_req;
+	uint64_t *offsets, *offset;
+	unsigned long i, flow;
+	uint64_t nmsgs = 0;
+	struct timeval start, elapsed;
+	double secs;
+	pthread_t sink;
+	int sv[2];
+	int out;
+	
+	if (socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) == -1)
+		err(1, "socketpair()");
+	sf = sv[0];
+	if (pthread_create(&sink, NULL, bench_sink, &sv[1]) != 0)
+		errx(1, "pthread_create()");
+	
+	offsets = calloc(bench_flows * 2, sizeof(uint64_t));
+	data_req = calloc(1, sizeof(struct cfil_msg_data_event) + BENCH_DATA_LEN);
+	if (offsets == NULL || data_req == NULL)
+		err(EX_OSERR, "calloc()");
+	
+	gettimeofday(&start, NULL);
+	now = start;
+	
+	bzero(&attached, sizeof(struct cfil_msg_sock_attached));
+	attached.cfs_msghdr.cfm_len = sizeof(struct cfil_msg_sock_attached);
+	attached.cfs_msghdr.cfm_version = CFM_VERSION_CURRENT;
+	attached.cfs_msghdr.cfm_type = CFM_TYPE_EVENT;
+	attached.cfs_msghdr.cfm_op = CFM_OP_SOCKET_ATTACHED;
+	attached.cfs_sock_family = AF_INET;
+	attached.cfs_sock_type = SOCK_STREAM;
+	attached.cfs_sock_protocol = IPPROTO_TCP;
+	attached.cfs_pid = getpid();
+	attached.cfs_e_pid = attached.cfs_pid;
+	for (flow = 0; flow < bench_flows; flow++, nmsgs++) {
+		attached.cfs_msghdr.cfm_sock_id = bench_sock_id(flow);
+		process_event(&attached.cfs_msghdr);
+	}
+	
+	data_req->cfd_msghdr.cfm_len = sizeof(struct cfil_msg_data_event) + BENCH_DATA_LEN;
+	data_req->cfd_msghdr.cfm_version = CFM_VERSION_CURRENT;
+	data_req->cfd_msghdr.cfm_type = CFM_TYPE_EVENT;
+	for (i = 0; i < bench_events; i++, nmsgs++) {
+		flow = arc4random_uniform((uint32_t)bench_flows);
+		out = arc4random() & 1;
+		offset = &offsets[2 * flow + out];
+		data_req->cfd_msghdr.cfm_op = out ? CFM_OP_DATA_OUT : CFM_OP_DATA_IN;
+		data_req->cfd_msghdr.cfm_sock_id = bench_sock_id(flow);
+		data_req->cfd_start_offset = *offset;
+		*offset += BENCH_DATA_LEN;
+		data_req->cfd_end_offset = *offset;
+		process_event(&data_req->cfd_msghdr);
+		
+		if ((i % 64) == 0) {
+			gettimeofday(&now, NULL);
+			if (deadline_heap_count > 0)
+				process_delayed_actions();
+			process_coalesced();
+		}
+	}
+	flush_coalesced();
+	
+	bzero(&closed, sizeof(struct cfil_msg_hdr));
+	closed.cfm_len = sizeof(struct cfil_msg_hdr);
+	closed.cfm_version = CFM_VERSION_CURRENT;
+	closed.cfm_type = CFM_TYPE_EVENT;
+	closed.cfm_op = CFM_OP_SOCKET_CLOSED;
+	for (flow = 0; flow < bench_flows; flow++, nmsgs++) {
+		closed.cfm_sock_id = bench_sock_id(flow);
+		process_event(&closed);
+	}
+	
+	gettimeofday(&now, NULL);
+	timersub(&now, &start, &elapsed);
+	
+	if (send(sf, &closed, 0, 0) == -1)
+		warn("send()");
+	pthread_join(sink, NULL);
+	close(sv[0]);
+	close(sv[1]);
+	free(offsets);
+	free(data_req);
+	
+	secs = elapsed.tv_sec + elapsed.tv_usec / 1000000.0;
+	printf("%llu messages for %lu flows in %.3f seconds, %.0f messages/sec\n",
+	       nmsgs, bench_flows, secs, secs > 0 ? nmsgs / secs : 0.0);
+	print_coalesce_stats();
+	
+	return (0);
+}
+
 static const char *
 basename(const char * str)
 {
@@ -806,7 +1249,10 @@ struct option_desc {
 
 struct option_desc option_desc_list[] = {
 	{ "-a offset", "auto start with offset", 0 },
+	{ "-b count", "benchmark with count synthetic data events, no kernel", 0 },
+	{ "-c window", "coalesce verdicts for up to window microseconds", 0 },
 	{ "-d offset value", "default offset value for passin, peekin, passout, peekout, pass, peek", 0 },
+	{ "-f flows", "number of flows for the benchmark (default 1000)", 0 },
 	{ "-h", "dsiplay this help", 0 },
 	{ "-i", "interactive mode", 0 },
 	{ "-k increment", "peek mode with increment", 0 },
@@ -866,11 +1312,23 @@ main(int argc, char * const argv[])
 	int stats_filt_list = 0;
 	int stats_cfil_stats = 0;
 	
-	while ((ch = getopt(argc, argv, "a:d:hik:lm:p:qr:s:t:u:v")) != -1) {
+	while ((ch = getopt(argc, argv, "a:b:c:d:f:hik:lm:p:qr:s:t:u:v")) != -1) {
 		switch (ch) {
 			case 'a':
 				auto_start = strtoul(optarg, NULL, 0);
 				break;
+			case 'b':
+				bench_events = strtoul(optarg, NULL, 0);
+				if (bench_events == 0)
+					errx(1, "bad benchmark event count: %s", optarg);
+				break;
+			case 'c':
+				coalesce_us = strtoul(optarg, NULL, 0);
+				if (coalesce_us == 0 || coalesce_us > 1000000)
+					errx(1, "bad coalescing window: %s -- it must be between 1 and 1000000", optarg);
+				coalesce_tv.tv_sec = coalesce_us / 1000000;
+				coalesce_tv.tv_usec = coalesce_us % 1000000;
+				break;
 			case 'd': {
 				if (optind >= argc)
 					errx(1, "'-d' needs 2 parameters");
@@ -898,6 +1356,11 @@ main(int argc, char * const argv[])
 					errx(1, "syntax error");
 				break;
 			}
+			case 'f':
+				bench_flows = strtoul(optarg, NULL, 0);
+				if (bench_flows == 0 || bench_flows > UINT32_MAX)
+					errx(1, "bad benchmark flow count: %s", optarg);
+				break;
 			case 'h':
 				usage(argv[0]);
 				exit(0);
@@ -974,6 +1437,9 @@ main(int argc, char * const argv[])
 	if (necp_control_unit == 0 && (stats_filt_list || stats_sock_list || stats_cfil_stats))
 		return (0);
 	
+	if (bench_events != 0)
+		return (bench());
+	
 	if (necp_control_unit == 0) {
 		warnx("necp filter control unit is 0");
 		usage(argv[0]);
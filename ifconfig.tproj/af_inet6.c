@@ -250,14 +250,13 @@ in6_status(int s __unused, const struct ifaddrs *ifa)
 		return;
 
 	strlcpy(ifr6.ifr_name, ifr.ifr_name, sizeof(ifr.ifr_name));
-	if ((s6 = socket(AF_INET6, SOCK_DGRAM, 0)) < 0) {
+	if ((s6 = ifsock(AF_INET6)) < 0) {
 		warn("socket(AF_INET6,SOCK_DGRAM)");
 		return;
 	}
 	ifr6.ifr_addr = *sin;
 	if (ioctl(s6, SIOCGIFAFLAG_IN6, &ifr6) < 0) {
 		warn("ioctl(SIOCGIFAFLAG_IN6)");
-		close(s6);
 		return;
 	}
 	flags6 = ifr6.ifr_ifru.ifru_flags6;
@@ -265,11 +264,9 @@ in6_status(int s __unused, const struct ifaddrs *ifa)
 	ifr6.ifr_addr = *sin;
 	if (ioctl(s6, SIOCGIFALIFETIME_IN6, &ifr6) < 0) {
 		warn("ioctl(SIOCGIFALIFETIME_IN6)");
-		close(s6);
 		return;
 	}
 	lifetime = ifr6.ifr_ifru.ifru_lifetime;
-	close(s6);
 
 	/* XXX: embedded link local addr check */
 	if (IN6_IS_ADDR_LINKLOCAL(&sin->sin6_addr) &&
@@ -546,7 +543,7 @@ nd6_status(int s)
 
 	memset(&nd, 0, sizeof(nd));
 	strlcpy(nd.ifname, ifr.ifr_name, sizeof(nd.ifname));
-	if ((s6 = socket(AF_INET6, SOCK_DGRAM, 0)) < 0) {
+	if ((s6 = ifsock(AF_INET6)) < 0) {
 		if (errno != EPROTONOSUPPORT)
 			warn("socket(AF_INET6, SOCK_DGRAM)");
 		return;
@@ -555,10 +552,8 @@ nd6_status(int s)
 	if (error) {
 		if (errno != EPFNOSUPPORT && errno != EINVAL)
 			warn("ioctl(SIOCGIFINFO_IN6)");
-		close(s6);
 		return;
 	}
-	close(s6);
 	if (nd.ndi.flags == 0)
 		return;
 	printb("\tnd6 options", (unsigned int)nd.ndi.flags, ND6BITS);
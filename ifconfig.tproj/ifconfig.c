@@ -143,8 +143,7 @@ int	printkeys = 0;		/* Print keying material for interfaces. */
 
 static	int ifconfig(int argc, char *const *argv, int iscreate,
 		const struct afswtch *afp);
-static	void status(const struct afswtch *afp, const struct sockaddr_dl *sdl,
-		struct ifaddrs *ifa);
+static	void status(const struct afswtch *afp, const struct ifsnap_if *ifsp);
 static char *bytes_to_str(unsigned long long bytes);
 static char *bps_to_str(unsigned long long rate);
 static char *ns_to_str(unsigned long long nsec);
@@ -200,11 +199,11 @@ main(int argc, char *argv[])
 {
 	int c, namesonly, downonly, uponly;
 	const struct afswtch *afp = NULL;
-	int ifindex;
-	struct ifaddrs *ifap, *ifa;
-	struct ifreq paifr;
-	const struct sockaddr_dl *sdl;
-	char options[1024], *cp;
+	int ifindex, i;
+	struct ifaddrs *ifa;
+	struct ifsnap snap;
+	const struct ifsnap_if *ifs;
+	char options[1024];
 	const char *ifname = NULL;
 	struct option *p;
 	size_t iflen;
@@ -344,17 +343,17 @@ main(int argc, char *argv[])
 			{ argc--; argv++; }
 	}
 
-	if (getifaddrs(&ifap) != 0)
+	/*
+	 * Take the interface list in one go; the ifmib data is only
+	 * needed when printing status.
+	 */
+	if (ifsnap_take(&snap, (namesonly || argc > 0) ? 0 :
+	    verbose ? IFSNAP_SUPPLEMENTAL : IFSNAP_MIB) != 0)
 		err(EXIT_FAILURE, "getifaddrs");
-	cp = NULL;
 	ifindex = 0;
-	for (ifa = ifap; ifa; ifa = ifa->ifa_next) {
-		memset(&paifr, 0, sizeof(paifr));
-		strlcpy(paifr.ifr_name, ifa->ifa_name, sizeof(paifr.ifr_name));
-		if (sizeof(paifr.ifr_addr) >= ifa->ifa_addr->sa_len) {
-			memcpy(&paifr.ifr_addr, ifa->ifa_addr,
-			    ifa->ifa_addr->sa_len);
-		}
+	for (i = 0; i < snap.ifsn_count; i++) {
+		ifs = &snap.ifsn_ifs[i];
+		ifa = ifs->ifs_addrs[0];
 
 		if (is_regex) {
 			if (regexec(&if_reg, ifa->ifa_name, 0, NULL, 0) != 0) {
@@ -364,19 +363,12 @@ main(int argc, char *argv[])
 			if (ifname != NULL && strcmp(ifname, ifa->ifa_name) != 0)
 				continue;
 		}
-		if (ifa->ifa_addr->sa_family == AF_LINK)
-			sdl = (const struct sockaddr_dl *) ifa->ifa_addr;
-		else
-			sdl = NULL;
-		if (cp != NULL && strcmp(cp, ifa->ifa_name) == 0)
-			continue;
 		iflen = strlcpy(name, ifa->ifa_name, sizeof(name));
 		if (iflen >= sizeof(name)) {
 			warnx("%s: interface name too long, skipping",
 			    ifa->ifa_name);
 			continue;
 		}
-		cp = ifa->ifa_name;
 
 		if (downonly && (ifa->ifa_flags & IFF_UP) != 0)
 			continue;
@@ -396,11 +388,11 @@ main(int argc, char *argv[])
 		if (argc > 0)
 			ifconfig(argc, argv, 0, afp);
 		else
-			status(afp, sdl, ifa);
+			status(afp, ifs);
 	}
 	if (namesonly)
 		printf("\n");
-	freeifaddrs(ifap);
+	ifsnap_free(&snap);
 	if (is_regex) {
 		regfree(&if_reg);
 	}
@@ -1647,16 +1639,13 @@ static void
 show_routermode6(void)
 {
 	struct afswtch *afp;
-	static int 	s = -1;
+	int 	s;
 
 	afp = af_getbyname("inet6");
 	if (afp != NULL) {
-		if (s < 0) {
-			s = socket(AF_INET6, SOCK_DGRAM, 0);
-			if (s < 0) {
-				perror("socket");
-				return;
-			}
+		if ((s = ifsock(AF_INET6)) < 0) {
+			perror("socket");
+			return;
 		}
 		(*afp->af_routermode)(s, 0, NULL);
 	}
@@ -1689,18 +1678,20 @@ show_routermode6(void)
 /*
  * Print the status of the interface.  If an address family was
  * specified, show only it; otherwise, show them all.
+ * Whatever the snapshot holds is taken from it rather than asked for.
  */
 static void
-status(const struct afswtch *afp, const struct sockaddr_dl *sdl,
-	struct ifaddrs *ifa)
+status(const struct afswtch *afp, const struct ifsnap_if *ifsp)
 {
-	struct ifaddrs *ift;
-	int allfamilies, s;
+	struct ifaddrs *ifa = ifsp->ifs_addrs[0], *ift;
+	int allfamilies, s, i;
+	unsigned int ifindex;
 	struct ifstat ifs;
 	struct if_descreq ifdr;
 	struct if_linkparamsreq iflpr;
 	int mib[6];
 	struct ifmibdata_supplemental ifmsupp;
+	const struct ifmibdata_supplemental *ifmsp;
 	size_t miblen = sizeof(struct ifmibdata_supplemental);
 	u_int64_t eflags = 0;
 	u_int64_t xflags = 0;
@@ -1715,21 +1706,31 @@ status(const struct afswtch *afp, const struct sockaddr_dl *sdl,
 	ifr.ifr_addr.sa_family = afp->af_af == AF_LINK ? AF_INET : afp->af_af;
 	strlcpy(ifr.ifr_name, name, sizeof(ifr.ifr_name));
 
-	s = socket(ifr.ifr_addr.sa_family, SOCK_DGRAM, 0);
+	s = ifsock(ifr.ifr_addr.sa_family);
 	if (s < 0)
 		err(1, "socket(family %u,SOCK_DGRAM)", ifr.ifr_addr.sa_family);
 
+	ifindex = ifsp->ifs_index;
+	if (ifindex == 0)
+		ifindex = if_nametoindex(name);
+
 	printf("%s: ", name);
 	printb("flags", ifa->ifa_flags, IFFBITS);
-	if (ioctl(s, SIOCGIFMETRIC, &ifr) != -1)
-		if (ifr.ifr_metric)
-			printf(" metric %d", ifr.ifr_metric);
-	if (ioctl(s, SIOCGIFMTU, &ifr) != -1)
-		printf(" mtu %d", ifr.ifr_mtu);
+	if (ifsp->ifs_mib != NULL) {
+		if (ifsp->ifs_mib->ifmd_data.ifi_metric)
+			printf(" metric %d",
+			    (int)ifsp->ifs_mib->ifmd_data.ifi_metric);
+		printf(" mtu %d", (int)ifsp->ifs_mib->ifmd_data.ifi_mtu);
+	} else {
+		if (ioctl(s, SIOCGIFMETRIC, &ifr) != -1)
+			if (ifr.ifr_metric)
+				printf(" metric %d", ifr.ifr_metric);
+		if (ioctl(s, SIOCGIFMTU, &ifr) != -1)
+			printf(" mtu %d", ifr.ifr_mtu);
+	}
 	if (showrtref && ioctl(s, SIOCGIFGETRTREFCNT, &ifr) != -1)
 		printf(" rtref %d", ifr.ifr_route_refcnt);
 	if (verbose) {
-		unsigned int ifindex = if_nametoindex(ifa->ifa_name);
 		if (ifindex != 0)
 			printf(" index %u", ifindex);
 	}
@@ -1768,11 +1769,10 @@ status(const struct afswtch *afp, const struct sockaddr_dl *sdl,
 
 	tunnel_status(s);
 
-	for (ift = ifa; ift != NULL; ift = ift->ifa_next) {
+	for (i = 0; i < ifsp->ifs_naddrs; i++) {
+		ift = ifsp->ifs_addrs[i];
 		if (ift->ifa_addr == NULL)
 			continue;
-		if (strcmp(ifa->ifa_name, ift->ifa_name) != 0)
-			continue;
 		if (allfamilies) {
 			const struct afswtch *p;
 			p = af_getbyfamily(ift->ifa_addr->sa_family);
@@ -1800,7 +1800,7 @@ status(const struct afswtch *afp, const struct sockaddr_dl *sdl,
 		 */
 		lafp = af_getbyname("lladdr");
 		if (lafp != NULL) {
-			info.rti_info[RTAX_IFA] = (struct sockaddr *)sdl;
+			info.rti_info[RTAX_IFA] = (struct sockaddr *)ifsp->ifs_sdl;
 			lafp->af_status(s, &info);
 		}
 	}
@@ -2053,23 +2053,26 @@ status(const struct afswtch *afp, const struct sockaddr_dl *sdl,
 		}
 	}
 
-	/* Common OID prefix */
-	mib[0] = CTL_NET;
-	mib[1] = PF_LINK;
-	mib[2] = NETLINK_GENERIC;
-	mib[3] = IFMIB_IFDATA;
-	mib[4] = if_nametoindex(name);
-	mib[5] = IFDATA_SUPPLEMENTAL;
-	if (sysctl(mib, 6, &ifmsupp, &miblen, (void *)0, 0) == -1)
-		err(1, "sysctl IFDATA_SUPPLEMENTAL");
+	if ((ifmsp = ifsp->ifs_supp) == NULL) {
+		/* Common OID prefix */
+		mib[0] = CTL_NET;
+		mib[1] = PF_LINK;
+		mib[2] = NETLINK_GENERIC;
+		mib[3] = IFMIB_IFDATA;
+		mib[4] = ifindex;
+		mib[5] = IFDATA_SUPPLEMENTAL;
+		if (sysctl(mib, 6, &ifmsupp, &miblen, (void *)0, 0) == -1)
+			err(1, "sysctl IFDATA_SUPPLEMENTAL");
+		ifmsp = &ifmsupp;
+	}
 
-	if (ifmsupp.ifmd_data_extended.ifi_alignerrs != 0) {
+	if (ifmsp->ifmd_data_extended.ifi_alignerrs != 0) {
 		printf("\tunaligned pkts: %llu\n",
-		    ifmsupp.ifmd_data_extended.ifi_alignerrs);
+		    ifmsp->ifmd_data_extended.ifi_alignerrs);
 	}
-	if (ifmsupp.ifmd_data_extended.ifi_dt_bytes != 0) {
+	if (ifmsp->ifmd_data_extended.ifi_dt_bytes != 0) {
 		printf("\tdata milestone interval: %s\n",
-		    bytes_to_str(ifmsupp.ifmd_data_extended.ifi_dt_bytes));
+		    bytes_to_str(ifmsp->ifmd_data_extended.ifi_dt_bytes));
 	}
 
 	bzero(&ifdr, sizeof (ifdr));
@@ -2146,7 +2149,6 @@ status(const struct afswtch *afp, const struct sockaddr_dl *sdl,
 	show_routermode6();
 
 done:
-	close(s);
 	return;
 }
 
@@ -186,3 +186,41 @@ void	clone_setcallback(clone_callback_func *);
  * operations on ifmedia can avoid cmd line ordering confusion.
  */
 struct ifmediareq *ifmedia_getstate(int s);
+
+/*
+ * Snapshot of the interface list for status display: the entries of
+ * one getifaddrs() grouped per interface, with the ifmib data of each
+ * interface when it could be fetched.
+ */
+struct sockaddr_dl;
+struct ifmibdata;
+struct ifmibdata_supplemental;
+
+struct ifsnap_if {
+	const char	*ifs_name;
+	struct ifaddrs	**ifs_addrs;	/* entries, in getifaddrs() order */
+	int		ifs_naddrs;
+	unsigned int	ifs_index;	/* 0 if there is no AF_LINK entry */
+	const struct sockaddr_dl *ifs_sdl;
+	const struct ifmibdata *ifs_mib;	/* NULL if not available */
+	const struct ifmibdata_supplemental *ifs_supp;
+};
+
+struct ifsnap {
+	struct ifaddrs	*ifsn_ifap;
+	struct ifsnap_if *ifsn_ifs;	/* in order of first appearance */
+	int		ifsn_count;
+	struct ifaddrs	**ifsn_addrs;
+	struct ifsnap_if **ifsn_hash;	/* by name, open addressing */
+	uint32_t	ifsn_hashmask;
+	struct ifmibdata *ifsn_mib;
+	struct ifmibdata_supplemental *ifsn_supp;
+};
+
+#define	IFSNAP_MIB		0x1	/* fetch IFDATA_GENERAL */
+#define	IFSNAP_SUPPLEMENTAL	0x2	/* and IFDATA_SUPPLEMENTAL */
+
+int	ifsnap_take(struct ifsnap *, int flags);
+void	ifsnap_free(struct ifsnap *);
+struct ifsnap_if *ifsnap_lookup(const struct ifsnap *, const char *);
+int	ifsock(int af);
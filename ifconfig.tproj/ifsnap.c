@@ -0,0 +1,440 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * ifsnap.c
+ * - take a snapshot of all interfaces for status display
+ *
+ * Listing every interface used to cost a socket and a dozen ioctls per
+ * interface, plus a scan of the remainder of the getifaddrs() list to
+ * find its addresses, which is quadratic in the number of interfaces.
+ * A snapshot is one getifaddrs() with the entries grouped per interface
+ * in a single pass, and the ifmib data of all interfaces fetched with
+ * one IFMIB_IFALLDATA sysctl.  Status output is rendered from it, with
+ * ioctls left only for attributes the snapshot does not carry, issued
+ * on one socket per address family.
+ */
+
+// Define for XNU/BSD headers
+#define PRIVATE 1
+
+#include <sys/param.h>
+#include "../bsd/sys/socket.h"
+#include <sys/sysctl.h>
+#include <sys/time.h>
+
+#include "../bsd/net/if.h"
+#include "../bsd/net/if_var.h"
+#include "../bsd/net/if_dl.h"
+#include "../bsd/net/if_mib.h"
+#include "../bsd/netinet/in.h"
+
+#include <ifaddrs.h>
+#include <err.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ifconfig.h"
+
+#define IFSNAP_SLACK	16	/* room for interfaces attached meanwhile */
+
+static uint32_t
+ifsnap_hash(const char *name)
+{
+	uint32_t h = 2166136261U;	/* FNV-1a */
+
+	while (*name != '\0') {
+		h ^= (u_char)*name++;
+		h *= 16777619U;
+	}
+	return (h);
+}
+
+/* interface of the snapshot with the given name, or NULL */
+struct ifsnap_if *
+ifsnap_lookup(const struct ifsnap *snap, const char *name)
+{
+	struct ifsnap_if *ifs;
+	uint32_t i;
+
+	if (snap->ifsn_hash == NULL)
+		return (NULL);
+	for (i = ifsnap_hash(name) & snap->ifsn_hashmask; ;
+	    i = (i + 1) & snap->ifsn_hashmask) {
+		if ((ifs = snap->ifsn_hash[i]) == NULL)
+			return (NULL);
+		if (strcmp(ifs->ifs_name, name) == 0)
+			return (ifs);
+	}
+}
+
+/*
+ * Group the entries of a getifaddrs() list by interface, keeping the
+ * order in which interfaces first appear and, per interface, the order
+ * of its addresses.  The entries of an interface are normally adjacent,
+ * but this does not rely on it.
+ */
+static void
+ifsnap_group(struct ifsnap *snap, struct ifaddrs *ifap)
+{
+	struct ifaddrs *ifa;
+	struct ifsnap_if *ifs, **slot;
+	const struct sockaddr_dl *sdl;
+	uint32_t hashsize, h;
+	int nent, i, off;
+
+	memset(snap, 0, sizeof(*snap));
+	snap->ifsn_ifap = ifap;
+
+	nent = 0;
+	for (ifa = ifap; ifa != NULL; ifa = ifa->ifa_next)
+		nent++;
+	for (hashsize = 16; hashsize < 2 * (uint32_t)nent; hashsize *= 2)
+		;
+	snap->ifsn_hashmask = hashsize - 1;
+	if ((snap->ifsn_hash = calloc(hashsize, sizeof(*slot))) == NULL ||
+	    (snap->ifsn_ifs = calloc(nent + 1, sizeof(*ifs))) == NULL ||
+	    (snap->ifsn_addrs = calloc(nent + 1, sizeof(ifa))) == NULL ||
+	    (slot = calloc(nent + 1, sizeof(*slot))) == NULL)
+		err(EXIT_FAILURE, "calloc");
+
+	/* first pass: find the interface of every entry and count */
+	ifs = NULL;
+	for (ifa = ifap, i = 0; ifa != NULL; ifa = ifa->ifa_next, i++) {
+		if (ifs == NULL || strcmp(ifs->ifs_name, ifa->ifa_name) != 0) {
+			if ((ifs = ifsnap_lookup(snap, ifa->ifa_name)) == NULL) {
+				ifs = &snap->ifsn_ifs[snap->ifsn_count++];
+				ifs->ifs_name = ifa->ifa_name;
+				for (h = ifsnap_hash(ifs->ifs_name) &
+				    snap->ifsn_hashmask;
+				    snap->ifsn_hash[h] != NULL;
+				    h = (h + 1) & snap->ifsn_hashmask)
+					;
+				snap->ifsn_hash[h] = ifs;
+			}
+		}
+		slot[i] = ifs;
+		ifs->ifs_naddrs++;
+		if (ifs->ifs_sdl == NULL && ifa->ifa_addr != NULL &&
+		    ifa->ifa_addr->sa_family == AF_LINK) {
+			sdl = (const struct sockaddr_dl *)ifa->ifa_addr;
+			ifs->ifs_sdl = sdl;
+			ifs->ifs_index = sdl->sdl_index;
+		}
+	}
+
+	/* second pass: lay the entries out contiguously per interface */
+	off = 0;
+	for (i = 0; i < snap->ifsn_count; i++) {
+		ifs = &snap->ifsn_ifs[i];
+		ifs->ifs_addrs = snap->ifsn_addrs + off;
+		off += ifs->ifs_naddrs;
+		ifs->ifs_naddrs = 0;
+	}
+	for (ifa = ifap, i = 0; ifa != NULL; ifa = ifa->ifa_next, i++) {
+		ifs = slot[i];
+		ifs->ifs_addrs[ifs->ifs_naddrs++] = ifa;
+	}
+	free(slot);
+}
+
+/*
+ * Fetch the ifmib data of all interfaces at once and attach it to the
+ * interfaces of the snapshot.  Failure is not fatal; interfaces left
+ * without data are queried with ioctls instead.
+ */
+static void
+ifsnap_mib(struct ifsnap *snap, int flags)
+{
+	struct ifmibdata *ifmd;
+	struct ifmibdata_supplemental *ifmsupp = NULL;
+	struct ifsnap_if *ifs;
+	int mib[6];
+	int ifcount, count, i;
+	size_t len;
+
+	mib[0] = CTL_NET;
+	mib[1] = PF_LINK;
+	mib[2] = NETLINK_GENERIC;
+	mib[3] = IFMIB_SYSTEM;
+	mib[4] = IFMIB_IFCOUNT;
+	len = sizeof(ifcount);
+	if (sysctl(mib, 5, &ifcount, &len, NULL, 0) == -1)
+		return;
+	ifcount += IFSNAP_SLACK;
+
+	len = ifcount * sizeof(*ifmd);
+	if ((ifmd = malloc(len)) == NULL)
+		err(EXIT_FAILURE, "malloc");
+	mib[3] = IFMIB_IFALLDATA;
+	mib[4] = 0;
+	mib[5] = IFDATA_GENERAL;
+	if (sysctl(mib, 6, ifmd, &len, NULL, 0) == -1) {
+		free(ifmd);
+		return;
+	}
+	count = (int)(len / sizeof(*ifmd));
+
+	if (flags & IFSNAP_SUPPLEMENTAL) {
+		len = ifcount * sizeof(*ifmsupp);
+		if ((ifmsupp = malloc(len)) == NULL)
+			err(EXIT_FAILURE, "malloc");
+		mib[5] = IFDATA_SUPPLEMENTAL;
+		/* both tables must describe the same interfaces */
+		if (sysctl(mib, 6, ifmsupp, &len, NULL, 0) == -1 ||
+		    len / sizeof(*ifmsupp) != (size_t)count) {
+			free(ifmsupp);
+			ifmsupp = NULL;
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		if ((ifs = ifsnap_lookup(snap, ifmd[i].ifmd_name)) == NULL)
+			continue;
+		ifs->ifs_mib = &ifmd[i];
+		if (ifmsupp != NULL)
+			ifs->ifs_supp = &ifmsupp[i];
+	}
+	snap->ifsn_mib = ifmd;
+	snap->ifsn_supp = ifmsupp;
+}
+
+int
+ifsnap_take(struct ifsnap *snap, int flags)
+{
+	struct ifaddrs *ifap;
+
+	if (getifaddrs(&ifap) != 0)
+		return (-1);
+	ifsnap_group(snap, ifap);
+	if (flags & (IFSNAP_MIB | IFSNAP_SUPPLEMENTAL))
+		ifsnap_mib(snap, flags);
+	return (0);
+}
+
+void
+ifsnap_free(struct ifsnap *snap)
+{
+	free(snap->ifsn_supp);
+	free(snap->ifsn_mib);
+	free(snap->ifsn_addrs);
+	free(snap->ifsn_ifs);
+	free(snap->ifsn_hash);
+	if (snap->ifsn_ifap != NULL)
+		freeifaddrs(snap->ifsn_ifap);
+	memset(snap, 0, sizeof(*snap));
+}
+
+/*
+ * Datagram socket of the given family for status ioctls, opened on
+ * first use and kept for the life of the process.
+ */
+int
+ifsock(int af)
+{
+	static int socks[AF_MAX];	/* descriptor + 1, 0 if not open */
+	int s;
+
+	if (af <= 0 || af >= AF_MAX) {
+		errno = EAFNOSUPPORT;
+		return (-1);
+	}
+	if (socks[af] == 0) {
+		if ((s = socket(af, SOCK_DGRAM, 0)) < 0)
+			return (-1);
+		socks[af] = s + 1;
+	}
+	return (socks[af] - 1);
+}
+
+/*
+ * Synthetic benchmark (-B): build a getifaddrs()-style list of
+ * ninterfaces interfaces with BENCH_ADDRS entries each, and time
+ * finding the addresses of every interface the old way, by scanning
+ * the rest of the list, against grouping the list into a snapshot.
+ * The cost of a socket per interface is measured against the shared
+ * per-family socket as well.  No interface is touched.
+ */
+#define BENCH_SECONDS	1
+#define BENCH_ADDRS	4	/* link, inet, two inet6 */
+
+static double
+bench_elapsed(struct timespec *from, struct timespec *to)
+{
+	return ((to->tv_sec - from->tv_sec) +
+	    (to->tv_nsec - from->tv_nsec) / 1e9);
+}
+
+static struct ifaddrs *
+bench_list(int ninterfaces)
+{
+	struct ifaddrs *ifas, *ifa;
+	struct sockaddr_dl *sdls;
+	struct sockaddr_in *sins;
+	struct sockaddr_in6 *sin6s;
+	char *names;
+	int i, j;
+
+	ifas = calloc(ninterfaces * BENCH_ADDRS, sizeof(*ifas));
+	names = calloc(ninterfaces, IFNAMSIZ);
+	sdls = calloc(ninterfaces, sizeof(*sdls));
+	sins = calloc(ninterfaces, sizeof(*sins));
+	sin6s = calloc(ninterfaces * 2, sizeof(*sin6s));
+	if (ifas == NULL || names == NULL || sdls == NULL || sins == NULL ||
+	    sin6s == NULL)
+		err(EXIT_FAILURE, "calloc");
+
+	for (i = 0; i < ninterfaces; i++) {
+		snprintf(names + i * IFNAMSIZ, IFNAMSIZ, "bench%d", i);
+		sdls[i].sdl_len = sizeof(sdls[i]);
+		sdls[i].sdl_family = AF_LINK;
+		sdls[i].sdl_index = i + 1;
+		sins[i].sin_len = sizeof(sins[i]);
+		sins[i].sin_family = AF_INET;
+		sins[i].sin_addr.s_addr = htonl(0x0a000000 | i);
+		for (j = 0; j < 2; j++) {
+			sin6s[2 * i + j].sin6_len = sizeof(sin6s[0]);
+			sin6s[2 * i + j].sin6_family = AF_INET6;
+		}
+		for (j = 0; j < BENCH_ADDRS; j++) {
+			ifa = &ifas[i * BENCH_ADDRS + j];
+			ifa->ifa_name = names + i * IFNAMSIZ;
+			ifa->ifa_flags = IFF_UP | IFF_RUNNING;
+			ifa->ifa_addr = j == 0 ? (struct sockaddr *)&sdls[i] :
+			    j == 1 ? (struct sockaddr *)&sins[i] :
+			    (struct sockaddr *)&sin6s[2 * i + j - 2];
+			ifa->ifa_next = ifa + 1;
+		}
+	}
+	ifas[ninterfaces * BENCH_ADDRS - 1].ifa_next = NULL;
+	return (ifas);
+}
+
+static void
+ifsnap_bench(const char *arg)
+{
+	struct ifaddrs *ifap, *ifa, *ift;
+	struct ifsnap snap;
+	struct ifsnap_if *ifs;
+	struct timespec start, now;
+	const char *cp;
+	double scan, group, sockper, sockshared;
+	u_long nscan, ngroup, nsock, found;
+	int ninterfaces, i, j, s;
+
+	ninterfaces = atoi(arg);
+	if (ninterfaces <= 0)
+		errx(1, "-B: bad interface count %s", arg);
+	ifap = bench_list(ninterfaces);
+
+	/* the old way: scan the rest of the list for each interface */
+	nscan = found = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		cp = NULL;
+		for (ifa = ifap; ifa != NULL; ifa = ifa->ifa_next) {
+			if (cp != NULL && strcmp(cp, ifa->ifa_name) == 0)
+				continue;
+			cp = ifa->ifa_name;
+			for (ift = ifa; ift != NULL; ift = ift->ifa_next) {
+				if (strcmp(ifa->ifa_name, ift->ifa_name) != 0)
+					continue;
+				found++;
+			}
+		}
+		nscan++;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	} while (bench_elapsed(&start, &now) < BENCH_SECONDS);
+	scan = bench_elapsed(&start, &now);
+	if (found != nscan * ninterfaces * BENCH_ADDRS)
+		errx(1, "scan found %lu addresses", found);
+
+	/* the snapshot: group once, then walk each interface */
+	ngroup = found = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		ifsnap_group(&snap, ifap);
+		for (i = 0; i < snap.ifsn_count; i++) {
+			ifs = &snap.ifsn_ifs[i];
+			for (j = 0; j < ifs->ifs_naddrs; j++)
+				if (ifs->ifs_addrs[j]->ifa_addr != NULL)
+					found++;
+		}
+		snap.ifsn_ifap = NULL;	/* not from getifaddrs() */
+		ifsnap_free(&snap);
+		ngroup++;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	} while (bench_elapsed(&start, &now) < BENCH_SECONDS);
+	group = bench_elapsed(&start, &now);
+	if (found != ngroup * ninterfaces * BENCH_ADDRS)
+		errx(1, "snapshot found %lu addresses", found);
+
+	/* a socket per interface against the shared one */
+	nsock = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		for (i = 0; i < ninterfaces; i++) {
+			if ((s = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+				err(1, "socket");
+			close(s);
+		}
+		nsock++;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	} while (bench_elapsed(&start, &now) < BENCH_SECONDS);
+	sockper = bench_elapsed(&start, &now);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < ninterfaces; i++) {
+		if (ifsock(AF_INET) < 0)
+			err(1, "socket");
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	sockshared = bench_elapsed(&start, &now);
+
+	printf("%d interfaces, %d entries each\n", ninterfaces, BENCH_ADDRS);
+	printf("address scan: %.3f ms/listing (%lu listings)\n",
+	    scan * 1e3 / nscan, nscan);
+	printf("snapshot:     %.3f ms/listing (%lu listings)\n",
+	    group * 1e3 / ngroup, ngroup);
+	printf("sockets:      %.3f ms/listing per interface, "
+	    "%.3f ms/listing shared\n", sockper * 1e3 / nsock,
+	    sockshared * 1e3);
+	exit(0);
+}
+
+static struct option ifsnap_Bopt = { "B:", "[-B ninterfaces]", ifsnap_bench };
+
+static __constructor void
+ifsnap_ctor(void)
+{
+	opt_register(&ifsnap_Bopt);
+}
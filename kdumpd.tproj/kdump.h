@@ -111,4 +111,36 @@ struct	kdumphdr {
 #define KDUMPD_DEBUG_LEVEL LOG_ALERT
 #define KDP_LARGE_CRASHDUMP_PKT_SIZE (1440 - sizeof(struct udpiphdr))
 
+/*
+ * Feature bits, requested by the sender as a 32-bit mask following the
+ * "features" string of the WRQ and granted in the high byte of the
+ * opcode of the block 0 ACK.
+ */
+#define KDP_FEATURE_MASK_STRING		"features"
+enum	{KDP_FEATURE_LARGE_CRASHDUMPS = 1, KDP_FEATURE_LARGE_PKT_SIZE = 2,
+	 KDP_FEATURE_WINDOW = 4};
+
+/*
+ * Windowed transfer (KDP_FEATURE_WINDOW).  The block 0 ACK carries the
+ * receiver's window, in blocks, as a 32-bit value after the block number.
+ * The sender may then have up to that many blocks outstanding past the
+ * cumulative ACK.  Every later ACK carries the cumulative block number
+ * (all blocks up to and including it have been received) followed by a
+ * selective ACK bitmap covering the window, as 32-bit words: bit (i % 32)
+ * of word (i / 32) set means block (cumulative + 1 + i) has been received
+ * as well.
+ *
+ * Within a run of DATA blocks every block but the last carries a full
+ * segment, so a block's file offset follows from its distance to the
+ * preceding KDP_SEEK.  KDP_SEEK and KDP_EOF are only sent once all prior
+ * blocks have been acknowledged, and no block may follow a KDP_SEEK until
+ * the KDP_SEEK itself has been acknowledged: the receiver cannot tell a
+ * lost KDP_SEEK from a lost DATA block, and would place the new run at
+ * the old run's offsets.
+ */
+#define KDP_WINDOW_DEFAULT	64
+#define KDP_WINDOW_MAX		1024
+#define KDP_SACK_WORDS(w)	(((w) + 31) / 32)
+#define KDP_WINDOW_ACK_SIZE(w)	(sizeof(struct kdumphdr) + KDP_SACK_WORDS(w) * sizeof(uint32_t))
+
 #endif
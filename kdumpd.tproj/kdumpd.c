@@ -69,6 +69,7 @@ __unused static const char copyright[] =
 #include <errno.h>
 #include <fcntl.h>
 #include <netdb.h>
+#include <poll.h>
 #include <pwd.h>
 #include <setjmp.h>
 #include <signal.h>
@@ -80,6 +81,7 @@ __unused static const char copyright[] =
 #include <libkern/OSByteOrder.h>
 
 #include "kdumpsubs.h"
+#include "kdumpz.h"
 
 #define DEFAULT_KDUMPD_PORTNO (1069)
 #define	TIMEOUT		2
@@ -113,6 +115,8 @@ static int	suppress_naks;
 static int	logging = 1;
 static int	ipchroot;
 static int  server_mode = 1;
+static int  multi_mode;
+int	compress_dumps;
 
 static char *errtomsg __P((int));
 static void  nak __P((int));
@@ -120,11 +124,10 @@ static char * __P(verifyhost(struct sockaddr_in *));
 uint32_t kdp_crashdump_pkt_size = (SEGSIZE + (sizeof(struct kdumphdr)));
 uint32_t kdp_crashdump_seg_size = SEGSIZE;
 
-#define KDP_FEATURE_MASK_STRING		"features"
-enum	{KDP_FEATURE_LARGE_CRASHDUMPS = 1, KDP_FEATURE_LARGE_PKT_SIZE = 2};
-
 uint32_t kdp_crashdump_feature_mask;
 uint32_t kdp_feature_large_crashdumps, kdp_feature_large_packets;
+uint32_t kdp_feature_window;
+uint32_t window_size = KDP_WINDOW_DEFAULT;
 
 int
 main(argc, argv)
@@ -138,9 +141,11 @@ main(argc, argv)
 	char *chroot_dir = NULL;
 	struct passwd *nobody;
 	char *chuser = "nobody";
+	char *sender_host = NULL;
+	int sender_loss = 0, expand = 0;
 
 	openlog("kdumpd", LOG_PID | LOG_NDELAY, LOG_FTP);
-	while ((ch = getopt(argc, argv, "cClns:u:w")) != -1) {
+	while ((ch = getopt(argc, argv, "cCL:lmns:t:u:wW:xz")) != -1) {
 		switch (ch) {
 		case 'c':
 			ipchroot = 1;
@@ -148,26 +153,69 @@ main(argc, argv)
 		case 'C':
 			ipchroot = 2;
 			break;
+		case 'L':
+			sender_loss = atoi(optarg);
+			break;
 		case 'l':
 			logging = 1;
 			break;
+		case 'm':
+			multi_mode = 1;
+			server_mode = 0;
+			break;
 		case 'n':
 			suppress_naks = 1;
 			break;
 		case 's':
 			chroot_dir = optarg;
 			break;
+		case 't':
+			sender_host = optarg;
+			break;
 		case 'u':
 			chuser = optarg;
 			break;
 		case 'w':
 			server_mode = 0;
 			break;
+		case 'W':
+			window_size = atoi(optarg);
+			if (window_size > KDP_WINDOW_MAX)
+				window_size = KDP_WINDOW_MAX;
+			break;
+		case 'x':
+			expand = 1;
+			break;
+		case 'z':
+			compress_dumps = 1;
+			break;
 		default:
 			syslog(LOG_WARNING, "ignoring unknown option -%c", ch);
 		}
 	}
 
+	/* Act as a dump sender rather than a server, for testing. */
+	if (sender_host != NULL) {
+		if (optind + 1 != argc) {
+			fprintf(stderr, "usage: kdumpd -t host[:port] [-L loss] [-W window] file\n");
+			exit(1);
+		}
+		exit(kdumpsend(sender_host, argv[optind], window_size, sender_loss));
+	}
+
+	/* Expand a compressed core file. */
+	if (expand) {
+		if (optind + 2 != argc) {
+			fprintf(stderr, "usage: kdumpd -x file" KDZ_SUFFIX " output\n");
+			exit(1);
+		}
+		exit(kdz_expand(argv[optind], argv[optind + 1]));
+	}
+	if (compress_dumps && !multi_mode) {
+		syslog(LOG_ERR, "-z requires -m");
+		exit(1);
+	}
+
 	if (optind < argc) {
 		struct dirlist *dirp;
 
@@ -189,6 +237,10 @@ main(argc, argv)
 		syslog(LOG_ERR, "-c requires -s");
 		exit(1);
 	}
+	if (ipchroot && multi_mode) {
+		syslog(LOG_ERR, "-c cannot be used with -m");
+		exit(1);
+	}
 
 	/* If we are not in server mode, skip the whole 'inetd' logic below. */
 	if (server_mode) {
@@ -313,6 +365,10 @@ main(argc, argv)
 		exit(1);
 	}
 
+	/* Serve every peer from this socket; does not return. */
+	if (multi_mode)
+		exit(kdumpd_serve(peer));
+
 	if (!server_mode) {
 		/*
 		 * Wait for an incoming message from a remote peer, note that we need to
@@ -343,6 +399,7 @@ struct formats;
 int	validate_access __P((char **, int));
 
 void	recvfile __P((struct formats *));
+static void	recvfile_window __P((struct formats *));
 
 struct formats {
 	char	*f_mode;
@@ -357,29 +414,30 @@ struct formats {
 };
 
 /*
- * Handle initial connection protocol.
+ * Parse a request: the file name, the mode, folded to lower case, and the
+ * optional feature mask.  Returns 0 or a KDUMP error code.
  */
-void
-kdump(tp, size)
+int
+parse_request(tp, size, filenamep, modep, maskp)
 	struct kdumphdr *tp;
 	int size;
+	char **filenamep, **modep;
+	uint32_t *maskp;
 {
-	register char *cp;
-	int first = 1, ecode;
-	register struct formats *pf;
-	char *filename, *mode = NULL;
+	register char *cp, *end = (char *)tp + size;
+	int first = 1;
+	char *mode = NULL;
+	uint32_t mask;
 
-	filename = cp = tp->th_stuff;
+	*filenamep = cp = tp->th_stuff;
 again:
-	while (cp < buf + size) {
+	while (cp < end) {
 		if (*cp == '\0')
 			break;
 		cp++;
 	}
-	if (*cp != '\0') {
-		nak(EBADOP);
-		exit(1);
-	}
+	if (cp >= end)
+		return (EBADOP);
 	if (first) {
 		mode = ++cp;
 		first = 0;
@@ -388,21 +446,46 @@ again:
 	for (cp = mode; *cp; cp++)
 		if (isupper(*cp))
 			*cp = tolower(*cp);
+	*modep = mode;
 
 	cp++;
-	if (strncmp(KDP_FEATURE_MASK_STRING, cp, sizeof(KDP_FEATURE_MASK_STRING)) == 0) {
-		kdp_crashdump_feature_mask = ntohl(*(uint32_t *) (cp + sizeof(KDP_FEATURE_MASK_STRING)));
-		kdp_feature_large_crashdumps = kdp_crashdump_feature_mask & KDP_FEATURE_LARGE_CRASHDUMPS;
-		kdp_feature_large_packets = kdp_crashdump_feature_mask & KDP_FEATURE_LARGE_PKT_SIZE;
-
-		if (kdp_feature_large_packets) {
-			kdp_crashdump_pkt_size = KDP_LARGE_CRASHDUMP_PKT_SIZE;
-			kdp_crashdump_seg_size = kdp_crashdump_pkt_size - sizeof(struct kdumphdr);
-		}
-		syslog(KDUMPD_DEBUG_LEVEL, "Received feature mask %s:0x%x", cp, kdp_crashdump_feature_mask);
+	*maskp = 0;
+	if (end - cp >= (int)(sizeof(KDP_FEATURE_MASK_STRING) + sizeof(mask)) &&
+	    strncmp(KDP_FEATURE_MASK_STRING, cp, sizeof(KDP_FEATURE_MASK_STRING)) == 0) {
+		bcopy(cp + sizeof(KDP_FEATURE_MASK_STRING), &mask, sizeof(mask));
+		*maskp = ntohl(mask);
+		syslog(KDUMPD_DEBUG_LEVEL, "Received feature mask %s:0x%x", cp, *maskp);
 	} else
 		syslog(KDUMPD_DEBUG_LEVEL, "Unable to locate feature mask, mode: %s", mode);
-	
+	return (0);
+}
+
+/*
+ * Handle initial connection protocol.
+ */
+void
+kdump(tp, size)
+	struct kdumphdr *tp;
+	int size;
+{
+	int ecode;
+	register struct formats *pf;
+	char *filename, *mode;
+
+	if ((ecode = parse_request(tp, size, &filename, &mode,
+	    &kdp_crashdump_feature_mask)) != 0) {
+		nak(ecode);
+		exit(1);
+	}
+	kdp_feature_large_crashdumps = kdp_crashdump_feature_mask & KDP_FEATURE_LARGE_CRASHDUMPS;
+	kdp_feature_large_packets = kdp_crashdump_feature_mask & KDP_FEATURE_LARGE_PKT_SIZE;
+	kdp_feature_window = kdp_crashdump_feature_mask & KDP_FEATURE_WINDOW;
+
+	if (kdp_feature_large_packets) {
+		kdp_crashdump_pkt_size = KDP_LARGE_CRASHDUMP_PKT_SIZE;
+		kdp_crashdump_seg_size = kdp_crashdump_pkt_size - sizeof(struct kdumphdr);
+	}
+
 	for (pf = formats; pf->f_mode; pf++)
 		if (strcmp(pf->f_mode, mode) == 0)
 			break;
@@ -410,6 +493,9 @@ again:
 		nak(EBADOP);
 		exit(1);
 	}
+	/* Windowed writes land at computed offsets, so no conversion. */
+	if (pf->f_convert || window_size == 0)
+		kdp_feature_window = 0;
 	ecode = (*pf->f_validate)(&filename, tp->th_opcode);
 	if (logging) {
 		syslog(KDUMPD_DEBUG_LEVEL, "%s: %s request for %s: %s", verifyhost(&from),
@@ -499,6 +585,26 @@ justquit()
 	exit(0);
 }
 
+/*
+ * Offset carried by a KDP_SEEK packet, 64 bits wide if large crashdumps
+ * were negotiated.
+ */
+off_t
+seek_offset(dp, large)
+	struct kdumphdr *dp;
+	int large;
+{
+	uint64_t off64;
+	unsigned int tempoff;
+
+	if (large) {
+		bcopy(dp->th_data, &off64, sizeof(off64));
+		return (off_t)OSSwapBigToHostInt64(off64);
+	}
+	bcopy(dp->th_data, &tempoff, sizeof(tempoff));
+	return (off_t)ntohl(tempoff);
+}
+
 /*
  * Receive a file.
  */
@@ -512,6 +618,10 @@ recvfile(pf)
 	volatile unsigned int block;
 	volatile unsigned int jmpval = 0;
 
+	if (kdp_feature_window) {
+		recvfile_window(pf);
+		return;
+	}
 	signal(SIGALRM, timer);
 	dp = w_init();
 	ap = (struct kdumphdr *)ackbuf;
@@ -562,16 +672,7 @@ send_ack:
 			  {
 			    if (dp->th_block == block)
 			      {
-				off_t crashdump_offset = 0;
-				unsigned int tempoff = 0;
-
-				if (kdp_feature_large_crashdumps) {
-					crashdump_offset = OSSwapBigToHostInt64((*(uint64_t *)dp->th_data));
-				}
-				else {
-				bcopy (dp->th_data, &tempoff, sizeof(unsigned int));
-				crashdump_offset = ntohl(tempoff);
-				}
+				off_t crashdump_offset = seek_offset(dp, kdp_feature_large_crashdumps);
 
 #if	DEBUG
 				syslog(KDUMPD_DEBUG_LEVEL, "Seeking to offset 0x%llx\n", crashdump_offset);
@@ -639,6 +740,186 @@ abort:
 	return;
 }
 
+/*
+ * Windowed receive state: each of the window_size ring slots holds the
+ * number of the block last stored in it, so a block past the cumulative
+ * ACK has arrived iff its slot holds it.  Block numbers start at 1, so a
+ * zeroed slot is empty.
+ */
+static uint32_t	*wring;
+static uint32_t	wcum;
+
+/*
+ * Send a windowed ACK: the block 0 form grants the features and the
+ * window, later ones carry the cumulative block and the SACK bitmap.
+ */
+static int
+send_window_ack()
+{
+	struct kdumphdr *ap = (struct kdumphdr *)ackbuf;
+	uint32_t word, i, b;
+	size_t len;
+
+	if (wcum == 0) {
+		ap->th_opcode = htons((u_short)ACK | ((kdp_feature_large_crashdumps | kdp_feature_large_packets | kdp_feature_window) << 8));
+		word = htonl(window_size);
+		bcopy(&word, ap->th_data, sizeof(word));
+		len = sizeof(struct kdumphdr) + sizeof(word);
+	} else {
+		ap->th_opcode = htons((u_short)ACK);
+		for (i = word = 0; i < window_size; i++) {
+			b = wcum + 1 + i;
+			if (wring[b % window_size] == b)
+				word |= 1U << (i % 32);
+			if (i % 32 == 31 || i == window_size - 1) {
+				word = htonl(word);
+				bcopy(&word, ap->th_data + (i / 32) * sizeof(word), sizeof(word));
+				word = 0;
+			}
+		}
+		len = KDP_WINDOW_ACK_SIZE(window_size);
+	}
+	ap->th_block = htonl(wcum);
+	if (send(peer, ackbuf, len, 0) != (ssize_t)len) {
+		syslog(LOG_ERR, "write: %m");
+		return (-1);
+	}
+	return (0);
+}
+
+/*
+ * Receive a file with up to window_size blocks outstanding.  DATA blocks
+ * are written with pwrite() at their offset as they arrive, in whatever
+ * order; the ring only tracks which ones have been seen.  Each burst of
+ * packets is acknowledged once it has been drained from the socket, and a
+ * block arriving past a hole is acknowledged at once so the sender learns
+ * of the loss without waiting for a timeout.
+ */
+static void
+recvfile_window(pf)
+	struct formats *pf;
+{
+	struct kdumphdr *dp = (struct kdumphdr *)buf;
+	struct pollfd pfd;
+	off_t run_offset = 0, off;
+	uint32_t run_first = 1, block, slot;
+	int fd = fileno(file), n, size, unacked = 0, idle = 0;
+
+	wring = calloc(window_size, sizeof(*wring));
+	if (wring == NULL) {
+		syslog(LOG_ERR, "malloc: %m");
+		nak(ENOMEM + 100);
+		return;
+	}
+	wcum = 0;
+	pfd.fd = peer;
+	pfd.events = POLLIN;
+	if (send_window_ack() < 0)
+		goto abort;
+	for (;;) {
+		n = recv(peer, buf, kdp_crashdump_pkt_size, MSG_DONTWAIT);
+		if (n < 0 && errno == EAGAIN) {
+			if (unacked) {
+				unacked = 0;
+				if (send_window_ack() < 0)
+					goto abort;
+			}
+			n = poll(&pfd, 1, rexmtval * 1000);
+			if (n == 0) {
+				idle += rexmtval;
+				if (idle >= maxtimeout) {
+					syslog(LOG_ERR, "Timing out and flushing file to disk");
+					goto flushfile;
+				}
+				if (send_window_ack() < 0)
+					goto abort;
+			} else if (n < 0 && errno != EINTR) {
+				syslog(LOG_ERR, "poll: %m");
+				goto abort;
+			}
+			continue;
+		}
+		if (n < 0) {
+			syslog(LOG_ERR, "read: %m");
+			goto abort;
+		}
+		if (n < (int)sizeof(struct kdumphdr))
+			continue;
+		idle = 0;
+		dp->th_opcode = ntohs((u_short)dp->th_opcode);
+		block = ntohl((unsigned int)dp->th_block);
+#if	DEBUG
+		syslog(KDUMPD_DEBUG_LEVEL, "Received packet type %u, block %u\n", (unsigned)dp->th_opcode, block);
+#endif
+		if (dp->th_opcode == ERROR)
+			goto abort;
+		if (block > wcum + window_size)
+			continue;
+		slot = block % window_size;
+		if (block <= wcum || wring[slot] == block) {
+			unacked++;		/* duplicate, our ACK was lost */
+			continue;
+		}
+
+		switch (dp->th_opcode) {
+		case KDP_SEEK:
+			if (block != wcum + 1)
+				continue;
+			run_offset = seek_offset(dp, kdp_feature_large_crashdumps);
+			run_first = block + 1;
+#if	DEBUG
+			syslog(KDUMPD_DEBUG_LEVEL, "Seeking to offset 0x%llx\n", run_offset);
+#endif
+			break;
+		case KDP_EOF:
+			if (block != wcum + 1) {
+				unacked++;
+				continue;
+			}
+			syslog(LOG_ERR, "Received last panic dump packet");
+			wcum = block;
+			goto final_ack;
+		case DATA:
+			off = run_offset + (off_t)(block - run_first) * kdp_crashdump_seg_size;
+			size = pwrite(fd, dp->th_data, n - sizeof(struct kdumphdr), off);
+			if (size != n - (int)sizeof(struct kdumphdr)) {
+				if (size < 0) nak(errno + 100);
+				else nak(ENOSPACE);
+				goto abort;
+			}
+			break;
+		default:
+			continue;
+		}
+
+		wring[slot] = block;
+		while (wring[(wcum + 1) % window_size] == wcum + 1)
+			wcum++;
+		if (dp->th_opcode == KDP_SEEK || block != wcum ||
+		    ++unacked >= (int)(window_size + 3) / 4) {
+			unacked = 0;
+			if (send_window_ack() < 0)
+				goto abort;
+		}
+	}
+
+final_ack:
+	(void) send_window_ack();
+flushfile:
+	(void) fclose(file);
+	syslog (LOG_ERR, "file closed, sending final ACK\n");
+
+	/* Linger in case the final ACK was lost and the EOF is resent. */
+	if (poll(&pfd, 1, rexmtval * 1000) > 0 &&
+	    recv(peer, buf, kdp_crashdump_pkt_size, 0) >= (ssize_t)sizeof(struct kdumphdr) &&
+	    ntohs((u_short)dp->th_opcode) == KDP_EOF &&
+	    ntohl((unsigned int)dp->th_block) == wcum)
+		(void) send_window_ack();
+abort:
+	free(wring);
+	wring = NULL;
+}
+
 /* update if needed, when adding new errmsgs */
 #define MAXERRMSGLEN	40
 
@@ -673,20 +954,22 @@ errtomsg(error)
 }
 
 /*
- * Send a nak packet (error message).
+ * Build a nak packet (error message) in pkt
+ * and return its length, or -1.
  * Error code passed in is one of the
  * standard KDUMP codes, or a UNIX errno
  * offset by 100.
  */
-static void
-nak(error)
+int
+nak_packet(pkt, error)
+	char *pkt;
 	int error;
 {
 	register struct kdumphdr *tp;
 	int length;
 	register struct errmsg *pe;
 
-	tp = (struct kdumphdr *)buf;
+	tp = (struct kdumphdr *)pkt;
 	tp->th_opcode = htons((u_short)ERROR);
 	tp->th_code = htons((unsigned int)error);
 	for (pe = errmsgs; pe->e_code >= 0; pe++)
@@ -698,13 +981,27 @@ nak(error)
 	}
 	if (strlen(pe->e_msg) > MAXERRMSGLEN) {
 		syslog(LOG_ERR, "nak: error msg too long");	
-		return;
+		return (-1);
 	}
 		
 	strlcpy(tp->th_msg, pe->e_msg, MAXERRMSGLEN);
 	length = strlen(pe->e_msg);
 	tp->th_msg[length] = '\0';
 	length += 5;
+	return (length);
+}
+
+/*
+ * Send a nak packet to the peer.
+ */
+static void
+nak(error)
+	int error;
+{
+	int length;
+
+	if ((length = nak_packet(buf, error)) < 0)
+		return;
 	if (send(peer, buf, length, 0) != length)
 		syslog(LOG_ERR, "nak: %m");
 	
@@ -0,0 +1,389 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * A user space stand-in for the kernel's crash dump sender, so that the
+ * server can be exercised without panicking a machine.  The file is sent
+ * in regions of SEND_REGION bytes, last region first, each introduced by
+ * a KDP_SEEK, so that the received copy is only correct if the server
+ * honours the seeks.  Regions that are all zeros, other than the last,
+ * are skipped the way the kernel skips unmapped memory, leaving holes for
+ * the server to preserve.  The windowed protocol is used when the server
+ * grants it, stop-and-wait otherwise, and a percentage of outgoing
+ * packets can be dropped on purpose to exercise retransmission.
+ */
+
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <netinet/in.h>
+#include "kdump.h"
+#include <arpa/inet.h>
+
+#include <err.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libkern/OSByteOrder.h>
+
+#include "kdumpsubs.h"
+
+#define SEND_REGION	(1024 * 1024)
+#define SEND_REXMT_MS	1000
+#define SEND_MAXTRIES	10
+
+static int	s;			/* socket connected to the server */
+static int	fd;			/* file being sent */
+static int	loss;			/* percentage of packets to drop */
+static uint32_t	features;		/* granted by the server */
+static uint32_t	window;			/* 0 for stop-and-wait */
+static uint32_t	segsize;
+static char	pkt[MAXIMUM_KDP_PKTSIZE];
+static char	rbuf[MAXIMUM_KDP_PKTSIZE + 1];
+static uint32_t	sackmap[KDP_SACK_WORDS(KDP_WINDOW_MAX)];
+static unsigned long npackets, nrexmt, ndropped;
+
+static void
+xmit(size_t len)
+{
+	if (loss > 0 && (int)arc4random_uniform(100) < loss) {
+		ndropped++;
+		return;
+	}
+	if (send(s, pkt, len, 0) != (ssize_t)len)
+		err(1, "send");
+	npackets++;
+}
+
+static size_t
+build(u_short opcode, uint32_t block)
+{
+	struct kdumphdr *hp = (struct kdumphdr *)pkt;
+
+	hp->th_opcode = htons(opcode);
+	hp->th_block = htonl(block);
+	return sizeof(struct kdumphdr);
+}
+
+static size_t
+build_seek(uint32_t block, off_t off)
+{
+	struct kdumphdr *hp = (struct kdumphdr *)pkt;
+	uint64_t off64;
+	uint32_t off32;
+
+	if (features & KDP_FEATURE_LARGE_CRASHDUMPS) {
+		off64 = OSSwapHostToBigInt64((uint64_t)off);
+		bcopy(&off64, hp->th_data, sizeof(off64));
+		return build(KDP_SEEK, block) + sizeof(off64);
+	}
+	off32 = htonl((uint32_t)off);
+	bcopy(&off32, hp->th_data, sizeof(off32));
+	return build(KDP_SEEK, block) + sizeof(off32);
+}
+
+/*
+ * DATA packet for block number block of the run that starts with block
+ * first at file offset off and ends at end.
+ */
+static size_t
+build_data(uint32_t block, uint32_t first, off_t off, off_t end)
+{
+	struct kdumphdr *hp = (struct kdumphdr *)pkt;
+	off_t o = off + (off_t)(block - first) * segsize;
+	size_t len = MIN((off_t)segsize, end - o);
+
+	if (pread(fd, hp->th_data, len, o) != (ssize_t)len)
+		err(1, "pread");
+	return build(DATA, block) + len;
+}
+
+static int
+region_is_zero(off_t off, off_t end)
+{
+	static char zero[SEGSIZE], chunk[SEGSIZE];
+	size_t len;
+
+	for (; off < end; off += len) {
+		len = MIN((off_t)sizeof(chunk), end - off);
+		if (pread(fd, chunk, len, off) != (ssize_t)len)
+			err(1, "pread");
+		if (memcmp(chunk, zero, len) != 0)
+			return (0);
+	}
+	return (1);
+}
+
+/*
+ * Wait up to ms milliseconds for an ACK.  Returns 0 on timeout, otherwise
+ * the cumulative block; the SACK bitmap of a windowed ACK is left in
+ * sackmap.
+ */
+static int
+recv_ack(int ms, uint32_t *cump)
+{
+	struct kdumphdr *ap = (struct kdumphdr *)rbuf;
+	struct pollfd pfd;
+	uint32_t i;
+	ssize_t n;
+
+	pfd.fd = s;
+	pfd.events = POLLIN;
+	for (;;) {
+		if (poll(&pfd, 1, ms) <= 0)
+			return (0);
+		n = recv(s, rbuf, sizeof(rbuf) - 1, 0);
+		if (n < 0)
+			err(1, "recv");
+		if (n < (ssize_t)sizeof(struct kdumphdr))
+			continue;
+		switch (ntohs((u_short)ap->th_opcode) & 0xff) {
+		case ERROR:
+			rbuf[n] = '\0';
+			errx(1, "server: %s", ap->th_msg);
+		case ACK:
+			*cump = ntohl(ap->th_block);
+			memset(sackmap, 0, sizeof(sackmap));
+			if (window != 0 && *cump != 0 &&
+			    n >= (ssize_t)KDP_WINDOW_ACK_SIZE(window)) {
+				bcopy(ap->th_data, sackmap,
+				    KDP_SACK_WORDS(window) * sizeof(uint32_t));
+				for (i = 0; i < KDP_SACK_WORDS(window); i++)
+					sackmap[i] = ntohl(sackmap[i]);
+			}
+			return (1);
+		}
+	}
+}
+
+/*
+ * Send the packet in pkt and wait until block has been acknowledged.
+ */
+static void
+exchange(size_t len, uint32_t block)
+{
+	uint32_t cum;
+	int tries;
+
+	for (tries = 0; tries < SEND_MAXTRIES; tries++) {
+		if (tries > 0)
+			nrexmt++;
+		xmit(len);
+		while (recv_ack(SEND_REXMT_MS, &cum))
+			if (cum >= block)
+				return;
+	}
+	errx(1, "no acknowledgement for block %u", block);
+}
+
+/*
+ * Send blocks first through last with up to window of them outstanding.
+ * Holes below the highest selectively acknowledged block are resent once
+ * as soon as they are reported; a timeout resends everything outstanding
+ * that the server has not reported.
+ */
+static void
+send_run(uint32_t first, uint32_t last, off_t off, off_t end)
+{
+	uint32_t *sacked, *resent;
+	uint32_t cum = first - 1, next = first, high, b, ackcum, i;
+	int timeouts = 0;
+
+	sacked = calloc(window, sizeof(*sacked));
+	resent = calloc(window, sizeof(*resent));
+	if (sacked == NULL || resent == NULL)
+		err(1, "calloc");
+	while (cum < last) {
+		while (next <= last && next <= cum + window)
+			xmit(build_data(next++, first, off, end));
+		if (!recv_ack(SEND_REXMT_MS, &ackcum)) {
+			if (++timeouts > SEND_MAXTRIES)
+				errx(1, "no acknowledgement for block %u", cum + 1);
+			for (b = cum + 1; b < next; b++) {
+				if (sacked[b % window] != b) {
+					xmit(build_data(b, first, off, end));
+					nrexmt++;
+				}
+			}
+			continue;
+		}
+		timeouts = 0;
+		if (ackcum > cum)
+			cum = MIN(ackcum, last);
+		high = cum;
+		for (i = 0; i < window; i++) {
+			b = ackcum + 1 + i;
+			if ((sackmap[i / 32] & (1U << (i % 32))) &&
+			    b > cum && b < next) {
+				sacked[b % window] = b;
+				high = b;
+			}
+		}
+		for (b = cum + 1; b < high; b++) {
+			if (sacked[b % window] != b && resent[b % window] != b) {
+				resent[b % window] = b;
+				xmit(build_data(b, first, off, end));
+				nrexmt++;
+			}
+		}
+	}
+	free(sacked);
+	free(resent);
+}
+
+int
+kdumpsend(const char *host, const char *path, uint32_t want_window, int lossp)
+{
+	struct kdumphdr *hp = (struct kdumphdr *)pkt, *ap = (struct kdumphdr *)rbuf;
+	struct addrinfo hints, *res;
+	struct sockaddr_storage from;
+	struct timeval start, stop;
+	struct pollfd pfd;
+	struct stat sb;
+	socklen_t fromlen;
+	char hostbuf[MAXHOSTNAMELEN], pathbuf[MAXPATHLEN], portbuf[8];
+	char *cp, *name;
+	uint32_t block, nblocks, mask, word;
+	off_t off, end, nregions, r;
+	size_t len;
+	ssize_t n;
+	double secs;
+	int error, tries;
+
+	loss = lossp;
+	strlcpy(hostbuf, host, sizeof(hostbuf));
+	snprintf(portbuf, sizeof(portbuf), "%d", 1069);
+	if ((cp = strrchr(hostbuf, ':')) != NULL) {
+		*cp++ = '\0';
+		strlcpy(portbuf, cp, sizeof(portbuf));
+	}
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	if ((error = getaddrinfo(hostbuf, portbuf, &hints, &res)) != 0)
+		errx(1, "%s: %s", hostbuf, gai_strerror(error));
+	if ((s = socket(res->ai_family, res->ai_socktype, 0)) < 0)
+		err(1, "socket");
+	if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &sb) < 0)
+		err(1, "%s", path);
+	strlcpy(pathbuf, path, sizeof(pathbuf));
+	name = basename(pathbuf);
+
+	/* WRQ: name, mode, then the feature mask we would like. */
+	hp->th_opcode = htons((u_short)WRQ);
+	cp = hp->th_stuff;
+	cp += strlcpy(cp, name, sizeof(pkt) - 64) + 1;
+	cp += strlcpy(cp, "octet", 6) + 1;
+	cp += strlcpy(cp, KDP_FEATURE_MASK_STRING, sizeof(KDP_FEATURE_MASK_STRING)) + 1;
+	mask = KDP_FEATURE_LARGE_CRASHDUMPS | KDP_FEATURE_LARGE_PKT_SIZE;
+	if (want_window > 0)
+		mask |= KDP_FEATURE_WINDOW;
+	mask = htonl(mask);
+	bcopy(&mask, cp, sizeof(mask));
+	len = cp + sizeof(mask) - pkt;
+
+	/* The reply comes from the server's transfer socket; connect to it. */
+	pfd.fd = s;
+	pfd.events = POLLIN;
+	for (tries = 0; ; tries++) {
+		if (tries == SEND_MAXTRIES)
+			errx(1, "%s: no response", host);
+		if (sendto(s, pkt, len, 0, res->ai_addr, res->ai_addrlen) != (ssize_t)len)
+			err(1, "sendto");
+		if (poll(&pfd, 1, SEND_REXMT_MS * 2) <= 0)
+			continue;
+		fromlen = sizeof(from);
+		n = recvfrom(s, rbuf, sizeof(rbuf) - 1, 0,
+		    (struct sockaddr *)&from, &fromlen);
+		if (n < (ssize_t)sizeof(struct kdumphdr))
+			continue;
+		if ((ntohs((u_short)ap->th_opcode) & 0xff) == ERROR) {
+			rbuf[n] = '\0';
+			errx(1, "server: %s", ap->th_msg);
+		}
+		if ((ntohs((u_short)ap->th_opcode) & 0xff) == ACK &&
+		    ntohl(ap->th_block) == 0)
+			break;
+	}
+	freeaddrinfo(res);
+	if (connect(s, (struct sockaddr *)&from, fromlen) < 0)
+		err(1, "connect");
+	features = ntohs((u_short)ap->th_opcode) >> 8;
+	if ((features & KDP_FEATURE_WINDOW) &&
+	    n >= (ssize_t)(sizeof(struct kdumphdr) + sizeof(word))) {
+		bcopy(ap->th_data, &word, sizeof(word));
+		window = MIN(ntohl(word), want_window);
+	}
+	if (features & KDP_FEATURE_LARGE_PKT_SIZE)
+		segsize = KDP_LARGE_CRASHDUMP_PKT_SIZE - sizeof(struct kdumphdr);
+	else
+		segsize = SEGSIZE;
+
+	gettimeofday(&start, NULL);
+	block = 1;
+	nregions = (sb.st_size + SEND_REGION - 1) / SEND_REGION;
+	for (r = nregions - 1; r >= 0; r--) {
+		off = r * SEND_REGION;
+		end = MIN(off + SEND_REGION, sb.st_size);
+		if (r != nregions - 1 && region_is_zero(off, end))
+			continue;
+		/* the run may only start once the seek is acknowledged */
+		exchange(build_seek(block, off), block);
+		block++;
+		nblocks = (uint32_t)((end - off + segsize - 1) / segsize);
+		if (window > 0) {
+			send_run(block, block + nblocks - 1, off, end);
+		} else {
+			uint32_t b;
+
+			for (b = block; b < block + nblocks; b++)
+				exchange(build_data(b, block, off, end), b);
+		}
+		block += nblocks;
+	}
+	exchange(build(KDP_EOF, block), block);
+	gettimeofday(&stop, NULL);
+
+	secs = (stop.tv_sec - start.tv_sec) + (stop.tv_usec - start.tv_usec) / 1e6;
+	printf("%lld bytes in %.3f seconds (%.0f KB/s), window %u, "
+	    "%lu packets, %lu retransmitted, %lu dropped\n",
+	    (long long)sb.st_size, secs,
+	    secs > 0 ? sb.st_size / 1024.0 / secs : 0.0, window,
+	    npackets, nrexmt, ndropped);
+	close(fd);
+	close(s);
+	return (0);
+}
@@ -0,0 +1,815 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Multi-session server (-m).
+ *
+ * A single UDP socket on the kdumpd port carries every transfer, and
+ * sessions are looked up by the peer's address and port.  The event loop
+ * only parses packets, tracks each session's window and sends ACKs.  DATA
+ * is copied into extents of up to EXTENT_SIZE contiguous bytes, which a
+ * pool of writer threads hands to pwrite().  Ranges skipped by KDP_SEEK
+ * are never written, so they stay holes in the core file.  Each session's
+ * retransmit and idle timer lives in a deadline heap that bounds the
+ * poll() timeout, in place of SIGALRM.
+ *
+ * With -z the writers compress each extent into a frame of a compressed
+ * core file (kdumpz.c) instead, so compression never holds up the ACKs.
+ */
+
+#include <sys/param.h>
+#include <sys/queue.h>
+#include <sys/socket.h>
+
+#include <netinet/in.h>
+#include "kdump.h"
+#include <arpa/inet.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "kdumpsubs.h"
+#include "kdumpz.h"
+
+extern int	rexmtval;
+extern int	maxtimeout;
+extern uint32_t	window_size;
+extern FILE	*file;
+extern int	compress_dumps;
+
+#define SESSION_HASH_BITS 6
+#define EXTENT_SIZE	(256 * 1024)
+#define EXTENT_MAX	256		/* 64 MB of buffered data */
+#define WRITERS		4
+#define RX_BURST	64		/* packets per pass before ACKing */
+#define SOCKBUF_SIZE	(4 * 1024 * 1024)
+
+struct session;
+
+struct extent {
+	STAILQ_ENTRY(extent) x_link;
+	struct session	*x_session;
+	int		x_fd;
+	struct kdz	*x_kdz;		/* compressed file, if any */
+	uint32_t	x_seq;
+	int		x_error;
+	off_t		x_offset;
+	size_t		x_len;
+	char		x_data[EXTENT_SIZE];
+};
+STAILQ_HEAD(extent_list, extent);
+
+struct session {
+	LIST_ENTRY(session) s_hash;
+	LIST_ENTRY(session) s_acks;	/* on ack_list */
+	struct sockaddr_in s_peer;
+	char		s_name[MAXPATHLEN];
+	FILE		*s_file;
+	struct kdz	*s_kdz;		/* with -z */
+	uint32_t	s_seq;		/* of the next extent */
+	uint32_t	s_features;	/* granted to the peer */
+	uint32_t	s_segsize;
+	uint32_t	s_window;	/* 1 for stop-and-wait */
+	uint32_t	*s_ring;	/* block held by each window slot */
+	uint32_t	s_cum;		/* last block received in sequence */
+	uint32_t	s_run_first;	/* first block after the last seek */
+	off_t		s_run_offset;	/* and its offset */
+	off_t		s_next_offset;	/* of the next stop-and-wait block */
+	off_t		s_bytes;
+	struct extent	*s_extent;	/* contiguous data being gathered */
+	int		s_pending;	/* extents with the writers */
+	int		s_error;	/* errno from a writer */
+	int		s_unacked;
+	int		s_acking;
+	int		s_lingering;	/* EOF acknowledged */
+	int		s_removed;	/* waiting for the writers */
+	int		s_idle;		/* seconds without input */
+	uint64_t	s_start;
+	uint64_t	s_last_input;
+	uint64_t	s_deadline;
+	uint32_t	s_heap_index;
+};
+LIST_HEAD(session_list, session);
+
+static int	sock;
+static uint64_t	now;			/* ms, as of the last wakeup */
+static struct session_list session_hash[1 << SESSION_HASH_BITS];
+static struct session_list ack_list = LIST_HEAD_INITIALIZER(ack_list);
+static struct session **deadline_heap;
+static uint32_t	deadline_heap_count, deadline_heap_size;
+static char	rxbuf[MAXIMUM_KDP_PKTSIZE];
+static char	txbuf[MAXIMUM_KDP_PKTSIZE];
+
+/*
+ * Extents move from the free list to a session, to the writers' queue and
+ * back through the done list, which the event loop drains after a byte on
+ * done_pipe wakes it.  The lists and extent_count are under extent_lock.
+ */
+static pthread_mutex_t	extent_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	extent_queued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	extent_completed = PTHREAD_COND_INITIALIZER;
+static struct extent_list extent_queue = STAILQ_HEAD_INITIALIZER(extent_queue);
+static struct extent_list extent_done = STAILQ_HEAD_INITIALIZER(extent_done);
+static struct extent_list extent_free = STAILQ_HEAD_INITIALIZER(extent_free);
+static int	extent_count;
+static int	done_pipe[2];
+
+static void	session_remove __P((struct session *));
+
+static uint64_t
+now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+static void
+deadline_heap_set(uint32_t i, struct session *s)
+{
+	deadline_heap[i] = s;
+	s->s_heap_index = i;
+}
+
+static void
+deadline_heap_up(uint32_t i)
+{
+	struct session *s = deadline_heap[i];
+
+	while (i > 1 && s->s_deadline < deadline_heap[i / 2]->s_deadline) {
+		deadline_heap_set(i, deadline_heap[i / 2]);
+		i /= 2;
+	}
+	deadline_heap_set(i, s);
+}
+
+static void
+deadline_heap_down(uint32_t i)
+{
+	struct session *s = deadline_heap[i];
+	uint32_t child;
+
+	while ((child = 2 * i) <= deadline_heap_count) {
+		if (child < deadline_heap_count &&
+		    deadline_heap[child + 1]->s_deadline < deadline_heap[child]->s_deadline)
+			child++;
+		if (deadline_heap[child]->s_deadline >= s->s_deadline)
+			break;
+		deadline_heap_set(i, deadline_heap[child]);
+		i = child;
+	}
+	deadline_heap_set(i, s);
+}
+
+static int
+deadline_heap_insert(struct session *s)
+{
+	struct session **heap;
+	uint32_t size;
+
+	if (deadline_heap_count + 1 >= deadline_heap_size) {
+		size = deadline_heap_size ? deadline_heap_size * 2 : 64;
+		heap = realloc(deadline_heap, size * sizeof(*heap));
+		if (heap == NULL)
+			return (-1);
+		deadline_heap = heap;
+		deadline_heap_size = size;
+	}
+	deadline_heap_set(++deadline_heap_count, s);
+	deadline_heap_up(deadline_heap_count);
+	return (0);
+}
+
+static void
+deadline_heap_remove(struct session *s)
+{
+	uint32_t i = s->s_heap_index;
+	struct session *last;
+
+	if (i == 0)
+		return;
+	s->s_heap_index = 0;
+	last = deadline_heap[deadline_heap_count--];
+	if (last == s)
+		return;
+	deadline_heap_set(i, last);
+	if (i > 1 && last->s_deadline < deadline_heap[i / 2]->s_deadline)
+		deadline_heap_up(i);
+	else
+		deadline_heap_down(i);
+}
+
+static void
+set_deadline(struct session *s, uint64_t deadline)
+{
+	s->s_deadline = deadline;
+	deadline_heap_up(s->s_heap_index);
+	deadline_heap_down(s->s_heap_index);
+}
+
+static struct session_list *
+session_bucket(const struct sockaddr_in *sin)
+{
+	uint32_t h;
+
+	h = (sin->sin_addr.s_addr ^ ((uint32_t)sin->sin_port << 16)) * 0x9e3779b1U;
+	return (&session_hash[h >> (32 - SESSION_HASH_BITS)]);
+}
+
+static struct session *
+session_lookup(const struct sockaddr_in *sin)
+{
+	struct session *s;
+
+	LIST_FOREACH(s, session_bucket(sin), s_hash) {
+		if (s->s_peer.sin_addr.s_addr == sin->sin_addr.s_addr &&
+		    s->s_peer.sin_port == sin->sin_port)
+			return (s);
+	}
+	return (NULL);
+}
+
+static void
+send_nak(const struct sockaddr_in *sin, int error)
+{
+	int length;
+
+	if ((length = nak_packet(txbuf, error)) < 0)
+		return;
+	if (sendto(sock, txbuf, length, 0, (const struct sockaddr *)sin,
+	    sizeof(*sin)) != length)
+		syslog(LOG_ERR, "nak: %m");
+}
+
+/*
+ * Send an ACK in the form the session negotiated: stop-and-wait ACKs are
+ * the bare header, windowed ones carry the window (block 0) or the SACK
+ * bitmap.
+ */
+static void
+session_ack(struct session *s)
+{
+	struct kdumphdr *ap = (struct kdumphdr *)txbuf;
+	uint32_t word, i, b;
+	size_t len = sizeof(struct kdumphdr);
+
+	if (s->s_acking) {
+		LIST_REMOVE(s, s_acks);
+		s->s_acking = 0;
+	}
+	s->s_unacked = 0;
+	if (s->s_cum == 0) {
+		ap->th_opcode = htons((u_short)ACK | (s->s_features << 8));
+		if (s->s_features & KDP_FEATURE_WINDOW) {
+			word = htonl(s->s_window);
+			bcopy(&word, ap->th_data, sizeof(word));
+			len += sizeof(word);
+		}
+	} else {
+		ap->th_opcode = htons((u_short)ACK);
+		if (s->s_features & KDP_FEATURE_WINDOW) {
+			for (i = word = 0; i < s->s_window; i++) {
+				b = s->s_cum + 1 + i;
+				if (s->s_ring[b % s->s_window] == b)
+					word |= 1U << (i % 32);
+				if (i % 32 == 31 || i == s->s_window - 1) {
+					word = htonl(word);
+					bcopy(&word, ap->th_data + (i / 32) * sizeof(word), sizeof(word));
+					word = 0;
+				}
+			}
+			len = KDP_WINDOW_ACK_SIZE(s->s_window);
+		}
+	}
+	ap->th_block = htonl(s->s_cum);
+	if (sendto(sock, txbuf, len, 0, (struct sockaddr *)&s->s_peer,
+	    sizeof(s->s_peer)) != (ssize_t)len)
+		syslog(LOG_ERR, "sendto: %m");
+}
+
+/*
+ * ACK once the current burst of packets has been read.
+ */
+static void
+session_ack_later(struct session *s)
+{
+	if (!s->s_acking) {
+		LIST_INSERT_HEAD(&ack_list, s, s_acks);
+		s->s_acking = 1;
+	}
+}
+
+static void *
+writer(void *arg)
+{
+	struct extent *x;
+	char *scratch = NULL;
+	ssize_t n;
+	size_t done;
+	int wake;
+
+	if (compress_dumps &&
+	    (scratch = malloc(kdz_scratch_size(EXTENT_SIZE))) == NULL) {
+		syslog(LOG_ERR, "malloc: %m");
+		exit(1);
+	}
+	pthread_mutex_lock(&extent_lock);
+	for (;;) {
+		while (STAILQ_EMPTY(&extent_queue))
+			pthread_cond_wait(&extent_queued, &extent_lock);
+		x = STAILQ_FIRST(&extent_queue);
+		STAILQ_REMOVE_HEAD(&extent_queue, x_link);
+		pthread_mutex_unlock(&extent_lock);
+
+		x->x_error = 0;
+		if (x->x_kdz != NULL) {
+			x->x_error = kdz_write(x->x_kdz, x->x_seq, x->x_offset,
+			    x->x_data, x->x_len, scratch);
+		} else {
+			for (done = 0; done < x->x_len; done += n) {
+				n = pwrite(x->x_fd, x->x_data + done,
+				    x->x_len - done, x->x_offset + done);
+				if (n < 0 && errno == EINTR) {
+					n = 0;
+					continue;
+				}
+				if (n <= 0) {
+					x->x_error = n < 0 ? errno : ENOSPC;
+					break;
+				}
+			}
+		}
+
+		pthread_mutex_lock(&extent_lock);
+		wake = STAILQ_EMPTY(&extent_done);
+		STAILQ_INSERT_TAIL(&extent_done, x, x_link);
+		pthread_cond_signal(&extent_completed);
+		if (wake)
+			(void) write(done_pipe[1], "", 1);
+	}
+	return (arg);
+}
+
+static void
+session_free(struct session *s)
+{
+	double secs = (now - s->s_start) / 1000.0;
+	struct kdz_stats st;
+	char zinfo[80];
+	int error;
+
+	zinfo[0] = '\0';
+	if (s->s_kdz != NULL) {
+		if ((error = kdz_close(s->s_kdz, &st)) != 0 && s->s_error == 0)
+			s->s_error = error;
+		snprintf(zinfo, sizeof(zinfo),
+		    ", compressed %.1f:1 at %.0f MB/s",
+		    st.ks_out ? (double)st.ks_in / st.ks_out : 0.0,
+		    st.ks_nsec ? st.ks_in * 1e9 / 1048576.0 / st.ks_nsec : 0.0);
+	}
+	if (fclose(s->s_file) != 0 && s->s_error == 0)
+		s->s_error = errno;
+	syslog(KDUMPD_DEBUG_LEVEL, "%s: %s: %lld bytes in %.1f seconds (%.0f KB/s)%s%s%s",
+	    inet_ntoa(s->s_peer.sin_addr), s->s_name, (long long)s->s_bytes,
+	    secs, secs > 0 ? s->s_bytes / 1024.0 / secs : 0.0, zinfo,
+	    s->s_error ? ", " : "", s->s_error ? strerror(s->s_error) : "");
+	free(s->s_ring);
+	free(s);
+}
+
+/*
+ * Retire extents the writers have finished with.
+ */
+static void
+process_done(void)
+{
+	struct extent_list done = STAILQ_HEAD_INITIALIZER(done);
+	struct extent *x;
+	struct session *s;
+
+	pthread_mutex_lock(&extent_lock);
+	STAILQ_CONCAT(&done, &extent_done);
+	pthread_mutex_unlock(&extent_lock);
+
+	STAILQ_FOREACH(x, &done, x_link) {
+		s = x->x_session;
+		if (x->x_error != 0 && s->s_error == 0)
+			s->s_error = x->x_error;
+		if (--s->s_pending == 0 && s->s_removed)
+			session_free(s);
+	}
+
+	pthread_mutex_lock(&extent_lock);
+	STAILQ_CONCAT(&extent_free, &done);
+	pthread_mutex_unlock(&extent_lock);
+}
+
+/*
+ * Get an extent, waiting for the writers if all of them are in use.
+ */
+static struct extent *
+extent_alloc(void)
+{
+	struct extent *x;
+
+	for (;;) {
+		pthread_mutex_lock(&extent_lock);
+		if ((x = STAILQ_FIRST(&extent_free)) != NULL) {
+			STAILQ_REMOVE_HEAD(&extent_free, x_link);
+			pthread_mutex_unlock(&extent_lock);
+			return (x);
+		}
+		if (extent_count < EXTENT_MAX) {
+			extent_count++;
+			pthread_mutex_unlock(&extent_lock);
+			if ((x = malloc(sizeof(*x))) == NULL) {
+				pthread_mutex_lock(&extent_lock);
+				extent_count--;
+				pthread_mutex_unlock(&extent_lock);
+			}
+			return (x);
+		}
+		while (STAILQ_EMPTY(&extent_done))
+			pthread_cond_wait(&extent_completed, &extent_lock);
+		pthread_mutex_unlock(&extent_lock);
+		process_done();
+	}
+}
+
+/*
+ * Hand the extent being gathered to the writers.
+ */
+static void
+session_flush(struct session *s)
+{
+	struct extent *x = s->s_extent;
+
+	if (x == NULL)
+		return;
+	s->s_extent = NULL;
+	s->s_pending++;
+	x->x_kdz = s->s_kdz;
+	x->x_seq = s->s_seq++;
+	pthread_mutex_lock(&extent_lock);
+	STAILQ_INSERT_TAIL(&extent_queue, x, x_link);
+	pthread_cond_signal(&extent_queued);
+	pthread_mutex_unlock(&extent_lock);
+}
+
+static void
+session_write(struct session *s, off_t off, const char *data, size_t len)
+{
+	struct extent *x = s->s_extent;
+
+	if (x != NULL && (off != x->x_offset + (off_t)x->x_len ||
+	    x->x_len + len > EXTENT_SIZE)) {
+		session_flush(s);
+		x = NULL;
+	}
+	if (x == NULL) {
+		if ((x = extent_alloc()) == NULL) {
+			s->s_error = ENOMEM;
+			return;
+		}
+		x->x_session = s;
+		x->x_fd = fileno(s->s_file);
+		x->x_offset = off;
+		x->x_len = 0;
+		s->s_extent = x;
+	}
+	bcopy(data, x->x_data + x->x_len, len);
+	x->x_len += len;
+	s->s_bytes += len;
+	if (x->x_len == EXTENT_SIZE)
+		session_flush(s);
+}
+
+/*
+ * Take a session out of service.  Its memory goes once the writers are
+ * done with its extents.
+ */
+static void
+session_remove(struct session *s)
+{
+	LIST_REMOVE(s, s_hash);
+	deadline_heap_remove(s);
+	if (s->s_acking) {
+		LIST_REMOVE(s, s_acks);
+		s->s_acking = 0;
+	}
+	session_flush(s);
+	s->s_removed = 1;
+	if (s->s_pending == 0)
+		session_free(s);
+}
+
+static void
+session_fail(struct session *s)
+{
+	send_nak(&s->s_peer, s->s_error == ENOSPC ? ENOSPACE : s->s_error + 100);
+	session_remove(s);
+}
+
+static void
+session_create(struct sockaddr_in *sin, struct kdumphdr *tp, int size)
+{
+	struct session *s;
+	char *filename, *mode, zname[MAXPATHLEN];
+	uint32_t mask;
+	int ecode;
+
+	if (ntohs((u_short)tp->th_opcode) != WRQ) {
+		send_nak(sin, EBADID);
+		return;
+	}
+	ecode = parse_request(tp, size, &filename, &mode, &mask);
+	/* Blocks are stored as received, so no netascii. */
+	if (ecode == 0 && strcmp(mode, "octet") != 0)
+		ecode = EBADOP;
+	if (ecode == 0 && compress_dumps) {
+		snprintf(zname, sizeof(zname), "%s" KDZ_SUFFIX, filename);
+		filename = zname;
+	}
+	if (ecode == 0)
+		ecode = validate_access(&filename, WRQ);
+	syslog(KDUMPD_DEBUG_LEVEL, "%s: write request for %s: %s",
+	    inet_ntoa(sin->sin_addr), ecode == EBADOP ? "?" : filename,
+	    ecode ? "refused" : "success");
+	if (ecode) {
+		send_nak(sin, ecode);
+		return;
+	}
+
+	if ((s = calloc(1, sizeof(*s))) == NULL) {
+		fclose(file);
+		send_nak(sin, ENOMEM + 100);
+		return;
+	}
+	s->s_peer = *sin;
+	strlcpy(s->s_name, filename, sizeof(s->s_name));
+	s->s_file = file;
+	file = NULL;
+	if (compress_dumps && (s->s_kdz = kdz_open(fileno(s->s_file))) == NULL) {
+		ecode = errno + 100;
+		fclose(s->s_file);
+		free(s);
+		send_nak(sin, ecode);
+		return;
+	}
+	s->s_features = mask & (KDP_FEATURE_LARGE_CRASHDUMPS |
+	    KDP_FEATURE_LARGE_PKT_SIZE | KDP_FEATURE_WINDOW);
+	if (window_size == 0)
+		s->s_features &= ~KDP_FEATURE_WINDOW;
+	s->s_window = (s->s_features & KDP_FEATURE_WINDOW) ? window_size : 1;
+	if (s->s_features & KDP_FEATURE_LARGE_PKT_SIZE)
+		s->s_segsize = KDP_LARGE_CRASHDUMP_PKT_SIZE - sizeof(struct kdumphdr);
+	else
+		s->s_segsize = SEGSIZE;
+	s->s_run_first = 1;
+	s->s_start = s->s_last_input = now;
+	s->s_deadline = now + rexmtval * 1000;
+	s->s_ring = calloc(s->s_window, sizeof(*s->s_ring));
+	if (s->s_ring == NULL || deadline_heap_insert(s) < 0) {
+		if (s->s_kdz != NULL)
+			kdz_close(s->s_kdz, NULL);
+		fclose(s->s_file);
+		free(s->s_ring);
+		free(s);
+		send_nak(sin, ENOMEM + 100);
+		return;
+	}
+	LIST_INSERT_HEAD(session_bucket(sin), s, s_hash);
+	session_ack(s);
+}
+
+static void
+session_input(struct session *s, struct kdumphdr *dp, int n)
+{
+	u_short opcode = ntohs((u_short)dp->th_opcode);
+	uint32_t block = ntohl(dp->th_block), slot;
+	size_t len;
+	off_t off;
+
+	if (s->s_error) {
+		session_fail(s);
+		return;
+	}
+	s->s_last_input = now;
+	s->s_idle = 0;
+	if (opcode == ERROR) {
+		syslog(LOG_ERR, "%s: transfer aborted by peer",
+		    inet_ntoa(s->s_peer.sin_addr));
+		session_remove(s);
+		return;
+	}
+	if (opcode == WRQ) {
+		if (s->s_cum == 0)
+			session_ack_later(s);	/* the block 0 ACK was lost */
+		return;
+	}
+	if (s->s_lingering) {
+		if (opcode == KDP_EOF && block == s->s_cum)
+			session_ack_later(s);	/* the final ACK was lost */
+		return;
+	}
+	if (block > s->s_cum + s->s_window)
+		return;
+	slot = block % s->s_window;
+	if (block <= s->s_cum || s->s_ring[slot] == block) {
+		session_ack_later(s);
+		return;
+	}
+
+	switch (opcode) {
+	case KDP_SEEK:
+		if (block != s->s_cum + 1)
+			return;
+		off = seek_offset(dp, s->s_features & KDP_FEATURE_LARGE_CRASHDUMPS);
+		s->s_run_offset = s->s_next_offset = off;
+		s->s_run_first = block + 1;
+		break;
+	case KDP_EOF:
+		if (block != s->s_cum + 1) {
+			session_ack_later(s);
+			return;
+		}
+		s->s_cum = block;
+		s->s_lingering = 1;
+		session_ack(s);
+		session_flush(s);
+		set_deadline(s, now + rexmtval * 1000);
+		return;
+	case DATA:
+		len = n - sizeof(struct kdumphdr);
+		if (len > s->s_segsize)
+			return;
+		if (s->s_features & KDP_FEATURE_WINDOW)
+			off = s->s_run_offset + (off_t)(block - s->s_run_first) * s->s_segsize;
+		else
+			off = s->s_next_offset;
+		s->s_next_offset = off + len;
+		session_write(s, off, dp->th_data, len);
+		break;
+	default:
+		return;
+	}
+
+	s->s_ring[slot] = block;
+	while (s->s_ring[(s->s_cum + 1) % s->s_window] == s->s_cum + 1)
+		s->s_cum++;
+	if ((s->s_features & KDP_FEATURE_WINDOW) &&
+	    (opcode == KDP_SEEK || block != s->s_cum ||
+	    ++s->s_unacked >= (int)(s->s_window + 3) / 4))
+		session_ack(s);
+	else
+		session_ack_later(s);
+}
+
+static void
+process_input(void)
+{
+	struct sockaddr_in from;
+	struct session *s;
+	socklen_t fromlen;
+	int i, n;
+
+	for (i = 0; i < RX_BURST; i++) {
+		fromlen = sizeof(from);
+		n = recvfrom(sock, rxbuf, sizeof(rxbuf), 0,
+		    (struct sockaddr *)&from, &fromlen);
+		if (n < 0) {
+			if (errno != EAGAIN && errno != EINTR)
+				syslog(LOG_ERR, "recvfrom: %m");
+			break;
+		}
+		if (n < (int)sizeof(struct kdumphdr) || from.sin_family != AF_INET)
+			continue;
+		if ((s = session_lookup(&from)) != NULL)
+			session_input(s, (struct kdumphdr *)rxbuf, n);
+		else
+			session_create(&from, (struct kdumphdr *)rxbuf, n);
+	}
+	while ((s = LIST_FIRST(&ack_list)) != NULL)
+		session_ack(s);
+}
+
+/*
+ * Deadlines are not moved on every packet: a session that has heard from
+ * its peer since is simply pushed back to rexmtval after its last input.
+ */
+static void
+process_deadlines(void)
+{
+	struct session *s;
+	uint64_t rexmt = rexmtval * 1000;
+
+	while (deadline_heap_count > 0 &&
+	    (s = deadline_heap[1])->s_deadline <= now) {
+		if (s->s_error) {
+			session_fail(s);
+		} else if (s->s_lingering) {
+			session_remove(s);
+		} else if (now < s->s_last_input + rexmt) {
+			set_deadline(s, s->s_last_input + rexmt);
+		} else if ((s->s_idle += rexmtval) >= maxtimeout) {
+			syslog(LOG_ERR, "%s: timing out and flushing file to disk",
+			    inet_ntoa(s->s_peer.sin_addr));
+			session_remove(s);
+		} else {
+			session_ack(s);
+			set_deadline(s, now + rexmt);
+		}
+	}
+}
+
+int
+kdumpd_serve(s)
+	int s;
+{
+	struct pollfd pfd[2];
+	pthread_t thread;
+	char drain[64];
+	int i, size, timeout;
+
+	sock = s;
+	for (i = 0; i < (1 << SESSION_HASH_BITS); i++)
+		LIST_INIT(&session_hash[i]);
+	if (pipe(done_pipe) < 0) {
+		syslog(LOG_ERR, "pipe: %m");
+		return (1);
+	}
+	(void) fcntl(done_pipe[0], F_SETFL, O_NONBLOCK);
+	(void) fcntl(done_pipe[1], F_SETFL, O_NONBLOCK);
+	(void) fcntl(sock, F_SETFL, O_NONBLOCK);
+	size = SOCKBUF_SIZE;
+	(void) setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	for (i = 0; i < WRITERS; i++) {
+		if ((errno = pthread_create(&thread, NULL, writer, NULL)) != 0) {
+			syslog(LOG_ERR, "pthread_create: %m");
+			return (1);
+		}
+		pthread_detach(thread);
+	}
+
+	pfd[0].fd = sock;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = done_pipe[0];
+	pfd[1].events = POLLIN;
+	for (;;) {
+		now = now_ms();
+		timeout = -1;
+		if (deadline_heap_count > 0)
+			timeout = deadline_heap[1]->s_deadline > now ?
+			    (int)(deadline_heap[1]->s_deadline - now) : 0;
+		if (poll(pfd, 2, timeout) < 0) {
+			if (errno == EINTR)
+				continue;
+			syslog(LOG_ERR, "poll: %m");
+			return (1);
+		}
+		now = now_ms();
+		if (pfd[1].revents & POLLIN) {
+			while (read(done_pipe[0], drain, sizeof(drain)) > 0)
+				;
+			process_done();
+		}
+		if (pfd[0].revents & POLLIN)
+			process_input();
+		process_deadlines();
+	}
+}
@@ -70,3 +70,17 @@ struct kdumphdr *w_init __P((void));
 int	write_behind __P((FILE *, int));
 int	writeit __P((FILE *, struct kdumphdr **, int, int));
 
+
+/*
+ * Local stand-in for the kernel's dump sender, for testing the server.
+ */
+int	kdumpsend __P((const char *, const char *, uint32_t, int));
+
+/*
+ * Shared by the single transfer server and the multi-session server (-m).
+ */
+int	parse_request __P((struct kdumphdr *, int, char **, char **, uint32_t *));
+int	validate_access __P((char **, int));
+off_t	seek_offset __P((struct kdumphdr *, int));
+int	nak_packet __P((char *, int));
+int	kdumpd_serve __P((int));
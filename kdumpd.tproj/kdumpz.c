@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+
+/*
+ * Compressed core files; see kdumpz.h for the layout.
+ *
+ * kdz_write() may be called from several threads at once.  Each caller
+ * compresses into its own scratch buffer and only takes the lock to claim
+ * room at the end of the file and to record the frame in the index.
+ */
+
+#include <sys/param.h>
+#include <sys/stat.h>
+
+#include <arpa/inet.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <libkern/OSByteOrder.h>
+
+#include "kdumpz.h"
+
+#define KDZ_LEVEL	Z_BEST_SPEED
+
+struct kdz_entry {
+	uint32_t	ke_seq;
+	uint32_t	ke_len;
+	uint32_t	ke_clen;
+	off_t		ke_offset;
+	off_t		ke_foffset;
+};
+
+struct kdz {
+	pthread_mutex_t	kz_lock;
+	int		kz_fd;
+	int		kz_error;
+	off_t		kz_end;		/* of the frames written so far */
+	off_t		kz_size;	/* of the core */
+	struct kdz_entry *kz_index;
+	uint32_t	kz_nframes;
+	uint32_t	kz_maxframes;
+	struct kdz_stats kz_stats;
+};
+
+static int
+pwrite_all(int fd, const char *buf, size_t len, off_t off)
+{
+	ssize_t n;
+
+	for (; len > 0; buf += n, len -= n, off += n) {
+		n = pwrite(fd, buf, len, off);
+		if (n < 0 && errno == EINTR) {
+			n = 0;
+			continue;
+		}
+		if (n <= 0)
+			return (n < 0 ? errno : ENOSPC);
+	}
+	return (0);
+}
+
+struct kdz *
+kdz_open(int fd)
+{
+	struct kdz_header kh;
+	struct kdz *z;
+
+	if ((z = calloc(1, sizeof(*z))) == NULL)
+		return (NULL);
+	kh.kh_magic = htonl(KDZ_MAGIC);
+	kh.kh_reserved = 0;
+	if ((errno = pwrite_all(fd, (char *)&kh, sizeof(kh), 0)) != 0) {
+		free(z);
+		return (NULL);
+	}
+	pthread_mutex_init(&z->kz_lock, NULL);
+	z->kz_fd = fd;
+	z->kz_end = sizeof(kh);
+	return (z);
+}
+
+/*
+ * Room a kdz_write() caller must provide for a range of len bytes.
+ */
+size_t
+kdz_scratch_size(size_t len)
+{
+	return (sizeof(struct kdz_frame) + compressBound(len));
+}
+
+/*
+ * Store len bytes of the core at offset off as a frame.  seq orders
+ * overlapping frames: the one with the higher seq wins.
+ */
+int
+kdz_write(struct kdz *z, uint32_t seq, off_t off, const char *data,
+    size_t len, char *scratch)
+{
+	struct kdz_frame *kf = (struct kdz_frame *)scratch;
+	struct kdz_entry *ke;
+	struct timespec t0, t1;
+	uLongf clen = compressBound(len);
+	uint32_t flags = 0;
+	off_t foff;
+	int error;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (compress2((Bytef *)(kf + 1), &clen, (const Bytef *)data, len,
+	    KDZ_LEVEL) != Z_OK || clen >= len) {
+		bcopy(data, kf + 1, len);
+		clen = len;
+		flags = KDZ_STORED;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	kf->kf_magic = htonl(KDZ_FRAME_MAGIC);
+	kf->kf_flags = htonl(flags);
+	kf->kf_offset = OSSwapHostToBigInt64((uint64_t)off);
+	kf->kf_len = htonl((uint32_t)len);
+	kf->kf_clen = htonl((uint32_t)clen);
+
+	pthread_mutex_lock(&z->kz_lock);
+	if (z->kz_nframes == z->kz_maxframes) {
+		uint32_t max = z->kz_maxframes ? z->kz_maxframes * 2 : 1024;
+
+		ke = realloc(z->kz_index, max * sizeof(*ke));
+		if (ke == NULL) {
+			pthread_mutex_unlock(&z->kz_lock);
+			return (ENOMEM);
+		}
+		z->kz_index = ke;
+		z->kz_maxframes = max;
+	}
+	foff = z->kz_end;
+	z->kz_end += sizeof(*kf) + clen;
+	ke = &z->kz_index[z->kz_nframes++];
+	ke->ke_seq = seq;
+	ke->ke_len = (uint32_t)len;
+	ke->ke_clen = (uint32_t)clen;
+	ke->ke_offset = off;
+	ke->ke_foffset = foff;
+	if (off + (off_t)len > z->kz_size)
+		z->kz_size = off + len;
+	z->kz_stats.ks_in += len;
+	z->kz_stats.ks_out += sizeof(*kf) + clen;
+	z->kz_stats.ks_nsec += (t1.tv_sec - t0.tv_sec) * 1000000000ULL +
+	    t1.tv_nsec - t0.tv_nsec;
+	z->kz_stats.ks_frames++;
+	pthread_mutex_unlock(&z->kz_lock);
+
+	error = pwrite_all(z->kz_fd, scratch, sizeof(*kf) + clen, foff);
+	if (error != 0) {
+		pthread_mutex_lock(&z->kz_lock);
+		if (z->kz_error == 0)
+			z->kz_error = error;
+		pthread_mutex_unlock(&z->kz_lock);
+	}
+	return (error);
+}
+
+static int
+kdz_entry_cmp(const void *a, const void *b)
+{
+	const struct kdz_entry *ka = a, *kb = b;
+
+	return (ka->ke_seq < kb->ke_seq ? -1 : ka->ke_seq > kb->ke_seq);
+}
+
+/*
+ * Write the index and trailer once every kdz_write() has returned, and
+ * free z.  The descriptor is left open.
+ */
+int
+kdz_close(struct kdz *z, struct kdz_stats *stats)
+{
+	struct kdz_index ki[256];
+	struct kdz_trailer kt;
+	struct kdz_entry *ke;
+	off_t off = z->kz_end;
+	uint32_t i, n;
+	int error = z->kz_error;
+
+	qsort(z->kz_index, z->kz_nframes, sizeof(*z->kz_index), kdz_entry_cmp);
+	for (i = 0; i < z->kz_nframes && error == 0; i += n) {
+		for (n = 0; n < 256 && i + n < z->kz_nframes; n++) {
+			ke = &z->kz_index[i + n];
+			ki[n].ki_offset = OSSwapHostToBigInt64((uint64_t)ke->ke_offset);
+			ki[n].ki_foffset = OSSwapHostToBigInt64((uint64_t)ke->ke_foffset);
+			ki[n].ki_len = htonl(ke->ke_len);
+			ki[n].ki_clen = htonl(ke->ke_clen);
+		}
+		error = pwrite_all(z->kz_fd, (char *)ki, n * sizeof(ki[0]), off);
+		off += n * sizeof(ki[0]);
+	}
+	if (error == 0) {
+		kt.kt_index = OSSwapHostToBigInt64((uint64_t)z->kz_end);
+		kt.kt_size = OSSwapHostToBigInt64((uint64_t)z->kz_size);
+		kt.kt_nframes = htonl(z->kz_nframes);
+		kt.kt_magic = htonl(KDZ_INDEX_MAGIC);
+		error = pwrite_all(z->kz_fd, (char *)&kt, sizeof(kt), off);
+	}
+	z->kz_stats.ks_out += off + sizeof(kt) - z->kz_end;
+	if (stats != NULL)
+		*stats = z->kz_stats;
+	pthread_mutex_destroy(&z->kz_lock);
+	free(z->kz_index);
+	free(z);
+	return (error);
+}
+
+/*
+ * Expand compressed core file path into a plain, sparse one at out.
+ * Any frame can be read on its own through the index; this applies them
+ * all in index order.
+ */
+int
+kdz_expand(const char *path, const char *out)
+{
+	struct kdz_trailer kt;
+	struct kdz_index *ki;
+	struct kdz_frame *kf;
+	struct stat sb;
+	char *fbuf, *dbuf;
+	uint32_t i, nframes, len, clen;
+	uLongf dlen;
+	off_t index;
+	int in, ofd;
+
+	if ((in = open(path, O_RDONLY)) < 0 || fstat(in, &sb) < 0)
+		err(1, "%s", path);
+	if (sb.st_size < (off_t)(sizeof(struct kdz_header) + sizeof(kt)) ||
+	    pread(in, &kt, sizeof(kt), sb.st_size - sizeof(kt)) != sizeof(kt) ||
+	    ntohl(kt.kt_magic) != KDZ_INDEX_MAGIC)
+		errx(1, "%s: not a complete compressed core file", path);
+	nframes = ntohl(kt.kt_nframes);
+	index = (off_t)OSSwapBigToHostInt64(kt.kt_index);
+	if (index + (off_t)nframes * (off_t)sizeof(*ki) + (off_t)sizeof(kt) != sb.st_size)
+		errx(1, "%s: bad index", path);
+	if ((ki = malloc(nframes * sizeof(*ki) + 1)) == NULL)
+		err(1, "malloc");
+	if (pread(in, ki, nframes * sizeof(*ki), index) != (ssize_t)(nframes * sizeof(*ki)))
+		err(1, "%s", path);
+	if ((ofd = open(out, O_WRONLY | O_CREAT | O_EXCL, 0644)) < 0)
+		err(1, "%s", out);
+
+	fbuf = dbuf = NULL;
+	for (i = 0; i < nframes; i++) {
+		len = ntohl(ki[i].ki_len);
+		clen = ntohl(ki[i].ki_clen);
+		if ((fbuf = realloc(fbuf, sizeof(*kf) + clen)) == NULL ||
+		    (dbuf = realloc(dbuf, len + 1)) == NULL)
+			err(1, "malloc");
+		if (pread(in, fbuf, sizeof(*kf) + clen,
+		    (off_t)OSSwapBigToHostInt64(ki[i].ki_foffset)) != (ssize_t)(sizeof(*kf) + clen))
+			err(1, "%s", path);
+		kf = (struct kdz_frame *)fbuf;
+		if (ntohl(kf->kf_magic) != KDZ_FRAME_MAGIC ||
+		    ntohl(kf->kf_len) != len || ntohl(kf->kf_clen) != clen)
+			errx(1, "%s: bad frame %u", path, i);
+		if (ntohl(kf->kf_flags) & KDZ_STORED) {
+			bcopy(kf + 1, dbuf, len);
+		} else {
+			dlen = len;
+			if (uncompress((Bytef *)dbuf, &dlen, (Bytef *)(kf + 1), clen) != Z_OK ||
+			    dlen != len)
+				errx(1, "%s: frame %u does not decompress", path, i);
+		}
+		if ((errno = pwrite_all(ofd, dbuf, len,
+		    (off_t)OSSwapBigToHostInt64(ki[i].ki_offset))) != 0)
+			err(1, "%s", out);
+	}
+	if (ftruncate(ofd, (off_t)OSSwapBigToHostInt64(kt.kt_size)) < 0)
+		err(1, "%s", out);
+	free(fbuf);
+	free(dbuf);
+	free(ki);
+	close(ofd);
+	close(in);
+	return (0);
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+
+/*
+ * Compressed core files, written by the multi-session server with -z.
+ *
+ * The file starts with a kdz_header.  Frames follow, each a kdz_frame
+ * and then the zlib stream for one contiguous range of the core, or the
+ * raw bytes if compressing did not make them smaller.  Frames are stored
+ * in the order their compression finished.  The file ends with an index
+ * listing every frame in the order its data was received, then a
+ * kdz_trailer that locates the index.  Where frames overlap, the later
+ * one in the index wins.  Ranges that no frame covers are holes.  All
+ * fields are big-endian.
+ */
+
+#ifndef _KDUMPZ_H_
+#define	_KDUMPZ_H_
+
+#define KDZ_MAGIC	0x4b445a31	/* "KDZ1" */
+#define KDZ_FRAME_MAGIC	0x4b445a46	/* "KDZF" */
+#define KDZ_INDEX_MAGIC	0x4b445a49	/* "KDZI" */
+#define KDZ_SUFFIX	".kdz"
+
+struct kdz_header {
+	uint32_t	kh_magic;
+	uint32_t	kh_reserved;
+} __attribute__((packed));
+
+struct kdz_frame {
+	uint32_t	kf_magic;
+	uint32_t	kf_flags;
+#define	KDZ_STORED	0x1		/* not compressed */
+	uint64_t	kf_offset;	/* in the core */
+	uint32_t	kf_len;		/* in the core */
+	uint32_t	kf_clen;	/* bytes following this header */
+} __attribute__((packed));
+
+struct kdz_index {
+	uint64_t	ki_offset;	/* in the core */
+	uint64_t	ki_foffset;	/* of the kdz_frame in this file */
+	uint32_t	ki_len;
+	uint32_t	ki_clen;
+} __attribute__((packed));
+
+struct kdz_trailer {
+	uint64_t	kt_index;	/* file offset of the index */
+	uint64_t	kt_size;	/* of the core */
+	uint32_t	kt_nframes;
+	uint32_t	kt_magic;
+} __attribute__((packed));
+
+struct kdz;
+
+struct kdz_stats {
+	uint64_t	ks_in;		/* core bytes */
+	uint64_t	ks_out;		/* file bytes, headers included */
+	uint64_t	ks_nsec;	/* spent compressing */
+	uint32_t	ks_frames;
+};
+
+struct kdz *kdz_open __P((int));
+size_t	kdz_scratch_size __P((size_t));
+int	kdz_write __P((struct kdz *, uint32_t, off_t, const char *, size_t, char *));
+int	kdz_close __P((struct kdz *, struct kdz_stats *));
+int	kdz_expand __P((const char *, const char *));
+
+#endif
@@ -136,6 +136,8 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include "../arp.tproj/ifindex_name.h"
+
 /* packing rule for routing socket */
 #define	ROUNDUP(a) \
 	((a) > 0 ? (1 + (((a) - 1) | (sizeof (uint32_t) - 1))) : \
@@ -161,6 +163,7 @@ static int delete(char *);
 static void dump(struct in6_addr *);
 static void dump_ext(struct in6_addr *, int);
 static struct in6_nbrinfo *getnbrinfo(struct in6_addr *, int, int);
+static char *nbr_host(struct sockaddr_in6 *);
 static char *ether_str(struct sockaddr_dl *);
 static int ndp_ether_aton(char *, u_char *);
 static void usage(void);
@@ -194,6 +197,9 @@ main(int argc, char **argv)
 	int aflag = 0, dflag = 0, sflag = 0, Hflag = 0, pflag = 0, rflag = 0,
 	    Pflag = 0, Rflag = 0, lflag = 0, xflag = 0, wflag = 0;
 
+	/* a whole neighbor cache goes out in large writes */
+	setvbuf(stdout, NULL, _IOFBF, 64 * 1024);
+
 	pid = getpid();
 	while ((ch = getopt(argc, argv, "acndfIilprstA:HPRxwW")) != -1)
 		switch ((char) ch) {
@@ -595,7 +601,7 @@ dump(struct in6_addr *addr)
 	int llwidth;
 	int ifwidth;
 	char flgbuf[8];
-	char *ifname;
+	const char *ifname;
 
 	/* Print header */
 	if (!tflag && !cflag)
@@ -620,6 +626,7 @@ again:;
 		lim = buf + needed;
 	} else
 		buf = lim = NULL;
+	gettimeofday(&time, 0);
 
 	for (next = buf; next && next < lim; next += rtm->rtm_msglen) {
 		int isrouter = 0, prbs = 0;
@@ -662,17 +669,16 @@ again:;
 			*(u_int16_t *)&sin->sin6_addr.s6_addr[2] = 0;
 #endif
 		}
-		getnameinfo((struct sockaddr *)sin, sin->sin6_len, host_buf,
-			    sizeof (host_buf), NULL, 0,
-			    NI_WITHSCOPEID | (nflag ? NI_NUMERICHOST : 0));
+		nbr_host(sin);
 		if (cflag == 1) {
 			if (rtm->rtm_flags & RTF_WASCLONED)
 				delete(host_buf);
 			continue;
 		}
-		gettimeofday(&time, 0);
-		if (tflag)
+		if (tflag) {
+			gettimeofday(&time, 0);
 			ts_print(&time);
+		}
 
 		addrwidth = strlen(host_buf);
 		if (addrwidth < W_ADDR)
@@ -680,7 +686,7 @@ again:;
 		llwidth = strlen(ether_str(sdl));
 		if (W_ADDR + W_LL - addrwidth > llwidth)
 			llwidth = W_ADDR + W_LL - addrwidth;
-		ifname = if_indextoname(sdl->sdl_index, ifix_buf);
+		ifname = ifindex_name(sdl->sdl_index);
 		if (!ifname)
 			ifname = "?";
 		ifwidth = strlen(ifname);
@@ -763,6 +769,7 @@ again:;
 
 	if (repeat) {
 		printf("\n");
+		fflush(stdout);
 		sleep(repeat);
 		goto again;
 	}
@@ -788,7 +795,7 @@ dump_ext(addr, xflag)
 	int llwidth;
 	int ifwidth;
 	char flgbuf[8];
-	char *ifname;
+	const char *ifname;
 
 	/* Print header */
 	if (!tflag && !cflag) {
@@ -818,6 +825,7 @@ again:;
 		lim = buf + needed;
 	} else
 		buf = lim = NULL;
+	gettimeofday(&time, 0);
 
 	for (next = buf; next && next < lim; next += ertm->rtm_msglen) {
 		int isrouter = 0, prbs = 0;
@@ -860,17 +868,16 @@ again:;
 			*(u_int16_t *)&sin->sin6_addr.s6_addr[2] = 0;
 #endif
 		}
-		getnameinfo((struct sockaddr *)sin, sin->sin6_len, host_buf,
-			    sizeof (host_buf), NULL, 0,
-			    NI_WITHSCOPEID | (nflag ? NI_NUMERICHOST : 0));
+		nbr_host(sin);
 		if (cflag == 1) {
 			if (ertm->rtm_flags & RTF_WASCLONED)
 				delete(host_buf);
 			continue;
 		}
-		gettimeofday(&time, 0);
-		if (tflag)
+		if (tflag) {
+			gettimeofday(&time, 0);
 			ts_print(&time);
+		}
 
 		addrwidth = strlen(host_buf);
 		if (addrwidth < W_ADDR)
@@ -878,7 +885,7 @@ again:;
 		llwidth = strlen(ether_str(sdl));
 		if (W_ADDR + W_LL - addrwidth > llwidth)
 			llwidth = W_ADDR + W_LL - addrwidth;
-		ifname = if_indextoname(sdl->sdl_index, ifix_buf);
+		ifname = ifindex_name(sdl->sdl_index);
 		if (!ifname)
 			ifname = "?";
 		ifwidth = strlen(ifname);
@@ -1019,6 +1026,7 @@ again:;
 
 	if (repeat) {
 		printf("\n");
+		fflush(stdout);
 		sleep(repeat);
 		goto again;
 	}
@@ -1031,25 +1039,55 @@ getnbrinfo(addr, ifindex, warning)
 	int warning;
 {
 	static struct in6_nbrinfo nbi;
-	int s;
+	static int s = -1;
+	const char *ifname;
 
-	if ((s = socket(AF_INET6, SOCK_DGRAM, 0)) < 0)
+	/* dump() calls us once per neighbor; keep the socket around */
+	if (s < 0 && (s = socket(AF_INET6, SOCK_DGRAM, 0)) < 0)
 		err(1, "socket");
 
 	bzero(&nbi, sizeof (nbi));
-	if_indextoname(ifindex, nbi.ifname);
+	if ((ifname = ifindex_name(ifindex)) != NULL)
+		strlcpy(nbi.ifname, ifname, sizeof (nbi.ifname));
 	nbi.addr = *addr;
 	if (ioctl(s, SIOCGNBRINFO_IN6, (caddr_t)&nbi) < 0) {
 		if (warning)
 			warn("ioctl(SIOCGNBRINFO_IN6)");
-		close(s);
 		return (NULL);
 	}
 
-	close(s);
 	return (&nbi);
 }
 
+/*
+ * Format a neighbor address into host_buf.  With -n this is done here
+ * instead of by getnameinfo(), which would look up the scope's interface
+ * name in the kernel for every link-local neighbor.
+ */
+static char *
+nbr_host(struct sockaddr_in6 *sin)
+{
+	const char *ifname;
+
+	if (!nflag) {
+		getnameinfo((struct sockaddr *)sin, sin->sin6_len, host_buf,
+			    sizeof (host_buf), NULL, 0, NI_WITHSCOPEID);
+		return (host_buf);
+	}
+	inet_ntop(AF_INET6, &sin->sin6_addr, host_buf, sizeof (host_buf));
+	if (sin->sin6_scope_id != 0) {
+		if ((ifname = ifindex_name(sin->sin6_scope_id)) != NULL) {
+			strlcat(host_buf, "%", sizeof (host_buf));
+			strlcat(host_buf, ifname, sizeof (host_buf));
+		} else {
+			snprintf(host_buf + strlen(host_buf),
+			    sizeof (host_buf) - strlen(host_buf), "%%%u",
+			    sin->sin6_scope_id);
+		}
+	}
+	return (host_buf);
+}
+
 static char *
 ether_str(struct sockaddr_dl *sdl)
 {
@@ -1120,6 +1120,43 @@ intervalpr(void (*pr)(uint32_t, char *, int), uint32_t off, char *name , int af)
 	}
 }
 
+/*
+ * Like intervalpr(), for the control block tables of several protocols
+ * at once.
+ */
+void
+pcbintervalpr(uint32_t *protos, char **names, int n, int af)
+{
+	struct itimerval timer_interval;
+	sigset_t sigset, oldsigset;
+	int i;
+
+	/* create a timer that fires repeatedly every interval seconds */
+	timer_interval.it_value.tv_sec = interval;
+	timer_interval.it_value.tv_usec = 0;
+	timer_interval.it_interval.tv_sec = interval;
+	timer_interval.it_interval.tv_usec = 0;
+	(void) signal(SIGALRM, catchalarm);
+	signalled = NO;
+	(void) setitimer(ITIMER_REAL, &timer_interval, NULL);
+
+	for (;;) {
+		for (i = 0; i < n; i++)
+			pcbwatch(protos[i], names[i], af);
+
+		fflush(stdout);
+		sigemptyset(&sigset);
+		sigaddset(&sigset, SIGALRM);
+		(void) sigprocmask(SIG_BLOCK, &sigset, &oldsigset);
+		if (!signalled) {
+			sigemptyset(&sigset);
+			sigsuspend(&sigset);
+		}
+		(void) sigprocmask(SIG_SETMASK, &oldsigset, NULL);
+		signalled = NO;
+	}
+}
+
 /*
  * Called if an interval expires before sidewaysintpr has completed a loop.
  * Sets a flag to not wait for the alarm.
@@ -187,6 +187,44 @@ _serv_cache_getservbyport(int port, char *proto)
 
 #endif /* SRVCACHE */
 	
+/*
+ * Start the name lookups for every foreign and local address in a
+ * pcblist_n buffer, so that protopr() can print while they complete.
+ */
+static void
+inp_prefetch(char *buf, size_t len)
+{
+	struct xinpgen *xig = (struct xinpgen *)buf;
+	struct xgen_n *xgn;
+	struct xinpcb_n *inp;
+	char *next;
+
+	for (next = buf + ROUNDUP64(xig->xig_len); next < buf + len; next += ROUNDUP64(xgn->xgn_len)) {
+		xgn = (struct xgen_n *)next;
+		if (xgn->xgn_len <= sizeof(struct xinpgen))
+			break;
+		if (xgn->xgn_kind != XSO_INPCB)
+			continue;
+		inp = (struct xinpcb_n *)xgn;
+		if (inp->inp_gencnt > xig->xig_gen)
+			continue;
+		if (inp->inp_vflag & INP_IPV4) {
+			if (inp->inp_laddr.s_addr != INADDR_ANY)
+				resolve_want(AF_INET, &inp->inp_laddr, 0);
+			if (inp->inp_faddr.s_addr != INADDR_ANY)
+				resolve_want(AF_INET, &inp->inp_faddr, 0);
+		}
+#ifdef INET6
+		else if (inp->inp_vflag & INP_IPV6) {
+			if (!IN6_IS_ADDR_UNSPECIFIED(&inp->in6p_laddr))
+				resolve_want(AF_INET6, &inp->in6p_laddr, 0);
+			if (!IN6_IS_ADDR_UNSPECIFIED(&inp->in6p_faddr))
+				resolve_want(AF_INET6, &inp->in6p_faddr, 0);
+		}
+#endif /* INET6 */
+	}
+}
+
 /*
  * Print a summary of connections related to an Internet
  * protocol.  For TCP, also give state of connection.
@@ -275,6 +313,8 @@ protopr(uint32_t proto,		/* for sysctl version we pass proto # */
 	}
 	
 	oxig = xig = (struct xinpgen *)buf;
+	if (!nflag)
+		inp_prefetch(buf, len);
 	for (next = buf + ROUNDUP64(xig->xig_len); next < buf + len; next += ROUNDUP64(xgn->xgn_len)) {
 		
 		xgn = (struct xgen_n*)next;
@@ -532,6 +572,355 @@ protopr(uint32_t proto,		/* for sysctl version we pass proto # */
 	free(buf);
 }
 
+/*
+ * Interval mode for the protocol tables.  Each call takes a fresh
+ * pcblist snapshot into a buffer that only ever grows, matches every
+ * PCB against the previous pass through a hash table keyed by
+ * inp_gencnt, and prints only the sockets that were opened, were
+ * closed or changed TCP state since the last call, along with the
+ * bytes each socket moved in between.  The first call only records
+ * the baseline.
+ */
+struct pcbent {
+	u_int64_t	pe_gencnt;	/* key */
+	u_int64_t	pe_so;
+	u_int64_t	pe_rxbytes;
+	u_int64_t	pe_txbytes;
+	u_int32_t	pe_pass;	/* last pass that saw this PCB */
+	int		pe_state;	/* TCP state, -1 if not TCP */
+	struct xinpcb_n	pe_inp;		/* kept to print it once it is gone */
+};
+
+/*
+ * The entries themselves are kept packed in pw_ents; the hash table only
+ * holds their indexes, so it costs a few bytes per slot however sparse
+ * it is kept.  Entries that go away are squeezed out at the end of each
+ * pass and the index rebuilt, so there are no tombstones to skip.
+ */
+struct pcbwatch {
+	struct pcbwatch	*pw_next;
+	uint32_t	pw_proto;
+	const char	*pw_mib;
+	char		*pw_buf;	/* grow-only sysctl buffer */
+	size_t		pw_buflen;
+	struct pcbent	*pw_ents;	/* pw_count in use */
+	u_int32_t	pw_maxents;
+	u_int32_t	*pw_tab;	/* 1 + index into pw_ents, 0 if free */
+	int		pw_bits;	/* log2 of the table size */
+	u_int32_t	pw_count;
+	u_int32_t	pw_pass;
+};
+
+static struct pcbwatch *pcbwatches;	/* one per protocol watched */
+
+static void	pcbwatch_rehash(struct pcbwatch *, u_int32_t);
+static struct pcbent *pcbwatch_find(struct pcbwatch *, u_int64_t, int *);
+static void	pcbwatch_row(const char *, char *, struct xinpcb_n *, int,
+		    int, u_int64_t, u_int64_t);
+
+#define	PCBHASH(g, bits) \
+	((u_int32_t)(((g) * 0x9e3779b97f4a7c15ULL) >> (64 - (bits))))
+
+/*
+ * Rebuild the index for the entries in pw_ents, sized so that it would
+ * stay at most half full with n of them.
+ */
+static void
+pcbwatch_rehash(struct pcbwatch *pw, u_int32_t n)
+{
+	u_int32_t i, j, mask;
+
+	while (n * 2 > (1U << pw->pw_bits) || pw->pw_bits < 10)
+		pw->pw_bits++;
+	free(pw->pw_tab);
+	if ((pw->pw_tab = calloc(1U << pw->pw_bits, sizeof(*pw->pw_tab))) ==
+	    NULL)
+		err(1, "calloc");
+	mask = (1U << pw->pw_bits) - 1;
+	for (i = 0; i < pw->pw_count; i++) {
+		for (j = PCBHASH(pw->pw_ents[i].pe_gencnt, pw->pw_bits);
+		    pw->pw_tab[j] != 0; j = (j + 1) & mask)
+			continue;
+		pw->pw_tab[j] = i + 1;
+	}
+}
+
+/*
+ * Find the entry for gencnt, or claim one for it and set *newp.  The
+ * pointer returned is good until the next call.
+ */
+static struct pcbent *
+pcbwatch_find(struct pcbwatch *pw, u_int64_t gencnt, int *newp)
+{
+	struct pcbent *pe;
+	u_int32_t i, mask;
+
+	if (pw->pw_tab == NULL || (pw->pw_count + 1) * 2 > (1U << pw->pw_bits))
+		pcbwatch_rehash(pw, pw->pw_count + 1);
+	mask = (1U << pw->pw_bits) - 1;
+	for (i = PCBHASH(gencnt, pw->pw_bits); pw->pw_tab[i] != 0;
+	    i = (i + 1) & mask) {
+		pe = &pw->pw_ents[pw->pw_tab[i] - 1];
+		if (pe->pe_gencnt == gencnt) {
+			*newp = 0;
+			return (pe);
+		}
+	}
+	if (pw->pw_count == pw->pw_maxents) {
+		pw->pw_maxents = pw->pw_maxents ? pw->pw_maxents * 2 : 256;
+		pe = realloc(pw->pw_ents, pw->pw_maxents * sizeof(*pe));
+		if (pe == NULL)
+			err(1, "realloc");
+		pw->pw_ents = pe;
+	}
+	pe = &pw->pw_ents[pw->pw_count++];
+	pw->pw_tab[i] = pw->pw_count;
+	memset(pe, 0, sizeof(*pe));
+	pe->pe_gencnt = gencnt;
+	*newp = 1;
+	return (pe);
+}
+
+static void
+pcbwatch_row(const char *what, char *name, struct xinpcb_n *inp, int state,
+    int showbytes, u_int64_t rxbytes, u_int64_t txbytes)
+{
+	const char *vchar;
+
+#ifdef INET6
+	if ((inp->inp_vflag & INP_IPV6) != 0)
+		vchar = ((inp->inp_vflag & INP_IPV4) != 0) ? "46" : "6 ";
+	else
+#endif
+		vchar = ((inp->inp_vflag & INP_IPV4) != 0) ? "4 " : "  ";
+	printf("%-6.6s %-3.3s%-2.2s ", what, name, vchar);
+	if (inp->inp_vflag & INP_IPV4) {
+		inetprint(&inp->inp_laddr, (int)inp->inp_lport, name, nflag);
+		inetprint(&inp->inp_faddr, (int)inp->inp_fport, name, nflag);
+	}
+#ifdef INET6
+	else if (inp->inp_vflag & INP_IPV6) {
+		inet6print(&inp->in6p_laddr, (int)inp->inp_lport, name, nflag);
+		inet6print(&inp->in6p_faddr, (int)inp->inp_fport, name, nflag);
+	}
+#endif /* INET6 */
+	if (state < 0)
+		printf("%-11s", "");
+	else if (state >= TCP_NSTATES)
+		printf("%-11d", state);
+	else
+		printf("%-11s", tcpstates[state]);
+	if (showbytes)
+		printf(" %10llu %10llu", rxbytes, txbytes);
+	putchar('\n');
+}
+
+void
+pcbwatch(uint32_t proto, char *name, int af)
+{
+	static int first = 1;
+	struct pcbwatch *pw;
+	struct pcbent *pe;
+	char *buf, *next;
+	struct xinpgen *xig;
+	struct xgen_n *xgn;
+	size_t len;
+	struct xtcpcb_n *tp = NULL;
+	struct xinpcb_n *inp = NULL;
+	struct xsocket_n *so = NULL;
+	struct xsockstat_n *so_stat = NULL;
+	u_int64_t rxbytes, txbytes, orx, otx;
+	u_int32_t i, n, nopen, nclose, nchange;
+	int istcp, which, want, isnew, state, ostate;
+
+	for (pw = pcbwatches; pw != NULL; pw = pw->pw_next)
+		if (pw->pw_proto == proto)
+			break;
+	if (pw == NULL) {
+		if ((pw = calloc(1, sizeof(*pw))) == NULL)
+			err(1, "calloc");
+		pw->pw_next = pcbwatches;
+		pcbwatches = pw;
+		pw->pw_proto = proto;
+		switch (proto) {
+		case IPPROTO_TCP:
+			pw->pw_mib = "net.inet.tcp.pcblist_n";
+			break;
+		case IPPROTO_UDP:
+			pw->pw_mib = "net.inet.udp.pcblist_n";
+			break;
+		case IPPROTO_DIVERT:
+			pw->pw_mib = "net.inet.divert.pcblist_n";
+			break;
+		default:
+			pw->pw_mib = "net.inet.raw.pcblist_n";
+			break;
+		}
+	}
+	istcp = (proto == IPPROTO_TCP);
+	want = istcp ? ALL_XGN_KIND_TCP : ALL_XGN_KIND_INP;
+
+	/*
+	 * Reuse the buffer from the last pass, growing it (with some
+	 * room for sockets opened meanwhile) only when it is too small.
+	 */
+	for (;;) {
+		len = pw->pw_buflen;
+		if (len > 0 &&
+		    sysctlbyname(pw->pw_mib, pw->pw_buf, &len, 0, 0) == 0)
+			break;
+		if (len > 0 && errno != ENOMEM) {
+			warn("sysctl: %s", pw->pw_mib);
+			return;
+		}
+		len = 0;
+		if (sysctlbyname(pw->pw_mib, 0, &len, 0, 0) < 0) {
+			if (errno != ENOENT)
+				warn("sysctl: %s", pw->pw_mib);
+			return;
+		}
+		len += len / 8;
+		if (len <= pw->pw_buflen)
+			len = pw->pw_buflen * 2;
+		if ((buf = realloc(pw->pw_buf, len)) == NULL) {
+			warn("malloc %lu bytes", (u_long)len);
+			return;
+		}
+		pw->pw_buf = buf;
+		pw->pw_buflen = len;
+	}
+	buf = pw->pw_buf;
+	if (len <= sizeof(struct xinpgen))
+		return;
+
+	if (first) {
+		printf("Active Internet connections");
+		if (aflag)
+			printf(" (including servers)");
+		printf(", changes every %d second%s\n", interval,
+		    plural(interval));
+		printf("%-6.6s %-5.5s ", "Change", "Proto");
+		if (lflag)
+			printf("%-45.45s %-45.45s ",
+			    "Local Address", "Foreign Address");
+		else
+			printf("%-22.22s %-22.22s ",
+			    "Local Address", "Foreign Address");
+		printf("%-11.11s %10.10s %10.10s\n",
+		    "(state)", "rxbytes", "txbytes");
+		first = 0;
+	}
+
+	pw->pw_pass++;
+	nopen = nclose = nchange = 0;
+	xig = (struct xinpgen *)buf;
+	which = 0;
+	for (next = buf + ROUNDUP64(xig->xig_len); next < buf + len;
+	    next += ROUNDUP64(xgn->xgn_len)) {
+		xgn = (struct xgen_n *)next;
+		if (xgn->xgn_len <= sizeof(struct xinpgen))
+			break;
+
+		switch (xgn->xgn_kind) {
+		case XSO_SOCKET:
+			so = (struct xsocket_n *)xgn;
+			break;
+		case XSO_STATS:
+			so_stat = (struct xsockstat_n *)xgn;
+			break;
+		case XSO_INPCB:
+			inp = (struct xinpcb_n *)xgn;
+			break;
+		case XSO_TCPCB:
+			tp = (struct xtcpcb_n *)xgn;
+			break;
+		}
+		which |= xgn->xgn_kind;
+		if (which != want)
+			continue;
+		which = 0;
+
+		if (so->xso_protocol != (int)proto)
+			continue;
+		if (inp->inp_gencnt > xig->xig_gen)
+			continue;
+		if ((af == AF_INET && (inp->inp_vflag & INP_IPV4) == 0)
+#ifdef INET6
+		    || (af == AF_INET6 && (inp->inp_vflag & INP_IPV6) == 0)
+#endif /* INET6 */
+		    )
+			continue;
+		if (!aflag && istcp && tp->t_state <= TCPS_LISTEN)
+			continue;
+
+		rxbytes = txbytes = 0;
+		for (i = 0; i < SO_TC_STATS_MAX; i++) {
+			rxbytes += so_stat->xst_tc_stats[i].rxbytes;
+			txbytes += so_stat->xst_tc_stats[i].txbytes;
+		}
+		state = istcp ? tp->t_state : -1;
+
+		pe = pcbwatch_find(pw, inp->inp_gencnt, &isnew);
+		if (!isnew && pe->pe_so != so->xso_so) {
+			/* the gencnt was reused by another socket */
+			if (pw->pw_pass > 1)
+				pcbwatch_row("close", name, &pe->pe_inp,
+				    pe->pe_state, 0, 0, 0);
+			nclose++;
+			isnew = 1;
+		}
+		orx = isnew ? 0 : pe->pe_rxbytes;
+		otx = isnew ? 0 : pe->pe_txbytes;
+		ostate = isnew ? -1 : pe->pe_state;
+		pe->pe_so = so->xso_so;
+		pe->pe_rxbytes = rxbytes;
+		pe->pe_txbytes = txbytes;
+		pe->pe_state = state;
+		pe->pe_pass = pw->pw_pass;
+		pe->pe_inp = *inp;
+		if (pw->pw_pass == 1)
+			continue;
+
+		/* inetprint() may scribble on inp, so print it last */
+		if (isnew) {
+			nopen++;
+			pcbwatch_row("open", name, inp, state, 1,
+			    rxbytes, txbytes);
+		} else if (ostate != state) {
+			nchange++;
+			pcbwatch_row("state", name, inp, state, 1,
+			    rxbytes - orx, txbytes - otx);
+		} else if (rxbytes != orx || txbytes != otx)
+			pcbwatch_row("bytes", name, inp, state, 1,
+			    rxbytes - orx, txbytes - otx);
+	}
+
+	/* Whatever was not seen this pass has gone away */
+	for (i = 0, n = 0; i < pw->pw_count; i++) {
+		pe = &pw->pw_ents[i];
+		if (pe->pe_pass != pw->pw_pass) {
+			pcbwatch_row("close", name, &pe->pe_inp, pe->pe_state,
+			    0, 0, 0);
+			nclose++;
+			continue;
+		}
+		if (n != i)
+			pw->pw_ents[n] = *pe;
+		n++;
+	}
+	if (n != pw->pw_count) {
+		pw->pw_count = n;
+		pcbwatch_rehash(pw, n);
+	}
+
+	if (pw->pw_pass > 1 || vflag) {
+		print_time();
+		printf("%s: %u socket%s, %u opened, %u closed, "
+		    "%u changed state\n", name, pw->pw_count,
+		    plural(pw->pw_count), nopen, nclose, nchange);
+	}
+}
+
 /*
  * Dump TCP statistics structure.
  */
@@ -1277,7 +1666,6 @@ inetname(struct in_addr *inp)
 {
 	register char *cp;
 	static char line[MAXHOSTNAMELEN];
-	struct hostent *hp;
 	struct netent *np;
 
 	cp = 0;
@@ -1291,11 +1679,8 @@ inetname(struct in_addr *inp)
 				cp = np->n_name;
 		}
 		if (cp == 0) {
-			hp = gethostbyaddr((char *)inp, sizeof (*inp), AF_INET);
-			if (hp) {
-				cp = hp->h_name;
-				 //### trimdomain(cp, strlen(cp));
-			}
+			cp = resolve_name(AF_INET, inp, 0);
+			 //### trimdomain(cp, strlen(cp));
 		}
 	}
 	if (inp->s_addr == INADDR_ANY)
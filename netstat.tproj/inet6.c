@@ -1215,7 +1215,6 @@ inet6name(struct in6_addr *in6p)
 {
 	register char *cp;
 	static char line[50];
-	struct hostent *hp;
 	static char domain[MAXHOSTNAMELEN];
 	static int first = 1;
 	char hbuf[NI_MAXHOST];
@@ -1232,12 +1231,13 @@ inet6name(struct in6_addr *in6p)
 	}
 	cp = 0;
 	if (!nflag && !IN6_IS_ADDR_UNSPECIFIED(in6p)) {
-		hp = gethostbyaddr((char *)in6p, sizeof(*in6p), AF_INET6);
-		if (hp) {
-			if ((cp = index(hp->h_name, '.')) &&
+		/* the cached name is shared, so trim a copy of it */
+		if ((cp = resolve_name(AF_INET6, in6p, 0)) != NULL) {
+			strlcpy(hbuf, cp, sizeof(hbuf));
+			if ((cp = index(hbuf, '.')) &&
 			    !strcmp(cp + 1, domain))
 				*cp = 0;
-			cp = hp->h_name;
+			cp = hbuf;
 		}
 	}
 	if (IN6_IS_ADDR_UNSPECIFIED(in6p))
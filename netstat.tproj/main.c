@@ -198,6 +198,7 @@ struct protox *protoprotox[] = {
 };
 
 static void printproto (struct protox *, char *);
+static void pcbwatchpr (struct protox *);
 static void usage (void);
 static struct protox *name2protox (char *);
 static struct protox *knownname (char *);
@@ -248,6 +249,7 @@ main(argc, argv)
 {
 	register struct protox *tp = NULL;  /* for printing cblocks & stats */
 	int ch;
+	int ichosen = 0;	/* -i or -I given, not just implied by -w */
 
 	af = AF_UNSPEC;
 
@@ -302,6 +304,7 @@ main(argc, argv)
 			char *cp;
 
 			iflag = 1;
+			ichosen = 1;
 			for (cp = interface = optarg; isalpha(*cp); cp++)
 				continue;
 			unit = atoi(cp);
@@ -309,6 +312,7 @@ main(argc, argv)
 		}
 		case 'i':
 			iflag = 1;
+			ichosen = 1;
 			break;
 		case 'l':
 			lflag += 1;
@@ -398,6 +402,19 @@ main(argc, argv)
 		mbpr();
 		exit(0);
 	}
+	/*
+	 * An interval with a protocol or an Internet address family, but
+	 * no interface, watches the control block tables for changes.
+	 */
+	if (interval && !ichosen && !sflag && !Lflag && !rflag &&
+	    (tp != NULL ? tp->pr_cblocks == protopr :
+#ifdef INET6
+	    af == AF_INET6 ||
+#endif
+	    af == AF_INET)) {
+		pcbwatchpr(tp);
+		exit(0);
+	}
 	if (iflag && !sflag && !Sflag && !gflag && !qflag && !Qflag) {
 		if (Rflag)
 			intpr_ri(NULL);
@@ -541,6 +558,45 @@ printproto(tp, name)
 	}
 }
 
+/*
+ * Watch the Internet control block tables of protocol tp or, if it is
+ * NULL, of every protocol in the selected address family.
+ */
+static void
+pcbwatchpr(struct protox *tp)
+{
+	struct protox *tables[2];
+	uint32_t protos[16];
+	char *names[16];
+	int n = 0, i, j;
+
+	if (tp != NULL) {
+		protos[n] = tp->pr_protocol;
+		names[n++] = tp->pr_name;
+	} else {
+		tables[0] = af == AF_INET ? protox : NULL;
+#ifdef INET6
+		tables[1] = af == AF_INET6 ? ip6protox : NULL;
+#else
+		tables[1] = NULL;
+#endif
+		for (i = 0; i < 2; i++)
+			for (tp = tables[i]; tp != NULL && tp->pr_name; tp++) {
+				if (tp->pr_cblocks != protopr)
+					continue;
+				/* tcp and udp appear in both tables */
+				for (j = 0; j < n; j++)
+					if (protos[j] == tp->pr_protocol)
+						break;
+				if (j == n && n < 16) {
+					protos[n] = tp->pr_protocol;
+					names[n++] = tp->pr_name;
+				}
+			}
+	}
+	pcbintervalpr(protos, names, n, af);
+}
+
 char *
 plural(int n)
 {
@@ -612,6 +668,7 @@ Usage:	netstat [-AaLlnW] [-f address_family | -p protocol]\n\
 	netstat -s [-s] [-f address_family | -p protocol] [-w wait]\n\
 	netstat -i | -I interface -s [-f address_family | -p protocol]\n\
 	netstat -m [-m]\n\
+	netstat -w wait [-an] [-f address_family | -p protocol]\n\
 	netstat -r [-Aaln] [-f address_family]\n\
 	netstat -rs [-s]\n\
 "
@@ -103,6 +103,7 @@ extern char	*plurales(int);
 extern char	*pluralies(int);
 
 extern void	protopr(uint32_t, char *, int);
+extern void	pcbwatch(uint32_t, char *, int);
 extern void	mptcppr(uint32_t, char *, int);
 extern void	tcp_stats(uint32_t, char *, int);
 extern void	mptcp_stats(uint32_t, char *, int);
@@ -145,6 +146,7 @@ extern void	intpr(void (*)(char *));
 extern void	intpr_ri(void (*)(char *));
 extern void	intervalpr(void (*)(uint32_t, char *, int), uint32_t,
 		    char *, int);
+extern void	pcbintervalpr(uint32_t *, char **, int, int);
 
 extern void	pr_rthdr(int);
 extern void	pr_family(int);
@@ -154,6 +156,9 @@ extern char	*routename(uint32_t);
 extern char	*netname(uint32_t, uint32_t);
 extern void	routepr(void);
 
+extern void	resolve_want(int, const void *, uint32_t);
+extern char	*resolve_name(int, const void *, uint32_t);
+
 extern void	unixpr(void);
 extern void	aqstatpr(void);
 extern void	rxpollstatpr(void);
@@ -0,0 +1,389 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Reverse name lookups for the symbolic displays.
+ *
+ * Callers that are about to print a table first hand every address in it
+ * to resolve_want(), which queues the address for a small pool of worker
+ * threads.  The table is then printed in order; resolve_name() only blocks
+ * until the name of the row at hand has arrived, so output streams while
+ * the lookups for later rows are still in flight.  Answers, including
+ * negative ones, are kept for the life of the process and, if
+ * NETSTAT_HOSTCACHE names a file, between runs.
+ */
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <err.h>
+#include <errno.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "netstat.h"
+
+#define	RESOLVE_NTHREADS	8	/* lookups in flight at once */
+#define	RESOLVE_WAIT		3	/* seconds a row waits for its name */
+#define	RESOLVE_TTL		3600	/* seconds a saved answer stays good */
+
+struct rname {
+	struct rname	*rn_next;	/* resolve queue */
+	int		rn_af;
+	uint32_t	rn_scope;
+	union {
+		struct in_addr	v4;
+		struct in6_addr	v6;
+	} rn_addr;
+	int		rn_state;
+#define	RN_QUEUED	0
+#define	RN_BUSY		1
+#define	RN_DONE		2
+	int		rn_late;	/* a reader already gave up on it */
+	time_t		rn_time;	/* when the answer arrived */
+	char		*rn_name;	/* NULL if the address has no name */
+};
+
+static pthread_mutex_t	rlock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	rwork = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	rdone = PTHREAD_COND_INITIALIZER;
+
+static struct rname	**rtab;		/* open addressing, never shrinks */
+static size_t		rsize, rcount;
+static struct rname	*rhead, **rtail = &rhead;
+static int		rqueued, nworkers, ridle;
+static int		rinited;
+static char		*rcachefile;
+
+static size_t
+rn_alen(int af)
+{
+	return (af == AF_INET6 ? sizeof(struct in6_addr) :
+	    sizeof(struct in_addr));
+}
+
+static size_t
+rn_hash(int af, const void *addr, uint32_t scope)
+{
+	const u_char *cp = addr;
+	uint32_t h = 2166136261U;	/* FNV-1a */
+	size_t i;
+
+	h = (h ^ (uint32_t)af) * 16777619U;
+	h = (h ^ scope) * 16777619U;
+	for (i = 0; i < rn_alen(af); i++)
+		h = (h ^ cp[i]) * 16777619U;
+	return (h);
+}
+
+/*
+ * Look an address up in the table, adding it if create is set.
+ * Called with rlock held.
+ */
+static struct rname *
+rn_find(int af, const void *addr, uint32_t scope, int create)
+{
+	struct rname *rn, **ntab;
+	size_t i, j, nsize;
+
+	if (rsize != 0) {
+		for (i = rn_hash(af, addr, scope) & (rsize - 1);
+		    (rn = rtab[i]) != NULL; i = (i + 1) & (rsize - 1))
+			if (rn->rn_af == af && rn->rn_scope == scope &&
+			    memcmp(&rn->rn_addr, addr, rn_alen(af)) == 0)
+				return (rn);
+	}
+	if (!create)
+		return (NULL);
+
+	/* keep the table at most half full */
+	if ((rcount + 1) * 2 > rsize) {
+		nsize = rsize ? rsize * 2 : 256;
+		if ((ntab = calloc(nsize, sizeof(*ntab))) == NULL)
+			err(1, "calloc");
+		for (j = 0; j < rsize; j++) {
+			if ((rn = rtab[j]) == NULL)
+				continue;
+			for (i = rn_hash(rn->rn_af, &rn->rn_addr,
+			    rn->rn_scope) & (nsize - 1); ntab[i] != NULL;
+			    i = (i + 1) & (nsize - 1))
+				continue;
+			ntab[i] = rn;
+		}
+		free(rtab);
+		rtab = ntab;
+		rsize = nsize;
+	}
+	if ((rn = calloc(1, sizeof(*rn))) == NULL)
+		err(1, "calloc");
+	rn->rn_af = af;
+	rn->rn_scope = scope;
+	memcpy(&rn->rn_addr, addr, rn_alen(af));
+	for (i = rn_hash(af, addr, scope) & (rsize - 1); rtab[i] != NULL;
+	    i = (i + 1) & (rsize - 1))
+		continue;
+	rtab[i] = rn;
+	rcount++;
+	return (rn);
+}
+
+static void *
+resolve_worker(void *arg __unused)
+{
+	struct rname *rn;
+	union {
+		struct sockaddr		sa;
+		struct sockaddr_in	sin;
+		struct sockaddr_in6	sin6;
+	} su;
+	char host[NI_MAXHOST];
+	char *name;
+
+	pthread_mutex_lock(&rlock);
+	for (;;) {
+		while ((rn = rhead) == NULL) {
+			ridle++;
+			pthread_cond_wait(&rwork, &rlock);
+			ridle--;
+		}
+		if ((rhead = rn->rn_next) == NULL)
+			rtail = &rhead;
+		rqueued--;
+		rn->rn_state = RN_BUSY;
+		pthread_mutex_unlock(&rlock);
+
+		memset(&su, 0, sizeof(su));
+		if (rn->rn_af == AF_INET6) {
+			su.sin6.sin6_len = sizeof(su.sin6);
+			su.sin6.sin6_family = AF_INET6;
+			su.sin6.sin6_addr = rn->rn_addr.v6;
+			su.sin6.sin6_scope_id = rn->rn_scope;
+		} else {
+			su.sin.sin_len = sizeof(su.sin);
+			su.sin.sin_family = AF_INET;
+			su.sin.sin_addr = rn->rn_addr.v4;
+		}
+		name = NULL;
+		if (getnameinfo(&su.sa, su.sa.sa_len, host, sizeof(host),
+		    NULL, 0, NI_NAMEREQD) == 0)
+			name = strdup(host);
+
+		pthread_mutex_lock(&rlock);
+		rn->rn_name = name;
+		rn->rn_time = time(NULL);
+		rn->rn_state = RN_DONE;
+		pthread_cond_broadcast(&rdone);
+	}
+	/* NOTREACHED */
+	return (NULL);
+}
+
+/*
+ * Queue a new entry for the workers, starting another one if all of
+ * them are busy.  Called with rlock held.
+ */
+static void
+rn_enqueue(struct rname *rn)
+{
+	pthread_t tid;
+
+	rn->rn_state = RN_QUEUED;
+	rn->rn_next = NULL;
+	*rtail = rn;
+	rtail = &rn->rn_next;
+	rqueued++;
+	if (ridle < rqueued && nworkers < RESOLVE_NTHREADS) {
+		if (pthread_create(&tid, NULL, resolve_worker, NULL) == 0) {
+			pthread_detach(tid);
+			nworkers++;
+		} else if (nworkers == 0)
+			errx(1, "cannot start a name lookup thread");
+	}
+	pthread_cond_signal(&rwork);
+}
+
+static void
+resolve_save(void)
+{
+	struct rname *rn;
+	char tmp[MAXPATHLEN], abuf[INET6_ADDRSTRLEN];
+	size_t i;
+	FILE *fp;
+	int fd, error;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", rcachefile) >=
+	    (int)sizeof(tmp))
+		return;
+	if ((fd = mkstemp(tmp)) < 0 || (fp = fdopen(fd, "w")) == NULL) {
+		warn("%s", rcachefile);
+		if (fd >= 0) {
+			close(fd);
+			unlink(tmp);
+		}
+		return;
+	}
+	pthread_mutex_lock(&rlock);
+	for (i = 0; i < rsize; i++) {
+		if ((rn = rtab[i]) == NULL || rn->rn_state != RN_DONE)
+			continue;
+		inet_ntop(rn->rn_af, &rn->rn_addr, abuf, sizeof(abuf));
+		fprintf(fp, "%d %s %u %ld %s\n", rn->rn_af, abuf,
+		    rn->rn_scope, (long)rn->rn_time,
+		    rn->rn_name ? rn->rn_name : "-");
+	}
+	pthread_mutex_unlock(&rlock);
+	error = ferror(fp);
+	if (fclose(fp) != 0 || error || rename(tmp, rcachefile) < 0) {
+		warn("%s", rcachefile);
+		unlink(tmp);
+	}
+}
+
+/*
+ * Read the answers saved by an earlier run that are still fresh.
+ * Called with rlock held.
+ */
+static void
+resolve_load(void)
+{
+	struct rname *rn;
+	char line[NI_MAXHOST + 128], abuf[INET6_ADDRSTRLEN], name[NI_MAXHOST];
+	struct in6_addr addr;
+	u_int scope;
+	long when;
+	time_t now;
+	FILE *fp;
+	int af;
+
+	if ((fp = fopen(rcachefile, "r")) == NULL) {
+		if (errno != ENOENT)
+			warn("%s", rcachefile);
+		return;
+	}
+	now = time(NULL);
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (sscanf(line, "%d %45s %u %ld %1024s", &af, abuf, &scope,
+		    &when, name) != 5)
+			continue;
+		if ((af != AF_INET && af != AF_INET6) ||
+		    inet_pton(af, abuf, &addr) != 1 ||
+		    when > now || now - when > RESOLVE_TTL)
+			continue;
+		rn = rn_find(af, &addr, scope, 1);
+		if (rn->rn_state == RN_DONE)
+			continue;
+		rn->rn_state = RN_DONE;
+		rn->rn_time = when;
+		if (strcmp(name, "-") != 0 && (rn->rn_name = strdup(name)) == NULL)
+			err(1, "strdup");
+	}
+	fclose(fp);
+}
+
+/*
+ * Called with rlock held.
+ */
+static void
+resolve_init(void)
+{
+	char *cp;
+
+	if (rinited)
+		return;
+	rinited = 1;
+	if ((cp = getenv("NETSTAT_HOSTCACHE")) != NULL && *cp != '\0') {
+		rcachefile = cp;
+		resolve_load();
+		atexit(resolve_save);
+	}
+}
+
+/*
+ * Start looking up the name of an address that is about to be printed.
+ */
+void
+resolve_want(int af, const void *addr, uint32_t scope)
+{
+	struct rname *rn;
+
+	if (nflag)
+		return;
+	pthread_mutex_lock(&rlock);
+	resolve_init();
+	if ((rn = rn_find(af, addr, scope, 0)) == NULL) {
+		rn = rn_find(af, addr, scope, 1);
+		rn_enqueue(rn);
+	}
+	pthread_mutex_unlock(&rlock);
+}
+
+/*
+ * Return the name of an address, or NULL if it has none or the lookup
+ * is taking too long.  The string is owned by the cache.
+ */
+char *
+resolve_name(int af, const void *addr, uint32_t scope)
+{
+	struct rname *rn;
+	struct timespec deadline;
+	struct timeval now;
+	char *name;
+
+	if (nflag)
+		return (NULL);
+	pthread_mutex_lock(&rlock);
+	resolve_init();
+	if ((rn = rn_find(af, addr, scope, 0)) == NULL) {
+		rn = rn_find(af, addr, scope, 1);
+		rn_enqueue(rn);
+	}
+	if (rn->rn_state != RN_DONE && !rn->rn_late) {
+		gettimeofday(&now, NULL);
+		deadline.tv_sec = now.tv_sec + RESOLVE_WAIT;
+		deadline.tv_nsec = now.tv_usec * 1000;
+		while (rn->rn_state != RN_DONE)
+			if (pthread_cond_timedwait(&rdone, &rlock,
+			    &deadline) == ETIMEDOUT) {
+				/* don't hold up later rows for it again */
+				rn->rn_late = 1;
+				break;
+			}
+	}
+	name = rn->rn_state == RN_DONE ? rn->rn_name : NULL;
+	pthread_mutex_unlock(&rlock);
+	return (name);
+}
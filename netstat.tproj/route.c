@@ -133,6 +133,8 @@ typedef union {
 } sa_u;
 
 static void np_rtentry __P((struct rt_msghdr2 *));
+static void np_prefetch __P((struct rt_msghdr2 *));
+static void p_prefetch __P((struct sockaddr *, int));
 static void p_sockaddr __P((struct sockaddr *, struct sockaddr *, int, int));
 static void p_flags __P((int, char *));
 static uint32_t forgemask __P((uint32_t));
@@ -268,6 +270,13 @@ routepr(void)
 		err(1, "sysctl: net.route.0.0.dump");
 	}
 	lim  = buf + needed;
+	if (!nflag) {
+		/* start the name lookups for the whole table up front */
+		for (next = buf; next < lim; next += rtm->rtm_msglen) {
+			rtm = (struct rt_msghdr2 *)next;
+			np_prefetch(rtm);
+		}
+	}
 	for (next = buf; next < lim; next += rtm->rtm_msglen) {
 		rtm = (struct rt_msghdr2 *)next;
 		np_rtentry(rtm);
@@ -289,6 +298,81 @@ get_rtaddrs(int addrs, struct sockaddr *sa, struct sockaddr **rti_info)
 }
 }
 
+#ifdef INET6
+/*
+ * XXX: This is a special workaround for KAME kernels.
+ * sin6_scope_id field of SA should be set in the future.
+ */
+static void
+in6_fillscopeid(struct sockaddr_in6 *sa6)
+{
+	struct in6_addr *in6 = &sa6->sin6_addr;
+
+	if (IN6_IS_ADDR_LINKLOCAL(in6) ||
+	    IN6_IS_ADDR_MC_NODELOCAL(in6) ||
+	    IN6_IS_ADDR_MC_LINKLOCAL(in6)) {
+	    /* XXX: override is ok? */
+	    sa6->sin6_scope_id = (u_int32_t)ntohs(*(u_short *)&in6->s6_addr[2]);
+	    *(u_short *)&in6->s6_addr[2] = 0;
+	}
+}
+#endif /*INET6*/
+
+/*
+ * Queue the addresses of a route that p_sockaddr() will want names for,
+ * skipping the routes np_rtentry() won't print.
+ */
+static void
+np_prefetch(struct rt_msghdr2 *rtm)
+{
+	struct sockaddr *sa = (struct sockaddr *)(rtm + 1);
+	struct sockaddr *rti_info[RTAX_MAX];
+
+	if ((rtm->rtm_flags & RTF_WASCLONED) &&
+	    (rtm->rtm_parentflags & RTF_PRCLONING) &&
+	    !aflag)
+		return;
+	if (lflag > 1 && zflag != 0 && rtm->rtm_rmx.rmx_rtt == 0 && rtm->rtm_rmx.rmx_rttvar == 0)
+		return;
+	if (af != AF_UNSPEC && af != sa->sa_family)
+		return;
+	get_rtaddrs(rtm->rtm_addrs, sa, rti_info);
+	if ((rtm->rtm_addrs & RTA_DST))
+		p_prefetch(rti_info[RTAX_DST], rtm->rtm_flags);
+	if ((rtm->rtm_addrs & RTA_GATEWAY))
+		p_prefetch(rti_info[RTAX_GATEWAY], RTF_HOST);
+	if (lflag && (rtm->rtm_addrs & RTA_IFA))
+		p_prefetch(rti_info[RTAX_IFA], RTF_HOST);
+}
+
+static void
+p_prefetch(struct sockaddr *sa, int flags)
+{
+	switch (sa->sa_family) {
+	case AF_INET: {
+		struct sockaddr_in *sin = (struct sockaddr_in *)sa;
+
+		/* network names come from getnetbyaddr() */
+		if ((flags & RTF_HOST) && sin->sin_addr.s_addr != INADDR_ANY)
+			resolve_want(AF_INET, &sin->sin_addr, 0);
+		break;
+	    }
+
+#ifdef INET6
+	case AF_INET6: {
+		/* p_sockaddr() rewrites the address in place, so use a copy */
+		struct sockaddr_in6 sa6 = *(struct sockaddr_in6 *)sa;
+
+		if (IN6_IS_ADDR_UNSPECIFIED(&sa6.sin6_addr))
+			break;
+		in6_fillscopeid(&sa6);
+		resolve_want(AF_INET6, &sa6.sin6_addr, sa6.sin6_scope_id);
+		break;
+	    }
+#endif /*INET6*/
+	}
+}
+
 static void
 np_rtentry(struct rt_msghdr2 *rtm)
 {
@@ -422,19 +506,8 @@ p_sockaddr(struct sockaddr *sa, struct sockaddr *mask, int flags, int width)
 #ifdef INET6
 	case AF_INET6: {
 		struct sockaddr_in6 *sa6 = (struct sockaddr_in6 *)sa;
-		struct in6_addr *in6 = &sa6->sin6_addr;
-
-		/*
-		 * XXX: This is a special workaround for KAME kernels.
-		 * sin6_scope_id field of SA should be set in the future.
-		 */
-		if (IN6_IS_ADDR_LINKLOCAL(in6) ||
-		    IN6_IS_ADDR_MC_NODELOCAL(in6) ||
-		    IN6_IS_ADDR_MC_LINKLOCAL(in6)) {
-		    /* XXX: override is ok? */
-		    sa6->sin6_scope_id = (u_int32_t)ntohs(*(u_short *)&in6->s6_addr[2]);
-		    *(u_short *)&in6->s6_addr[2] = 0;
-		}
+
+		in6_fillscopeid(sa6);
 
 		if (flags & RTF_HOST)
 		    cp = routename6(sa6);
@@ -519,16 +592,11 @@ routename(uint32_t in)
 {
 	char *cp;
 	static char line[MAXHOSTNAMELEN];
-	struct hostent *hp;
 
 	cp = 0;
 	if (!nflag) {
-		hp = gethostbyaddr((char *)&in, sizeof (struct in_addr),
-			AF_INET);
-		if (hp) {
-			cp = hp->h_name;
-			 //### trimdomain(cp, strlen(cp));
-		}
+		cp = resolve_name(AF_INET, &in, 0);
+		 //### trimdomain(cp, strlen(cp));
 	}
 	if (cp) {
 		strlcpy(line, cp, sizeof(line));
@@ -647,6 +715,7 @@ char *
 netname6(struct sockaddr_in6 *sa6, struct sockaddr *sam)
 {
 	static char line[MAXHOSTNAMELEN];
+	char *cp;
 	u_char *lim;
 	int masklen, illegal = 0, flag = NI_WITHSCOPEID;
 	struct in6_addr *mask = sam ? &((struct sockaddr_in6 *)sam)->sin6_addr : 0;
@@ -696,10 +765,12 @@ netname6(struct sockaddr_in6 *sa6, struct sockaddr *sam)
 	if (masklen == 0 && IN6_IS_ADDR_UNSPECIFIED(&sa6->sin6_addr))
 		return("default");
 
-	if (nflag)
-		flag |= NI_NUMERICHOST;
-	getnameinfo((struct sockaddr *)sa6, sa6->sin6_len, line, sizeof(line),
-		    NULL, 0, flag);
+	if (nflag || (cp = resolve_name(AF_INET6, &sa6->sin6_addr,
+	    sa6->sin6_scope_id)) == NULL)
+		getnameinfo((struct sockaddr *)sa6, sa6->sin6_len, line,
+		    sizeof(line), NULL, 0, flag | NI_NUMERICHOST);
+	else
+		strlcpy(line, cp, sizeof(line));
 
 	if (nflag)
 		snprintf(&line[strlen(line)], sizeof(line) - strlen(line), "/%d", masklen);
@@ -712,17 +783,19 @@ routename6(struct sockaddr_in6 *sa6)
 {
 	static char line[MAXHOSTNAMELEN];
 	int flag = NI_WITHSCOPEID;
+	char *cp;
 	/* use local variable for safety */
 	struct sockaddr_in6 sa6_local = {sizeof(sa6_local), AF_INET6, };
 
 	sa6_local.sin6_addr = sa6->sin6_addr;
 	sa6_local.sin6_scope_id = sa6->sin6_scope_id;
 
-	if (nflag)
-		flag |= NI_NUMERICHOST;
-
-	getnameinfo((struct sockaddr *)&sa6_local, sa6_local.sin6_len,
-		    line, sizeof(line), NULL, 0, flag);
+	if (nflag || (cp = resolve_name(AF_INET6, &sa6_local.sin6_addr,
+	    sa6_local.sin6_scope_id)) == NULL)
+		getnameinfo((struct sockaddr *)&sa6_local, sa6_local.sin6_len,
+		    line, sizeof(line), NULL, 0, flag | NI_NUMERICHOST);
+	else
+		strlcpy(line, cp, sizeof(line));
 
 	return line;
 }
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#include <sys/types.h>
+#include <machine/endian.h>
+#include <string.h>
+
+#include "in_cksum.h"
+
+/*
+ * Loads go through memcpy() so that callers may hand in buffers with any
+ * alignment; the compiler turns these into plain loads.
+ */
+static inline u_int32_t
+load32(const u_int8_t *p)
+{
+	u_int32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return (v);
+}
+
+static inline u_int16_t
+load16(const u_int8_t *p)
+{
+	u_int16_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return (v);
+}
+
+/*
+ * in_cksum_partial --
+ *	One's complement sum in the style of the kernel's os_cpu_in_cksum():
+ * 32 bit words are added into a 64 bit accumulator, 64 bytes per
+ * iteration, and the carries are only folded back at the end.  This does
+ * a quarter as many additions as the classic 16 bit loop and has no
+ * loop-carried dependency on the carry, so the compiler is free to
+ * vectorize it.
+ */
+u_int16_t
+in_cksum_partial(const void *addr, int len, u_int32_t sum)
+{
+	const u_int8_t *data = addr;
+	u_int64_t partial = 0;
+	u_int32_t final_acc;
+
+	while (len >= 64) {
+		partial += load32(data);
+		partial += load32(data + 4);
+		partial += load32(data + 8);
+		partial += load32(data + 12);
+		partial += load32(data + 16);
+		partial += load32(data + 20);
+		partial += load32(data + 24);
+		partial += load32(data + 28);
+		partial += load32(data + 32);
+		partial += load32(data + 36);
+		partial += load32(data + 40);
+		partial += load32(data + 44);
+		partial += load32(data + 48);
+		partial += load32(data + 52);
+		partial += load32(data + 56);
+		partial += load32(data + 60);
+		data += 64;
+		len -= 64;
+	}
+	/*
+	 * len is not updated below as the remaining tests
+	 * are using bit masks, which are not affected.
+	 */
+	if (len & 32) {
+		partial += load32(data);
+		partial += load32(data + 4);
+		partial += load32(data + 8);
+		partial += load32(data + 12);
+		partial += load32(data + 16);
+		partial += load32(data + 20);
+		partial += load32(data + 24);
+		partial += load32(data + 28);
+		data += 32;
+	}
+	if (len & 16) {
+		partial += load32(data);
+		partial += load32(data + 4);
+		partial += load32(data + 8);
+		partial += load32(data + 12);
+		data += 16;
+	}
+	if (len & 8) {
+		partial += load32(data);
+		partial += load32(data + 4);
+		data += 8;
+	}
+	if (len & 4) {
+		partial += load32(data);
+		data += 4;
+	}
+	if (len & 2) {
+		partial += load16(data);
+		data += 2;
+	}
+	/* mop up an odd byte, if necessary */
+	if (len & 1) {
+#if BYTE_ORDER == LITTLE_ENDIAN
+		partial += *data;
+#else
+		partial += *data << 8;
+#endif
+	}
+
+	partial += sum;
+	final_acc = (partial >> 48) + ((partial >> 32) & 0xffff) +
+	    ((partial >> 16) & 0xffff) + (partial & 0xffff);
+	final_acc = (final_acc >> 16) + (final_acc & 0xffff);
+	final_acc = (final_acc >> 16) + (final_acc & 0xffff);
+	return (final_acc & 0xffff);
+}
+
+/*
+ * in_cksum --
+ *	Checksum routine for Internet Protocol family headers.
+ */
+u_short
+in_cksum(const void *addr, int len)
+{
+
+	return (~in_cksum_partial(addr, len, 0) & 0xffff);
+}
+
+/*
+ * in_cksum_update --
+ *	Incrementally update a checksum for a change of the 16 bit words
+ * at "old" to the ones at "new": HC' = ~(~HC + ~m + m') (RFC 1624).
+ */
+u_short
+in_cksum_update(u_short cksum, const void *old, const void *new, int len)
+{
+	const u_int8_t *op = old, *np = new;
+	u_int32_t sum;
+
+	sum = ~cksum & 0xffff;
+	for (; len > 1; len -= 2, op += 2, np += 2) {
+		sum += ~load16(op) & 0xffff;
+		sum += load16(np);
+	}
+	sum = (sum >> 16) + (sum & 0xffff);
+	sum += (sum >> 16);
+	return (~sum & 0xffff);
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#ifndef _IN_CKSUM_H_
+#define _IN_CKSUM_H_
+
+#include <sys/types.h>
+
+/*
+ * Internet checksum routines shared by ping and traceroute.
+ *
+ * in_cksum_partial() returns the 16 bit one's complement sum of len bytes
+ * added to "sum", without the final inversion, so that it can be chained.
+ * in_cksum() returns the finished checksum of a buffer.
+ * in_cksum_update() patches an existing checksum after the len bytes at
+ * "old" have been replaced by the bytes at "new" (RFC 1624, eqn. 3); len
+ * must be even and the bytes must start at an even offset in the packet.
+ */
+u_int16_t	in_cksum_partial(const void *, int, u_int32_t);
+u_short		in_cksum(const void *, int);
+u_short		in_cksum_update(u_short, const void *, const void *, int);
+
+#endif /* _IN_CKSUM_H_ */
@@ -118,6 +118,10 @@ __unused static const char copyright[] =
 #include <unistd.h>
 #include <ifaddrs.h>
 #include <getopt.h>
+#include <stddef.h>
+#include <mach/mach_time.h>
+
+#include "in_cksum.h"
 
 #define	INADDR_LEN	((int)sizeof(in_addr_t))
 #define	TIMEVAL_LEN	((int)sizeof(struct tv32))
@@ -132,17 +136,26 @@ __unused static const char copyright[] =
 #define	MAXALARM	(60 * 60)	/* max seconds for alarm timeout */
 #define	MAXTOS		255
 
-#define	A(bit)		rcvd_tbl[(bit)>>3]	/* identify byte in array */
+#define	A(tbl, bit)	(tbl)[(bit)>>3]		/* identify byte in array */
 #define	B(bit)		(1 << ((bit) & 0x07))	/* identify bit in byte */
-#define	SET(bit)	(A(bit) |= B(bit))
-#define	CLR(bit)	(A(bit) &= (~B(bit)))
-#define	TST(bit)	(A(bit) & B(bit))
+#define	SET(tbl, bit)	(A(tbl, bit) |= B(bit))
+#define	CLR(tbl, bit)	(A(tbl, bit) &= (~B(bit)))
+#define	TST(tbl, bit)	(A(tbl, bit) & B(bit))
 
 struct tv32 {
 	u_int32_t tv32_sec;
 	u_int32_t tv32_usec;
 };
 
+/*
+ * With --apple-monotonic the timestamp in the payload is instead a
+ * single 64 bit count of nanoseconds on the monotonic clock, in network
+ * byte order.  It takes the same TIMEVAL_LEN bytes as a struct tv32.
+ */
+struct tv64 {
+	u_int64_t tv64_nsec;
+};
+
 /* various options */
 int options;
 #define	F_FLOOD		0x0001
@@ -174,6 +187,7 @@ int options;
 #define	F_WAITTIME	0x400000
 #define	F_CONNECT	0x800000
 #define F_PRTIME	0x1000000
+#define	F_MONOTONIC	0x2000000
 
 /*
  * MAX_DUP_CHK is the number of bits in received table, i.e. the maximum
@@ -184,6 +198,60 @@ int options;
 int mx_dup_ck = MAX_DUP_CHK;
 char rcvd_tbl[MAX_DUP_CHK / 8];
 
+/*
+ * Per-destination state for multi-target mode (--apple-targets).  Each
+ * target gets its own ICMP ident, allocated consecutively from the process
+ * ident, so a reply is mapped back to its target by a subtraction instead
+ * of a search.  The duplicate table is smaller than the single host one
+ * to keep the table compact when probing many thousands of hosts.
+ */
+#define	PT_DUP_CHK	(8 * 32)
+#define	MAXTARGETS	0xffff
+
+struct ping_target {
+	struct sockaddr_in pt_to;	/* destination */
+	char	*pt_name;		/* name as given in the targets file */
+	long	pt_ntransmitted;	/* sequence # for outbound packets */
+	long	pt_nreceived;		/* # of packets we got back */
+	long	pt_nrepeats;		/* number of duplicates */
+	double	pt_tmin;		/* minimum round trip time */
+	double	pt_tmax;		/* maximum round trip time */
+	double	pt_tsum;		/* sum of all times */
+	double	pt_tsumsq;		/* sum of all times squared */
+	char	pt_rcvd_tbl[PT_DUP_CHK / 8];
+};
+
+struct ping_target *targets;	/* multi-target table, indexed by ident */
+int ntargets;			/* number of entries in targets */
+char *targetsfile;		/* file the targets were read from */
+
+/*
+ * Batched I/O (--apple-batch): each transmission sends a burst of "batch"
+ * prebuilt echo requests, and each wakeup drains up to "batch" replies
+ * before any of them are processed.
+ */
+#define	MAXBATCH	1024
+#define	CTRL_LEN	(CMSG_SPACE(sizeof(struct timeval)) + \
+			    CMSG_SPACE(sizeof(u_int64_t)) + \
+			    CMSG_SPACE(sizeof(int)))
+
+struct batch_slot {
+	u_char	*bs_buf;		/* packet */
+	struct iovec bs_iov;
+	int	bs_cksum_len;		/* length bs_buf's checksum covers */
+	struct sockaddr_in bs_from;	/* receive only */
+	char	bs_ctrl[CTRL_LEN];	/* receive only */
+};
+
+int batch;			/* packets per burst, 0 if not batching */
+struct batch_slot *sslots;	/* send ring */
+struct batch_slot *rslots;	/* receive ring */
+struct msghdr_x *smsgs;
+struct msghdr_x *rmsgs;
+size_t rslotlen;		/* size of each receive buffer */
+int batch_nosendx;		/* socket does not support sendmsg_x() */
+int batch_norecvx;		/* socket does not support recvmsg_x() */
+
 struct sockaddr_in whereto;	/* who to ping */
 int datalen = DEFDATALEN;
 int maxpayload;
@@ -228,24 +296,63 @@ int icmp_len = 0;		/* length of the ICMP header */
 
 /* timing */
 int timing;			/* flag to do timing */
+int tprec = 3;			/* digits of milliseconds to print */
+mach_timebase_info_data_t timebase;	/* for F_MONOTONIC */
 double tmin = 999999999.0;	/* minimum round trip time */
 double tmax = 0.0;		/* maximum round trip time */
 double tsum = 0.0;		/* sum of all times, for doing average */
 double tsumsq = 0.0;		/* sum of all times squared, for std. dev. */
 
+/*
+ * Round trip time histogram (--apple-percentiles, --apple-histogram).
+ * Buckets are log-linear in microseconds, in the style of an HDR
+ * histogram: values below HIST_SUB are counted exactly, and every power
+ * of two above that is split into HIST_SUB / 2 equal buckets, so a
+ * bucket is never wider than 1/64 of its value.  Memory is fixed at
+ * HIST_NBUCKETS counters however long ping runs; the last bucket also
+ * counts anything longer (about 38 hours).
+ */
+#define	HIST_SUB_BITS	7
+#define	HIST_SUB	(1 << HIST_SUB_BITS)
+#define	HIST_HALF	(HIST_SUB / 2)
+#define	HIST_MAXSHIFT	30
+#define	HIST_NBUCKETS	(HIST_SUB + HIST_MAXSHIFT * HIST_HALF)
+
+int hist_enabled;		/* keep the histogram */
+char *hist_file;		/* where to dump it at exit, if anywhere */
+u_int64_t hist_counts[HIST_NBUCKETS];
+u_int64_t hist_total;
+
 volatile sig_atomic_t finish_up;  /* nonzero if we've been told to finish up */
 volatile sig_atomic_t siginfo_p;
 
 static void fill(char *, char *);
-static u_short in_cksum(u_short *, int);
 static void check_status(void);
 static void finish(void) __dead2;
 static void pinger(void);
+static int send_echo(const struct sockaddr_in *, int, u_int16_t);
+static int build_echo(u_char *, int *, int, u_int16_t);
+static int recv_pack(int);
+static void pr_msg(u_char *, int, struct sockaddr_in *, void *, socklen_t);
+static void batch_setup(void);
+static void pinger_batch(void);
+static int recv_batch(void);
+static void read_targets(const char *);
+static struct ping_target *target_lookup(int);
+static void targets_loop(void) __dead2;
+static void pr_targets(void);
+static void hist_add(double);
+static void hist_bucket(int, double *, double *);
+static double hist_pct(double);
+static void pr_pcts(FILE *, const char *);
+static void hist_dump(const char *);
 static char *pr_addr(struct in_addr);
 static char *pr_ntime(n_time);
 static void pr_icmph(struct icmp *);
 static void pr_iph(struct ip *);
-static void pr_pack(char *, int, struct sockaddr_in *, struct timeval *, int);
+static void pr_pack(char *, int, struct sockaddr_in *, struct timeval *,
+    u_int64_t, int);
+static u_int64_t mono_ns(u_int64_t);
 static void pr_retip(struct ip *);
 static void status(int);
 static void stopit(int);
@@ -258,30 +365,41 @@ static void usage(void) __dead2;
 int32_t thiszone;		/* seconds offset from gmt to local time */
 extern int32_t gmt2local(time_t);
 static void pr_currenttime(void);
+static void cksum_bench(const char *) __dead2;
 
 static int longopt_flag = 0;
 
 #define	LOF_CONNECT	0x01
 #define	LOF_PRTIME	0x02
+#define	LOF_TARGETS	0x03
+#define	LOF_BATCH	0x04
+#define	LOF_PCTS	0x05
+#define	LOF_HIST	0x06
+#define	LOF_MONOTONIC	0x07
+#define	LOF_CKSUMBENCH	0x08
 
 static const struct option longopts[] = {
 	{ "apple-connect", no_argument, &longopt_flag, LOF_CONNECT },
 	{ "apple-time", no_argument, &longopt_flag, LOF_PRTIME },
+	{ "apple-targets", required_argument, &longopt_flag, LOF_TARGETS },
+	{ "apple-batch", required_argument, &longopt_flag, LOF_BATCH },
+	{ "apple-percentiles", no_argument, &longopt_flag, LOF_PCTS },
+	{ "apple-histogram", required_argument, &longopt_flag, LOF_HIST },
+	{ "apple-monotonic", no_argument, &longopt_flag, LOF_MONOTONIC },
+	{ "apple-cksum-bench", required_argument, &longopt_flag, LOF_CKSUMBENCH },
 	{ NULL, 0, NULL, 0 }
 };
 
 int
 main(int argc, char *const *argv)
 {
-	struct sockaddr_in from, sock_in;
+	struct sockaddr_in sock_in;
 	struct in_addr ifaddr;
 	struct timeval last, intvl;
-	struct iovec iov;
 	struct ip *ip;
-	struct msghdr msg;
 	struct sigaction si_sa;
 	size_t sz;
-	u_char *datap, packet[IP_MAXPACKET] __attribute__((aligned(4)));
+	u_char *datap;
 	char *ep, *source, *target, *payload;
 	struct hostent *hp;
 #ifdef IPSEC_POLICY_IPSEC
@@ -292,7 +410,6 @@ main(int argc, char *const *argv)
 	u_long alarmtimeout, ultmp;
 	int almost_done, ch, df, hold, i, mib[4], preload, sockerrno,
 	    tos, ttl;
-	char ctrl[CMSG_SPACE(sizeof(struct timeval)) + CMSG_SPACE(sizeof(int))];
 	char hnamebuf[MAXHOSTNAMELEN], snamebuf[MAXHOSTNAMELEN];
 	unsigned char loop, mttl;
 
@@ -588,6 +705,40 @@ main(int argc, char *const *argv)
 					options |= F_PRTIME;
 					thiszone = gmt2local(0);
 					break;
+				case LOF_TARGETS:
+					targetsfile = optarg;
+					break;
+				case LOF_BATCH:
+					ultmp = strtoul(optarg, &ep, 0);
+					if (*ep || ep == optarg || ultmp < 1 ||
+					    ultmp > MAXBATCH)
+						errx(EX_USAGE,
+						    "invalid batch size: `%s'",
+						    optarg);
+					if (uid && ultmp > 1) {
+						errno = EPERM;
+						err(EX_NOPERM, "--apple-batch");
+					}
+					batch = ultmp;
+					break;
+				case LOF_PCTS:
+					hist_enabled = 1;
+					break;
+				case LOF_HIST:
+					hist_enabled = 1;
+					hist_file = optarg;
+					break;
+				case LOF_MONOTONIC:
+					options |= F_MONOTONIC;
+					if (mach_timebase_info(&timebase) !=
+					    KERN_SUCCESS)
+						errx(EX_OSERR,
+						    "mach_timebase_info failed");
+					tprec = 6;
+					break;
+				case LOF_CKSUMBENCH:
+					cksum_bench(optarg);
+					/* NOTREACHED */
 				default:
 					break;
 			}
@@ -601,9 +752,15 @@ main(int argc, char *const *argv)
 	if (boundif != NULL && (ifscope = if_nametoindex(boundif)) == 0)
 		errx(1, "bad interface name");
 
-	if (argc - optind != 1)
-		usage();
-	target = argv[optind];
+	if (targetsfile != NULL) {
+		if (argc - optind != 0)
+			usage();
+		target = NULL;
+	} else {
+		if (argc - optind != 1)
+			usage();
+		target = argv[optind];
+	}
 
 	switch (options & (F_MASK|F_TIME)) {
 	case 0: break;
@@ -668,7 +825,16 @@ main(int argc, char *const *argv)
 	to = &whereto;
 	to->sin_family = AF_INET;
 	to->sin_len = sizeof *to;
-	if (inet_aton(target, &to->sin_addr) != 0) {
+	if (targetsfile != NULL) {
+		if (options & (F_FLOOD | F_SWEEP | F_HDRINCL | F_CONNECT |
+		    F_MIF | F_NOLOOP | F_MTTL))
+			errx(EX_USAGE, "--apple-targets cannot be used with "
+			    "-D, -f, -G, -g, -h, -I, -L, -T, -z or "
+			    "--apple-connect");
+		read_targets(targetsfile);
+		*to = targets[0].pt_to;
+		hostname = targetsfile;
+	} else if (inet_aton(target, &to->sin_addr) != 0) {
 		hostname = target;
 	} else {
 		hp = gethostbyname2(target, AF_INET);
@@ -686,6 +852,8 @@ main(int argc, char *const *argv)
 	do {
 		struct ifaddrs *ifa_list, *ifa;
 		
+		if (ntargets > 0)
+			break;
 		if (IN_MULTICAST(ntohl(whereto.sin_addr.s_addr)) || whereto.sin_addr.s_addr == INADDR_BROADCAST) {
 			no_dup = 1;
 			break;
@@ -710,6 +878,11 @@ main(int argc, char *const *argv)
 	if (options & F_FLOOD && options & F_INTERVAL)
 		errx(EX_USAGE, "-f and -i: incompatible options");
 
+	if (batch > 0 && (ntargets > 0 || options & (F_SWEEP | F_HDRINCL) ||
+	    use_sendmsg))
+		errx(EX_USAGE, "--apple-batch cannot be used with -D, -G, -g, "
+		    "-h, -z, -k sendmsg or --apple-targets");
+
 	if (options & F_FLOOD && IN_MULTICAST(ntohl(to->sin_addr.s_addr)))
 		errx(EX_USAGE,
 		    "-f flag cannot be used with multicast destination");
@@ -846,6 +1019,12 @@ main(int argc, char *const *argv)
 		err(EX_OSERR, "setsockopt SO_TIMESTAMP");
 	}
 #endif
+	if (options & F_MONOTONIC) {
+		int on = 1;
+		if (setsockopt(s, SOL_SOCKET, SO_TIMESTAMP_MONOTONIC, &on,
+		    sizeof(on)) < 0)
+			err(EX_OSERR, "setsockopt SO_TIMESTAMP_MONOTONIC");
+	}
 
 	if ((options & F_CONNECT)) {
 		if (connect(s, (struct sockaddr *)&whereto, sizeof whereto) == -1)
@@ -889,7 +1068,12 @@ main(int argc, char *const *argv)
 		(void)setsockopt(s, SOL_SOCKET, SO_SNDBUF, (char *)&hold,
 		    sizeof(hold));
 
-	if (to->sin_family == AF_INET) {
+	if (ntargets > 0) {
+		(void)printf("PING %d targets (%s)", ntargets, hostname);
+		if (source)
+			(void)printf(" from %s", shostname);
+		(void)printf(": %d data bytes\n", datalen);
+	} else if (to->sin_family == AF_INET) {
 		(void)printf("PING %s (%s)", hostname,
 		    inet_ntoa(to->sin_addr));
 		if (source)
@@ -946,15 +1130,10 @@ main(int argc, char *const *argv)
 			err(EX_OSERR, "sigaction SIGALRM");
 	}
 
-	bzero(&msg, sizeof(msg));
-	msg.msg_name = (caddr_t)&from;
-	msg.msg_iov = &iov;
-	msg.msg_iovlen = 1;
-#ifdef SO_TIMESTAMP
-	msg.msg_control = (caddr_t)ctrl;
-#endif
-	iov.iov_base = packet;
-	iov.iov_len = IP_MAXPACKET;
+	if (batch > 0)
+		batch_setup();
+	if (ntargets > 0)
+		targets_loop();
 
 	if (preload == 0)
 		pinger();		/* send the first ping */
@@ -978,8 +1157,7 @@ main(int argc, char *const *argv)
 	while (!finish_up) {
 		struct timeval now, timeout;
 		fd_set rfds;
-		int cc, n;
-		int tc = -1;
+		int n;
 
 		check_status();
 		if ((unsigned)s >= FD_SETSIZE)
@@ -1003,41 +1181,8 @@ main(int argc, char *const *argv)
 		if (n < 0)
 			continue;	/* Must be EINTR. */
 		if (n == 1) {
-			struct timeval *tv = NULL;
-#ifdef SO_TIMESTAMP
-			struct cmsghdr *cmsg;
-
-			msg.msg_controllen = sizeof(ctrl);
-#endif
-			msg.msg_namelen = sizeof(from);
-			if ((cc = recvmsg(s, &msg, 0)) < 0) {
-				if (errno == EINTR)
-					continue;
-				warn("recvmsg");
+			if ((batch > 0 ? recv_batch() : recv_pack(0)) < 0)
 				continue;
-			}
-			for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
-#ifdef SO_TIMESTAMP
-				if (cmsg->cmsg_level == SOL_SOCKET &&
-					cmsg->cmsg_type == SCM_TIMESTAMP &&
-					cmsg->cmsg_len == CMSG_LEN(sizeof *tv)) {
-					/* Copy to avoid alignment problems: */
-					memcpy(&now, CMSG_DATA(cmsg), sizeof(now));
-					tv = &now;
-				}
-#endif
-				if (cmsg->cmsg_level == SOL_SOCKET &&
-					cmsg->cmsg_type == SO_TRAFFIC_CLASS &&
-					cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
-					/* Copy to avoid alignment problems: */
-					memcpy(&tc, CMSG_DATA(cmsg), sizeof(tc));
-				}
-			}
-			if (tv == NULL) {
-				(void)gettimeofday(&now, NULL);
-				tv = &now;
-			}
-			pr_pack((char *)packet, cc, &from, tv, tc);
 			if ((options & F_ONCE && nreceived) ||
 			    (npackets && nreceived >= npackets))
 				break;
@@ -1115,29 +1260,73 @@ stopit(int sig __unused)
 static void
 pinger(void)
 {
+
+	if (batch > 0) {
+		pinger_batch();
+		return;
+	}
+	CLR(rcvd_tbl, ntransmitted % mx_dup_ck);
+
+	if (send_echo(&whereto, ident, ntransmitted) < 0) {
+		if (options & F_FLOOD && errno == ENOBUFS) {
+			usleep(FLOOD_BACKOFF);
+			return;
+		}
+		warn("sendto");
+	}
+	ntransmitted++;
+	sntransmitted++;
+	if (!(options & F_QUIET) && options & F_FLOOD)
+		(void)write(STDOUT_FILENO, &DOT, 1);
+}
+
+/*
+ * build_echo --
+ *	Fill in the ICMP header and timestamp of the echo request in "pkt"
+ * for the given ident and sequence number, and return its length.  The
+ * payload past the timestamp must already be in place.
+ *
+ * Only the header and the timestamp change from one packet to the next,
+ * so as long as the length stays the same the checksum of the previous
+ * packet is patched rather than recomputed over the whole payload.
+ * *cksum_lenp remembers the length the checksum in "pkt" covers.
+ */
+static int
+build_echo(u_char *pkt, int *cksum_lenp, int id, u_int16_t seq)
+{
+	u_char ohdr[ICMP_MINLEN + TS_LEN + TIMEVAL_LEN];
 	struct timeval now;
 	struct tv32 tv32;
-	struct ip *ip;
+	struct tv64 tv64;
 	struct icmp *icp;
-	int cc, i;
-	u_char *packet;
-
-	packet = outpack;
-	icp = (struct icmp *)outpack;
-	icp->icmp_type = icmp_type;
-	icp->icmp_code = 0;
-	icp->icmp_cksum = 0;
-	icp->icmp_seq = htons(ntransmitted);
-	icp->icmp_id = ident;			/* ID */
-
-	CLR(ntransmitted % mx_dup_ck);
+	int cc, hdrlen;
+	u_short ocksum;
 
 	if (datalen >= TIMEVAL_LEN)	/* can we time transfer */
 		timing = 1;
 	else
 		timing = 0;
+
+	cc = ICMP_MINLEN + phdr_len + datalen;
+	hdrlen = ICMP_MINLEN + phdr_len + (timing ? TIMEVAL_LEN : 0);
+
+	icp = (struct icmp *)pkt;
+	ocksum = icp->icmp_cksum;
+	if (cc == *cksum_lenp)
+		memcpy(ohdr, icp, hdrlen);
+	icp->icmp_type = icmp_type;
+	icp->icmp_code = 0;
+	icp->icmp_cksum = 0;
+	icp->icmp_seq = htons(seq);
+	icp->icmp_id = id;			/* ID */
 	
-	if ((options & F_TIME) || timing) {
+	if (timing && (options & F_MONOTONIC)) {
+		tv64.tv64_nsec = htonll(mono_ns(mach_absolute_time()));
+		bcopy((void *)&tv64, (void *)&pkt[ICMP_MINLEN + phdr_len],
+		    sizeof(tv64));
+	}
+	if ((options & F_TIME) ||
+	    (timing && !(options & F_MONOTONIC))) {
 		(void)gettimeofday(&now, NULL);
 
 		tv32.tv32_sec = htonl(now.tv_sec);
@@ -1145,22 +1334,46 @@ pinger(void)
 		if (options & F_TIME)
 			icp->icmp_otime = htonl((now.tv_sec % (24*60*60))
 				* 1000 + now.tv_usec / 1000);
-		if (timing)
+		if (timing && !(options & F_MONOTONIC))
 			bcopy((void *)&tv32,
-			    (void *)&outpack[ICMP_MINLEN + phdr_len],
+			    (void *)&pkt[ICMP_MINLEN + phdr_len],
 			    sizeof(tv32));
 	}
 
-	cc = ICMP_MINLEN + phdr_len + datalen;
-
 	/* compute ICMP checksum here */
-	icp->icmp_cksum = in_cksum((u_short *)icp, cc);
+	if (cc == *cksum_lenp) {
+		bzero(&ohdr[offsetof(struct icmp, icmp_cksum)],
+		    sizeof(icp->icmp_cksum));
+		icp->icmp_cksum = in_cksum_update(ocksum, ohdr, icp, hdrlen);
+	} else {
+		icp->icmp_cksum = in_cksum(icp, cc);
+		*cksum_lenp = cc;
+	}
+	return (cc);
+}
+
+/*
+ * send_echo --
+ *	Build the echo request in outpack for the given ident and sequence
+ * number and send it to "to".  Returns -1 with errno set if the packet
+ * could not be sent.
+ */
+static int
+send_echo(const struct sockaddr_in *to, int id, u_int16_t seq)
+{
+	static int cksum_len;		/* length outpack's checksum covers */
+	struct ip *ip;
+	int cc, i;
+	u_char *packet;
+
+	packet = outpack;
+	cc = build_echo(outpack, &cksum_len, id, seq);
 
 	if (options & F_HDRINCL) {
 		cc += sizeof(struct ip);
 		ip = (struct ip *)outpackhdr;
 		ip->ip_len = cc;
-		ip->ip_sum = in_cksum((u_short *)outpackhdr, cc);
+		ip->ip_sum = in_cksum(outpackhdr, cc);
 		packet = outpackhdr;
 	}
 	if (use_sendmsg > 0) {
@@ -1173,8 +1386,8 @@ pinger(void)
 			msg.msg_name = NULL;
 			msg.msg_namelen = 0;
 		} else {
-		msg.msg_name = &whereto;
-		msg.msg_namelen = sizeof(whereto);
+		msg.msg_name = (void *)(uintptr_t)to;
+		msg.msg_namelen = sizeof(*to);
 		}
 		iov.iov_base = packet;
 		iov.iov_len = cc;
@@ -1208,26 +1421,461 @@ pinger(void)
 		if ((options & F_CONNECT)) {
 			i = send(s, (char *)packet, cc, 0);
 		} else {
-		i = sendto(s, (char *)packet, cc, 0, (struct sockaddr *)&whereto,
-			sizeof(whereto));
+		i = sendto(s, (char *)packet, cc, 0, (const struct sockaddr *)to,
+			sizeof(*to));
+	}
+	}
+	if (i < 0)
+		return (-1);
+	if (i != cc)
+		warn("%s: partial write: %d of %d bytes",
+		     inet_ntoa(to->sin_addr), i, cc);
+	return (0);
+}
+
+/*
+ * recv_pack --
+ *	Read one packet from the ICMP socket and hand it to pr_msg().
+ * Returns -1 if nothing was read.
+ */
+static int
+recv_pack(int flags)
+{
+	static u_char packet[IP_MAXPACKET] __attribute__((aligned(4)));
+	static char ctrl[CTRL_LEN];
+	struct sockaddr_in from;
+	struct msghdr msg;
+	struct iovec iov;
+	int cc;
+
+	bzero(&msg, sizeof(msg));
+	msg.msg_name = (caddr_t)&from;
+	msg.msg_namelen = sizeof(from);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+#ifdef SO_TIMESTAMP
+	msg.msg_control = (caddr_t)ctrl;
+	msg.msg_controllen = sizeof(ctrl);
+#endif
+	iov.iov_base = packet;
+	iov.iov_len = IP_MAXPACKET;
+
+	if ((cc = recvmsg(s, &msg, flags)) < 0) {
+		if (errno != EINTR && errno != EAGAIN)
+			warn("recvmsg");
+		return (-1);
+	}
+	pr_msg(packet, cc, &from, msg.msg_control, msg.msg_controllen);
+	return (0);
+}
+
+/*
+ * pr_msg --
+ *	Pick up the kernel receive timestamp and traffic class from the
+ * control messages of a received packet and hand it to pr_pack().
+ */
+static void
+pr_msg(u_char *packet, int cc, struct sockaddr_in *from, void *ctrl,
+    socklen_t ctrllen)
+{
+	struct timeval now, *tv = NULL;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	u_int64_t mono = 0;
+	int tc = -1;
+
+	bzero(&msg, sizeof(msg));
+	msg.msg_control = ctrl;
+	msg.msg_controllen = ctrllen;
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+#ifdef SO_TIMESTAMP
+		if (cmsg->cmsg_level == SOL_SOCKET &&
+			cmsg->cmsg_type == SCM_TIMESTAMP &&
+			cmsg->cmsg_len == CMSG_LEN(sizeof *tv)) {
+			/* Copy to avoid alignment problems: */
+			memcpy(&now, CMSG_DATA(cmsg), sizeof(now));
+			tv = &now;
+		}
+#endif
+		if (cmsg->cmsg_level == SOL_SOCKET &&
+			cmsg->cmsg_type == SCM_TIMESTAMP_MONOTONIC &&
+			cmsg->cmsg_len == CMSG_LEN(sizeof(mono))) {
+			/* Copy to avoid alignment problems: */
+			memcpy(&mono, CMSG_DATA(cmsg), sizeof(mono));
+		}
+		if (cmsg->cmsg_level == SOL_SOCKET &&
+			cmsg->cmsg_type == SO_TRAFFIC_CLASS &&
+			cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+			/* Copy to avoid alignment problems: */
+			memcpy(&tc, CMSG_DATA(cmsg), sizeof(tc));
+		}
+	}
+	if (tv == NULL) {
+		(void)gettimeofday(&now, NULL);
+		tv = &now;
 	}
+	if (options & F_MONOTONIC)
+		mono = mono_ns(mono != 0 ? mono : mach_absolute_time());
+	pr_pack((char *)packet, cc, from, tv, mono, tc);
+}
+
+/*
+ * batch_setup --
+ *	Allocate the send and receive rings for batched I/O.  Every send
+ * slot gets its own copy of the payload so that a whole burst can be
+ * handed to the kernel at once; receive slots are sized for an echo
+ * reply with IP options, anything longer is truncated.
+ */
+static void
+batch_setup(void)
+{
+	struct batch_slot *bs;
+	size_t slen;
+	int i;
+
+	slen = ICMP_MINLEN + phdr_len + datalen;
+	rslotlen = MAX(send_len + MAX_IPOPTLEN, 1024);
+	if ((sslots = calloc(batch, sizeof(*sslots))) == NULL ||
+	    (rslots = calloc(batch, sizeof(*rslots))) == NULL ||
+	    (smsgs = calloc(batch, sizeof(*smsgs))) == NULL ||
+	    (rmsgs = calloc(batch, sizeof(*rmsgs))) == NULL)
+		err(EX_OSERR, "malloc");
+	for (i = 0; i < batch; i++) {
+		bs = &sslots[i];
+		if ((bs->bs_buf = malloc(slen)) == NULL)
+			err(EX_OSERR, "malloc");
+		memcpy(bs->bs_buf, outpack, slen);
+		bs->bs_iov.iov_base = bs->bs_buf;
+		smsgs[i].msg_iov = &bs->bs_iov;
+		smsgs[i].msg_iovlen = 1;
+
+		bs = &rslots[i];
+		if ((bs->bs_buf = malloc(rslotlen)) == NULL)
+			err(EX_OSERR, "malloc");
+		bs->bs_iov.iov_base = bs->bs_buf;
+		bs->bs_iov.iov_len = rslotlen;
+		rmsgs[i].msg_name = &bs->bs_from;
+		rmsgs[i].msg_iov = &bs->bs_iov;
+		rmsgs[i].msg_iovlen = 1;
+#ifdef SO_TIMESTAMP
+		rmsgs[i].msg_control = bs->bs_ctrl;
+#endif
 	}
-	if (i < 0 || i != cc)  {
-		if (i < 0) {
-			if (options & F_FLOOD && errno == ENOBUFS) {
-				usleep(FLOOD_BACKOFF);
-				return;
+}
+
+/*
+ * pinger_batch --
+ *	Build up to "batch" echo requests in the send ring and transmit
+ * them together.  sendmsg_x() cannot carry a destination address, so
+ * the single vectored call is only possible on a connected socket (and
+ * on kernels whose ICMP sockets support it); otherwise the burst goes
+ * out one sendto() at a time.
+ */
+static void
+pinger_batch(void)
+{
+	struct batch_slot *bs;
+	int cc, cnt, i, n;
+
+	cnt = batch;
+	if (npackets && npackets - ntransmitted < cnt)
+		cnt = npackets - ntransmitted;
+	for (i = 0; i < cnt; i++) {
+		bs = &sslots[i];
+		CLR(rcvd_tbl, (ntransmitted + i) % mx_dup_ck);
+		bs->bs_iov.iov_len = build_echo(bs->bs_buf, &bs->bs_cksum_len,
+		    ident, ntransmitted + i);
+	}
+
+	n = -1;
+	if ((options & F_CONNECT) && !batch_nosendx) {
+		n = sendmsg_x(s, smsgs, cnt, 0);
+		if (n < 0 && (errno == EOPNOTSUPP || errno == ENOTSUP))
+			batch_nosendx = 1;
+	}
+	if (!(options & F_CONNECT) || batch_nosendx) {
+		for (n = 0; n < cnt; n++) {
+			bs = &sslots[n];
+			cc = sendto(s, bs->bs_buf, bs->bs_iov.iov_len, 0,
+			    (options & F_CONNECT) ? NULL :
+			    (struct sockaddr *)&whereto,
+			    (options & F_CONNECT) ? 0 : sizeof(whereto));
+			if (cc < 0) {
+				if (n == 0)
+					n = -1;
+				break;
 			}
-			warn("sendto");
-		} else {
-			warn("%s: partial write: %d of %d bytes",
-			     hostname, i, cc);
 		}
 	}
-	ntransmitted++;
-	sntransmitted++;
+	if (n < 0) {
+		if (options & F_FLOOD && errno == ENOBUFS) {
+			usleep(FLOOD_BACKOFF);
+			return;
+		}
+		warn("sendmsg_x");
+		n = cnt;
+	}
+	ntransmitted += n;
+	sntransmitted += n;
 	if (!(options & F_QUIET) && options & F_FLOOD)
-		(void)write(STDOUT_FILENO, &DOT, 1);
+		for (i = 0; i < n; i++)
+			(void)write(STDOUT_FILENO, &DOT, 1);
+}
+
+/*
+ * recv_batch --
+ *	Drain up to "batch" pending packets from the ICMP socket into the
+ * receive ring with one recvmsg_x() call, or with a non-blocking
+ * recvmsg() per slot if the socket does not support it, and only then
+ * run pr_pack() over the batch.  Returns -1 if nothing was read.
+ */
+static int
+recv_batch(void)
+{
+	struct batch_slot *bs;
+	struct msghdr msg;
+	struct msghdr_x *mx;
+	ssize_t cc;
+	int i, n;
+
+	for (i = 0; i < batch; i++) {
+		mx = &rmsgs[i];
+		mx->msg_namelen = sizeof(struct sockaddr_in);
+#ifdef SO_TIMESTAMP
+		mx->msg_controllen = CTRL_LEN;
+#endif
+		mx->msg_flags = 0;
+		mx->msg_datalen = 0;
+	}
+
+	n = -1;
+	if (!batch_norecvx) {
+		n = recvmsg_x(s, rmsgs, batch, MSG_DONTWAIT);
+		if (n < 0 && (errno == EOPNOTSUPP || errno == ENOTSUP ||
+		    errno == EINVAL))
+			batch_norecvx = 1;
+	}
+	if (n < 0 && batch_norecvx) {
+		for (n = 0; n < batch; n++) {
+			mx = &rmsgs[n];
+			bzero(&msg, sizeof(msg));
+			msg.msg_name = mx->msg_name;
+			msg.msg_namelen = mx->msg_namelen;
+			msg.msg_iov = mx->msg_iov;
+			msg.msg_iovlen = mx->msg_iovlen;
+			msg.msg_control = mx->msg_control;
+			msg.msg_controllen = mx->msg_controllen;
+			if ((cc = recvmsg(s, &msg, MSG_DONTWAIT)) < 0) {
+				if (n == 0)
+					n = -1;
+				break;
+			}
+			mx->msg_controllen = msg.msg_controllen;
+			mx->msg_datalen = cc;
+		}
+	}
+	if (n < 0) {
+		if (errno != EINTR && errno != EAGAIN)
+			warn("recvmsg_x");
+		return (-1);
+	}
+
+	for (i = 0; i < n; i++) {
+		mx = &rmsgs[i];
+		bs = &rslots[i];
+		pr_msg(bs->bs_buf, mx->msg_datalen, &bs->bs_from,
+		    mx->msg_control, mx->msg_controllen);
+	}
+	return (0);
+}
+
+/*
+ * read_targets --
+ *	Load the multi-target table from a file with one host name or
+ * address per line.  Blank lines and text following a '#' are ignored.
+ */
+static void
+read_targets(const char *path)
+{
+	struct ping_target *pt;
+	struct hostent *hp;
+	FILE *fp;
+	char *line, *cp, *name;
+	size_t len;
+	int lineno, maxtargets;
+
+	if (strcmp(path, "-") == 0)
+		fp = stdin;
+	else if ((fp = fopen(path, "r")) == NULL)
+		err(EX_NOINPUT, "%s", path);
+
+	maxtargets = 0;
+	lineno = 0;
+	while ((line = fgetln(fp, &len)) != NULL) {
+		lineno++;
+		if ((name = malloc(len + 1)) == NULL)
+			err(EX_OSERR, "malloc");
+		memcpy(name, line, len);
+		name[len] = '\0';
+		if ((cp = strchr(name, '#')) != NULL)
+			*cp = '\0';
+		cp = name;
+		while (isspace((unsigned char)*cp))
+			cp++;
+		len = strcspn(cp, " \t\r\n");
+		if (len == 0) {
+			free(name);
+			continue;
+		}
+		cp[len] = '\0';
+		memmove(name, cp, len + 1);
+
+		if (ntargets == MAXTARGETS)
+			errx(EX_USAGE, "%s: too many targets (max %d)",
+			    path, MAXTARGETS);
+		if (ntargets == maxtargets) {
+			maxtargets = maxtargets ? maxtargets * 2 : 256;
+			if (maxtargets > MAXTARGETS)
+				maxtargets = MAXTARGETS;
+			targets = reallocf(targets,
+			    maxtargets * sizeof(struct ping_target));
+			if (targets == NULL)
+				err(EX_OSERR, "malloc");
+		}
+		pt = &targets[ntargets];
+		bzero(pt, sizeof(*pt));
+		pt->pt_to.sin_family = AF_INET;
+		pt->pt_to.sin_len = sizeof(pt->pt_to);
+		pt->pt_tmin = 999999999.0;
+		if (inet_aton(name, &pt->pt_to.sin_addr) == 0) {
+			hp = gethostbyname2(name, AF_INET);
+			if (!hp)
+				errx(EX_NOHOST, "%s:%d: cannot resolve %s: %s",
+				    path, lineno, name, hstrerror(h_errno));
+			if ((unsigned)hp->h_length > sizeof(pt->pt_to.sin_addr))
+				errx(1, "gethostbyname2 returned an illegal address");
+			memcpy(&pt->pt_to.sin_addr, hp->h_addr_list[0],
+			    sizeof(pt->pt_to.sin_addr));
+		}
+		if (IN_MULTICAST(ntohl(pt->pt_to.sin_addr.s_addr)))
+			errx(EX_USAGE, "%s:%d: multicast target %s not allowed",
+			    path, lineno, name);
+		pt->pt_name = name;
+		ntargets++;
+	}
+	if (ferror(fp))
+		err(EX_IOERR, "%s", path);
+	if (fp != stdin)
+		(void)fclose(fp);
+	if (ntargets == 0)
+		errx(EX_USAGE, "%s: no targets", path);
+}
+
+/*
+ * target_lookup --
+ *	Map the ICMP ident of a reply back to its multi-target entry.
+ */
+static struct ping_target *
+target_lookup(int id)
+{
+	u_int16_t idx;
+
+	idx = (u_int16_t)(id - ident);
+	if (idx >= ntargets)
+		return (NULL);
+	return (&targets[idx]);
+}
+
+/*
+ * targets_loop --
+ *	Main loop for multi-target mode.  All targets are probed from the
+ * one ICMP socket at the same rate, so rather than keeping a timer per
+ * target the sends are spread evenly over each interval and a single
+ * cursor walks the table: the n-th send overall is due at
+ * start + n * interval / ntargets.  Replies are drained from the socket
+ * between sends and demultiplexed in pr_pack() by ident.
+ */
+static void
+targets_loop(void)
+{
+	struct ping_target *pt;
+	struct timeval start, now, due, timeout;
+	fd_set rfds;
+	long long nsent, step_us;
+	long rounds;
+	int cursor, n, sending;
+
+	if ((unsigned)s >= FD_SETSIZE)
+		errx(EX_OSERR, "descriptor too large");
+
+	(void)gettimeofday(&start, NULL);
+	nsent = 0;
+	rounds = 0;
+	cursor = 0;
+	sending = 1;
+	due = start;
+	while (!finish_up) {
+		check_status();
+		(void)gettimeofday(&now, NULL);
+
+		/* Send everything that has come due, but no more than a round */
+		for (n = 0; sending && n < ntargets && timercmp(&now, &due, >=);
+		    n++) {
+			pt = &targets[cursor];
+			CLR(pt->pt_rcvd_tbl, pt->pt_ntransmitted % PT_DUP_CHK);
+			if (send_echo(&pt->pt_to, ident + cursor,
+			    pt->pt_ntransmitted) < 0) {
+				if (errno == ENOBUFS)
+					break;		/* retry on next pass */
+				warn("sendto %s", pt->pt_name);
+			}
+			pt->pt_ntransmitted++;
+			ntransmitted++;
+			nsent++;
+			if (++cursor == ntargets) {
+				cursor = 0;
+				if (npackets && ++rounds >= npackets)
+					sending = 0;
+			}
+			step_us = nsent * interval * 1000LL / ntargets;
+			due.tv_sec = start.tv_sec + step_us / 1000000;
+			due.tv_usec = start.tv_usec + step_us % 1000000;
+			if (due.tv_usec >= 1000000) {
+				due.tv_sec++;
+				due.tv_usec -= 1000000;
+			}
+			if (!sending) {
+				/* Wait for the stragglers, then quit */
+				due = now;
+				due.tv_sec += waittime / 1000;
+				due.tv_usec += waittime % 1000 * 1000;
+				if (due.tv_usec >= 1000000) {
+					due.tv_sec++;
+					due.tv_usec -= 1000000;
+				}
+			}
+		}
+		if (!sending && (timercmp(&now, &due, >=) ||
+		    nreceived >= ntransmitted))
+			break;
+
+		if (timercmp(&now, &due, <)) {
+			timersub(&due, &now, &timeout);
+		} else {
+			timeout.tv_sec = 0;
+			timeout.tv_usec = n < ntargets ? FLOOD_BACKOFF : 0;
+		}
+		FD_ZERO(&rfds);
+		FD_SET(s, &rfds);
+		n = select(s + 1, &rfds, NULL, NULL, &timeout);
+		if (n < 0)
+			continue;	/* Must be EINTR. */
+		if (n == 1) {
+			while (recv_pack(MSG_DONTWAIT) == 0)
+				;
+		}
+	}
+	finish();
 }
 
 /*
@@ -1239,15 +1887,17 @@ pinger(void)
  */
 static void
 pr_pack(char *buf, int cc, struct sockaddr_in *from, struct timeval *tv,
-    int tc)
+    u_int64_t mono, int tc)
 {
 	struct in_addr ina;
 	u_char *cp, *dp;
 	struct icmp *icp;
 	struct ip *ip;
+	struct ping_target *pt;
 	const void *tp;
 	double triptime;
-	int dupflag, hlen, i, j, recv_len, seq;
+	char *dup_tbl;
+	int dup_ck, dupflag, hlen, i, j, recv_len, seq;
 	static int old_rrlen;
 	static char old_rr[MAX_IPOPTLEN];
 
@@ -1266,13 +1916,25 @@ pr_pack(char *buf, int cc, struct sockaddr_in *from, struct timeval *tv,
 	cc -= hlen;
 	icp = (struct icmp *)(buf + hlen);
 	if (icp->icmp_type == icmp_type_rsp) {
-		if (icp->icmp_id != ident)
-			return;			/* 'Twas not our ECHO */
+		if (ntargets > 0) {
+			if ((pt = target_lookup(icp->icmp_id)) == NULL)
+				return;		/* 'Twas not our ECHO */
+			++pt->pt_nreceived;
+			dup_tbl = pt->pt_rcvd_tbl;
+			dup_ck = PT_DUP_CHK;
+		} else {
+			if (icp->icmp_id != ident)
+				return;		/* 'Twas not our ECHO */
+			pt = NULL;
+			dup_tbl = rcvd_tbl;
+			dup_ck = mx_dup_ck;
+		}
 		++nreceived;
 		triptime = 0.0;
 		if (timing) {
 			struct timeval tv1;
 			struct tv32 tv32;
+			struct tv64 tv64;
 #ifndef icmp_data
 			tp = &icp->icmp_ip;
 #else
@@ -1281,31 +1943,52 @@ pr_pack(char *buf, int cc, struct sockaddr_in *from, struct timeval *tv,
 			tp = (const char *)tp + phdr_len;
 
 			if (cc - ICMP_MINLEN - phdr_len >= sizeof(tv1)) {
-				/* Copy to avoid alignment problems: */
-				memcpy(&tv32, tp, sizeof(tv32));
-				tv1.tv_sec = ntohl(tv32.tv32_sec);
-				tv1.tv_usec = ntohl(tv32.tv32_usec);
-				tvsub(tv, &tv1);
- 				triptime = ((double)tv->tv_sec) * 1000.0 +
- 				    ((double)tv->tv_usec) / 1000.0;
+				if (options & F_MONOTONIC) {
+					/* Copy to avoid alignment problems: */
+					memcpy(&tv64, tp, sizeof(tv64));
+					triptime = (double)(int64_t)(mono -
+					    ntohll(tv64.tv64_nsec)) / 1000000.0;
+				} else {
+					/* Copy to avoid alignment problems: */
+					memcpy(&tv32, tp, sizeof(tv32));
+					tv1.tv_sec = ntohl(tv32.tv32_sec);
+					tv1.tv_usec = ntohl(tv32.tv32_usec);
+					tvsub(tv, &tv1);
+					triptime = ((double)tv->tv_sec) * 1000.0 +
+					    ((double)tv->tv_usec) / 1000.0;
+				}
 				tsum += triptime;
 				tsumsq += triptime * triptime;
+				if (hist_enabled)
+					hist_add(triptime);
 				if (triptime < tmin)
 					tmin = triptime;
 				if (triptime > tmax)
 					tmax = triptime;
+				if (pt != NULL) {
+					pt->pt_tsum += triptime;
+					pt->pt_tsumsq += triptime * triptime;
+					if (triptime < pt->pt_tmin)
+						pt->pt_tmin = triptime;
+					if (triptime > pt->pt_tmax)
+						pt->pt_tmax = triptime;
+				}
 			} else
 				timing = 0;
 		}
 
 		seq = ntohs(icp->icmp_seq);
 
-		if (TST(seq % mx_dup_ck)) {
+		if (TST(dup_tbl, seq % dup_ck)) {
 			++nrepeats;
 			--nreceived;
+			if (pt != NULL) {
+				++pt->pt_nrepeats;
+				--pt->pt_nreceived;
+			}
 			dupflag = 1;
 		} else {
-			SET(seq % mx_dup_ck);
+			SET(dup_tbl, seq % dup_ck);
 			dupflag = 0;
 		}
 
@@ -1338,7 +2021,7 @@ pr_pack(char *buf, int cc, struct sockaddr_in *from, struct timeval *tv,
 			   seq);
 			(void)printf(" ttl=%d", ip->ip_ttl);
 			if (timing)
-				(void)printf(" time=%.3f ms", triptime);
+				(void)printf(" time=%.*f ms", tprec, triptime);
 			if (tc != -1) {
 				(void)printf(" tc=%d", tc);
 			}
@@ -1412,13 +2095,23 @@ pr_pack(char *buf, int cc, struct sockaddr_in *from, struct timeval *tv,
 		struct ip *oip = (struct ip *)icp->icmp_data;
 #endif
 		struct icmp *oicmp = (struct icmp *)(oip + 1);
+		struct in_addr odst = whereto.sin_addr;
+		int oident = ident;
 
+		if (ntargets > 0) {
+			if ((pt = target_lookup(oicmp->icmp_id)) == NULL)
+				odst.s_addr = INADDR_ANY;
+			else {
+				odst = pt->pt_to.sin_addr;
+				oident = oicmp->icmp_id;
+			}
+		}
 		if (((options & F_VERBOSE) && uid == 0) ||
 		    (!(options & F_QUIET2) &&
-		     (oip->ip_dst.s_addr == whereto.sin_addr.s_addr) &&
+		     (oip->ip_dst.s_addr == odst.s_addr) &&
 		     (oip->ip_p == IPPROTO_ICMP) &&
 		     (oicmp->icmp_type == ICMP_ECHO) &&
-		     (oicmp->icmp_id == ident))) {
+		     (oicmp->icmp_id == oident))) {
 		    if (options & F_PRTIME)
 			    pr_currenttime();
 		    (void)printf("%d bytes from %s: ", cc,
@@ -1518,46 +2211,18 @@ pr_pack(char *buf, int cc, struct sockaddr_in *from, struct timeval *tv,
 }
 
 /*
- * in_cksum --
- *	Checksum routine for Internet Protocol family headers (C Version)
+ * mono_ns --
+ *	Convert mach_absolute_time() units, which is also what the kernel
+ * reports for SO_TIMESTAMP_MONOTONIC, to nanoseconds.
  */
-u_short
-in_cksum(u_short *addr, int len)
+static u_int64_t
+mono_ns(u_int64_t abstime)
 {
-	int nleft, sum;
-	u_short *w;
-	union {
-		u_short	us;
-		u_char	uc[2];
-	} last;
-	u_short answer;
-
-	nleft = len;
-	sum = 0;
-	w = addr;
-
-	/*
-	 * Our algorithm is simple, using a 32 bit accumulator (sum), we add
-	 * sequential 16 bit words to it, and at the end, fold back all the
-	 * carry bits from the top 16 bits into the lower 16 bits.
-	 */
-	while (nleft > 1)  {
-		sum += *w++;
-		nleft -= 2;
-	}
 
-	/* mop up an odd byte, if necessary */
-	if (nleft == 1) {
-		last.uc[0] = *(u_char *)w;
-		last.uc[1] = 0;
-		sum += last.us;
-	}
-
-	/* add back carry outs from top 16 bits to low 16 bits */
-	sum = (sum >> 16) + (sum & 0xffff);	/* add hi 16 to low 16 */
-	sum += (sum >> 16);			/* add carry */
-	answer = ~sum;				/* truncate to 16 bits */
-	return(answer);
+	if (timebase.numer == timebase.denom)
+		return (abstime);
+	return (abstime / timebase.denom * timebase.numer +
+	    abstime % timebase.denom * timebase.numer / timebase.denom);
 }
 
 /*
@@ -1598,8 +2263,11 @@ check_status(void)
 		    nreceived, ntransmitted,
 		    ntransmitted ? nreceived * 100.0 / ntransmitted : 0.0);
 		if (nreceived && timing)
-			(void)fprintf(stderr, " %.3f min / %.3f avg / %.3f max",
-			    tmin, tsum / (nreceived + nrepeats), tmax);
+			(void)fprintf(stderr, " %.*f min / %.*f avg / %.*f max",
+			    tprec, tmin, tprec, tsum / (nreceived + nrepeats),
+			    tprec, tmax);
+		if (hist_total)
+			pr_pcts(stderr, ",");
 		(void)fprintf(stderr, "\n");
 	}
 }
@@ -1616,6 +2284,8 @@ finish(void)
 	(void)signal(SIGALRM, SIG_IGN);
 	(void)putchar('\n');
 	(void)fflush(stdout);
+	if (ntargets > 0)
+		pr_targets();
 	(void)printf("--- %s ping statistics ---\n", hostname);
 	(void)printf("%ld packets transmitted, ", ntransmitted);
 	(void)printf("%ld packets received, ", nreceived);
@@ -1637,9 +2307,16 @@ finish(void)
 		double avg = tsum / n;
 		double vari = tsumsq / n - avg * avg;
 		(void)printf(
-		    "round-trip min/avg/max/stddev = %.3f/%.3f/%.3f/%.3f ms\n",
-		    tmin, avg, tmax, sqrt(vari));
+		    "round-trip min/avg/max/stddev = %.*f/%.*f/%.*f/%.*f ms\n",
+		    tprec, tmin, tprec, avg, tprec, tmax, tprec, sqrt(vari));
+		if (hist_total) {
+			(void)printf("round-trip");
+			pr_pcts(stdout, "");
+			(void)putchar('\n');
+		}
 	}
+	if (hist_file != NULL)
+		hist_dump(hist_file);
 
 	if (nreceived)
 		exit(0);
@@ -1647,6 +2324,165 @@ finish(void)
 		exit(2);
 }
 
+/*
+ * pr_targets --
+ *	Print a one line summary for each target of a multi-target run.
+ */
+static void
+pr_targets(void)
+{
+	struct ping_target *pt;
+	double n, avg;
+	int i;
+
+	for (i = 0; i < ntargets; i++) {
+		pt = &targets[i];
+		(void)printf("%s : xmt/rcv/%%loss = %ld/%ld/%.1f%%", pt->pt_name,
+		    pt->pt_ntransmitted, pt->pt_nreceived,
+		    pt->pt_ntransmitted ? ((pt->pt_ntransmitted -
+		    pt->pt_nreceived) * 100.0) / pt->pt_ntransmitted : 0.0);
+		if (pt->pt_nrepeats)
+			(void)printf(", +%ld duplicates", pt->pt_nrepeats);
+		if (pt->pt_nreceived && timing) {
+			n = pt->pt_nreceived + pt->pt_nrepeats;
+			avg = pt->pt_tsum / n;
+			(void)printf(", min/avg/max/stddev = "
+			    "%.*f/%.*f/%.*f/%.*f ms", tprec, pt->pt_tmin,
+			    tprec, avg, tprec, pt->pt_tmax,
+			    tprec, sqrt(pt->pt_tsumsq / n - avg * avg));
+		}
+		(void)putchar('\n');
+	}
+}
+
+/*
+ * hist_add --
+ *	Count one round trip time, in milliseconds, in the histogram.
+ */
+static void
+hist_add(double ms)
+{
+	u_int64_t us;
+	int idx, shift;
+
+	us = ms > 0.0 ? (u_int64_t)(ms * 1000.0) : 0;
+	if (us < HIST_SUB)
+		idx = (int)us;
+	else {
+		/* shift so that the top bits of us land in [HIST_HALF, HIST_SUB) */
+		shift = 64 - __builtin_clzll(us) - HIST_SUB_BITS;
+		if (shift > HIST_MAXSHIFT)
+			idx = HIST_NBUCKETS - 1;
+		else
+			idx = HIST_SUB + (shift - 1) * HIST_HALF +
+			    (int)(us >> shift) - HIST_HALF;
+	}
+	hist_counts[idx]++;
+	hist_total++;
+}
+
+/*
+ * hist_bucket --
+ *	Return the range of round trip times, in milliseconds, counted in
+ * bucket idx.
+ */
+static void
+hist_bucket(int idx, double *lo, double *hi)
+{
+	int shift;
+
+	if (idx < HIST_SUB) {
+		*lo = idx / 1000.0;
+		*hi = (idx + 1) / 1000.0;
+	} else {
+		shift = (idx - HIST_SUB) / HIST_HALF + 1;
+		*lo = (double)((u_int64_t)((idx - HIST_SUB) % HIST_HALF +
+		    HIST_HALF) << shift) / 1000.0;
+		*hi = *lo + (double)(1ULL << shift) / 1000.0;
+	}
+}
+
+/*
+ * hist_pct --
+ *	Return the p-th percentile of the round trip times seen so far,
+ * as the middle of the bucket it falls in, clamped to the observed
+ * minimum and maximum.
+ */
+static double
+hist_pct(double p)
+{
+	u_int64_t rank, seen;
+	double lo, hi, v;
+	int i;
+
+	rank = (u_int64_t)ceil(p / 100.0 * hist_total);
+	if (rank == 0)
+		rank = 1;
+	seen = 0;
+	for (i = 0; i < HIST_NBUCKETS - 1; i++) {
+		seen += hist_counts[i];
+		if (seen >= rank)
+			break;
+	}
+	hist_bucket(i, &lo, &hi);
+	v = (lo + hi) / 2.0;
+	if (v < tmin)
+		v = tmin;
+	if (v > tmax)
+		v = tmax;
+	return (v);
+}
+
+/*
+ * pr_pcts --
+ *	Print the usual percentiles of the round trip time.
+ */
+static void
+pr_pcts(FILE *fp, const char *sep)
+{
+
+	(void)fprintf(fp, "%s p50/p90/p99/p99.9 = %.*f/%.*f/%.*f/%.*f ms", sep,
+	    tprec, hist_pct(50.0), tprec, hist_pct(90.0),
+	    tprec, hist_pct(99.0), tprec, hist_pct(99.9));
+}
+
+/*
+ * hist_dump --
+ *	Write the non-empty histogram buckets to path ("-" for the standard
+ * output), one per line: the lower and upper bound in milliseconds, the
+ * count and the cumulative fraction of all samples.
+ */
+static void
+hist_dump(const char *path)
+{
+	FILE *fp;
+	u_int64_t seen;
+	double lo, hi;
+	int i;
+
+	if (strcmp(path, "-") == 0)
+		fp = stdout;
+	else if ((fp = fopen(path, "w")) == NULL) {
+		warn("%s", path);
+		return;
+	}
+	(void)fprintf(fp, "# lo_ms hi_ms count cumulative\n");
+	seen = 0;
+	for (i = 0; i < HIST_NBUCKETS; i++) {
+		if (hist_counts[i] == 0)
+			continue;
+		seen += hist_counts[i];
+		hist_bucket(i, &lo, &hi);
+		(void)fprintf(fp, "%.*f %.*f %llu %.6f\n", tprec, lo, tprec, hi,
+		    (unsigned long long)hist_counts[i],
+		    (double)seen / hist_total);
+	}
+	if (fp != stdout)
+		(void)fclose(fp);
+	else
+		(void)fflush(fp);
+}
+
 #ifdef notdef
 static char *ttab[] = {
 	"Echo Reply",		/* ip + seq + udata */
@@ -2087,6 +2923,136 @@ pr_currenttime(void)
 	       (u_int32_t)tv.tv_usec);
 }
 
+/*
+ * cksum_bench --
+ *	Time the checksum of an echo request carrying "size" bytes of data
+ * three ways: the historical 16-bit summing loop, in_cksum(), and the
+ * in_cksum_update() that build_echo() uses when only the sequence number
+ * and the timestamp change between packets.  Nothing is sent.
+ */
+#define	BENCH_SECONDS	3
+
+static u_short
+legacy_cksum(u_short *addr, int len)
+{
+	int nleft, sum;
+	u_short *w;
+	union {
+		u_short	us;
+		u_char	uc[2];
+	} last;
+	u_short answer;
+
+	nleft = len;
+	sum = 0;
+	w = addr;
+
+	while (nleft > 1)  {
+		sum += *w++;
+		nleft -= 2;
+	}
+	if (nleft == 1) {
+		last.uc[0] = *(u_char *)w;
+		last.uc[1] = 0;
+		sum += last.us;
+	}
+	sum = (sum >> 16) + (sum & 0xffff);
+	sum += (sum >> 16);
+	answer = ~sum;
+	return(answer);
+}
+
+static double
+bench_elapsed(struct timespec *from, struct timespec *to)
+{
+	return((to->tv_sec - from->tv_sec) +
+	    (to->tv_nsec - from->tv_nsec) / 1e9);
+}
+
+static void
+cksum_bench(const char *arg)
+{
+	u_char *pkt, ohdr[ICMP_MINLEN + TIMEVAL_LEN];
+	struct icmp *icp;
+	struct tv32 tv32;
+	struct timespec t0, t1;
+	volatile u_short sink;
+	u_short sum;
+	double secs[3];
+	u_long n[3], ultmp;
+	char *ep;
+	int cc, hdrlen, i, k;
+
+	ultmp = strtoul(arg, &ep, 0);
+	if (*ep || ep == arg || ultmp < TIMEVAL_LEN ||
+	    ultmp > IP_MAXPACKET - sizeof(struct ip) - ICMP_MINLEN)
+		errx(EX_USAGE, "invalid packet size: `%s'", arg);
+	cc = ICMP_MINLEN + ultmp;
+	hdrlen = ICMP_MINLEN + TIMEVAL_LEN;
+
+	/* the legacy loop reads whole u_shorts, so keep it aligned */
+	if ((pkt = calloc(1, cc + 1)) == NULL)
+		err(EX_OSERR, "calloc");
+	icp = (struct icmp *)pkt;
+	icp->icmp_type = ICMP_ECHO;
+	icp->icmp_id = htons(getpid() & 0xFFFF);
+	for (i = hdrlen; i < cc; i++)
+		pkt[i] = i;
+
+	sum = in_cksum(pkt, cc);
+	if (legacy_cksum((u_short *)pkt, cc) != sum)
+		errx(EX_SOFTWARE, "in_cksum disagrees with the legacy loop");
+
+	for (k = 0; k < 3; k++) {
+		icp->icmp_cksum = sum;
+		n[k] = 0;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		do {
+			for (i = 0; i < 1000; i++) {
+				switch (k) {
+				case 0:
+					sink = legacy_cksum((u_short *)pkt, cc);
+					break;
+				case 1:
+					sink = in_cksum(pkt, cc);
+					break;
+				case 2:
+					/* what build_echo() does per packet */
+					memcpy(ohdr, pkt, hdrlen);
+					bzero(&ohdr[offsetof(struct icmp,
+					    icmp_cksum)], sizeof(icp->icmp_cksum));
+					icp->icmp_seq = htons(n[k] + i);
+					tv32.tv32_sec = htonl(n[k] + i);
+					tv32.tv32_usec = htonl(i);
+					memcpy(&pkt[ICMP_MINLEN], &tv32,
+					    sizeof(tv32));
+					icp->icmp_cksum = 0;
+					sum = in_cksum_update(sum, ohdr, pkt,
+					    hdrlen);
+					icp->icmp_cksum = sum;
+					break;
+				}
+			}
+			n[k] += i;
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+		} while (bench_elapsed(&t0, &t1) < BENCH_SECONDS);
+		secs[k] = bench_elapsed(&t0, &t1);
+	}
+	(void)sink;
+
+	/* the incrementally maintained sum must match a full recompute */
+	icp->icmp_cksum = 0;
+	if (in_cksum(pkt, cc) != sum)
+		errx(EX_SOFTWARE, "in_cksum_update drifted from in_cksum");
+
+	printf("%d byte echo request:\n", cc);
+	printf("    legacy loop      %8.1f ns/packet\n", secs[0] * 1e9 / n[0]);
+	printf("    in_cksum         %8.1f ns/packet\n", secs[1] * 1e9 / n[1]);
+	printf("    in_cksum_update  %8.1f ns/packet\n", secs[2] * 1e9 / n[2]);
+	free(pkt);
+	exit(0);
+}
+
 #if defined(IPSEC) && defined(IPSEC_POLICY_IPSEC)
 #define	SECOPT		" [-P policy]"
 #else
@@ -2112,5 +3078,11 @@ usage(void)
 	(void)fprintf(stderr, "            -K net_service_type  # set traffic class socket options\n");
 	(void)fprintf(stderr, "            --apple-connect       # call connect(2) in the socket\n");
 	(void)fprintf(stderr, "            --apple-time          # display current time\n");
+	(void)fprintf(stderr, "            --apple-targets file  # ping every host listed in file\n");
+	(void)fprintf(stderr, "            --apple-batch count   # send and receive in bursts of count\n");
+	(void)fprintf(stderr, "            --apple-monotonic     # time packets with the monotonic clock\n");
+	(void)fprintf(stderr, "            --apple-percentiles   # report round-trip percentiles\n");
+	(void)fprintf(stderr, "            --apple-histogram file # also write the round-trip histogram to file\n");
+	(void)fprintf(stderr, "            --apple-cksum-bench size # time the echo request checksum and exit\n");
 	exit(EX_USAGE);
 }
@@ -117,3 +117,11 @@
 	{"xresolve", K_XRESOLVE},
 #define	K_IFSCOPE	46
 	{"ifscope", K_IFSCOPE},
+#define	K_BINARY	47
+	{"binary", K_BINARY},
+#define	K_COMPACT	48
+	{"compact", K_COMPACT},
+#define	K_STATS	49
+	{"stats", K_STATS},
+#define	K_TYPE	50
+	{"type", K_TYPE},
@@ -71,6 +71,8 @@ __unused static const char copyright[] =
 #include "../bsd/sys/socket.h"
 #include "../bsd/sys/ioctl.h"
 #include <sys/sysctl.h>
+#include <sys/time.h>
+#include <sys/uio.h>
 #include <sys/types.h>
 
 #include "../bsd/net/if.h"
@@ -83,7 +85,10 @@ __unused static const char copyright[] =
 #include <ctype.h>
 #include <err.h>
 #include <errno.h>
+#include <limits.h>
 #include <paths.h>
+#include <signal.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -125,8 +130,11 @@ const char *routename(struct sockaddr*);
 const char *netname(struct sockaddr*);
 void flushroutes(int, char**);
 void newroute(int, char**);
+void batchroutes(const char *);
+static int routeargs(int, char **, int *, char **, char **, struct hostent **);
+static int rtmsg_build(int, int);
 void interfaces(void);
-void monitor(void);
+void monitor(int, char **);
 void sockaddr(register char*, register struct sockaddr*);
 void sodump(register sup, char*);
 void bprintf(register FILE*, register int, register char*);
@@ -153,7 +161,8 @@ usage(const char *cp)
 	if (cp)
 		warnx("bad keyword: %s", cp);
 	(void) fprintf(stderr,
-	    "usage: route [-dnqtv] command [[modifiers] args]\n");
+	    "usage: route [-dnqtv] command [[modifiers] args]\n"
+	    "       route [-dnqtv] -b file\n");
 	exit(EX_USAGE);
 	/* NOTREACHED */
 }
@@ -166,12 +175,16 @@ int
 main(int argc, char **argv)
 {
 	int ch;
+	char *batchfile = NULL;
 
 	if (argc < 2)
 		usage((char *)NULL);
 
-	while ((ch = getopt(argc, argv, "nqdtv")) != -1)
+	while ((ch = getopt(argc, argv, "b:nqdtv")) != -1)
 		switch(ch) {
+		case 'b':
+			batchfile = optarg;
+			break;
 		case 'n':
 			nflag = 1;
 			break;
@@ -203,6 +216,12 @@ main(int argc, char **argv)
 	if (s < 0)
 		err(EX_OSERR, "socket");
 	setuid(uid);
+	if (batchfile != NULL) {
+		if (*argv)
+			usage(*argv);
+		batchroutes(batchfile);
+		/* NOTREACHED */
+	}
 	if (*argv)
 		switch (keyword(*argv)) {
 		case K_GET:
@@ -217,7 +236,7 @@ main(int argc, char **argv)
 			/* NOTREACHED */
 
 		case K_MONITOR:
-			monitor();
+			monitor(argc, argv);
 			/* NOTREACHED */
 
 		case K_FLUSH:
@@ -229,6 +248,63 @@ main(int argc, char **argv)
 	/* NOTREACHED */
 }
 
+/*
+ * Read the replies to our own messages numbered seq0 to seq0 + n - 1
+ * off the routing socket, passing the index and rtm_errno of each one
+ * to fn, and return how many were read.  Without a timeout, return as
+ * soon as the socket is empty; with one, keep waiting until want
+ * replies have been read or nothing arrives for that long.
+ */
+static int
+rtsock_drain(int seq0, int n, void (*fn)(int, int), int want,
+    struct timeval *timeout)
+{
+	static char *rbuf;
+	struct rt_msghdr *rtm;
+	struct timeval tv;
+	fd_set rfds;
+	ssize_t len;
+	int i, got = 0;
+
+	if (rbuf == NULL && (rbuf = malloc(8192)) == NULL)
+		errx(EX_OSERR, "malloc failed");
+	for (;;) {
+		len = recv(s, rbuf, 8192, MSG_DONTWAIT);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == ENOBUFS)	/* some replies were lost */
+				continue;
+			if (errno != EAGAIN || timeout == NULL || got >= want)
+				return (got);
+			FD_ZERO(&rfds);
+			FD_SET(s, &rfds);
+			tv = *timeout;
+			if (select(s + 1, &rfds, NULL, NULL, &tv) <= 0)
+				return (got);
+			continue;
+		}
+		rtm = (struct rt_msghdr *)rbuf;
+		if (len < (ssize_t)sizeof(*rtm) || rtm->rtm_pid != pid ||
+		    rtm->rtm_version != RTM_VERSION)
+			continue;
+		i = rtm->rtm_seq - seq0;
+		if (i < 0 || i >= n)
+			continue;
+		(*fn)(i, rtm->rtm_errno);
+		got++;
+	}
+}
+
+static u_char *flushstatus;	/* errno of each delete, 0 if it worked */
+
+static void
+flush_reply(int i, int error)
+{
+	if (error != 0)
+		flushstatus[i] = error > UCHAR_MAX ? UCHAR_MAX : error;
+}
+
 /*
  * Purge all entries in the routing tables not
  * associated with network interfaces.
@@ -237,14 +313,16 @@ void
 flushroutes(int argc, char *argv[])
 {
 	size_t needed;
-	int mib[6], rlen, seqno;
+	int mib[6], ncand, i, want, failed;
+	int rcvbuf = 4 * 1024 * 1024;
 	char *buf, *next, *lim;
 	register struct rt_msghdr *rtm;
+	u_int32_t *cand;
+	struct timeval timeout;
 
 	if (uid) {
 		errx(EX_NOPERM, "must be root to alter routing table");
 	}
-	shutdown(s, 0); /* Don't want to read back our messages */
 	if (argc > 1) {
 		argv++;
 		if (argc == 2 && **argv == '-')
@@ -278,9 +356,16 @@ bad:			usage(*argv);
 	if (sysctl(mib, 6, buf, &needed, NULL, 0) < 0)
 		err(EX_OSERR, "route-sysctl-get");
 	lim = buf + needed;
+
+	/*
+	 * Pick the routes to delete in one pass over the dump,
+	 * remembering where each one starts.
+	 */
+	if ((cand = malloc((needed / sizeof(*rtm) + 1) * sizeof(*cand))) == NULL)
+		errx(EX_OSERR, "malloc failed");
 	if (verbose)
 		(void) printf("Examining routing table from sysctl\n");
-	seqno = 0;		/* ??? */
+	ncand = 0;
 	for (next = buf; next < lim; next += rtm->rtm_msglen) {
 		rtm = (struct rt_msghdr *)next;
 		if (verbose)
@@ -293,32 +378,73 @@ bad:			usage(*argv);
 			if (sa->sa_family != af)
 				continue;
 		}
-		if (debugonly)
-			continue;
+		cand[ncand++] = next - buf;
+	}
+	if (debugonly)
+		return;
+
+	/*
+	 * Send all the deletes back to back, reading the replies as we go
+	 * so the socket buffer doesn't overflow.  A write that fails
+	 * reports the error itself; one that succeeds may still have been
+	 * refused, which only its reply, matched by rtm_seq, tells us.
+	 */
+	if ((flushstatus = calloc(ncand + 1, 1)) == NULL)
+		errx(EX_OSERR, "malloc failed");
+	if (!tflag)
+		(void) setsockopt(s, SOL_SOCKET, SO_RCVBUF, &rcvbuf,
+		    sizeof(rcvbuf));
+	want = 0;
+	for (i = 0; i < ncand; i++) {
+		rtm = (struct rt_msghdr *)(buf + cand[i]);
 		rtm->rtm_type = RTM_DELETE;
-		rtm->rtm_seq = seqno;
-		rlen = write(s, next, rtm->rtm_msglen);
-		if (rlen < (int)rtm->rtm_msglen) {
-			warn("write to routing socket");
-			(void) printf("got only %d for rlen\n", rlen);
-			break;
-		}
-		seqno++;
+		rtm->rtm_seq = i + 1;
+		if (write(s, rtm, rtm->rtm_msglen) < 0)
+			flush_reply(i, errno);
+		else
+			want++;
+		if (!tflag && (i & 63) == 63)
+			want -= rtsock_drain(1, ncand, flush_reply, 0, NULL);
+	}
+	if (!tflag) {
+		timeout.tv_sec = 1;
+		timeout.tv_usec = 0;
+		(void) rtsock_drain(1, ncand, flush_reply, want, &timeout);
+	}
+
+	failed = 0;
+	for (i = 0; i < ncand; i++) {
+		if (flushstatus[i] != 0)
+			failed++;
 		if (qflag)
 			continue;
+		rtm = (struct rt_msghdr *)(buf + cand[i]);
 		if (verbose)
-			print_rtmsg(rtm, rlen);
+			print_rtmsg(rtm, rtm->rtm_msglen);
 		else {
 			struct sockaddr *sa = (struct sockaddr *)(rtm + 1);
 			(void) printf("%-20.20s ", rtm->rtm_flags & RTF_HOST ?
 			    routename(sa) : netname(sa));
 			sa = (struct sockaddr *)(ROUNDUP(sa->sa_len) + (char *)sa);
 			(void) printf("%-20.20s ", routename(sa));
-			(void) printf("done\n");
+			if (flushstatus[i] == 0)
+				(void) printf("done\n");
+			else
+				(void) printf("%s\n",
+				    route_strerror(flushstatus[i]));
 		}
 	}
+	if (!qflag)
+		(void) printf("%d route%s flushed, %d failed\n",
+		    ncand - failed, ncand - failed == 1 ? "" : "s", failed);
 }
 
+static struct hcache {
+	struct in_addr	hc_addr;
+	char		*hc_name;	/* NULL if it has none */
+	int		hc_valid;
+} hcache[256];
+
 const char *
 routename(struct sockaddr *sa)
 {
@@ -350,13 +476,29 @@ routename(struct sockaddr *sa)
 		if (in.s_addr == INADDR_ANY || sa->sa_len < 4)
 			cp = "default";
 		if (cp == 0 && !nflag) {
-			hp = gethostbyaddr((char *)&in, sizeof (struct in_addr),
-				AF_INET);
-			if (hp) {
-				if ((cp = index(hp->h_name, '.')) &&
-				    !strcmp(cp + 1, domain))
-					*cp = 0;
-				cp = hp->h_name;
+			/*
+			 * A flush names the same few gateways over and
+			 * over, so remember the last answer in each slot.
+			 */
+			struct hcache *hc;
+
+			hc = &hcache[(ntohl(in.s_addr) * 2654435761U) >> 24];
+
+			if (hc->hc_valid && hc->hc_addr.s_addr == in.s_addr)
+				cp = hc->hc_name;
+			else {
+				hp = gethostbyaddr((char *)&in,
+				    sizeof (struct in_addr), AF_INET);
+				if (hp) {
+					if ((cp = index(hp->h_name, '.')) &&
+					    !strcmp(cp + 1, domain))
+						*cp = 0;
+					cp = hp->h_name;
+				}
+				free(hc->hc_name);
+				hc->hc_addr = in;
+				hc->hc_name = cp ? strdup(cp) : NULL;
+				hc->hc_valid = 1;
 			}
 		}
 		if (cp) {
@@ -565,8 +707,7 @@ void
 newroute(int argc, register char **argv)
 {
 	char *cmd, *dest = "", *gateway = "";
-	int ishost = 0, ret, attempts, oerrno, flags = RTF_STATIC;
-	int key;
+	int ishost, ret, attempts, oerrno, flags = RTF_STATIC;
 	struct hostent *hp = 0;
 
 	if (uid) {
@@ -575,6 +716,49 @@ newroute(int argc, register char **argv)
 	cmd = argv[0];
 	if (*cmd != 'g')
 		shutdown(s, 0); /* Don't want to read back our messages */
+	ishost = routeargs(argc, argv, &flags, &dest, &gateway, &hp);
+	for (attempts = 1; ; attempts++) {
+		errno = 0;
+		if ((ret = rtmsg(*cmd, flags)) == 0)
+			break;
+		if (errno != ENETUNREACH && errno != ESRCH)
+			break;
+		if (af == AF_INET && *gateway && hp && hp->h_addr_list[1]) {
+			hp->h_addr_list++;
+			bcopy(hp->h_addr_list[0], &so_gate.sin.sin_addr,
+			    MIN(hp->h_length, sizeof(so_gate.sin.sin_addr)));
+		} else
+			break;
+	}
+	if (*cmd == 'g')
+		exit(0);
+	oerrno = errno;
+	(void) printf("%s %s %s", cmd, ishost? "host" : "net", dest);
+	if (*gateway) {
+		(void) printf(": gateway %s", gateway);
+		if (attempts > 1 && ret == 0 && af == AF_INET)
+		    (void) printf(" (%s)", inet_ntoa(so_gate.sin.sin_addr));
+	}
+	if (ret == 0)
+		(void) printf("\n");
+	else {
+		(void)printf(": %s\n", route_strerror(oerrno));
+	}
+}
+
+/*
+ * Parse the modifiers and arguments of an add, change, delete or get
+ * command into so_dst and friends, returning 1 for a host route.
+ * *flagsp comes in with the default flags and goes out with the
+ * flags for the routing message.
+ */
+static int
+routeargs(int argc, char **argv, int *flagsp, char **destp, char **gatewayp,
+    struct hostent **hpp)
+{
+	int ishost = 0, flags = *flagsp;
+	int key;
+
 	while (--argc > 0) {
 		if (**(++argv)== '-') {
 			switch (key = keyword(1 + *argv)) {
@@ -659,8 +843,8 @@ newroute(int argc, register char **argv)
 			case K_DST:
 				if (!--argc)
 					usage((char *)NULL);
-				ishost = getaddr(RTA_DST, *++argv, &hp);
-				dest = *argv;
+				ishost = getaddr(RTA_DST, *++argv, hpp);
+				*destp = *argv;
 				break;
 			case K_NETMASK:
 				if (!--argc)
@@ -706,11 +890,11 @@ newroute(int argc, register char **argv)
 			}
 		} else {
 			if ((rtm_addrs & RTA_DST) == 0) {
-				dest = *argv;
-				ishost = getaddr(RTA_DST, *argv, &hp);
+				*destp = *argv;
+				ishost = getaddr(RTA_DST, *argv, hpp);
 			} else if ((rtm_addrs & RTA_GATEWAY) == 0) {
-				gateway = *argv;
-				(void) getaddr(RTA_GATEWAY, *argv, &hp);
+				*gatewayp = *argv;
+				(void) getaddr(RTA_GATEWAY, *argv, hpp);
 			} else {
 				(void) getaddr(RTA_NETMASK, *argv, 0);
 			}
@@ -742,33 +926,8 @@ newroute(int argc, register char **argv)
 			if (((so_mask.sin.sin_addr.s_addr) & ntohl((1 << i))) == 0)
 				errx(EX_NOHOST, "invalid mask: %s", inet_ntoa(so_mask.sin.sin_addr));
 	}
-	for (attempts = 1; ; attempts++) {
-		errno = 0;
-		if ((ret = rtmsg(*cmd, flags)) == 0)
-			break;
-		if (errno != ENETUNREACH && errno != ESRCH)
-			break;
-		if (af == AF_INET && *gateway && hp && hp->h_addr_list[1]) {
-			hp->h_addr_list++;
-			bcopy(hp->h_addr_list[0], &so_gate.sin.sin_addr,
-			    MIN(hp->h_length, sizeof(so_gate.sin.sin_addr)));
-		} else
-			break;
-	}
-	if (*cmd == 'g')
-		exit(0);
-	oerrno = errno;
-	(void) printf("%s %s %s", cmd, ishost? "host" : "net", dest);
-	if (*gateway) {
-		(void) printf(": gateway %s", gateway);
-		if (attempts > 1 && ret == 0 && af == AF_INET)
-		    (void) printf(" (%s)", inet_ntoa(so_gate.sin.sin_addr));
-	}
-	if (ret == 0)
-		(void) printf("\n");
-	else {
-		(void)printf(": %s\n", route_strerror(oerrno));
-	}
+	*flagsp = flags;
+	return (ishost);
 }
 
 static void
@@ -1109,17 +1268,392 @@ interfaces()
 	}
 }
 
+/*
+ * Fast monitor: filter routing messages on their headers, print what
+ * is left as one line each (or copy it out raw), and keep count.
+ */
+static const char *const rtmnames[] = {
+	"", "add", "delete", "change", "get", "losing", "redirect", "miss",
+	"lock", "oldadd", "olddel", "resolve", "newaddr", "deladdr",
+	"ifinfo", "newmaddr", "delmaddr",
+};
+#define	NRTMNAMES	(sizeof(rtmnames) / sizeof(rtmnames[0]))
+
+static volatile sig_atomic_t mon_stop;
+
+static void
+mon_catch(int sig __unused)
+{
+	mon_stop = 1;
+}
+
+static u_int32_t
+mon_types(char *list)
+{
+	u_int32_t mask = 0;
+	char *cp;
+	u_int i;
+
+	while ((cp = strsep(&list, ",")) != NULL) {
+		for (i = 1; i < NRTMNAMES; i++)
+			if (strcmp(cp, rtmnames[i]) == 0)
+				break;
+		if (i == NRTMNAMES)
+			errx(EX_USAGE, "unknown message type: %s", cp);
+		mask |= 1 << i;
+	}
+	return (mask);
+}
+
+/*
+ * Interface index and first address of a message, from whichever
+ * header it carries.  The second versions of each header only add
+ * fields at the end.  Returns -1 if the n bytes read are too few to
+ * hold the header.
+ */
+static int
+mon_header(struct rt_msghdr *rtm, ssize_t n, u_short *indexp, int *addrsp,
+    struct sockaddr **sap)
+{
+	size_t len;
+
+	switch (rtm->rtm_type) {
+	case RTM_IFINFO:
+	case RTM_IFINFO2:
+		len = rtm->rtm_type == RTM_IFINFO ?
+		    sizeof(struct if_msghdr) : sizeof(struct if_msghdr2);
+		if (n < (ssize_t)len)
+			return (-1);
+		*indexp = ((struct if_msghdr *)rtm)->ifm_index;
+		*addrsp = ((struct if_msghdr *)rtm)->ifm_addrs;
+		break;
+	case RTM_NEWADDR:
+	case RTM_DELADDR:
+		len = sizeof(struct ifa_msghdr);
+		if (n < (ssize_t)len)
+			return (-1);
+		*indexp = ((struct ifa_msghdr *)rtm)->ifam_index;
+		*addrsp = ((struct ifa_msghdr *)rtm)->ifam_addrs;
+		break;
+#ifdef RTM_NEWMADDR
+	case RTM_NEWMADDR:
+	case RTM_DELMADDR:
+	case RTM_NEWMADDR2:
+		len = rtm->rtm_type == RTM_NEWMADDR2 ?
+		    sizeof(struct ifma_msghdr2) : sizeof(struct ifma_msghdr);
+		if (n < (ssize_t)len)
+			return (-1);
+		*indexp = ((struct ifma_msghdr *)rtm)->ifmam_index;
+		*addrsp = ((struct ifma_msghdr *)rtm)->ifmam_addrs;
+		break;
+#endif
+	default:
+		len = rtm->rtm_type == RTM_GET2 ?
+		    sizeof(struct rt_msghdr2) : sizeof(struct rt_msghdr);
+		if (n < (ssize_t)len)
+			return (-1);
+		*indexp = rtm->rtm_index;
+		*addrsp = rtm->rtm_addrs;
+		break;
+	}
+	*sap = (struct sockaddr *)((char *)rtm + len);
+	return (0);
+}
+
+/*
+ * Numeric form of an address, with the prefix length of mask if one
+ * is given.  The names are left to the slow path.
+ */
+static char *
+mon_ntop(struct sockaddr *sa, struct sockaddr *mask, char *buf, size_t len)
+{
+	struct sockaddr_dl *sdl;
+	u_char *cp, *lim, b;
+	size_t off;
+	int bits;
+
+	switch (sa->sa_family) {
+	case AF_INET:
+		inet_ntop(AF_INET, &((struct sockaddr_in *)sa)->sin_addr,
+		    buf, len);
+		off = offsetof(struct sockaddr_in, sin_addr);
+		break;
+#ifdef INET6
+	case AF_INET6:
+		inet_ntop(AF_INET6, &((struct sockaddr_in6 *)sa)->sin6_addr,
+		    buf, len);
+		off = offsetof(struct sockaddr_in6, sin6_addr);
+		break;
+#endif
+	case AF_LINK:
+		sdl = (struct sockaddr_dl *)sa;
+		if (sdl->sdl_nlen == 0 && sdl->sdl_alen == 0)
+			snprintf(buf, len, "link#%d", sdl->sdl_index);
+		else
+			strlcpy(buf, link_ntoa(sdl), len);
+		return (buf);
+	default:
+		snprintf(buf, len, "af%d", sa->sa_family);
+		return (buf);
+	}
+	if (mask == NULL)
+		return (buf);
+	/* masks come trimmed to their last nonzero byte */
+	bits = 0;
+	lim = (u_char *)mask + mask->sa_len;
+	for (cp = (u_char *)mask + off; cp < lim && *cp == 0xff; cp++)
+		bits += 8;
+	if (cp < lim)
+		for (b = *cp; b & 0x80; b <<= 1)
+			bits++;
+	snprintf(buf + strlen(buf), len - strlen(buf), "/%d", bits);
+	return (buf);
+}
+
+static void
+mon_print(struct rt_msghdr *rtm, ssize_t n, struct timeval *tv,
+    u_short index, int addrs, struct sockaddr *sa)
+{
+	static char ifnames[256][IFNAMSIZ];
+	struct sockaddr *rti[RTAX_MAX];
+	char ifname[IFNAMSIZ], a1[INET6_ADDRSTRLEN + 8], a2[INET6_ADDRSTRLEN + 8];
+	char *cp = (char *)sa, *lim = (char *)rtm + n;
+	struct tm *tm;
+	int i;
+
+	for (i = 0; i < RTAX_MAX; i++)
+		rti[i] = NULL;
+	for (i = 0; i < RTAX_MAX; i++) {
+		if ((addrs & (1 << i)) == 0)
+			continue;
+		/* stop at an address running past the end of the message */
+		if (cp + offsetof(struct sockaddr, sa_data) > lim ||
+		    cp + ((struct sockaddr *)cp)->sa_len > lim)
+			break;
+		rti[i] = (struct sockaddr *)cp;
+		ADVANCE(cp, rti[i]);
+	}
+	if (index < 256) {
+		/* interfaces rarely change name; forget it when one changes */
+		if (rtm->rtm_type == RTM_IFINFO)
+			ifnames[index][0] = '\0';
+		if (ifnames[index][0] == '\0' &&
+		    if_indextoname(index, ifnames[index]) == NULL)
+			snprintf(ifnames[index], IFNAMSIZ, "if%d", index);
+		strlcpy(ifname, ifnames[index], sizeof(ifname));
+	} else if (if_indextoname(index, ifname) == NULL)
+		snprintf(ifname, sizeof(ifname), "if%d", index);
+
+	tm = localtime(&tv->tv_sec);
+	(void) printf("%02d:%02d:%02d.%06d ", tm->tm_hour, tm->tm_min,
+	    tm->tm_sec, (int)tv->tv_usec);
+	if (rtm->rtm_type < NRTMNAMES)
+		(void) printf("%s", rtmnames[rtm->rtm_type]);
+	else
+		(void) printf("type%d", rtm->rtm_type);
+	switch (rtm->rtm_type) {
+	case RTM_IFINFO:
+		(void) printf(" %s flags 0x%x\n", ifname,
+		    ((struct if_msghdr *)rtm)->ifm_flags);
+		break;
+	case RTM_NEWADDR:
+	case RTM_DELADDR:
+		(void) printf(" %s %s\n", ifname, rti[RTAX_IFA] == NULL ? "-" :
+		    mon_ntop(rti[RTAX_IFA], rti[RTAX_NETMASK], a1, sizeof(a1)));
+		break;
+#ifdef RTM_NEWMADDR
+	case RTM_NEWMADDR:
+	case RTM_DELMADDR:
+		(void) printf(" %s %s\n", ifname, rti[RTAX_IFA] == NULL ? "-" :
+		    mon_ntop(rti[RTAX_IFA], NULL, a1, sizeof(a1)));
+		break;
+#endif
+	default:
+		(void) printf(" %s %s %s flags 0x%x pid %ld seq %d",
+		    rti[RTAX_DST] == NULL ? "-" :
+		    mon_ntop(rti[RTAX_DST], (rtm->rtm_flags & RTF_HOST) ?
+		    NULL : rti[RTAX_NETMASK], a1, sizeof(a1)),
+		    rti[RTAX_GATEWAY] == NULL ? "-" :
+		    mon_ntop(rti[RTAX_GATEWAY], NULL, a2, sizeof(a2)),
+		    ifname, rtm->rtm_flags, (long)rtm->rtm_pid, rtm->rtm_seq);
+		if (rtm->rtm_errno)
+			(void) printf(" errno %d", rtm->rtm_errno);
+		(void) putchar('\n');
+		break;
+	}
+}
+
+static void
+mon_fast(u_int32_t types, int family, u_int ifindex, int binary, int stats)
+{
+	struct rt_msghdr *rtm;
+	struct sockaddr *sa;
+	struct sigaction sact;
+	struct timeval now, last, tv;
+	struct iovec iov[2];
+	u_int32_t stamp[2];
+	u_int64_t total[NRTMNAMES + 1], nmsgs = 0, nshown = 0, ndrops = 0;
+	u_int persec = 0, pershown = 0, perdrops = 0;
+	fd_set rfds;
+	char *buf;
+	ssize_t n;
+	u_short index;
+	int addrs, rcvbuf;
+	size_t bufsize = 65536;
+	u_int i;
+
+	/* ask for the largest receive buffer the system allows */
+	for (rcvbuf = 8 * 1024 * 1024; rcvbuf >= 65536; rcvbuf /= 2)
+		if (setsockopt(s, SOL_SOCKET, SO_RCVBUF, &rcvbuf,
+		    sizeof(rcvbuf)) == 0)
+			break;
+	if ((buf = malloc(bufsize)) == NULL)
+		errx(EX_OSERR, "malloc failed");
+	(void) setvbuf(stdout, NULL, _IOFBF, 1024 * 1024);
+	memset(total, 0, sizeof(total));
+	memset(&sact, 0, sizeof(sact));
+	sact.sa_handler = mon_catch;
+	(void) sigaction(SIGINT, &sact, NULL);	/* no SA_RESTART */
+	(void) sigaction(SIGTERM, &sact, NULL);
+	(void) gettimeofday(&last, NULL);
+
+	while (!mon_stop) {
+		/* sleep until something arrives, then empty the socket */
+		FD_ZERO(&rfds);
+		FD_SET(s, &rfds);
+		tv.tv_sec = 1;
+		tv.tv_usec = 0;
+		if (select(s + 1, &rfds, NULL, NULL, stats ? &tv : NULL) < 0 &&
+		    errno != EINTR)
+			err(EX_OSERR, "select");
+		for (;;) {
+			n = recv(s, buf, bufsize, MSG_DONTWAIT);
+			if (n < 0) {
+				if (errno == ENOBUFS) {
+					/* the socket overflowed */
+					ndrops++;
+					perdrops++;
+					continue;
+				}
+				if (errno == EAGAIN || errno == EINTR)
+					break;
+				err(EX_OSERR, "read from routing socket");
+			}
+			rtm = (struct rt_msghdr *)buf;
+			if (n < (ssize_t)offsetof(struct rt_msghdr, rtm_index) ||
+			    rtm->rtm_version != RTM_VERSION)
+				continue;
+			nmsgs++;
+			persec++;
+			total[rtm->rtm_type < NRTMNAMES ? rtm->rtm_type :
+			    NRTMNAMES]++;
+			if (types != 0 && (rtm->rtm_type >= 32 ||
+			    (types & (1 << rtm->rtm_type)) == 0))
+				continue;
+			if (mon_header(rtm, n, &index, &addrs, &sa) < 0)
+				continue;
+			if (ifindex != 0 && index != ifindex)
+				continue;
+			if (family != 0 && (addrs == 0 ||
+			    (char *)sa + sizeof(*sa) > buf + n ||
+			    sa->sa_family != family))
+				continue;
+			nshown++;
+			pershown++;
+			(void) gettimeofday(&now, NULL);
+			if (binary) {
+				stamp[0] = (u_int32_t)now.tv_sec;
+				stamp[1] = (u_int32_t)now.tv_usec;
+				iov[0].iov_base = (char *)stamp;
+				iov[0].iov_len = sizeof(stamp);
+				iov[1].iov_base = buf;
+				iov[1].iov_len = n;
+				if (writev(STDOUT_FILENO, iov, 2) < 0)
+					err(EX_IOERR, "write");
+			} else
+				mon_print(rtm, n, &now, index, addrs, sa);
+		}
+		if (!binary)
+			(void) fflush(stdout);
+		if (stats) {
+			(void) gettimeofday(&now, NULL);
+			if (now.tv_sec != last.tv_sec) {
+				fprintf(stderr, "%u msg/s, %u shown, %u dropped\n",
+				    persec, pershown, perdrops);
+				persec = pershown = perdrops = 0;
+				last = now;
+			}
+		}
+	}
+	(void) fflush(stdout);
+	if (stats) {
+		fprintf(stderr, "%llu messages, %llu shown, %llu overflows\n",
+		    (unsigned long long)nmsgs, (unsigned long long)nshown,
+		    (unsigned long long)ndrops);
+		for (i = 1; i <= NRTMNAMES; i++)
+			if (total[i] != 0)
+				fprintf(stderr, "\t%llu %s\n",
+				    (unsigned long long)total[i],
+				    i < NRTMNAMES ? rtmnames[i] : "other");
+	}
+	exit(0);
+}
+
 void
-monitor()
+monitor(int argc, char **argv)
 {
 	int n;
 	char msg[2048];
+	u_int32_t types = 0;
+	u_int ifindex = 0;
+	int family = 0, binary = 0, compact = 0, stats = 0;
 
+	while (--argc > 0) {
+		if (**(++argv) != '-')
+			usage(*argv);
+		switch (keyword(1 + *argv)) {
+		case K_INET:
+			family = AF_INET;
+			break;
+#ifdef INET6
+		case K_INET6:
+			family = AF_INET6;
+			break;
+#endif
+		case K_LINK:
+			family = AF_LINK;
+			break;
+		case K_IFP:
+			if (!--argc)
+				usage((char *)NULL);
+			if ((ifindex = if_nametoindex(*++argv)) == 0)
+				errx(1, "bad interface name");
+			break;
+		case K_TYPE:
+			if (!--argc)
+				usage((char *)NULL);
+			types = mon_types(*++argv);
+			break;
+		case K_COMPACT:
+			compact = 1;
+			break;
+		case K_BINARY:
+			binary = 1;
+			break;
+		case K_STATS:
+			stats = 1;
+			break;
+		default:
+			usage(1 + *argv);
+		}
+	}
 	verbose = 1;
 	if (debugonly) {
 		interfaces();
 		exit(0);
 	}
+	if (types || family || ifindex || compact || binary || stats)
+		mon_fast(types, family, ifindex, binary, stats);
 	for(;;) {
 		time_t now;
 		n = read(s, msg, 2048);
@@ -1134,11 +1668,15 @@ struct {
 	char	m_space[512];
 } m_rtmsg;
 
-int
-rtmsg(int cmd, int flags)
+static int seq;
+
+/*
+ * Build the routing message for cmd in m_rtmsg from so_dst and friends,
+ * returning its length.
+ */
+static int
+rtmsg_build(int cmd, int flags)
 {
-	static int seq;
-	int rlen;
 	register char *cp = m_rtmsg.m_space;
 	register int l;
 
@@ -1184,6 +1722,19 @@ rtmsg(int cmd, int flags)
 	rtm.rtm_msglen = l = cp - (char *)&m_rtmsg;
 	if (verbose)
 		print_rtmsg(&rtm, l);
+	return (l);
+#undef rtm
+}
+
+int
+rtmsg(int cmd, int flags)
+{
+	int rlen;
+	register int l;
+
+	l = rtmsg_build(cmd, flags);
+	cmd = m_rtmsg.m_rtm.rtm_type;
+#define rtm m_rtmsg.m_rtm
 	if (debugonly)
 		return (0);
 	if ((rlen = write(s, (char *)&m_rtmsg, l)) < 0) {
@@ -1203,6 +1754,237 @@ rtmsg(int cmd, int flags)
 	return (0);
 }
 
+/*
+ * Batch mode: apply the add, change and delete commands in a file, one
+ * per line, over a single routing socket.  The whole file is parsed
+ * before anything is written, so a bad line leaves the routing table
+ * untouched; the messages are then written back to back and the kernel's
+ * answers are matched to lines by rtm_seq.
+ */
+struct bline {
+	char	*bl_text;	/* the line, cut up by routeargs() */
+	char	*bl_dest;
+	char	*bl_gateway;
+	int	bl_lineno;
+	int	bl_seq;
+	int	bl_error;	/* errno, 0 or BL_PENDING */
+#define	BL_PENDING	(-1)
+	u_char	bl_cmd;
+	u_char	bl_ishost;
+};
+
+static const char *batchname;
+static int batchlineno;		/* nonzero while parsing */
+static struct bline *blines;
+static int nblines;
+static int bseq0;		/* rtm_seq of blines[0] */
+
+#define	BATCH_MAXARGS	64
+
+static void
+batch_where(void)
+{
+	/* routeargs() and getaddr() exit on a bad line */
+	if (batchlineno != 0)
+		warnx("%s: line %d: nothing was changed", batchname,
+		    batchlineno);
+}
+
+static void
+batch_reply(int i, int error)
+{
+	struct bline *bl = &blines[i];
+
+	if (error != 0)
+		bl->bl_error = error;
+	else if (bl->bl_error == BL_PENDING)
+		bl->bl_error = 0;
+}
+
+void
+batchroutes(const char *file)
+{
+	FILE *fp;
+	char *line, *msgs, *cp, *av[BATCH_MAXARGS + 1];
+	size_t len, msgsize, msglen, off;
+	struct bline *bl;
+	struct timeval start, end, timeout;
+	double secs;
+	int ac, flags, l, i, nalloc, failed, want;
+	int rcvbuf = 4 * 1024 * 1024;
+
+	if (uid) {
+		errx(EX_NOPERM, "must be root to alter routing table");
+	}
+	if (strcmp(file, "-") == 0)
+		fp = stdin;
+	else if ((fp = fopen(file, "r")) == NULL)
+		err(EX_NOINPUT, "%s", file);
+	batchname = file;
+	atexit(batch_where);
+	(void) gettimeofday(&start, NULL);
+
+	/*
+	 * Pass 1: build every message.
+	 */
+	nalloc = 0;
+	msgs = NULL;
+	msgsize = msglen = 0;
+	while ((cp = fgetln(fp, &len)) != NULL) {
+		batchlineno++;
+		if ((line = malloc(len + 1)) == NULL)
+			errx(EX_OSERR, "malloc failed");
+		memcpy(line, cp, len);
+		line[len] = '\0';
+		for (ac = 0, cp = line; ac < BATCH_MAXARGS; ) {
+			while (isspace((unsigned char)*cp))
+				cp++;
+			if (*cp == '\0' || *cp == '#')
+				break;
+			av[ac++] = cp;
+			while (*cp != '\0' && !isspace((unsigned char)*cp))
+				cp++;
+			if (*cp != '\0')
+				*cp++ = '\0';
+		}
+		av[ac] = NULL;
+		if (ac == 0) {
+			free(line);
+			continue;
+		}
+		if (ac == BATCH_MAXARGS)
+			errx(EX_DATAERR, "%s: line %d: too many arguments",
+			    file, batchlineno);
+		switch (keyword(av[0])) {
+		case K_ADD:
+		case K_CHANGE:
+		case K_DELETE:
+			break;
+		default:
+			usage(av[0]);
+		}
+		if (nblines == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : 1024;
+			if ((blines = realloc(blines,
+			    nalloc * sizeof(*blines))) == NULL)
+				errx(EX_OSERR, "malloc failed");
+		}
+		bl = &blines[nblines];
+		memset(bl, 0, sizeof(*bl));
+		bl->bl_text = line;
+		bl->bl_dest = "";
+		bl->bl_gateway = "";
+		bl->bl_lineno = batchlineno;
+		bl->bl_cmd = av[0][0];
+
+		/* each line starts from the command line defaults */
+		memset(&so_dst, 0, sizeof(so_dst));
+		memset(&so_gate, 0, sizeof(so_gate));
+		memset(&so_mask, 0, sizeof(so_mask));
+		memset(&so_genmask, 0, sizeof(so_genmask));
+		memset(&so_ifa, 0, sizeof(so_ifa));
+		memset(&so_ifp, 0, sizeof(so_ifp));
+		memset(&rt_metrics, 0, sizeof(rt_metrics));
+		rtm_addrs = 0;
+		rtm_inits = 0;
+		ifscope = 0;
+		af = 0;
+		aflen = sizeof (struct sockaddr_in);
+		forcehost = forcenet = iflag = 0;
+		locking = lockrest = 0;
+
+		flags = RTF_STATIC;
+		bl->bl_ishost = routeargs(ac, av, &flags, &bl->bl_dest,
+		    &bl->bl_gateway, NULL);
+		l = rtmsg_build(bl->bl_cmd, flags);
+		bl->bl_seq = m_rtmsg.m_rtm.rtm_seq;
+		if (msglen + l > msgsize) {
+			msgsize = msgsize ? msgsize * 2 : 256 * 1024;
+			if ((msgs = realloc(msgs, msgsize)) == NULL)
+				errx(EX_OSERR, "malloc failed");
+		}
+		memcpy(msgs + msglen, &m_rtmsg, l);
+		msglen += l;
+		nblines++;
+	}
+	if (ferror(fp))
+		err(EX_IOERR, "%s", file);
+	if (fp != stdin)
+		fclose(fp);
+	batchlineno = 0;
+	if (nblines == 0)
+		exit(0);
+	bseq0 = blines[0].bl_seq;
+
+	/*
+	 * Pass 2: write them back to back, picking up the replies as they
+	 * come so the socket buffer doesn't overflow.
+	 */
+	if (!debugonly) {
+		if (!tflag)
+			(void) setsockopt(s, SOL_SOCKET, SO_RCVBUF, &rcvbuf,
+			    sizeof(rcvbuf));
+		want = 0;
+		for (i = 0, off = 0; i < nblines; i++) {
+			struct rt_msghdr *rtm = (struct rt_msghdr *)(msgs + off);
+
+			bl = &blines[i];
+			bl->bl_error = BL_PENDING;
+			if (write(s, rtm, rtm->rtm_msglen) < 0)
+				bl->bl_error = errno;
+			else
+				want++;
+			off += rtm->rtm_msglen;
+			if (!tflag && (i & 63) == 63)
+				want -= rtsock_drain(bseq0, nblines,
+				    batch_reply, 0, NULL);
+		}
+		if (!tflag) {
+			timeout.tv_sec = 1;
+			timeout.tv_usec = 0;
+			(void) rtsock_drain(bseq0, nblines, batch_reply,
+			    want, &timeout);
+		}
+	}
+	(void) gettimeofday(&end, NULL);
+
+	/*
+	 * A write that succeeded applied the change even if its reply was
+	 * lost to a full socket buffer.
+	 */
+	failed = 0;
+	for (i = 0; i < nblines; i++) {
+		bl = &blines[i];
+		if (bl->bl_error == BL_PENDING)
+			bl->bl_error = 0;
+		if (bl->bl_error != 0)
+			failed++;
+		else if (qflag)
+			continue;
+		if (bl->bl_error != 0)
+			(void) printf("%s: line %d: ", file, bl->bl_lineno);
+		(void) printf("%s %s %s", bl->bl_cmd == 'a' ? "add" :
+		    bl->bl_cmd == 'c' ? "change" : "delete",
+		    bl->bl_ishost ? "host" : "net", bl->bl_dest);
+		if (*bl->bl_gateway)
+			(void) printf(": gateway %s", bl->bl_gateway);
+		if (bl->bl_error == 0)
+			(void) printf("\n");
+		else
+			(void) printf(": %s\n", route_strerror(bl->bl_error));
+	}
+	if (!qflag) {
+		secs = (end.tv_sec - start.tv_sec) +
+		    (end.tv_usec - start.tv_usec) / 1e6;
+		(void) printf("%d route%s, %d failed, in %.3f seconds",
+		    nblines, nblines == 1 ? "" : "s", failed, secs);
+		if (secs > 0)
+			(void) printf(" (%.0f routes/s)", nblines / secs);
+		(void) printf("\n");
+	}
+	exit(failed ? 1 : 0);
+}
+
 void
 mask_addr()
 {
@@ -88,11 +88,13 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <time.h>
 
 #include "rtadvd.h"
 #include "advcap.h"
 #include "timer.h"
 #include "if.h"
+#include "prefixtree.h"
 #include "config.h"
 
 #define ND_OPT_PREF64_LIFETIME_MAX		65528
@@ -106,9 +108,11 @@
 
 static time_t prefix_timo = (60 * 120);	/* 2 hours.
 					 * XXX: should be configurable. */
-extern struct rainfo *ralist;
 
 static struct rtadvd_timer *prefix_timeout(void *);
+static void prefix_lifetimes(struct prefix *, time_t, u_int32_t *,
+    u_int32_t *);
+static void patch_prefix(struct prefix *, time_t);
 static void makeentry(char *, size_t, int, char *);
 static int getinet6sysctl(int);
 static int encode_domain(char *, u_char *);
@@ -434,6 +438,7 @@ getconfig(intface)
 		}
 		/* link into chain */
 		insque(pfx, &rai->prefix);
+		prefix_tree_insert(rai, pfx);
 		rai->pfxs++;
 	}
 	if (rai->pfxs == 0)
@@ -812,8 +817,7 @@ getconfig(intface)
 	}
 
 	/* okey */
-	rai->next = ralist;
-	ralist = rai;
+	rainfo_insert(rai);
 
 	/* construct the sending packet */
 	make_packet(rai);
@@ -897,6 +901,7 @@ get_prefix(struct rainfo *rai)
 
 		/* link into chain */
 		insque(pfx, &rai->prefix);
+		prefix_tree_insert(rai, pfx);
 
 		/* counter increment */
 		rai->pfxs++;
@@ -943,6 +948,7 @@ add_prefix(struct rainfo *rai, struct in6_prefixreq *ipr)
 	prefix->rainfo = rai;
 
 	insque(prefix, &rai->prefix);
+	prefix_tree_insert(rai, prefix);
 
 	debuglog("<%s> new prefix %s/%d was added on %s",
 	       __func__, inet_ntop(AF_INET6, &ipr->ipr_prefix.sin6_addr,
@@ -970,6 +976,7 @@ delete_prefix(struct prefix *prefix)
 	struct rainfo *rai = prefix->rainfo;
 
 	remque(prefix);
+	prefix_tree_delete(rai, prefix);
 	debuglog("<%s> prefix %s/%d was deleted on %s",
 	       __func__, inet_ntop(AF_INET6, &prefix->prefix,
 				       ntopbuf, INET6_ADDRSTRLEN),
@@ -978,6 +985,9 @@ delete_prefix(struct prefix *prefix)
 		rtadvd_remove_timer(&prefix->timer);
 	free(prefix);
 	rai->pfxs--;
+
+	/* the option is gone; rebuild the packet before the next send */
+	rai->ra_stale = 1;
 }
 
 void
@@ -1009,6 +1019,9 @@ invalidate_prefix(struct prefix *prefix)
 	timo.tv_sec = prefix_timo;
 	timo.tv_usec = 0;
 	rtadvd_set_timer(&timo, prefix->timer);
+
+	/* advertise zero lifetimes from now on */
+	patch_prefix(prefix, 0);
 }
 
 static struct rtadvd_timer *
@@ -1039,6 +1052,9 @@ update_prefix(struct prefix * prefix)
 
 	/* stop the expiration timer */
 	rtadvd_remove_timer(&prefix->timer);
+
+	/* restore the advertised lifetimes */
+	patch_prefix(prefix, time(NULL));
 }
 
 /*
@@ -1125,7 +1141,8 @@ make_packet(struct rainfo *rainfo)
 	struct nd_opt_route_info *ndopt_rti;
 	struct rtinfo *rti;
 #endif
-	struct prefix *pfx;
+	struct prefix *pfx, **decr;
+	time_t now;
 
 	/* calculate total length */
 	packlen = sizeof(struct nd_router_advert);
@@ -1174,6 +1191,19 @@ make_packet(struct rainfo *rainfo)
 	rainfo->ra_data = buf;
 	/* XXX: what if packlen > 576? */
 	rainfo->ra_datalen = packlen;
+	rainfo->ra_stale = 0;
+
+	/* room to remember the prefixes whose lifetimes decrement */
+	if (rainfo->ra_decrmax < rainfo->pfxs) {
+		decr = realloc(rainfo->ra_decr,
+		    rainfo->pfxs * sizeof(*rainfo->ra_decr));
+		if (decr == NULL) {
+			errorlog("<%s> can't allocate memory", __func__);
+			exit(1);
+		}
+		rainfo->ra_decr = decr;
+		rainfo->ra_decrmax = rainfo->pfxs;
+	}
 
 	/*
 	 * construct the packet
@@ -1212,10 +1242,15 @@ make_packet(struct rainfo *rainfo)
 		buf += sizeof(struct nd_opt_mtu);
 	}
 
+	now = time(NULL);
+	rainfo->ra_ndecr = 0;
 	for (pfx = rainfo->prefix.next;
 	     pfx != &rainfo->prefix; pfx = pfx->next) {
 		u_int32_t vltime, pltime;
-		struct timeval now;
+
+		pfx->pi_off = buf - rainfo->ra_data;
+		if (pfx->vltimeexpire || pfx->pltimeexpire)
+			rainfo->ra_decr[rainfo->ra_ndecr++] = pfx;
 
 		ndopt_pi = (struct nd_opt_prefix_info *)buf;
 		ndopt_pi->nd_opt_pi_type = ND_OPT_PREFIX_INFORMATION;
@@ -1228,33 +1263,7 @@ make_packet(struct rainfo *rainfo)
 		if (pfx->autoconfflg)
 			ndopt_pi->nd_opt_pi_flags_reserved |=
 				ND_OPT_PI_FLAG_AUTO;
-		if (pfx->timer)
-			vltime = 0;
-		else {
-			if (pfx->vltimeexpire || pfx->pltimeexpire)
-				gettimeofday(&now, NULL);
-			if (pfx->vltimeexpire == 0)
-				vltime = pfx->validlifetime;
-			else
-				vltime = (pfx->vltimeexpire > now.tv_sec) ?
-				    pfx->vltimeexpire - now.tv_sec : 0;
-		}
-		if (pfx->timer)
-			pltime = 0;
-		else {
-			if (pfx->pltimeexpire == 0)
-				pltime = pfx->preflifetime;
-			else
-				pltime = (pfx->pltimeexpire > now.tv_sec) ? 
-				    pfx->pltimeexpire - now.tv_sec : 0;
-		}
-		if (vltime < pltime) {
-			/*
-			 * this can happen if vltime is decrement but pltime
-			 * is not.
-			 */
-			pltime = vltime;
-		}
+		prefix_lifetimes(pfx, now, &vltime, &pltime);
 		ndopt_pi->nd_opt_pi_valid_time = htonl(vltime);
 		ndopt_pi->nd_opt_pi_preferred_time = htonl(pltime);
 		ndopt_pi->nd_opt_pi_reserved2 = 0;
@@ -1379,6 +1388,105 @@ make_packet(struct rainfo *rainfo)
 	return;
 }
 
+/*
+ * Compute the lifetimes to advertise for a prefix at time now.
+ */
+static void
+prefix_lifetimes(struct prefix *pfx, time_t now, u_int32_t *vltimep,
+    u_int32_t *pltimep)
+{
+	u_int32_t vltime, pltime;
+
+	if (pfx->timer) {
+		*vltimep = *pltimep = 0;
+		return;
+	}
+	if (pfx->vltimeexpire == 0)
+		vltime = pfx->validlifetime;
+	else
+		vltime = (pfx->vltimeexpire > now) ?
+		    pfx->vltimeexpire - now : 0;
+	if (pfx->pltimeexpire == 0)
+		pltime = pfx->preflifetime;
+	else
+		pltime = (pfx->pltimeexpire > now) ?
+		    pfx->pltimeexpire - now : 0;
+	if (vltime < pltime) {
+		/*
+		 * this can happen if vltime is decrement but pltime
+		 * is not.
+		 */
+		pltime = vltime;
+	}
+	*vltimep = vltime;
+	*pltimep = pltime;
+}
+
+/*
+ * Rewrite the lifetimes of a prefix in the cached packet of its
+ * interface.  Nothing to do if the packet is about to be rebuilt anyway.
+ */
+static void
+patch_prefix(struct prefix *pfx, time_t now)
+{
+	struct rainfo *rai = pfx->rainfo;
+	struct nd_opt_prefix_info *ndopt_pi;
+	u_int32_t vltime, pltime;
+
+	if (rai->ra_data == NULL || rai->ra_stale)
+		return;
+
+	ndopt_pi = (struct nd_opt_prefix_info *)(rai->ra_data + pfx->pi_off);
+	prefix_lifetimes(pfx, now, &vltime, &pltime);
+	ndopt_pi->nd_opt_pi_valid_time = htonl(vltime);
+	ndopt_pi->nd_opt_pi_preferred_time = htonl(pltime);
+}
+
+/*
+ * Make the cached packet of an interface current before it is sent.
+ * The packet is built once by make_packet() and rebuilt only when its
+ * layout changed (ra_stale); otherwise only the lifetimes of prefixes
+ * that decrement in real time are patched in place.
+ */
+void
+refresh_packet(struct rainfo *rai)
+{
+	time_t now;
+	int i;
+
+	if (rai->ra_data == NULL || rai->ra_stale) {
+		make_packet(rai);
+		return;
+	}
+	if (rai->ra_ndecr == 0)
+		return;
+
+	now = time(NULL);
+	for (i = 0; i < rai->ra_ndecr; i++)
+		patch_prefix(rai->ra_decr[i], now);
+}
+
+/*
+ * Rewrite the router lifetime and flags in the cached packet after
+ * they were changed in the rainfo.
+ */
+void
+patch_packet_header(struct rainfo *rai)
+{
+	struct nd_router_advert *ra;
+
+	if (rai->ra_data == NULL || rai->ra_stale)
+		return;
+
+	ra = (struct nd_router_advert *)rai->ra_data;
+	ra->nd_ra_flags_reserved = 0xff & rai->rtpref;
+	ra->nd_ra_flags_reserved |=
+		rai->managedflg ? ND_RA_FLAG_MANAGED : 0;
+	ra->nd_ra_flags_reserved |=
+		rai->otherflg ? ND_RA_FLAG_OTHER : 0;
+	ra->nd_ra_router_lifetime = htons(rai->lifetime);
+}
+
 static int
 getinet6sysctl(int code)
 {
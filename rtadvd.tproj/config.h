@@ -35,6 +35,8 @@ extern void invalidate_prefix(struct prefix *);
 extern void update_prefix(struct prefix *);
 extern void make_prefix(struct rainfo *, int, struct in6_addr *, int);
 extern void make_packet(struct rainfo *);
+extern void refresh_packet(struct rainfo *);
+extern void patch_packet_header(struct rainfo *);
 extern void get_prefix(struct rainfo *);
 
 
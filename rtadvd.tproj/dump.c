@@ -146,8 +146,13 @@ if_dump()
 			    ctime((time_t *)&rai->lastsent.tv_sec));
 		}
 		if (rai->timer) {
+			time_t next;
+
+			/* timers run on the monotonic clock */
+			next = now.tv_sec +
+			    rtadvd_timer_rest(rai->timer)->tv_sec;
 			fprintf(fp, "  Next RA will be sent: %s",
-			    ctime((time_t *)&rai->timer->tm.tv_sec));
+			    ctime(&next));
 		}
 		else
 			fprintf(fp, "  RA timer is stopped");
@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Longest-prefix trie of the prefixes advertised on an interface.
+ *
+ * find_prefix() is called for every Prefix Information option of every
+ * RA received (prefix_check()) and for every routing socket update, and
+ * router renumbering looks for all the prefixes under a match prefix.
+ * With the prefixes kept only on the rainfo list, each of those was a
+ * scan of the whole list.  The trie answers an exact lookup in at most
+ * one visit per distinct prefix length on the path, and enumerates the
+ * prefixes under a given prefix without looking at the others.
+ *
+ * Each node holds a key masked to its length.  A node with a NULL pfx is
+ * only there to branch on bit plen.  Several prefixes with the same key
+ * and length may be configured; they are chained through pfx->dupnext,
+ * most recent first, which is the one the list scan used to find.
+ */
+
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/queue.h>
+
+#include <net/if.h>
+#include <netinet/in.h>
+#include <netinet/icmp6.h>
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rtadvd.h"
+#include "prefixtree.h"
+
+#define PFXTREE_MAXDEPTH	130
+
+/* bit n (0 is the most significant) of an address */
+static inline int
+addr_bit(const struct in6_addr *a, int n)
+{
+	return((a->s6_addr[n >> 3] >> (7 - (n & 7))) & 1);
+}
+
+/* number of leading bits, up to max, that a and b have in common */
+static int
+common_len(const struct in6_addr *a, const struct in6_addr *b, int max)
+{
+	int i, n;
+	u_char x;
+
+	for (i = 0; i * 8 < max; i++) {
+		if ((x = a->s6_addr[i] ^ b->s6_addr[i]) != 0) {
+			n = i * 8;
+			while ((x & 0x80) == 0) {
+				x <<= 1;
+				n++;
+			}
+			return(MIN(n, max));
+		}
+	}
+	return(max);
+}
+
+static void
+mask_key(struct in6_addr *key, const struct in6_addr *addr, int plen)
+{
+	int i;
+
+	memset(key, 0, sizeof(*key));
+	for (i = 0; i < plen / 8; i++)
+		key->s6_addr[i] = addr->s6_addr[i];
+	if (plen % 8)
+		key->s6_addr[i] = addr->s6_addr[i] & (0xff << (8 - plen % 8));
+}
+
+static struct pfxnode *
+node_alloc(const struct in6_addr *key, int plen, struct prefix *pfx)
+{
+	struct pfxnode *n;
+
+	ELM_MALLOC(n, exit(1));
+	mask_key(&n->key, key, plen);
+	n->plen = plen;
+	n->pfx = pfx;
+	return(n);
+}
+
+void
+prefix_tree_insert(struct rainfo *rai, struct prefix *pfx)
+{
+	struct pfxnode **np, *n, *new, *branch;
+	struct in6_addr *key = &pfx->prefix;
+	int plen = pfx->prefixlen, common;
+
+	pfx->dupnext = NULL;
+	for (np = &rai->pfxtree; (n = *np) != NULL;
+	    np = &n->child[addr_bit(key, n->plen)]) {
+		common = common_len(key, &n->key, MIN(plen, n->plen));
+		if (common < n->plen) {
+			/* the new prefix leaves the path above n */
+			new = node_alloc(key, plen, pfx);
+			if (common == plen) {
+				/* ... and covers it */
+				new->child[addr_bit(&n->key, plen)] = n;
+				*np = new;
+			} else {
+				branch = node_alloc(key, common, NULL);
+				branch->child[addr_bit(key, common)] = new;
+				branch->child[addr_bit(&n->key, common)] = n;
+				*np = branch;
+			}
+			return;
+		}
+		if (plen == n->plen) {
+			/* same prefix; the newest shadows the others */
+			pfx->dupnext = n->pfx;
+			n->pfx = pfx;
+			return;
+		}
+	}
+	*np = node_alloc(key, plen, pfx);
+}
+
+void
+prefix_tree_delete(struct rainfo *rai, struct prefix *pfx)
+{
+	struct pfxnode **path[PFXTREE_MAXDEPTH], **np, *n;
+	struct prefix **pp;
+	struct in6_addr *key = &pfx->prefix;
+	int plen = pfx->prefixlen, depth = 0;
+
+	for (np = &rai->pfxtree; (n = *np) != NULL && n->plen < plen;
+	    np = &n->child[addr_bit(key, n->plen)])
+		path[depth++] = np;
+	if (n == NULL || n->plen != plen)
+		return;
+
+	for (pp = &n->pfx; *pp != NULL; pp = &(*pp)->dupnext) {
+		if (*pp == pfx) {
+			*pp = pfx->dupnext;
+			break;
+		}
+	}
+	pfx->dupnext = NULL;
+
+	/* drop nodes that no longer hold a prefix or branch */
+	while (n->pfx == NULL &&
+	    (n->child[0] == NULL || n->child[1] == NULL)) {
+		*np = n->child[0] != NULL ? n->child[0] : n->child[1];
+		free(n);
+		if (depth == 0)
+			break;
+		np = path[--depth];
+		n = *np;
+	}
+}
+
+struct prefix *
+prefix_tree_lookup(struct rainfo *rai, struct in6_addr *addr, int plen)
+{
+	struct pfxnode *n;
+
+	if (plen < 0 || plen > 128)
+		return(NULL);
+	for (n = rai->pfxtree; n != NULL && n->plen <= plen;
+	    n = n->child[addr_bit(addr, n->plen)]) {
+		if (common_len(addr, &n->key, n->plen) < n->plen)
+			return(NULL);
+		if (n->plen == plen)
+			return(n->pfx);
+	}
+	return(NULL);
+}
+
+static void
+walk_subtree(struct pfxnode *n, void (*func)(struct prefix *, void *),
+    void *arg)
+{
+	struct prefix *pfx, *next;
+
+	for (; n != NULL; n = n->child[1]) {
+		for (pfx = n->pfx; pfx != NULL; pfx = next) {
+			next = pfx->dupnext;
+			(*func)(pfx, arg);
+		}
+		walk_subtree(n->child[0], func, arg);
+	}
+}
+
+/*
+ * Call func for every prefix that is at least plen long and matches addr
+ * in its first plen bits, i.e. for every p for which
+ * prefix_match(&p->prefix, p->prefixlen, addr, plen) holds.
+ * func must not add or remove prefixes.
+ */
+void
+prefix_tree_walk(struct rainfo *rai, struct in6_addr *addr, int plen,
+    void (*func)(struct prefix *, void *), void *arg)
+{
+	struct pfxnode *n;
+
+	if (plen < 0 || plen > 128)
+		return;
+	for (n = rai->pfxtree; n != NULL;
+	    n = n->child[addr_bit(addr, n->plen)]) {
+		if (n->plen >= plen) {
+			if (common_len(addr, &n->key, plen) == plen)
+				walk_subtree(n, func, arg);
+			return;
+		}
+		if (common_len(addr, &n->key, n->plen) < n->plen)
+			return;
+	}
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2026 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#ifndef _PREFIXTREE_H_
+#define _PREFIXTREE_H_
+
+/*
+ * Per-interface index of the advertised prefixes: a path-compressed
+ * binary trie keyed by the first plen bits of each prefix.
+ */
+struct pfxnode {
+	struct pfxnode *child[2];
+	struct in6_addr key;	/* bits beyond plen are zero */
+	int plen;
+	struct prefix *pfx;	/* NULL for a branching node */
+};
+
+void prefix_tree_insert(struct rainfo *, struct prefix *);
+void prefix_tree_delete(struct rainfo *, struct prefix *);
+struct prefix *prefix_tree_lookup(struct rainfo *, struct in6_addr *, int);
+void prefix_tree_walk(struct rainfo *, struct in6_addr *, int,
+    void (*)(struct prefix *, void *), void *);
+
+#endif /* _PREFIXTREE_H_ */
@@ -49,6 +49,7 @@
 #include "rtadvd.h"
 #include "rrenum.h"
 #include "if.h"
+#include "prefixtree.h"
 
 #define	RR_ISSET_SEGNUM(segnum_bits, segnum) \
 	((((segnum_bits)[(segnum) >> 5]) & (1 << ((segnum) & 31))) != 0)
@@ -134,13 +135,38 @@ rr_pco_check(int len, struct rr_pco_match *rpm)
 	return 0;
 }
 
+/*
+ * Apply the lifetimes of a use-prefix part, as already converted into
+ * the in6_rrenumreq, to an advertised prefix that its match-prefix part
+ * selected.
+ */
+static void
+change_prefix(struct prefix *pp, void *arg)
+{
+	struct in6_rrenumreq *irr = (struct in6_rrenumreq *)arg;
+	struct timeval now;
+
+	pp->validlifetime = irr->irr_vltime;
+	pp->preflifetime = irr->irr_pltime;
+	if (irr->irr_rrf_decrvalid) {
+		gettimeofday(&now, 0);
+		pp->vltimeexpire = now.tv_sec + pp->validlifetime;
+	} else
+		pp->vltimeexpire = 0;
+	if (irr->irr_rrf_decrprefd) {
+		gettimeofday(&now, 0);
+		pp->pltimeexpire = now.tv_sec + pp->preflifetime;
+	} else
+		pp->pltimeexpire = 0;
+	pp->rainfo->ra_stale = 1;
+}
+
 static void
 do_use_prefix(int len, struct rr_pco_match *rpm,
 	      struct in6_rrenumreq *irr, int ifindex)
 {
 	struct rr_pco_use *rpu, *rpulim;
 	struct rainfo *rai;
-	struct prefix *pp;
 
 	rpu = (struct rr_pco_use *)(rpm + 1);
 	rpulim = (struct rr_pco_use *)((char *)rpm + len);
@@ -204,30 +230,9 @@ do_use_prefix(int len, struct rr_pco_match *rpm,
 			if ((rai = if_indextorainfo(ifindex)) == NULL)
 				continue; /* non-advertising IF */
 
-			for (pp = rai->prefix.next; pp != &rai->prefix;
-			     pp = pp->next) {
-				struct timeval now;
-
-				if (prefix_match(&pp->prefix, pp->prefixlen,
-						 &rpm->rpm_prefix,
-						 rpm->rpm_matchlen)) {
-					/* change parameters */
-					pp->validlifetime = ntohl(rpu->rpu_vltime);
-					pp->preflifetime = ntohl(rpu->rpu_pltime);
-					if (irr->irr_rrf_decrvalid) {
-						gettimeofday(&now, 0);
-						pp->vltimeexpire =
-							now.tv_sec + pp->validlifetime;
-					} else
-						pp->vltimeexpire = 0;
-					if (irr->irr_rrf_decrprefd) {
-						gettimeofday(&now, 0);
-						pp->pltimeexpire =
-							now.tv_sec + pp->preflifetime;
-					} else
-						pp->pltimeexpire = 0;
-				}
-			}
+			/* change parameters of every matching prefix */
+			prefix_tree_walk(rai, &rpm->rpm_prefix,
+			    rpm->rpm_matchlen, change_prefix, irr);
 		}
 	}
 }
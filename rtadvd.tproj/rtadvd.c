@@ -63,6 +63,7 @@
 #include <sys/uio.h>
 #include <sys/time.h>
 #include <sys/queue.h>
+#include <sys/event.h>
 
 #include <net/if.h>
 #include <net/route.h>
@@ -90,12 +91,14 @@
 #include "if.h"
 #include "config.h"
 #include "dump.h"
+#include "prefixtree.h"
 
 struct msghdr rcvmhdr;
 static u_char *rcvcmsgbuf;
 static size_t rcvcmsgbuflen;
 static u_char *sndcmsgbuf = NULL;
 static size_t sndcmsgbuflen;
+static struct in6_pktinfo *sndpktinfo;	/* outgoing interface in sndcmsgbuf */
 volatile sig_atomic_t do_dump;
 volatile sig_atomic_t do_die;
 struct msghdr sndmhdr;
@@ -116,6 +119,8 @@ int so_traffic_class = SO_TC_CTL;	/* use control class, by default */
 char *conffile = NULL;
 
 struct rainfo *ralist = NULL;
+static struct rainfo **ra_byindex;	/* ralist indexed by ifindex */
+static int ra_byindexlen;
 
 struct nd_optlist {
 	struct nd_optlist *next;
@@ -140,6 +145,9 @@ union nd_opts {
 #define nd_opts_mtu		nd_opt_each.mtu
 #define nd_opts_list		nd_opt_each.list
 
+#define INPUT_BATCH	64	/* packets read per wakeup */
+#define MAX_SOLICITERS	64	/* RS sources remembered per interface */
+
 #define NDOPT_FLAG_SRCLINKADDR 0x1
 #define NDOPT_FLAG_TGTLINKADDR 0x2
 #define NDOPT_FLAG_PREFIXINFO 0x4
@@ -156,7 +164,7 @@ static void set_die(int);
 static void die(void);
 static void sock_open(void);
 static void rtsock_open(void);
-static void rtadvd_input(void);
+static int rtadvd_input(int);
 static void rs_input(int, struct nd_router_solicit *,
 			  struct in6_pktinfo *, struct sockaddr_in6 *);
 static void ra_input(int, struct nd_router_advert *,
@@ -170,23 +178,30 @@ static void ra_output(struct rainfo *);
 static void rtmsg_input(void);
 static void rtadvd_set_dump_file(int);
 static void set_short_delay(struct rainfo *);
+static void timer_bench(int);
 
 int
 main(argc, argv)
 	int argc;
 	char *argv[];
 {
-	fd_set *fdsetp, *selectfdp;
-	int fdmasks;
-	int maxfd = 0;
+	struct kevent kev[4];
+	struct timespec ts, *tsp;
 	struct timeval *timeout;
-	int i, ch;
+	int kq, nkev, i, ch;
 	int fflag = 0;
+	int nbench = 0;
+	int rtready, sockready;
 	pid_t pid, otherpid;
 
 	/* get command line options and arguments */
-	while ((ch = getopt(argc, argv, "c:dDF:fMp:Rs")) != -1) {
+	while ((ch = getopt(argc, argv, "b:c:dDF:fMp:Rs")) != -1) {
 		switch (ch) {
+		case 'b':
+			nbench = atoi(optarg);
+			if (nbench <= 0)
+				errx(1, "invalid interface count: %s", optarg);
+			break;
 		case 'c':
 			conffile = optarg;
 			break;
@@ -221,16 +236,22 @@ main(argc, argv)
 	}
 	argc -= optind;
 	argv += optind;
-	if (argc == 0) {
+	if (argc == 0 && nbench == 0) {
 		fprintf(stderr,
 			"usage: rtadvd [-dDfMRs] [-c conffile] "
-			"[-F dumpfile] [-p pidfile] interfaces...\n");
+			"[-F dumpfile] [-p pidfile] interfaces...\n"
+			"       rtadvd -b ninterfaces\n");
 		exit(1);
 	}
 
 	/* timer initialization */
 	rtadvd_timer_init();
 
+	if (nbench) {
+		timer_bench(nbench);
+		exit(0);
+	}
+
 	/* random value initialization */
 	srandom((u_long)time(NULL));
 
@@ -263,34 +284,36 @@ main(argc, argv)
 	pid = getpid();
 	pidfile_write(pfh);
 
-	maxfd = sock;
-	if (sflag == 0) {
+	if (sflag == 0)
 		rtsock_open();
-		if (rtsock > sock)
-			maxfd = rtsock;
-	} else
+	else
 		rtsock = -1;
 
-	fdmasks = howmany(maxfd + 1, NFDBITS) * sizeof(fd_mask);
-	if ((fdsetp = malloc(fdmasks)) == NULL) {
-		err(1, "malloc");
+	/*
+	 * Wait on a kqueue rather than select() so the cost of a wakeup
+	 * does not depend on descriptor numbers.  SIGTERM and SIGUSR1 are
+	 * delivered as events too, which closes the window in which a
+	 * signal arriving just before the wait would be noticed only at
+	 * the next timeout.
+	 */
+	if ((kq = kqueue()) < 0) {
+		err(1, "kqueue");
 		/*NOTREACHED*/
 	}
-	if ((selectfdp = malloc(fdmasks)) == NULL) {
-		err(1, "malloc");
+	nkev = 0;
+	EV_SET(&kev[nkev++], sock, EVFILT_READ, EV_ADD, 0, 0, NULL);
+	if (rtsock >= 0)
+		EV_SET(&kev[nkev++], rtsock, EVFILT_READ, EV_ADD, 0, 0, NULL);
+	EV_SET(&kev[nkev++], SIGTERM, EVFILT_SIGNAL, EV_ADD, 0, 0, NULL);
+	EV_SET(&kev[nkev++], SIGUSR1, EVFILT_SIGNAL, EV_ADD, 0, 0, NULL);
+	if (kevent(kq, kev, nkev, NULL, 0, NULL) < 0) {
+		err(1, "kevent");
 		/*NOTREACHED*/
 	}
-	memset(fdsetp, 0, fdmasks);
-	FD_SET(sock, fdsetp);
-	if (rtsock >= 0)
-		FD_SET(rtsock, fdsetp);
-
-	signal(SIGTERM, set_die);
-	signal(SIGUSR1, rtadvd_set_dump_file);
+	signal(SIGTERM, SIG_IGN);
+	signal(SIGUSR1, SIG_IGN);
 
 	while (1) {
-		memcpy(selectfdp, fdsetp, fdmasks); /* reinitialize */
-
 		if (do_dump) {	/* SIGUSR1 */
 			do_dump = 0;
 			rtadvd_dump_file(dumpfilename);
@@ -314,20 +337,48 @@ main(argc, argv)
 			    __func__);
 		}
 
-		if ((i = select(maxfd + 1, selectfdp, NULL, NULL,
-		    timeout)) < 0) {
-			/* EINTR would occur upon SIGUSR1 for status dump */
+		if (timeout != NULL) {
+			TIMEVAL_TO_TIMESPEC(timeout, &ts);
+			tsp = &ts;
+		} else
+			tsp = NULL;
+
+		if ((nkev = kevent(kq, NULL, 0, kev, sizeof(kev) /
+		    sizeof(kev[0]), tsp)) < 0) {
 			if (errno != EINTR)
-				errorlog( "<%s> select: %s",
+				errorlog( "<%s> kevent: %s",
 				    __func__, strerror(errno));
 			continue;
 		}
-		if (i == 0)	/* timeout */
+		if (nkev == 0)	/* timeout */
 			continue;
-		if (rtsock != -1 && FD_ISSET(rtsock, selectfdp))
+
+		rtready = sockready = 0;
+		for (i = 0; i < nkev; i++) {
+			if (kev[i].filter == EVFILT_SIGNAL) {
+				if (kev[i].ident == SIGTERM)
+					set_die(SIGTERM);
+				else
+					rtadvd_set_dump_file(SIGUSR1);
+			} else if ((int)kev[i].ident == rtsock)
+				rtready = 1;
+			else if ((int)kev[i].ident == sock)
+				sockready = 1;
+		}
+		/* routing changes first, as select() ordering did */
+		if (rtready)
 			rtmsg_input();
-		if (FD_ISSET(sock, selectfdp))
-			rtadvd_input();
+		if (sockready) {
+			/*
+			 * Take a burst of solicitations in one wakeup; they
+			 * are answered together by the next multicast RA of
+			 * each interface.
+			 */
+			for (i = 0; i < INPUT_BATCH; i++) {
+				if (rtadvd_input(i ? MSG_DONTWAIT : 0) == 0)
+					break;
+			}
+		}
 	}
 	exit(0);		/* NOTREACHED */
 }
@@ -360,7 +411,7 @@ die()
 
 	for (ra = ralist; ra; ra = ra->next) {
 		ra->lifetime = 0;
-		make_packet(ra);
+		patch_packet_header(ra);
 	}
 	for (i = 0; i < retrans; i++) {
 		for (ra = ralist; ra; ra = ra->next)
@@ -584,8 +635,8 @@ rtmsg_input()
 	return;
 }
 
-void
-rtadvd_input()
+int
+rtadvd_input(int flags)
 {
 	int i;
 	int *hlimp = NULL;
@@ -606,8 +657,8 @@ rtadvd_input()
 	 * receive options.
 	 */
 	rcvmhdr.msg_controllen = rcvcmsgbuflen;
-	if ((i = recvmsg(sock, &rcvmhdr, 0)) < 0)
-		return;
+	if ((i = recvmsg(sock, &rcvmhdr, flags)) < 0)
+		return(0);
 
 	/* extract optional information via Advanced API */
 	for (cm = (struct cmsghdr *)CMSG_FIRSTHDR(&rcvmhdr);
@@ -628,12 +679,12 @@ rtadvd_input()
 	if (ifindex == 0) {
 		errorlog("<%s> failed to get receiving interface",
 		       __func__);
-		return;
+		return(1);
 	}
 	if (hlimp == NULL) {
 		errorlog("<%s> failed to get receiving hop limit",
 		       __func__);
-		return;
+		return(1);
 	}
 
     ifm = get_interface_entry(pi->ipi6_ifindex);
@@ -647,14 +698,14 @@ rtadvd_input()
 		       __func__,
 		       (ifm == NULL) ? "[gone]" :
 			    if_indextoname(pi->ipi6_ifindex, ifnamebuf));
-		return;
+		return(1);
 	}
 
 #ifdef OLDRAWSOCKET
 	if (i < sizeof(struct ip6_hdr) + sizeof(struct icmp6_hdr)) {
 		errorlog("<%s> packet size(%d) is too short",
 		       __func__, i);
-		return;
+		return(1);
 	}
 
 	ip = (struct ip6_hdr *)rcvmhdr.msg_iov[0].iov_base;
@@ -663,7 +714,7 @@ rtadvd_input()
 	if (i < sizeof(struct icmp6_hdr)) {
 		errorlog("<%s> packet size(%d) is too short",
 		       __func__, i);
-		return;
+		return(1);
 	}
 
 	icp = (struct icmp6_hdr *)rcvmhdr.msg_iov[0].iov_base;
@@ -683,7 +734,7 @@ rtadvd_input()
 			    inet_ntop(AF_INET6, &rcvfrom.sin6_addr, ntopbuf,
 			    INET6_ADDRSTRLEN),
 			    if_indextoname(pi->ipi6_ifindex, ifnamebuf));
-			return;
+			return(1);
 		}
 		if (icp->icmp6_code) {
 			noticelog("<%s> RS with invalid ICMP6 code(%d) "
@@ -692,7 +743,7 @@ rtadvd_input()
 			    inet_ntop(AF_INET6, &rcvfrom.sin6_addr, ntopbuf,
 			    INET6_ADDRSTRLEN),
 			    if_indextoname(pi->ipi6_ifindex, ifnamebuf));
-			return;
+			return(1);
 		}
 		if (i < sizeof(struct nd_router_solicit)) {
 			noticelog("<%s> RS from %s on %s does not have enough "
@@ -701,7 +752,7 @@ rtadvd_input()
 			    inet_ntop(AF_INET6, &rcvfrom.sin6_addr, ntopbuf,
 			    INET6_ADDRSTRLEN),
 			    if_indextoname(pi->ipi6_ifindex, ifnamebuf), i);
-			return;
+			return(1);
 		}
 		rs_input(i, (struct nd_router_solicit *)icp, pi, &rcvfrom);
 		break;
@@ -717,7 +768,7 @@ rtadvd_input()
 			    inet_ntop(AF_INET6, &rcvfrom.sin6_addr, ntopbuf,
 			    INET6_ADDRSTRLEN),
 			    if_indextoname(pi->ipi6_ifindex, ifnamebuf));
-			return;
+			return(1);
 		}
 		if (icp->icmp6_code) {
 			noticelog("<%s> RA with invalid ICMP6 code(%d) "
@@ -726,7 +777,7 @@ rtadvd_input()
 			    inet_ntop(AF_INET6, &rcvfrom.sin6_addr, ntopbuf,
 			    INET6_ADDRSTRLEN),
 			    if_indextoname(pi->ipi6_ifindex, ifnamebuf));
-			return;
+			return(1);
 		}
 		if (i < sizeof(struct nd_router_advert)) {
 			noticelog("<%s> RA from %s on %s does not have enough "
@@ -735,7 +786,7 @@ rtadvd_input()
 			    inet_ntop(AF_INET6, &rcvfrom.sin6_addr, ntopbuf,
 			    INET6_ADDRSTRLEN),
 			    if_indextoname(pi->ipi6_ifindex, ifnamebuf), i);
-			return;
+			return(1);
 		}
 		ra_input(i, (struct nd_router_advert *)icp, pi, &rcvfrom);
 		break;
@@ -758,10 +809,10 @@ rtadvd_input()
 		 */
 		errorlog("<%s> invalid icmp type(%d)",
 		    __func__, icp->icmp6_type);
-		return;
+		return(1);
 	}
 
-	return;
+	return(1);
 }
 
 static void
@@ -807,13 +858,7 @@ rs_input(int len, struct nd_router_solicit *rs,
 		goto done;
 	}
 
-	ra = ralist;
-	while (ra != NULL) {
-		if (pi->ipi6_ifindex == ra->ifindex)
-			break;
-		ra = ra->next;
-	}
-	if (ra == NULL) {
+	if ((ra = if_indextorainfo(pi->ipi6_ifindex)) == NULL) {
 		infolog("<%s> RS received on non advertising interface(%s)",
 		       __func__,
 		       if_indextoname(pi->ipi6_ifindex, ifnamebuf));
@@ -827,8 +872,14 @@ rs_input(int len, struct nd_router_solicit *rs,
 	 * consideration.
 	 */
 
-	/* record sockaddr waiting for RA, if possible */
-	sol = (struct soliciter *)malloc(sizeof(*sol));
+	/*
+	 * record sockaddr waiting for RA, if possible.  All of them are
+	 * answered by one multicast RA, so an RS storm only needs to be
+	 * remembered up to a bound.
+	 */
+	sol = NULL;
+	if (ra->waiting < MAX_SOLICITERS)
+		sol = (struct soliciter *)malloc(sizeof(*sol));
 	if (sol) {
 		sol->addr = *from;
 		/* XXX RFC2553 need clarification on flowinfo */
@@ -1175,26 +1226,7 @@ prefix_check(struct nd_opt_prefix_info *pinfo,
 struct prefix *
 find_prefix(struct rainfo *rai, struct in6_addr *prefix, int plen)
 {
-	struct prefix *pp;
-	int bytelen, bitlen;
-	u_char bitmask;
-
-	for (pp = rai->prefix.next; pp != &rai->prefix; pp = pp->next) {
-		if (plen != pp->prefixlen)
-			continue;
-		bytelen = plen / 8;
-		bitlen = plen % 8;
-		bitmask = 0xff << (8 - bitlen);
-		if (memcmp((void *)prefix, (void *)&pp->prefix, bytelen))
-			continue;
-		if (bitlen == 0 ||
-		    ((prefix->s6_addr[bytelen] & bitmask) == 
-		     (pp->prefix.s6_addr[bytelen] & bitmask))) {
-			return(pp);
-		}
-	}
-
-	return(NULL);
+	return(prefix_tree_lookup(rai, prefix, plen));
 }
 
 /* check if p0/plen0 matches p1/plen1; return 1 if matches, otherwise 0. */
@@ -1333,7 +1365,8 @@ sock_open()
 	struct icmp6_filter filt;
 	struct ipv6_mreq mreq;
 	struct rainfo *ra = ralist;
-	int on;
+	struct cmsghdr *cm;
+	int on, hoplimit;
 	/* XXX: should be max MTU attached to the node */
 	static u_char answer[1500];
 
@@ -1486,6 +1519,25 @@ sock_open()
 	sndmhdr.msg_iovlen = 1;
 	sndmhdr.msg_control = (caddr_t)sndcmsgbuf;
 	sndmhdr.msg_controllen = sndcmsgbuflen;
+
+	/*
+	 * The control data is the same for every RA but for the outgoing
+	 * interface, so build it once; ra_output() fills in the index.
+	 */
+	memset(sndcmsgbuf, 0, sndcmsgbuflen);
+	cm = CMSG_FIRSTHDR(&sndmhdr);
+	cm->cmsg_level = IPPROTO_IPV6;
+	cm->cmsg_type = IPV6_PKTINFO;
+	cm->cmsg_len = CMSG_LEN(sizeof(struct in6_pktinfo));
+	sndpktinfo = (struct in6_pktinfo *)CMSG_DATA(cm);
+
+	/* specify the hop limit of the packet */
+	hoplimit = 255;
+	cm = CMSG_NXTHDR(&sndmhdr, cm);
+	cm->cmsg_level = IPPROTO_IPV6;
+	cm->cmsg_type = IPV6_HOPLIMIT;
+	cm->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cm), &hoplimit, sizeof(int));
 	
 	return;
 }
@@ -1500,17 +1552,44 @@ rtsock_open()
 	}
 }
 
+/*
+ * Link a new rainfo into ralist and into the ifindex lookup table.
+ * A later entry for the same interface shadows the earlier one, as
+ * it did when ralist was searched from its head.
+ */
+void
+rainfo_insert(struct rainfo *rai)
+{
+	struct rainfo **newtab;
+	int newlen;
+
+	if (rai->ifindex >= ra_byindexlen) {
+		newlen = ra_byindexlen ? ra_byindexlen : 64;
+		while (newlen <= rai->ifindex)
+			newlen *= 2;
+		newtab = realloc(ra_byindex, newlen * sizeof(*ra_byindex));
+		if (newtab == NULL) {
+			errorlog("<%s> can't allocate memory", __func__);
+			exit(1);
+		}
+		memset(newtab + ra_byindexlen, 0,
+		    (newlen - ra_byindexlen) * sizeof(*ra_byindex));
+		ra_byindex = newtab;
+		ra_byindexlen = newlen;
+	}
+	ra_byindex[rai->ifindex] = rai;
+
+	rai->next = ralist;
+	ralist = rai;
+}
+
 struct rainfo *
 if_indextorainfo(int idx)
 {
-	struct rainfo *rai = ralist;
-
-	for (rai = ralist; rai; rai = rai->next) {
-		if (rai->ifindex == idx)
-			return(rai);
-	}
+	if (idx <= 0 || idx >= ra_byindexlen)
+		return(NULL);		/* search failed */
 
-	return(NULL);		/* search failed */
+	return(ra_byindex[idx]);
 }
 
 static void
@@ -1518,8 +1597,6 @@ ra_output(rainfo)
 struct rainfo *rainfo;
 {
 	int i;
-	struct cmsghdr *cm;
-	struct in6_pktinfo *pi;
 	struct soliciter *sol, *nextsol;
     struct if_msghdr *ifm = get_interface_entry(rainfo->ifindex);
 
@@ -1530,31 +1607,15 @@ struct rainfo *rainfo;
 		return;
 	}
 
-	make_packet(rainfo);	/* XXX: inefficient */
+	/* patch the cached packet, rebuilding it only if its layout changed */
+	refresh_packet(rainfo);
 
 	sndmhdr.msg_name = (caddr_t)&sin6_allnodes;
 	sndmhdr.msg_iov[0].iov_base = (caddr_t)rainfo->ra_data;
 	sndmhdr.msg_iov[0].iov_len = rainfo->ra_datalen;
 
-	cm = CMSG_FIRSTHDR(&sndmhdr);
-	/* specify the outgoing interface */
-	cm->cmsg_level = IPPROTO_IPV6;
-	cm->cmsg_type = IPV6_PKTINFO;
-	cm->cmsg_len = CMSG_LEN(sizeof(struct in6_pktinfo));
-	pi = (struct in6_pktinfo *)CMSG_DATA(cm);
-	memset(&pi->ipi6_addr, 0, sizeof(pi->ipi6_addr));	/*XXX*/
-	pi->ipi6_ifindex = rainfo->ifindex;
-
-	/* specify the hop limit of the packet */
-	{
-		int hoplimit = 255;
-
-		cm = CMSG_NXTHDR(&sndmhdr, cm);
-		cm->cmsg_level = IPPROTO_IPV6;
-		cm->cmsg_type = IPV6_HOPLIMIT;
-		cm->cmsg_len = CMSG_LEN(sizeof(int));
-		memcpy(CMSG_DATA(cm), &hoplimit, sizeof(int));
-	}
+	/* the rest of the control data was set up by sock_open() */
+	sndpktinfo->ipi6_ifindex = rainfo->ifindex;
 
 	debuglog("<%s> send RA on %s, # of waitings = %d",
 	       __func__, rainfo->ifname, rainfo->waiting); 
@@ -1648,3 +1709,132 @@ ra_timer_update(void *data, struct timeval *tm)
 
 	return;
 }
+
+/*
+ * Synthetic benchmark (-b): register ninterfaces fake advertising
+ * interfaces, each with an RA timer that is rearmed to a random interval
+ * below one second, and run the timer loop for a few seconds without
+ * touching the network.  Reports the cost of a wakeup, of an expiration,
+ * of an ifindex lookup and of a prefix lookup among BENCH_PREFIXES.
+ */
+#define BENCH_SECONDS	3
+#define BENCH_PREFIXES	256
+static u_quad_t bench_expired;
+
+static struct rtadvd_timer *
+bench_timeout(void *data)
+{
+	struct rainfo *rai = (struct rainfo *)data;
+
+	if (if_indextorainfo(rai->ifindex) != rai)
+		errx(1, "lookup of %s failed", rai->ifname);
+	bench_expired++;
+	return(rai->timer);
+}
+
+static void
+bench_update(void *data, struct timeval *tm)
+{
+#ifdef HAVE_ARC4RANDOM
+	tm->tv_usec = arc4random_uniform(1000000);
+#else
+	tm->tv_usec = random() % 1000000;
+#endif
+	tm->tv_sec = 0;
+}
+
+static double
+bench_elapsed(struct timespec *from, struct timespec *to)
+{
+	return((to->tv_sec - from->tv_sec) +
+	    (to->tv_nsec - from->tv_nsec) / 1e9);
+}
+
+static void
+timer_bench(int ninterfaces)
+{
+	struct rainfo *rais, *rai;
+	struct prefix *pfxs;
+	struct timespec start, end, t0, t1, ts;
+	struct timeval *timeout;
+	double setup, busy = 0, lookup, pfxlookup;
+	u_quad_t wakeups = 0, nlookups;
+	int i, idx;
+
+	if ((rais = calloc(ninterfaces, sizeof(*rais))) == NULL)
+		err(1, "calloc");
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < ninterfaces; i++) {
+		rai = &rais[i];
+		rai->ifindex = i + 1;
+		snprintf(rai->ifname, sizeof(rai->ifname), "bench%d", i);
+		rainfo_insert(rai);
+		rai->timer = rtadvd_add_timer(bench_timeout, bench_update,
+		    rai, rai);
+		bench_update(rai, &rai->timer->tm);
+		rtadvd_set_timer(&rai->timer->tm, rai->timer);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	setup = bench_elapsed(&t0, &t1);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		timeout = rtadvd_check_timer();
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		busy += bench_elapsed(&t0, &t1);
+		wakeups++;
+		if (timeout != NULL) {
+			TIMEVAL_TO_TIMESPEC(timeout, &ts);
+			nanosleep(&ts, NULL);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+	} while (bench_elapsed(&start, &end) < BENCH_SECONDS);
+
+	nlookups = 1000000;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (idx = 0; idx < (int)nlookups; idx++) {
+		if (if_indextorainfo(idx % ninterfaces + 1) == NULL)
+			errx(1, "lookup of index %d failed",
+			    idx % ninterfaces + 1);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	lookup = bench_elapsed(&t0, &t1);
+
+	/* random /64s under 2001:db8::/32 on the first interface */
+	if ((pfxs = calloc(BENCH_PREFIXES, sizeof(*pfxs))) == NULL)
+		err(1, "calloc");
+	rai = &rais[0];
+	for (i = 0; i < BENCH_PREFIXES; i++) {
+		pfxs[i].prefix.s6_addr[0] = 0x20;
+		pfxs[i].prefix.s6_addr[1] = 0x01;
+		pfxs[i].prefix.s6_addr[2] = 0x0d;
+		pfxs[i].prefix.s6_addr[3] = 0xb8;
+		for (idx = 4; idx < 8; idx++)
+			pfxs[i].prefix.s6_addr[idx] = random() & 0xff;
+		pfxs[i].prefixlen = 64;
+		pfxs[i].rainfo = rai;
+		prefix_tree_insert(rai, &pfxs[i]);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (idx = 0; idx < (int)nlookups; idx++) {
+		if (find_prefix(rai, &pfxs[idx % BENCH_PREFIXES].prefix,
+		    64) == NULL)
+			errx(1, "prefix lookup failed");
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	pfxlookup = bench_elapsed(&t0, &t1);
+
+	printf("%d interfaces, %.0f s: setup %.3f ms\n", ninterfaces,
+	    bench_elapsed(&start, &end), setup * 1e3);
+	printf("%llu wakeups, %llu expirations, %.3f%% busy\n",
+	    (unsigned long long)wakeups, (unsigned long long)bench_expired,
+	    100.0 * busy / bench_elapsed(&start, &end));
+	printf("%.3f us/wakeup, %.3f us/expiration, %.1f ns/lookup\n",
+	    busy * 1e6 / wakeups,
+	    bench_expired ? busy * 1e6 / bench_expired : 0.0,
+	    lookup * 1e9 / nlookups);
+	printf("%.1f ns/prefix lookup among %d prefixes\n",
+	    pfxlookup * 1e9 / nlookups, BENCH_PREFIXES);
+}
@@ -98,6 +98,9 @@ struct prefix {
 	int prefixlen;
 	int origin;		/* from kernel or config */
 	struct in6_addr prefix;
+
+	size_t pi_off;		/* offset of its option in rainfo->ra_data */
+	struct prefix *dupnext;	/* same prefix configured again, in pfxtree */
 };
 
 #ifdef ROUTEINFO
@@ -162,6 +165,7 @@ struct	rainfo {
 	u_int	hoplimit;	/* AdvCurHopLimit */
 	struct prefix prefix;	/* AdvPrefixList(link head) */
 	int	pfxs;		/* number of prefixes */
+	struct pfxnode *pfxtree; /* the same prefixes, indexed */
 	long	clockskew;	/* used for consisitency check of lifetimes */
 
 #ifdef ROUTEINFO
@@ -194,6 +198,10 @@ struct	rainfo {
 	/* actual RA packet data and its length */
 	size_t ra_datalen;
 	u_char *ra_data;
+	int	ra_stale;	/* layout changed, rebuild before sending */
+	struct prefix **ra_decr; /* prefixes with decrementing lifetimes */
+	int	ra_ndecr;
+	int	ra_decrmax;
 
 	/* statistics */
 	u_quad_t raoutput;	/* number of RAs sent */
@@ -209,6 +217,7 @@ struct rtadvd_timer *ra_timeout(void *);
 void ra_timer_update(void *, struct timeval *);
 
 int prefix_match(struct in6_addr *, int, struct in6_addr *, int);
+void rainfo_insert(struct rainfo *);
 struct rainfo *if_indextorainfo(int);
 struct prefix *find_prefix(struct rainfo *, struct in6_addr *, int);
 
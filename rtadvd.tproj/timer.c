@@ -34,25 +34,130 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
-#include <search.h>
+#include <time.h>
 #include "timer.h"
 #include "rtadvd_logging.h"
 
-static struct rtadvd_timer timer_head;
+/*
+ * Pending timers are kept in a binary min-heap ordered by expiration
+ * time, so arming, cancelling and finding the next expiration cost
+ * O(log n) regardless of the number of advertising interfaces.
+ * Expiration times are taken from the monotonic clock so that a step
+ * of the wall clock neither fires every timer at once nor stalls them.
+ */
+static struct rtadvd_timer **timer_heap;
+static int timer_count;		/* number of timers in the heap */
+static int timer_heapmax;	/* allocated slots */
+static u_int timer_pass;	/* rtadvd_check_timer() generation */
 
 #define MILLION 1000000
-#define TIMEVAL_EQUAL(t1,t2) ((t1)->tv_sec == (t2)->tv_sec &&\
- (t1)->tv_usec == (t2)->tv_usec)
+#define TIMER_HEAP_MIN 64
 
 static struct timeval tm_max = {0x7fffffff, 0x7fffffff};
 
+static void
+timer_now(struct timeval *tv)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	tv->tv_sec = ts.tv_sec;
+	tv->tv_usec = (int)(ts.tv_nsec / 1000);
+}
+
+static void
+heap_place(struct rtadvd_timer *timer, int i)
+{
+	timer_heap[i] = timer;
+	timer->heapidx = i;
+}
+
+static void
+heap_up(int i)
+{
+	struct rtadvd_timer *timer = timer_heap[i];
+	int parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (!TIMEVAL_LT(timer->tm, timer_heap[parent]->tm))
+			break;
+		heap_place(timer_heap[parent], i);
+		i = parent;
+	}
+	heap_place(timer, i);
+}
+
+static void
+heap_down(int i)
+{
+	struct rtadvd_timer *timer = timer_heap[i];
+	int child;
+
+	while ((child = 2 * i + 1) < timer_count) {
+		if (child + 1 < timer_count &&
+		    TIMEVAL_LT(timer_heap[child + 1]->tm, timer_heap[child]->tm))
+			child++;
+		if (!TIMEVAL_LT(timer_heap[child]->tm, timer->tm))
+			break;
+		heap_place(timer_heap[child], i);
+		i = child;
+	}
+	heap_place(timer, i);
+}
+
+/* (re)position a timer whose expiration time has just changed */
+static void
+heap_update(struct rtadvd_timer *timer)
+{
+	struct rtadvd_timer **newheap;
+	int newmax;
+
+	if (timer->heapidx < 0) {
+		if (timer_count == timer_heapmax) {
+			newmax = timer_heapmax ? timer_heapmax * 2 :
+			    TIMER_HEAP_MIN;
+			newheap = realloc(timer_heap,
+			    newmax * sizeof(*timer_heap));
+			if (newheap == NULL) {
+				errorlog("<%s> can't allocate memory",
+				    __func__);
+				exit(1);
+			}
+			timer_heap = newheap;
+			timer_heapmax = newmax;
+		}
+		heap_place(timer, timer_count++);
+		heap_up(timer->heapidx);
+		return;
+	}
+	heap_up(timer->heapidx);
+	heap_down(timer->heapidx);
+}
+
+static void
+heap_delete(struct rtadvd_timer *timer)
+{
+	struct rtadvd_timer *last;
+	int i = timer->heapidx;
+
+	if (i < 0)
+		return;
+	timer->heapidx = -1;
+	if (i == --timer_count)
+		return;
+	last = timer_heap[timer_count];
+	heap_place(last, i);
+	heap_up(i);
+	heap_down(last->heapidx);
+}
+
 void
 rtadvd_timer_init()
 {
-	memset(&timer_head, 0, sizeof(timer_head));
-
-	timer_head.next = timer_head.prev = &timer_head;
-	timer_head.tm = tm_max;
+	free(timer_heap);
+	timer_heap = NULL;
+	timer_count = timer_heapmax = 0;
 }
 
 struct rtadvd_timer *
@@ -79,8 +184,8 @@ rtadvd_add_timer(struct rtadvd_timer *(*timeout)(void *),
 	newtimer->update_data = updatedata;
 	newtimer->tm = tm_max;
 
-	/* link into chain */
-	insque(newtimer, &timer_head);
+	/* not queued until rtadvd_set_timer() arms it */
+	newtimer->heapidx = -1;
 
 	return(newtimer);
 }
@@ -88,7 +193,7 @@ rtadvd_add_timer(struct rtadvd_timer *(*timeout)(void *),
 void
 rtadvd_remove_timer(struct rtadvd_timer **timer)
 {
-	remque(*timer);
+	heap_delete(*timer);
 	free(*timer);
 	*timer = NULL;
 }
@@ -99,56 +204,54 @@ rtadvd_set_timer(struct timeval *tm, struct rtadvd_timer *timer)
 	struct timeval now;
 
 	/* reset the timer */
-	gettimeofday(&now, NULL);
+	timer_now(&now);
 
 	TIMEVAL_ADD(&now, tm, &timer->tm);
 
-	/* update the next expiration time */
-	if (TIMEVAL_LT(timer->tm, timer_head.tm))
-		timer_head.tm = timer->tm;
+	/* move it to its new place in the heap */
+	heap_update(timer);
 
 	return;
 }
 
 /*
- * Check expiration for each timer. If a timer expires,
- * call the expire function for the timer and update the timer.
- * Return the next interval for select() call.
+ * Call the expire function of each timer at the top of the heap that
+ * has expired, then update and requeue it.  A timer fires at most once
+ * per call even if it is rearmed with a zero interval.
+ * Return the next interval for the event loop.
  */
 struct timeval *
 rtadvd_check_timer()
 {
 	static struct timeval returnval;
 	struct timeval now;
-	struct rtadvd_timer *tm = timer_head.next, *tm_next;
-
-	gettimeofday(&now, NULL);
-
-	timer_head.tm = tm_max;
-
-	for (tm = timer_head.next; tm != &timer_head; tm = tm_next) {
-		tm_next = tm->next;
-
-		if (TIMEVAL_LEQ(tm->tm, now)) {
-			if (((*tm->expire)(tm->expire_data) == NULL))
-				continue; /* the timer was removed */
-			if (tm->update)
-				(*tm->update)(tm->update_data, &tm->tm);
-			TIMEVAL_ADD(&tm->tm, &now, &tm->tm);
-		}
-
-		if (TIMEVAL_LT(tm->tm, timer_head.tm))
-			timer_head.tm = tm->tm;
+	struct rtadvd_timer *tm;
+
+	timer_now(&now);
+
+	timer_pass++;
+	while (timer_count > 0) {
+		tm = timer_heap[0];
+		if (!TIMEVAL_LEQ(tm->tm, now) || tm->pass == timer_pass)
+			break;
+		tm->pass = timer_pass;
+
+		if (((*tm->expire)(tm->expire_data) == NULL))
+			continue; /* the timer was removed */
+		if (tm->update)
+			(*tm->update)(tm->update_data, &tm->tm);
+		TIMEVAL_ADD(&tm->tm, &now, &tm->tm);
+		heap_update(tm);
 	}
 
-	if (TIMEVAL_EQUAL(&tm_max, &timer_head.tm)) {
+	if (timer_count == 0) {
 		/* no need to timeout */
 		return(NULL);
-	} else if (TIMEVAL_LT(timer_head.tm, now)) {
+	} else if (TIMEVAL_LEQ(timer_heap[0]->tm, now)) {
 		/* this may occur when the interval is too small */
 		returnval.tv_sec = returnval.tv_usec = 0;
 	} else
-		TIMEVAL_SUB(&timer_head.tm, &now, &returnval);
+		TIMEVAL_SUB(&timer_heap[0]->tm, &now, &returnval);
 	return(&returnval);
 }
 
@@ -157,7 +260,7 @@ rtadvd_timer_rest(struct rtadvd_timer *timer)
 {
 	static struct timeval returnval, now;
 
-	gettimeofday(&now, NULL);
+	timer_now(&now);
 	if (TIMEVAL_LEQ(timer->tm, now)) {
 		debuglog("<%s> a timer must be expired, but not yet",
 		       __func__);
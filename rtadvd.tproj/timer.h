@@ -40,10 +40,10 @@
  			    ((a).tv_usec <= (b).tv_usec)))
 
 struct rtadvd_timer {
-	struct rtadvd_timer *next;
-	struct rtadvd_timer *prev;
+	int heapidx;		/* slot in the timer heap, -1 if not armed */
+	u_int pass;		/* last rtadvd_check_timer() pass it fired in */
 	struct rainfo *rai;
-	struct timeval tm;
+	struct timeval tm;	/* expiration, on the monotonic clock */
 
 	struct rtadvd_timer *(*expire)(void *);	/* expiration function */
 	void *expire_data;
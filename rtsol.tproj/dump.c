@@ -91,7 +91,7 @@ dump_interface_status()
 	struct ifinfo *ifinfo;
 	struct timeval now;
 
-	gettimeofday(&now, NULL);
+	rtsol_gettime(&now);
 
 	for (ifinfo = iflist; ifinfo; ifinfo = ifinfo->next) {
 		fprintf(fp, "Interface %s\n", ifinfo->ifname);
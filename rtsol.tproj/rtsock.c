@@ -63,6 +63,8 @@
 	 ((ap)->sa_len ? ROUNDUP((ap)->sa_len, sizeof(uint32_t)) \
 		       : sizeof(uint32_t)))
 
+static int rtsock_input_ifinfo __P((int, struct rt_msghdr *, char *));
+static int rtsock_input_newaddr __P((int, struct rt_msghdr *, char *));
 #ifdef RTM_IFANNOUNCE	/*NetBSD 1.5 or later*/
 static int rtsock_input_ifannounce __P((int, struct rt_msghdr *, char *));
 #endif
@@ -72,6 +74,8 @@ static struct {
 	size_t minlen;
 	int (*func) __P((int, struct rt_msghdr *, char *));
 } rtsock_dispatch[] = {
+	{ RTM_IFINFO, sizeof(struct if_msghdr), rtsock_input_ifinfo },
+	{ RTM_NEWADDR, sizeof(struct ifa_msghdr), rtsock_input_newaddr },
 #ifdef RTM_IFANNOUNCE	/*NetBSD 1.5 or later*/
 	{ RTM_IFANNOUNCE, sizeof(struct if_announcemsghdr),
 	  rtsock_input_ifannounce },
@@ -134,6 +138,63 @@ rtsock_input(s)
 	return ret;
 }
 
+/*
+ * Interface flags changed: let the interface react now rather than
+ * discovering the change when its timer next fires.
+ */
+static int
+rtsock_input_ifinfo(s, rtm, lim)
+	int s;
+	struct rt_msghdr *rtm;
+	char *lim;
+{
+	struct if_msghdr *ifm;
+	struct ifinfo *ifinfo;
+
+	ifm = (struct if_msghdr *)rtm;
+	if ((char *)(ifm + 1) > lim)
+		return -1;
+
+	if ((ifinfo = find_ifinfo(ifm->ifm_index)) == NULL)
+		return 0;
+	if (dflag > 1) {
+		warnmsg(LOG_INFO, __FUNCTION__,
+		    "flags of %s changed to 0x%x", ifinfo->ifname,
+		    ifm->ifm_flags);
+	}
+	rtsol_link_change(ifinfo, ifm->ifm_flags);
+
+	return 0;
+}
+
+/*
+ * An address was added, typically the link-local address an interface
+ * waits for before it can solicit.
+ */
+static int
+rtsock_input_newaddr(s, rtm, lim)
+	int s;
+	struct rt_msghdr *rtm;
+	char *lim;
+{
+	struct ifa_msghdr *ifam;
+	struct ifinfo *ifinfo;
+
+	ifam = (struct ifa_msghdr *)rtm;
+	if ((char *)(ifam + 1) > lim)
+		return -1;
+
+	if ((ifinfo = find_ifinfo(ifam->ifam_index)) == NULL)
+		return 0;
+	if (dflag > 1) {
+		warnmsg(LOG_INFO, __FUNCTION__,
+		    "address added on %s", ifinfo->ifname);
+	}
+	rtsol_link_change(ifinfo, -1);
+
+	return 0;
+}
+
 #ifdef RTM_IFANNOUNCE	/*NetBSD 1.5 or later*/
 static int
 rtsock_input_ifannounce(s, rtm, lim)
@@ -65,6 +65,7 @@ static struct msghdr sndmhdr;
 static struct iovec rcviov[2];
 static struct iovec sndiov[2];
 static struct sockaddr_in6 from;
+static struct in6_pktinfo *sndpktinfo;
 
 int rssock;
 
@@ -77,6 +78,8 @@ sockopen()
 	struct icmp6_filter filt;
 	static u_char answer[1500];
 	int rcvcmsglen, sndcmsglen;
+	int hoplimit = 255;
+	struct cmsghdr *cm;
 	static u_char *rcvcmsgbuf = NULL, *sndcmsgbuf = NULL;
 
 	sndcmsglen = rcvcmsglen = CMSG_SPACE(sizeof(struct in6_pktinfo)) +
@@ -167,6 +170,26 @@ sockopen()
 	sndmhdr.msg_control = (caddr_t)sndcmsgbuf;
 	sndmhdr.msg_controllen = sndcmsglen;
 
+	/*
+	 * The ancillary data is the same for every RS but for the
+	 * outgoing interface, so build it once here and let
+	 * sendpacket() fill in only the interface index.
+	 */
+	cm = CMSG_FIRSTHDR(&sndmhdr);
+	/* specify the outgoing interface */
+	cm->cmsg_level = IPPROTO_IPV6;
+	cm->cmsg_type = IPV6_PKTINFO;
+	cm->cmsg_len = CMSG_LEN(sizeof(struct in6_pktinfo));
+	sndpktinfo = (struct in6_pktinfo *)CMSG_DATA(cm);
+	memset(sndpktinfo, 0, sizeof(*sndpktinfo));
+
+	/* specify the hop limit of the packet */
+	cm = CMSG_NXTHDR(&sndmhdr, cm);
+	cm->cmsg_level = IPPROTO_IPV6;
+	cm->cmsg_type = IPV6_HOPLIMIT;
+	cm->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cm), &hoplimit, sizeof(int));
+
 	return(rssock);
 }
 
@@ -174,32 +197,13 @@ void
 sendpacket(struct ifinfo *ifinfo)
 {
 	int i;
-	struct cmsghdr *cm;
-	struct in6_pktinfo *pi;
 
 	sndmhdr.msg_name = (caddr_t)&sin6_allrouters;
 	sndmhdr.msg_iov[0].iov_base = (caddr_t)ifinfo->rs_data;
 	sndmhdr.msg_iov[0].iov_len = ifinfo->rs_datalen;
 
-	cm = CMSG_FIRSTHDR(&sndmhdr);
-	/* specify the outgoing interface */
-	cm->cmsg_level = IPPROTO_IPV6;
-	cm->cmsg_type = IPV6_PKTINFO;
-	cm->cmsg_len = CMSG_LEN(sizeof(struct in6_pktinfo));
-	pi = (struct in6_pktinfo *)CMSG_DATA(cm);
-	memset(&pi->ipi6_addr, 0, sizeof(pi->ipi6_addr));	/*XXX*/
-	pi->ipi6_ifindex = ifinfo->sdl->sdl_index;
-
-	/* specify the hop limit of the packet */
-	{
-		int hoplimit = 255;
-
-		cm = CMSG_NXTHDR(&sndmhdr, cm);
-		cm->cmsg_level = IPPROTO_IPV6;
-		cm->cmsg_type = IPV6_HOPLIMIT;
-		cm->cmsg_len = CMSG_LEN(sizeof(int));
-		memcpy(CMSG_DATA(cm), &hoplimit, sizeof(int));
-	}
+	/* the rest of the ancillary data was set up by sockopen() */
+	sndpktinfo->ipi6_ifindex = ifinfo->sdl->sdl_index;
 
 	warnmsg(LOG_DEBUG,
 	       __FUNCTION__, "send RS on %s, whose state is %d",
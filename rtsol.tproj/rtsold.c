@@ -34,6 +34,7 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/socket.h>
+#include <sys/event.h>
 
 #include <net/if.h>
 #include <net/if_dl.h>
@@ -50,6 +51,7 @@
 #include <errno.h>
 #include <err.h>
 #include <stdarg.h>
+#include <time.h>
 #include <ifaddrs.h>
 #include "rtsold.h"
 
@@ -67,6 +69,10 @@ static int fflag = 0;
 
 /* implementation dependent constants */
 #define PROBE_INTERVAL 60	/* secondes XXX: should be configurable */
+#define RS_BATCH	32	/* max RSs sent in one timer pass */
+#define RS_SPREAD	250000	/* usec; spread of deferred and woken timers */
+#define TIMER_COALESCE	10000	/* usec; timers this close fire together */
+#define TIMER_HEAP_MIN	64
 
 /* utility macros */
 /* a < b */
@@ -90,12 +96,32 @@ static int do_dump;
 static char *dumpfilename = "/var/run/rtsold.dump"; /* XXX: should be configurable */
 static char *pidfilename = "/var/run/rtsold.pid"; /* should be configurable */
 
+/*
+ * Interfaces with a running timer are kept in a binary min-heap ordered
+ * by expiration, and configured interfaces are indexed by ifindex, so
+ * neither a timer pass nor an RA lookup walks the whole interface list.
+ */
+static struct ifinfo **timer_heap;
+static int timer_count;		/* number of interfaces in the heap */
+static int timer_heapmax;	/* allocated slots */
+static u_int timer_pass;	/* rtsol_check_timer() generation */
+static struct ifinfo **ifindex2info;
+static int ifindex2infolen;
+
 static int ifconfig __P((char *ifname));
 #if 0
 static int ifreconfig __P((char *ifname));
 #endif
 static int make_packet __P((struct ifinfo *ifinfo));
+static void ifindex_insert __P((struct ifinfo *ifinfo));
 static struct timeval *rtsol_check_timer __P((void));
+static void rtsol_timer_set __P((struct ifinfo *ifinfo, long usec));
+static long rtsol_random __P((long range));
+static void heap_place __P((struct ifinfo *ifinfo, int i));
+static void heap_up __P((int i));
+static void heap_down __P((int i));
+static void heap_update __P((struct ifinfo *ifinfo));
+static void heap_delete __P((struct ifinfo *ifinfo));
 static void TIMEVAL_ADD __P((struct timeval *a, struct timeval *b,
 			     struct timeval *result));
 static void TIMEVAL_SUB __P((struct timeval *a, struct timeval *b,
@@ -110,10 +136,12 @@ main(argc, argv)
 	int argc;
 	char *argv[];
 {
-	int s, rtsock, maxfd, ch;
+	int s, rtsock, ch;
+	int kq, nkev, i;
 	int once = 0;
 	struct timeval *timeout;
-	struct fd_set fdset;
+	struct timespec ts, *tsp;
+	struct kevent kev[3];
 	char *argv0;
 	char *opts;
 
@@ -208,11 +236,11 @@ main(argc, argv)
 	if (getinet6sysctl(IPV6CTL_FORWARDING))
 		warnx("kernel is configured as a router, not a host");
 
-	/* initialization to dump internal status to a file */
-	if (signal(SIGUSR1, (void *)rtsold_set_dump_file) < 0) {
-		errx(1, "failed to set signal for dump status");
-		/*NOTREACHED*/
-	}
+	/*
+	 * SIGUSR1 requests a dump of the internal status; it is picked
+	 * up by the kqueue below, so the default action is disabled.
+	 */
+	signal(SIGUSR1, SIG_IGN);
 
 	/*
 	 * Open a socket for sending RS and receiving RA.
@@ -223,13 +251,10 @@ main(argc, argv)
 		errx(1, "failed to open a socket");
 		/*NOTREACHED*/
 	}
-	maxfd = s;
 	if ((rtsock = rtsock_open()) < 0) {
 		errx(1, "failed to open a socket");
 		/*NOTREACHED*/
 	}
-	if (rtsock > maxfd)
-		maxfd = rtsock;
 
 	/* configuration per interface */
 	if (ifinit()) {
@@ -268,12 +293,26 @@ main(argc, argv)
 		}
 	}
 
-	FD_ZERO(&fdset);
-	FD_SET(s, &fdset);
-	FD_SET(rtsock, &fdset);
+	/*
+	 * Wait on a kqueue rather than select(); SIGUSR1 is delivered as
+	 * an event as well.  This must follow daemon(), as a kqueue is
+	 * not inherited by the child.
+	 */
+	if ((kq = kqueue()) < 0) {
+		errx(1, "kqueue: %s", strerror(errno));
+		/*NOTREACHED*/
+	}
+	nkev = 0;
+	EV_SET(&kev[nkev++], s, EVFILT_READ, EV_ADD, 0, 0, NULL);
+	EV_SET(&kev[nkev++], rtsock, EVFILT_READ, EV_ADD, 0, 0, NULL);
+	EV_SET(&kev[nkev++], SIGUSR1, EVFILT_SIGNAL, EV_ADD, 0, 0, NULL);
+	if (kevent(kq, kev, nkev, NULL, 0, NULL) < 0) {
+		errx(1, "failed to set events: %s", strerror(errno));
+		/*NOTREACHED*/
+	}
+
 	while (1) {		/* main loop */
-		int e;
-		struct fd_set select_fd = fdset;
+		int rtready, sready;
 
 		if (do_dump) {	/* SIGUSR1 */
 			do_dump = 0;
@@ -297,19 +336,35 @@ main(argc, argv)
 			if (ifi == NULL)
 				break;
 		}
-		e = select(maxfd + 1, &select_fd, NULL, NULL, timeout);
-		if (e < 1) {
-			if (e < 0 && errno != EINTR) {
-				warnmsg(LOG_ERR, __FUNCTION__, "select: %s",
+		if (timeout != NULL) {
+			TIMEVAL_TO_TIMESPEC(timeout, &ts);
+			tsp = &ts;
+		} else
+			tsp = NULL;
+		nkev = kevent(kq, NULL, 0, kev, sizeof(kev) / sizeof(kev[0]),
+		    tsp);
+		if (nkev < 1) {
+			if (nkev < 0 && errno != EINTR) {
+				warnmsg(LOG_ERR, __FUNCTION__, "kevent: %s",
 				       strerror(errno));
 			}
 			continue;
 		}
 
-		/* packet reception */
-		if (FD_ISSET(rtsock, &select_fd))
+		rtready = sready = 0;
+		for (i = 0; i < nkev; i++) {
+			if (kev[i].filter == EVFILT_SIGNAL)
+				rtsold_set_dump_file();
+			else if ((int)kev[i].ident == rtsock)
+				rtready = 1;
+			else if ((int)kev[i].ident == s)
+				sready = 1;
+		}
+
+		/* packet reception; link state first, as before */
+		if (rtready)
 			rtsock_input(rtsock);
-		if (FD_ISSET(s, &select_fd))
+		if (sready)
 			rtsol_input(s);
 	}
 	/* NOTREACHED */
@@ -343,6 +398,7 @@ ifconfig(char *ifname)
 	}
 	memset(ifinfo, 0, sizeof(*ifinfo));
 	ifinfo->sdl = sdl;
+	ifinfo->heapidx = -1;
 
 	strlcpy(ifinfo->ifname, ifname, sizeof(ifinfo->ifname));
 
@@ -379,6 +435,7 @@ ifconfig(char *ifname)
 	if (iflist)
 		ifinfo->next = iflist;
 	iflist = ifinfo;
+	ifindex_insert(ifinfo);
 
 	return(0);
 
@@ -415,16 +472,36 @@ ifreconfig(char *ifname)
 }
 #endif
 
+static void
+ifindex_insert(struct ifinfo *ifinfo)
+{
+	struct ifinfo **newtab;
+	int idx = ifinfo->sdl->sdl_index, newlen;
+
+	if (idx >= ifindex2infolen) {
+		newlen = ifindex2infolen ? ifindex2infolen : TIMER_HEAP_MIN;
+		while (newlen <= idx)
+			newlen *= 2;
+		newtab = realloc(ifindex2info, newlen * sizeof(*newtab));
+		if (newtab == NULL) {
+			warnmsg(LOG_ERR, __FUNCTION__,
+				"memory allocation failed");
+			exit(1);
+		}
+		memset(newtab + ifindex2infolen, 0,
+		    (newlen - ifindex2infolen) * sizeof(*newtab));
+		ifindex2info = newtab;
+		ifindex2infolen = newlen;
+	}
+	ifindex2info[idx] = ifinfo;
+}
+
 struct ifinfo *
 find_ifinfo(int ifindex)
 {
-	struct ifinfo *ifi;
-
-	for (ifi = iflist; ifi; ifi = ifi->next)
-		if (ifi->sdl->sdl_index == ifindex)
-			return(ifi);
-
-	return(NULL);
+	if (ifindex <= 0 || ifindex >= ifindex2infolen)
+		return(NULL);
+	return(ifindex2info[ifindex]);
 }
 
 static int
@@ -465,102 +542,126 @@ make_packet(struct ifinfo *ifinfo)
 	return(0);
 }
 
+/*
+ * Handle the interfaces at the top of the timer heap whose timers have
+ * expired, or will within TIMER_COALESCE, so that interfaces coming up
+ * together share wakeups.  At most RS_BATCH solicitations go out per
+ * pass; interfaces beyond that are pushed back by a random delay within
+ * RS_SPREAD instead of all transmitting in the same instant.
+ */
 static struct timeval *
 rtsol_check_timer()
 {
 	static struct timeval returnval;
-	struct timeval now, rtsol_timer;
+	static struct timeval coalesce = {0, TIMER_COALESCE};
+	struct timeval now, deadline;
 	struct ifinfo *ifinfo;
-	int flags;
+	int flags, nsent;
 
-	gettimeofday(&now, NULL);
+	rtsol_gettime(&now);
+	TIMEVAL_ADD(&now, &coalesce, &deadline);
 
-	rtsol_timer = tm_max;
+	timer_pass++;
+	nsent = 0;
+	while (timer_count > 0) {
+		ifinfo = timer_heap[0];
+		if (!TIMEVAL_LEQ(ifinfo->expire, deadline) ||
+		    ifinfo->pass == timer_pass)
+			break;
+		ifinfo->pass = timer_pass;
 
-	for (ifinfo = iflist; ifinfo; ifinfo = ifinfo->next) {
-		if (TIMEVAL_LEQ(ifinfo->expire, now)) {
+		if (nsent >= RS_BATCH &&
+		    (ifinfo->state == IFS_DELAY ||
+		     (ifinfo->state == IFS_PROBE &&
+		      ifinfo->probes < MAX_RTR_SOLICITATIONS))) {
 			if (dflag > 1)
 				warnmsg(LOG_DEBUG, __FUNCTION__,
-					"timer expiration on %s, "
-				       "state = %d", ifinfo->ifname,
-				       ifinfo->state);
-
-			switch (ifinfo->state) {
-			case IFS_DOWN:
-			case IFS_TENTATIVE:
-				/* interface_up returns 0 on success */
-				flags = interface_up(ifinfo->ifname);
-				if (flags == 0)
-					ifinfo->state = IFS_DELAY;
-				else if (flags == IFS_TENTATIVE)
-					ifinfo->state = IFS_TENTATIVE;
-				else
-					ifinfo->state = IFS_DOWN;
-				break;
-			case IFS_IDLE:
-			{
-				int oldstatus = ifinfo->active;
-				int probe = 0;
-
-				ifinfo->active =
-					interface_status(ifinfo);
-
-				if (oldstatus != ifinfo->active) {
-					warnmsg(LOG_DEBUG, __FUNCTION__,
-						"%s status is changed"
-						" from %d to %d",
-						ifinfo->ifname,
-						oldstatus, ifinfo->active);
-					probe = 1;
-					ifinfo->state = IFS_DELAY;
-				}
-				else if (ifinfo->probeinterval &&
-					 (ifinfo->probetimer -=
-					  ifinfo->timer.tv_sec) <= 0) {
-					/* probe timer expired */
-					ifinfo->probetimer =
-						ifinfo->probeinterval;
-					probe = 1;
-					ifinfo->state = IFS_PROBE;
-				}
-
-				if (probe && mobile_node)
-					defrouter_probe(ifinfo->sdl->sdl_index);
-				break;
+					"defer RS on %s", ifinfo->ifname);
+			rtsol_timer_set(ifinfo,
+			    TIMER_COALESCE + rtsol_random(RS_SPREAD));
+			continue;
+		}
+
+		if (dflag > 1)
+			warnmsg(LOG_DEBUG, __FUNCTION__,
+				"timer expiration on %s, "
+			       "state = %d", ifinfo->ifname,
+			       ifinfo->state);
+
+		switch (ifinfo->state) {
+		case IFS_DOWN:
+		case IFS_TENTATIVE:
+			/* interface_up returns 0 on success */
+			flags = interface_up(ifinfo->ifname);
+			if (flags == 0)
+				ifinfo->state = IFS_DELAY;
+			else if (flags == IFS_TENTATIVE)
+				ifinfo->state = IFS_TENTATIVE;
+			else
+				ifinfo->state = IFS_DOWN;
+			break;
+		case IFS_IDLE:
+		{
+			int oldstatus = ifinfo->active;
+			int probe = 0;
+
+			ifinfo->active =
+				interface_status(ifinfo);
+
+			if (oldstatus != ifinfo->active) {
+				warnmsg(LOG_DEBUG, __FUNCTION__,
+					"%s status is changed"
+					" from %d to %d",
+					ifinfo->ifname,
+					oldstatus, ifinfo->active);
+				probe = 1;
+				ifinfo->state = IFS_DELAY;
 			}
-			case IFS_DELAY:
+			else if (ifinfo->probeinterval &&
+				 (ifinfo->probetimer -=
+				  ifinfo->timer.tv_sec) <= 0) {
+				/* probe timer expired */
+				ifinfo->probetimer =
+					ifinfo->probeinterval;
+				probe = 1;
 				ifinfo->state = IFS_PROBE;
+			}
+
+			if (probe && mobile_node)
+				defrouter_probe(ifinfo->sdl->sdl_index);
+			break;
+		}
+		case IFS_DELAY:
+			ifinfo->state = IFS_PROBE;
+			sendpacket(ifinfo);
+			nsent++;
+			break;
+		case IFS_PROBE:
+			if (ifinfo->probes < MAX_RTR_SOLICITATIONS) {
 				sendpacket(ifinfo);
-				break;
-			case IFS_PROBE:
-				if (ifinfo->probes < MAX_RTR_SOLICITATIONS)
-					sendpacket(ifinfo);
-				else {
-					warnmsg(LOG_INFO, __FUNCTION__,
-						"No answer "
-						"after sending %d RSs",
-						ifinfo->probes);
-					ifinfo->probes = 0;
-					ifinfo->state = IFS_IDLE;
-				}
-				break;
+				nsent++;
+			} else {
+				warnmsg(LOG_INFO, __FUNCTION__,
+					"No answer "
+					"after sending %d RSs",
+					ifinfo->probes);
+				ifinfo->probes = 0;
+				ifinfo->state = IFS_IDLE;
 			}
-			rtsol_timer_update(ifinfo);
+			break;
 		}
-
-		if (TIMEVAL_LT(ifinfo->expire, rtsol_timer))
-			rtsol_timer = ifinfo->expire;
+		rtsol_timer_update(ifinfo);
 	}
 
-	if (TIMEVAL_EQ(rtsol_timer, tm_max)) {
+	if (timer_count == 0) {
 		warnmsg(LOG_DEBUG, __FUNCTION__, "there is no timer");
 		return(NULL);
 	}
-	else if (TIMEVAL_LT(rtsol_timer, now))
+	else if (TIMEVAL_LEQ(timer_heap[0]->expire, now))
 		/* this may occur when the interval is too small */
 		returnval.tv_sec = returnval.tv_usec = 0;
 	else
-		TIMEVAL_SUB(&rtsol_timer, &now, &returnval);
+		TIMEVAL_SUB(&timer_heap[0]->expire, &now, &returnval);
 
 	if (dflag > 1)
 		warnmsg(LOG_DEBUG, __FUNCTION__, "New timer is %ld:%08ld",
@@ -575,7 +676,6 @@ rtsol_timer_update(struct ifinfo *ifinfo)
 #define MILLION 1000000
 #define DADRETRY 10		/* XXX: adhoc */
 	long interval;
-	struct timeval now;
 
 	bzero(&ifinfo->timer, sizeof(ifinfo->timer));
 
@@ -586,8 +686,15 @@ rtsol_timer_update(struct ifinfo *ifinfo)
 			ifinfo->dadcount = 0;
 			ifinfo->timer.tv_sec = PROBE_INTERVAL;
 		}
-		else
-			ifinfo->timer.tv_sec = 1;
+		else {
+			/*
+			 * Retry after about a second, jittered so that
+			 * interfaces brought up together do not poll in step.
+			 */
+			interval = MILLION / 2 + rtsol_random(MILLION);
+			ifinfo->timer.tv_sec = interval / MILLION;
+			ifinfo->timer.tv_usec = interval % MILLION;
+		}
 		break;
 	case IFS_IDLE:
 		if (mobile_node) {
@@ -598,11 +705,7 @@ rtsol_timer_update(struct ifinfo *ifinfo)
 			ifinfo->timer = tm_max;	/* stop timer(valid?) */
 		break;
 	case IFS_DELAY:
-#ifndef HAVE_ARC4RANDOM
-		interval = random() % (MAX_RTR_SOLICITATION_DELAY * MILLION);
-#else
-		interval = arc4random() % (MAX_RTR_SOLICITATION_DELAY * MILLION);
-#endif
+		interval = rtsol_random(MAX_RTR_SOLICITATION_DELAY * MILLION);
 		ifinfo->timer.tv_sec = interval / MILLION;
 		ifinfo->timer.tv_usec = interval % MILLION;
 		break;
@@ -630,12 +733,13 @@ rtsol_timer_update(struct ifinfo *ifinfo)
 	/* reset the timer */
 	if (TIMEVAL_EQ(ifinfo->timer, tm_max)) {
 		ifinfo->expire = tm_max;
+		heap_delete(ifinfo);
 		warnmsg(LOG_DEBUG, __FUNCTION__,
 			"stop timer for %s", ifinfo->ifname);
 	}
 	else {
-		gettimeofday(&now, NULL);
-		TIMEVAL_ADD(&now, &ifinfo->timer, &ifinfo->expire);
+		rtsol_timer_set(ifinfo,
+		    ifinfo->timer.tv_sec * MILLION + ifinfo->timer.tv_usec);
 
 		if (dflag > 1)
 			warnmsg(LOG_DEBUG, __FUNCTION__,
@@ -647,6 +751,162 @@ rtsol_timer_update(struct ifinfo *ifinfo)
 #undef MILLION
 }
 
+/*
+ * Called from the routing socket when the flags or addresses of an
+ * interface change; ifflags is -1 when the message carries no flags.
+ * An interface waiting to come up is rechecked right away instead of
+ * at its next retry, and one that goes down stops soliciting until it
+ * is back, at which point it solicits again.
+ */
+void
+rtsol_link_change(struct ifinfo *ifinfo, int ifflags)
+{
+	switch (ifinfo->state) {
+	case IFS_DOWN:
+	case IFS_TENTATIVE:
+		if (ifflags != -1 && !(ifflags & IFF_UP))
+			break;
+		ifinfo->dadcount = 0;
+		rtsol_timer_set(ifinfo, rtsol_random(RS_SPREAD));
+		break;
+	case IFS_IDLE:
+	case IFS_DELAY:
+	case IFS_PROBE:
+		if (ifflags == -1 ||
+		    (ifflags & (IFF_UP|IFF_RUNNING)) == (IFF_UP|IFF_RUNNING))
+			break;
+		warnmsg(LOG_DEBUG, __FUNCTION__, "%s went down",
+			ifinfo->ifname);
+		ifinfo->state = IFS_DOWN;
+		ifinfo->probes = 0;
+		ifinfo->dadcount = 0;
+		rtsol_timer_update(ifinfo);
+		break;
+	}
+}
+
+void
+rtsol_gettime(struct timeval *tv)
+{
+	struct timespec ts;
+
+	/* timers must not follow steps of the wall clock */
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	tv->tv_sec = ts.tv_sec;
+	tv->tv_usec = (int)(ts.tv_nsec / 1000);
+}
+
+/* arm the timer of an interface to expire usec from now */
+static void
+rtsol_timer_set(struct ifinfo *ifinfo, long usec)
+{
+	struct timeval now, tv;
+
+	tv.tv_sec = usec / 1000000;
+	tv.tv_usec = usec % 1000000;
+	rtsol_gettime(&now);
+	TIMEVAL_ADD(&now, &tv, &ifinfo->expire);
+	heap_update(ifinfo);
+}
+
+static long
+rtsol_random(long range)
+{
+#ifndef HAVE_ARC4RANDOM
+	return(random() % range);
+#else
+	return(arc4random() % range);
+#endif
+}
+
+static void
+heap_place(struct ifinfo *ifinfo, int i)
+{
+	timer_heap[i] = ifinfo;
+	ifinfo->heapidx = i;
+}
+
+static void
+heap_up(int i)
+{
+	struct ifinfo *ifinfo = timer_heap[i];
+	int parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (!TIMEVAL_LT(ifinfo->expire, timer_heap[parent]->expire))
+			break;
+		heap_place(timer_heap[parent], i);
+		i = parent;
+	}
+	heap_place(ifinfo, i);
+}
+
+static void
+heap_down(int i)
+{
+	struct ifinfo *ifinfo = timer_heap[i];
+	int child;
+
+	while ((child = 2 * i + 1) < timer_count) {
+		if (child + 1 < timer_count &&
+		    TIMEVAL_LT(timer_heap[child + 1]->expire,
+			timer_heap[child]->expire))
+			child++;
+		if (!TIMEVAL_LT(timer_heap[child]->expire, ifinfo->expire))
+			break;
+		heap_place(timer_heap[child], i);
+		i = child;
+	}
+	heap_place(ifinfo, i);
+}
+
+/* (re)position an interface whose expiration time has just changed */
+static void
+heap_update(struct ifinfo *ifinfo)
+{
+	struct ifinfo **newheap;
+	int newmax;
+
+	if (ifinfo->heapidx < 0) {
+		if (timer_count == timer_heapmax) {
+			newmax = timer_heapmax ? timer_heapmax * 2 :
+			    TIMER_HEAP_MIN;
+			newheap = realloc(timer_heap,
+			    newmax * sizeof(*timer_heap));
+			if (newheap == NULL) {
+				warnmsg(LOG_ERR, __FUNCTION__,
+					"memory allocation failed");
+				exit(1);
+			}
+			timer_heap = newheap;
+			timer_heapmax = newmax;
+		}
+		heap_place(ifinfo, timer_count++);
+		heap_up(ifinfo->heapidx);
+		return;
+	}
+	heap_up(ifinfo->heapidx);
+	heap_down(ifinfo->heapidx);
+}
+
+static void
+heap_delete(struct ifinfo *ifinfo)
+{
+	struct ifinfo *last;
+	int i = ifinfo->heapidx;
+
+	if (i < 0)
+		return;
+	ifinfo->heapidx = -1;
+	if (i == --timer_count)
+		return;
+	last = timer_heap[timer_count];
+	heap_place(last, i);
+	heap_up(i);
+	heap_down(last->heapidx);
+}
+
 /* timer related utility functions */
 #define MILLION 1000000
 
@@ -33,6 +33,8 @@
 
 struct ifinfo {
 	struct ifinfo *next;	/* pointer to the next interface */
+	int heapidx;		/* slot in the timer heap, -1 if stopped */
+	u_int pass;		/* timer pass in which it last fired */
 
 	struct sockaddr_dl *sdl; /* link-layer address */
 	char ifname[IF_NAMESIZE]; /* interface name */
@@ -66,6 +68,8 @@ extern struct timeval tm_max;
 extern int dflag;
 struct ifinfo *find_ifinfo __P((int ifindex));
 void rtsol_timer_update __P((struct ifinfo *ifinfo));
+void rtsol_link_change __P((struct ifinfo *ifinfo, int ifflags));
+void rtsol_gettime __P((struct timeval *tv));
 extern void warnmsg __P((int, const char *, const char *, ...))
      __attribute__((__format__(__printf__, 3, 4)));
 
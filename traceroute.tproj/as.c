@@ -39,43 +39,101 @@
 
 #include <sys/cdefs.h>
 #include <sys/types.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <err.h>
 #include <stdio.h>
+#include <time.h>
 
 #include "as.h"
 
 #define DEFAULT_AS_SERVER "whois.radb.net"
 #undef AS_DEBUG_FILE
 
+/*
+ * Prefix to AS number cache.  Every answer from the server is kept as
+ * the route it came from (or as a /32 if it named none, named one not
+ * covering the address, or had no origin at all), and later
+ * addresses falling inside a known route are answered by longest
+ * prefix match without a query.  Entries are kept sorted by prefix
+ * length and then prefix, with as_start[] giving the first entry of
+ * each length, so a lookup is at most one binary search per length.
+ *
+ * If a cache file is given, it holds the same table behind a small
+ * header and is mapped read-only at setup; what this run learns is
+ * merged back into it at shutdown.
+ */
+#define AS_CACHE_MAGIC	0x41534331	/* "ASC1" */
+#define AS_CACHE_TTL	(7 * 24 * 60 * 60)
+#define AS_NPLEN	33		/* prefix lengths 0 to 32 */
+#define AS_MAXBATCH	64		/* queries in flight at once */
+
+struct as_ent {
+	u_int32_t ae_prefix;		/* host order, masked to ae_plen */
+	u_int32_t ae_as;		/* 0 if the server knew none */
+	u_int32_t ae_time;		/* when the server said so */
+	u_int8_t ae_plen;
+	u_int8_t ae_pad[3];
+};
+
+struct as_hdr {
+	u_int32_t ah_magic;
+	u_int32_t ah_count;
+	u_int32_t ah_start[AS_NPLEN + 1];
+};
+
+struct as_tab {
+	struct as_ent *at_ent;
+	u_int32_t at_count;
+	u_int32_t at_max;
+	u_int32_t at_start[AS_NPLEN + 1];
+};
+
 struct aslookup {
 	FILE *as_f;
+	char *as_server;		/* connected on the first miss */
+	int as_failed;			/* and not tried again if that fails */
+	char *as_path;			/* cache file, or NULL */
+	void *as_map;
+	size_t as_maplen;
+	struct as_tab as_disk;		/* mapped from as_path */
+	struct as_tab as_new;		/* learned by this run */
 #ifdef AS_DEBUG_FILE
 	FILE *as_debug;
 #endif /* AS_DEBUG_FILE */
 };
 
-void *
-as_setup(server)
+static FILE *as_connect __P((char *));
+static int as_answer __P((struct aslookup *, u_int32_t *, int *));
+static struct as_ent *as_find __P((struct aslookup *, u_int32_t));
+static void as_insert __P((struct as_tab *, u_int32_t, int, int));
+static void as_query __P((struct aslookup *, struct in_addr *, int));
+static void as_load __P((struct aslookup *));
+static void as_save __P((struct aslookup *));
+static int as_entcmp __P((const void *, const void *));
+static void as_standin __P((int)) __dead2;
+static int as_test_run __P((char *, int, double *));
+
+static FILE *
+as_connect(server)
 	char *server;
 {
-	struct aslookup *asn;
 	struct hostent *he = NULL;
 	struct servent *se;
 	struct sockaddr_in in;
 	FILE *f;
 	int s;
 
-	if (server == NULL)
-		server = DEFAULT_AS_SERVER;
-
 	(void)memset(&in, 0, sizeof(in));
 	in.sin_family = AF_INET;
 	in.sin_len = sizeof(in);
@@ -119,12 +177,35 @@ as_setup(server)
 	f = fdopen(s, "r+");
 	(void)fprintf(f, "!!\n");
 	(void)fflush(f);
+	return (f);
+}
 
-	asn = malloc(sizeof(struct aslookup));
+/*
+ * Without a cache file the server is connected to right away, as it
+ * always was.  With one, the connection waits for the first address
+ * the cache cannot answer, so a warm cache needs no network at all.
+ */
+void *
+as_setup(server, cache)
+	char *server;
+	char *cache;
+{
+	struct aslookup *asn;
+
+	if (server == NULL)
+		server = DEFAULT_AS_SERVER;
+
+	asn = calloc(1, sizeof(struct aslookup));
 	if (asn == NULL)
-		(void)fclose(f);
-	else
-		asn->as_f = f;
+		return (NULL);
+	asn->as_server = server;
+	if (cache != NULL) {
+		asn->as_path = cache;
+		as_load(asn);
+	} else if ((asn->as_f = as_connect(server)) == NULL) {
+		free(asn);
+		return (NULL);
+	}
 
 #ifdef AS_DEBUG_FILE
 	asn->as_debug = fopen(AS_DEBUG_FILE, "w");
@@ -137,28 +218,27 @@ as_setup(server)
 	return (asn);
 }
 
-int
-as_lookup(_asn, addr)
-	void *_asn;
-	struct in_addr *addr;
+/*
+ * Read one answer off the connection.  Returns the origin AS, 0 if
+ * there was none or -1 if the connection was lost, and the route it
+ * belongs to in *prefixp and *plenp (*plenp is -1 if the answer named
+ * no route).
+ */
+static int
+as_answer(asn, prefixp, plenp)
+	struct aslookup *asn;
+	u_int32_t *prefixp;
+	int *plenp;
 {
-	struct aslookup *asn = _asn;
-	char buf[1024];
-	int as, rc, dlen;
+	char buf[1024], route[16];
+	struct in_addr ra;
+	int as, rc, dlen, plen;
 
 	as = rc = dlen = 0;
-	(void)fprintf(asn->as_f, "!r%s/32,l\n", inet_ntoa(*addr));
-	(void)fflush(asn->as_f);
-
-#ifdef AS_DEBUG_FILE
-	if (asn->as_debug) {
-		(void)fprintf(asn->as_debug, ">> !r%s/32,l\n",
-		     inet_ntoa(*addr));
-		(void)fflush(asn->as_debug);
-	}
-#endif /* AS_DEBUG_FILE */
-
-	while (fgets(buf, sizeof(buf), asn->as_f) != NULL) {
+	*plenp = -1;
+	for (;;) {
+		if (fgets(buf, sizeof(buf), asn->as_f) == NULL)
+			return (-1);
 		buf[sizeof(buf) - 1] = '\0';
 
 #ifdef AS_DEBUG_FILE
@@ -207,6 +287,14 @@ as_lookup(_asn, addr)
 		/* data received, thank you */
 		dlen -= strlen(buf);
 
+		/* the route line says how far the answer reaches */
+		if (*plenp < 0 && strncasecmp(buf, "route:", 6) == 0 &&
+		    sscanf(buf + 6, " %15[0-9.]/%d", route, &plen) == 2 &&
+		    plen >= 0 && plen <= 32 && inet_aton(route, &ra) != 0) {
+			*prefixp = ntohl(ra.s_addr);
+			*plenp = plen;
+		}
+
 		/* origin line is the interesting bit */
 		if (as == 0 && strncasecmp(buf, "origin:", 7) == 0) {
 			sscanf(buf + 7, " AS%d", &as);
@@ -222,14 +310,336 @@ as_lookup(_asn, addr)
 	return (as);
 }
 
+/*
+ * Ask the server about n addresses at once: all the queries are
+ * written before the first answer is read, so the batch costs one
+ * round trip instead of n.  The answers come back in order.
+ */
+static void
+as_query(asn, addrs, n)
+	struct aslookup *asn;
+	struct in_addr *addrs;
+	int n;
+{
+	u_int32_t addr, prefix, mask;
+	int i, as, plen;
+
+	if (asn->as_f == NULL) {
+		if (asn->as_failed)
+			return;
+		if ((asn->as_f = as_connect(asn->as_server)) == NULL) {
+			asn->as_failed = 1;
+			return;
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		(void)fprintf(asn->as_f, "!r%s/32,l\n", inet_ntoa(addrs[i]));
+#ifdef AS_DEBUG_FILE
+		if (asn->as_debug)
+			(void)fprintf(asn->as_debug, ">> !r%s/32,l\n",
+			     inet_ntoa(addrs[i]));
+#endif /* AS_DEBUG_FILE */
+	}
+	(void)fflush(asn->as_f);
+
+	for (i = 0; i < n; i++) {
+		addr = ntohl(addrs[i].s_addr);
+		if ((as = as_answer(asn, &prefix, &plen)) < 0) {
+			warnx("%s: connection lost", asn->as_server);
+			(void)fclose(asn->as_f);
+			asn->as_f = NULL;
+			asn->as_failed = 1;
+			return;
+		}
+		mask = plen > 0 ? ~0U << (32 - plen) : 0;
+		if (plen < 0 || (addr & mask) != (prefix & mask)) {
+			prefix = addr;
+			plen = 32;
+			mask = ~0U;
+		}
+		as_insert(&asn->as_new, prefix & mask, plen, as);
+	}
+}
+
+int
+as_lookup(_asn, addr)
+	void *_asn;
+	struct in_addr *addr;
+{
+	struct aslookup *asn = _asn;
+	struct as_ent *ae;
+
+	if ((ae = as_find(asn, ntohl(addr->s_addr))) == NULL) {
+		as_query(asn, addr, 1);
+		ae = as_find(asn, ntohl(addr->s_addr));
+	}
+	return (ae != NULL ? ae->ae_as : 0);
+}
+
+/*
+ * Look up every address in addrs that the cache cannot answer with
+ * pipelined queries, so that the as_lookup() calls that follow do not
+ * each wait on the server.
+ */
+void
+as_prefetch(_asn, addrs, n)
+	void *_asn;
+	struct in_addr *addrs;
+	int n;
+{
+	struct aslookup *asn = _asn;
+	struct in_addr miss[AS_MAXBATCH];
+	int i, j, nmiss;
+
+	for (i = 0, nmiss = 0; i < n; i++) {
+		if (as_find(asn, ntohl(addrs[i].s_addr)) != NULL)
+			continue;
+		for (j = 0; j < nmiss; j++)
+			if (miss[j].s_addr == addrs[i].s_addr)
+				break;
+		if (j < nmiss)
+			continue;
+		miss[nmiss++] = addrs[i];
+		if (nmiss == AS_MAXBATCH) {
+			as_query(asn, miss, nmiss);
+			nmiss = 0;
+		}
+	}
+	if (nmiss > 0)
+		as_query(asn, miss, nmiss);
+}
+
+/*
+ * Longest prefix match over both tables.  Entries past AS_CACHE_TTL
+ * are treated as missing.
+ */
+static struct as_ent *
+as_find(asn, addr)
+	struct aslookup *asn;
+	u_int32_t addr;
+{
+	struct as_tab *tabs[2], *at;
+	struct as_ent *ae;
+	u_int32_t key, lo, hi, mid;
+	time_t now;
+	int plen, t;
+
+	tabs[0] = &asn->as_new;
+	tabs[1] = &asn->as_disk;
+	now = time(NULL);
+	for (plen = 32; plen >= 0; plen--) {
+		key = plen > 0 ? addr & (~0U << (32 - plen)) : 0;
+		for (t = 0; t < 2; t++) {
+			at = tabs[t];
+			lo = at->at_start[plen];
+			hi = at->at_start[plen + 1];
+			while (lo < hi) {
+				mid = lo + (hi - lo) / 2;
+				ae = &at->at_ent[mid];
+				if (ae->ae_prefix < key)
+					lo = mid + 1;
+				else if (ae->ae_prefix > key)
+					hi = mid;
+				else {
+					if (now - ae->ae_time < AS_CACHE_TTL)
+						return (ae);
+					break;
+				}
+			}
+		}
+	}
+	return (NULL);
+}
+
+static void
+as_insert(at, prefix, plen, as)
+	struct as_tab *at;
+	u_int32_t prefix;
+	int plen, as;
+{
+	struct as_ent *ae;
+	u_int32_t lo, hi, mid;
+	int i;
+
+	lo = at->at_start[plen];
+	hi = at->at_start[plen + 1];
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (at->at_ent[mid].ae_prefix < prefix)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo < at->at_start[plen + 1] && at->at_ent[lo].ae_prefix == prefix) {
+		ae = &at->at_ent[lo];
+	} else {
+		if (at->at_count == at->at_max) {
+			at->at_max = at->at_max ? at->at_max * 2 : 64;
+			ae = realloc(at->at_ent, at->at_max * sizeof(*ae));
+			if (ae == NULL) {
+				warn("realloc");
+				return;
+			}
+			at->at_ent = ae;
+		}
+		ae = &at->at_ent[lo];
+		memmove(ae + 1, ae, (at->at_count - lo) * sizeof(*ae));
+		at->at_count++;
+		for (i = plen + 1; i <= AS_NPLEN; i++)
+			at->at_start[i]++;
+	}
+	memset(ae, 0, sizeof(*ae));
+	ae->ae_prefix = prefix;
+	ae->ae_plen = plen;
+	ae->ae_as = as;
+	ae->ae_time = time(NULL);
+}
+
+/*
+ * Map the cache file, if it is there and looks sane.
+ */
+static void
+as_load(asn)
+	struct aslookup *asn;
+{
+	struct as_hdr *ah;
+	struct stat sb;
+	void *p;
+	int fd, i;
+
+	if ((fd = open(asn->as_path, O_RDONLY)) == -1) {
+		if (errno != ENOENT)
+			warn("%s", asn->as_path);
+		return;
+	}
+	if (fstat(fd, &sb) == -1 || sb.st_size < (off_t)sizeof(*ah)) {
+		(void)close(fd);
+		return;
+	}
+	p = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	(void)close(fd);
+	if (p == MAP_FAILED) {
+		warn("mmap %s", asn->as_path);
+		return;
+	}
+	ah = p;
+	if (ah->ah_magic != AS_CACHE_MAGIC || sb.st_size !=
+	    (off_t)(sizeof(*ah) + ah->ah_count * sizeof(struct as_ent)) ||
+	    ah->ah_start[0] != 0 || ah->ah_start[AS_NPLEN] != ah->ah_count) {
+		warnx("%s: not an AS cache, ignored", asn->as_path);
+		(void)munmap(p, sb.st_size);
+		return;
+	}
+	for (i = 0; i < AS_NPLEN; i++)
+		if (ah->ah_start[i] > ah->ah_start[i + 1]) {
+			warnx("%s: corrupt, ignored", asn->as_path);
+			(void)munmap(p, sb.st_size);
+			return;
+		}
+	asn->as_map = p;
+	asn->as_maplen = sb.st_size;
+	asn->as_disk.at_ent = (struct as_ent *)(ah + 1);
+	asn->as_disk.at_count = ah->ah_count;
+	memcpy(asn->as_disk.at_start, ah->ah_start, sizeof(ah->ah_start));
+}
+
+static int
+as_entcmp(a, b)
+	const void *a, *b;
+{
+	const struct as_ent *x = a, *y = b;
+
+	if (x->ae_plen != y->ae_plen)
+		return (x->ae_plen < y->ae_plen ? -1 : 1);
+	if (x->ae_prefix != y->ae_prefix)
+		return (x->ae_prefix < y->ae_prefix ? -1 : 1);
+	/* newest first, so it is the one kept */
+	if (x->ae_time != y->ae_time)
+		return (x->ae_time > y->ae_time ? -1 : 1);
+	return (0);
+}
+
+/*
+ * Merge what this run learned into the cache file, dropping expired
+ * entries, and replace the file atomically.
+ */
+static void
+as_save(asn)
+	struct aslookup *asn;
+{
+	struct as_hdr ah;
+	struct as_ent *ents, *ae;
+	u_int32_t n, i, j;
+	time_t now;
+	char tmp[1024];
+	FILE *f;
+
+	if (asn->as_new.at_count == 0)
+		return;
+	n = asn->as_disk.at_count + asn->as_new.at_count;
+	if ((ents = malloc(n * sizeof(*ents))) == NULL) {
+		warn("malloc");
+		return;
+	}
+	memcpy(ents, asn->as_new.at_ent,
+	    asn->as_new.at_count * sizeof(*ents));
+	memcpy(ents + asn->as_new.at_count, asn->as_disk.at_ent,
+	    asn->as_disk.at_count * sizeof(*ents));
+	qsort(ents, n, sizeof(*ents), as_entcmp);
+
+	now = time(NULL);
+	memset(&ah, 0, sizeof(ah));
+	for (i = 0, j = 0; i < n; i++) {
+		ae = &ents[i];
+		if (now - ae->ae_time >= AS_CACHE_TTL)
+			continue;
+		if (j > 0 && ents[j - 1].ae_plen == ae->ae_plen &&
+		    ents[j - 1].ae_prefix == ae->ae_prefix)
+			continue;
+		ents[j++] = *ae;
+		ah.ah_start[ae->ae_plen + 1] = j;
+	}
+	for (i = 1; i <= AS_NPLEN; i++)
+		if (ah.ah_start[i] < ah.ah_start[i - 1])
+			ah.ah_start[i] = ah.ah_start[i - 1];
+	ah.ah_magic = AS_CACHE_MAGIC;
+	ah.ah_count = j;
+
+	(void)snprintf(tmp, sizeof(tmp), "%s.%d", asn->as_path, getpid());
+	if ((f = fopen(tmp, "w")) == NULL) {
+		warn("%s", tmp);
+		free(ents);
+		return;
+	}
+	if (fwrite(&ah, sizeof(ah), 1, f) != 1 ||
+	    fwrite(ents, sizeof(*ents), j, f) != j) {
+		warn("%s", tmp);
+		(void)fclose(f);
+		(void)unlink(tmp);
+	} else if (fclose(f) == EOF || rename(tmp, asn->as_path) == -1) {
+		warn("%s", asn->as_path);
+		(void)unlink(tmp);
+	}
+	free(ents);
+}
+
 void
 as_shutdown(_asn)
 	void *_asn;
 {
 	struct aslookup *asn = _asn;
 
-	(void)fprintf(asn->as_f, "!q\n");
-	(void)fclose(asn->as_f);
+	if (asn->as_f != NULL) {
+		(void)fprintf(asn->as_f, "!q\n");
+		(void)fclose(asn->as_f);
+	}
+
+	if (asn->as_path != NULL)
+		as_save(asn);
+	if (asn->as_map != NULL)
+		(void)munmap(asn->as_map, asn->as_maplen);
+	free(asn->as_new.at_ent);
 
 #ifdef AS_DEBUG_FILE
 	if (asn->as_debug) {
@@ -240,3 +650,175 @@ as_shutdown(_asn)
 
 	free(asn);
 }
+
+/*
+ * Self test and benchmark (traceroute -T): look a few documentation
+ * addresses up against a stand-in for the whois server, once with a cold
+ * cache file and once with the file that run left behind, check both the
+ * answers and how many queries reached the server, and time lookups
+ * answered from the warm cache.
+ */
+static const struct {
+	const char *sd_addr;
+	const char *sd_reply;		/* NULL: key not found */
+} as_standin_db[] = {
+	/* covered by the route named */
+	{ "192.0.2.1",		"route: 192.0.2.0/24\norigin: AS64496\n" },
+	/* the route named does not cover the address */
+	{ "198.51.100.7",	"route: 203.0.113.0/24\norigin: AS64497\n" },
+	/* no route named */
+	{ "203.0.113.9",	"origin: AS64498\n" },
+};
+
+static const struct {
+	const char *tl_addr;
+	int tl_as;
+} as_test_lookups[] = {
+	/* the first AS_TEST_PREFETCH are prefetched when the cache is cold */
+	{ "192.0.2.1",		64496 },
+	{ "198.51.100.7",	64497 },
+	{ "203.0.113.9",	64498 },
+	{ "233.252.0.1",	0 },
+	/* answered from 192.0.2.0/24 */
+	{ "192.0.2.200",	64496 },
+	/* not from 198.51.100.7's answer */
+	{ "198.51.100.8",	0 },
+};
+#define AS_TEST_NLOOKUPS \
+	((int)(sizeof(as_test_lookups) / sizeof(as_test_lookups[0])))
+#define AS_TEST_PREFETCH	4
+#define AS_TEST_COLD		5	/* queries expected from a cold cache */
+#define AS_TEST_TIMED		1000000	/* warm lookups timed */
+
+/*
+ * Answer queries on fd until told to quit, then exit with the number
+ * of queries asked.
+ */
+static void
+as_standin(fd)
+	int fd;
+{
+	FILE *in, *out;
+	char buf[1024], addr[16];
+	const char *reply;
+	int i, nq;
+
+	if ((in = fdopen(fd, "r")) == NULL ||
+	    (out = fdopen(dup(fd), "w")) == NULL)
+		_exit(255);
+	nq = 0;
+	while (fgets(buf, sizeof(buf), in) != NULL) {
+		if (strncmp(buf, "!q", 2) == 0)
+			break;
+		if (sscanf(buf, "!r%15[0-9.]/32,l", addr) != 1)
+			continue;
+		nq++;
+		reply = NULL;
+		for (i = 0; i < (int)(sizeof(as_standin_db) /
+		    sizeof(as_standin_db[0])); i++)
+			if (strcmp(addr, as_standin_db[i].sd_addr) == 0)
+				reply = as_standin_db[i].sd_reply;
+		if (reply != NULL)
+			(void)fprintf(out, "A%d\n%sC\n", (int)strlen(reply),
+			    reply);
+		else
+			(void)fprintf(out, "D\n");
+		(void)fflush(out);
+	}
+	_exit(nq);
+}
+
+/*
+ * One run against a fresh stand-in: every address is looked up twice,
+ * the second round having to come from the cache.  A warm run then
+ * times AS_TEST_TIMED more lookups and stores the cost of one, in
+ * nanoseconds, in *nsp.  Returns the number of queries the stand-in
+ * saw, or -1 if an answer was wrong.
+ */
+static int
+as_test_run(path, cold, nsp)
+	char *path;
+	int cold;
+	double *nsp;
+{
+	static char server[] = "stand-in";
+	struct aslookup *asn;
+	struct in_addr addrs[AS_TEST_NLOOKUPS];
+	struct timespec t0, t1;
+	int sv[2], i, round, as, bad, status;
+	pid_t pid;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+		warn("socketpair");
+		return (-1);
+	}
+	if ((pid = fork()) == -1) {
+		warn("fork");
+		return (-1);
+	}
+	if (pid == 0) {
+		(void)close(sv[0]);
+		as_standin(sv[1]);
+	}
+	(void)close(sv[1]);
+
+	if ((asn = calloc(1, sizeof(*asn))) == NULL)
+		err(1, "calloc");
+	asn->as_server = server;
+	asn->as_path = path;
+	as_load(asn);
+	if ((asn->as_f = fdopen(sv[0], "r+")) == NULL)
+		err(1, "fdopen");
+
+	for (i = 0; i < AS_TEST_NLOOKUPS; i++)
+		(void)inet_aton(as_test_lookups[i].tl_addr, &addrs[i]);
+	if (cold)
+		as_prefetch(asn, addrs, AS_TEST_PREFETCH);
+	bad = 0;
+	for (round = 0; round < 2; round++)
+		for (i = 0; i < AS_TEST_NLOOKUPS; i++) {
+			as = as_lookup(asn, &addrs[i]);
+			if (as == as_test_lookups[i].tl_as)
+				continue;
+			warnx("%s: AS%d, expected AS%d",
+			    as_test_lookups[i].tl_addr, as,
+			    as_test_lookups[i].tl_as);
+			bad = 1;
+		}
+	if (!cold) {
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for (i = 0; i < AS_TEST_TIMED; i++)
+			(void)as_lookup(asn, &addrs[i % AS_TEST_NLOOKUPS]);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		*nsp = ((t1.tv_sec - t0.tv_sec) * 1e9 +
+		    (t1.tv_nsec - t0.tv_nsec)) / AS_TEST_TIMED;
+	}
+	as_shutdown(asn);
+
+	if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status)) {
+		warnx("stand-in server failed");
+		return (-1);
+	}
+	return (bad ? -1 : WEXITSTATUS(status));
+}
+
+int
+as_test()
+{
+	char path[] = "/tmp/traceroute.as.XXXXXX";
+	double ns = 0;
+	int fd, cold, warm;
+
+	if ((fd = mkstemp(path)) == -1)
+		err(1, "mkstemp");
+	(void)close(fd);
+	cold = as_test_run(path, 1, &ns);
+	warm = cold < 0 ? -1 : as_test_run(path, 0, &ns);
+	(void)unlink(path);
+
+	printf("cold cache: %d queries (expected %d)\n", cold, AS_TEST_COLD);
+	printf("warm cache: %d queries (expected 0)\n", warm);
+	if (warm == 0)
+		printf("cached lookup: %.1f ns\n", ns);
+	return (cold == AS_TEST_COLD && warm == 0 ? 0 : 1);
+}
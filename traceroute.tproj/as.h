@@ -37,6 +37,8 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
-void	*as_setup __P((char *));
+void	*as_setup __P((char *, char *));
 int	as_lookup __P((void *, struct in_addr *));
+void	as_prefetch __P((void *, struct in_addr *, int));
 void	as_shutdown __P((void *));
+int	as_test __P((void));
@@ -289,6 +289,7 @@ The Regents of the University of California.  All rights reserved.\n";
 #include "ifaddrlist.h"
 #include "as.h"
 #include "traceroute.h"
+#include "../ping.tproj/in_cksum.h"
 
 /* Maximum number of gateways (include room for one noop) */
 #define NGATEWAYS ((int)((MAX_IPOPTLEN - IPOPT_MINOFF - 1) / sizeof(u_int32_t)))
@@ -377,6 +378,7 @@ int waittime = 5;		/* time to wait for response (in seconds) */
 int nflag;			/* print addresses numerically */
 int as_path;			/* print as numbers for each hop */
 char *as_server = NULL;
+char *as_cache = NULL;		/* AS# cache file kept across runs */
 void *asn;
 #ifdef CANT_HACK_IPCKSUM
 int doipcksum = 0;		/* don't calculate ip checksums by default */
@@ -386,6 +388,74 @@ int doipcksum = 1;		/* calculate ip checksums by default */
 int optlen;			/* length of ip options */
 int fixedPort = 0;		/* Use fixed destination port for TCP and UDP */
 int printdiff = 0;		/* Print the difference between sent and quoted */
+int sump = 0;			/* print a loss summary for each hop */
+int window = 0;			/* probes in flight at once (0 = serial) */
+
+/*
+ * Parallel mode state.  Each destination being traced has a struct
+ * trace whose probes for every (ttl, probe) pair live in t_probes[],
+ * hop-major.  The u_char seq carried by a probe indexes seqtab[] while
+ * it is outstanding, so a reply can be matched to its trace and hop
+ * without waiting on it.  Seq 0 is never sent, and seqs are unique
+ * across all traces in flight.
+ */
+#define	NSEQ		256
+#define	PR_IDLE		0	/* not sent yet */
+#define	PR_SENT		1	/* outstanding */
+#define	PR_DONE		2	/* answered or timed out */
+
+struct probe {
+	u_char	pr_state;
+	u_char	pr_rttl;	/* ttl of the reply packet */
+	int	pr_code;	/* packet_ok() result, 0 if lost */
+	int	pr_cc;		/* length of the reply, less ip header */
+	int	pr_mtu;		/* next-hop mtu from a NEEDFRAG reply */
+	u_char	pr_seq;		/* seq the probe was sent with */
+	struct	trace *pr_trace;	/* trace the probe belongs to */
+	struct	sockaddr_in pr_from;
+	struct	in_addr pr_dst;
+	struct	timeval pr_sent;
+	double	pr_rtt;
+};
+
+#define	T_WAIT		0	/* not started */
+#define	T_ACTIVE	1	/* probes being sent */
+#define	T_DONE		2	/* all hops printed */
+
+struct trace {
+	int	t_state;
+	struct	in_addr t_dst;
+	struct	probe *t_probes;
+	int	t_next;		/* next probe to send */
+	int	t_hop;		/* first hop not yet printed */
+	int	t_cached;	/* leading hops taken from the hop cache */
+	int	t_lastttl;	/* lowest ttl known to reach t_dst */
+	struct	hopcache *t_hc;	/* hop cache entry for t_dst's prefix */
+};
+
+/*
+ * Batch mode hop cache.  Destinations in the same /HC_PLEN share their
+ * path up to the last transit hop, so once one of them has been traced
+ * the others reuse its leading TIME_EXCEEDED hops for HC_LIFETIME
+ * seconds instead of probing them again.
+ */
+#define	HC_PLEN		24
+#define	HC_LIFETIME	300
+#define	HC_NBUCKETS	1024
+
+struct hopcache {
+	struct	hopcache *hc_next;
+	u_int32_t hc_prefix;	/* host order, masked to HC_PLEN */
+	int	hc_busy;	/* a trace for the prefix is active */
+	int	hc_nhops;	/* transit hops in hc_probes */
+	time_t	hc_time;	/* when hc_probes was filled */
+	struct	probe *hc_probes;
+};
+
+struct probe *seqtab[NSEQ];	/* outstanding probe for each seq */
+int rseq;			/* seq matched by the last packet_ok(.., 0) */
+char *batchfile;		/* batch mode destination list */
+struct hopcache *hctab[HC_NBUCKETS];
 
 extern int optind;
 extern int opterr;
@@ -396,13 +466,23 @@ double	deltaT(struct timeval *, struct timeval *);
 void	freehostinfo(struct hostinfo *);
 void	getaddr(u_int32_t *, char *);
 struct	hostinfo *gethostinfo(char *);
-u_short	in_cksum(u_short *, int);
 char	*inetname(struct in_addr);
 int	main(int, char **);
 u_short p_cksum(struct ip *, u_short *, int);
 int	packet_ok(u_char *, int, struct sockaddr_in *, int);
 char	*pr_type(u_char);
 void	print(u_char *, int, struct sockaddr_in *);
+void	print_from(struct sockaddr_in *, struct in_addr, int);
+int	pr_hop(int, struct probe *);
+void	pr_rtt(double);
+void	pr_status(int, int, int, int *, int *);
+int	probe_check(const u_char *, int, int);
+struct	trace *read_batch(char *, int *);
+struct	hopcache *hc_lookup(struct in_addr);
+void	hc_store(struct trace *);
+int	pr_record(struct trace *, int, struct probe *, int);
+void	trace_parallel(struct sockaddr_in *, struct trace *, int);
+void	as_prefetch_trace(struct trace *);
 #ifdef	IPSEC
 int	setpolicy __P((int so, char *policy));
 #endif
@@ -497,7 +577,7 @@ const char *ip_hdr_key = "vhtslen id  off tlprsum srcip   dstip   opts";
 int
 main(int argc, char **argv)
 {
-	register int op, code, n;
+	register int op, n;
 	register char *cp;
 	register const char *err;
 	register u_int32_t *ap;
@@ -514,8 +594,9 @@ main(int argc, char **argv)
 	struct ifaddrlist *al;
 	char errbuf[132];
 	int requestPort = -1;
-	int sump = 0;
 	int sockerrno = 0;
+	struct trace *traces = NULL;
+	int ntraces = 0;
 
 	if (argv[0] == NULL)
 		prog = "traceroute";
@@ -563,7 +644,7 @@ main(int argc, char **argv)
 #endif
 
 	opterr = 0;
-	while ((op = getopt(argc, argv, "aA:edDFInrSvxf:g:i:M:m:P:p:q:s:t:w:z:")) != EOF)
+	while ((op = getopt(argc, argv, "aA:B:C:edDFInrSTvxf:g:i:M:m:N:P:p:q:s:t:w:z:")) != EOF)
 		switch (op) {
 		case 'a':
 			as_path = 1;
@@ -573,6 +654,23 @@ main(int argc, char **argv)
 			as_path = 1;
 			as_server = optarg;
 			break;
+
+		case 'B':
+			batchfile = optarg;
+			break;
+
+		case 'C':
+			as_path = 1;
+			as_cache = optarg;
+			break;
+
+		case 'T':
+			/* Nothing is probed; don't keep the raw sockets. */
+			if (s > 0)
+				(void)close(s);
+			if (sndsock > 0)
+				(void)close(sndsock);
+			exit(as_test());
 			    
 		case 'd':
 			options |= SO_DEBUG;
@@ -622,6 +720,11 @@ main(int argc, char **argv)
 			++nflag;
 			break;
 
+		case 'N':
+			window = str2val(optarg, "probes in flight",
+			    1, NSEQ - 1);
+			break;
+
 		case 'P':
 			proto = setproto(optarg);
 			break;
@@ -684,6 +787,21 @@ main(int argc, char **argv)
 	if (nprobes == -1)
 		nprobes = printdiff ? 1 : 3;
 
+	if (batchfile != NULL) {
+		if (lsrr > 0) {
+			Fprintf(stderr, "%s: -g may not be used with -B\n",
+			    prog);
+			exit(1);
+		}
+		if (window == 0)
+			window = 32;
+	}
+
+	if (window > 0 && printdiff) {
+		Fprintf(stderr, "%s: -D may not be used with -N\n", prog);
+		exit(1);
+	}
+
 	if (first_ttl > max_ttl) {
 		Fprintf(stderr,
 		    "%s: first ttl (%d) may not be greater than max ttl (%d)\n",
@@ -700,6 +818,25 @@ main(int argc, char **argv)
 	packlen = minpacket;			/* minimum sized packet */
 
 	/* Process destination and optional packet size */
+	if (batchfile != NULL) {
+		/* The destinations come from the file */
+		switch (argc - optind) {
+
+		case 1:
+			packlen = str2val(argv[optind],
+			    "packet length", minpacket, maxpacket);
+			/* Fall through */
+
+		case 0:
+			break;
+
+		default:
+			usage();
+		}
+		traces = read_batch(batchfile, &ntraces);
+		setsin(to, traces[0].t_dst.s_addr);
+		hostname = batchfile;
+	} else
 	switch (argc - optind) {
 
 	case 2:
@@ -952,7 +1089,7 @@ main(int argc, char **argv)
 	}
 
 	if (as_path) {
-		asn = as_setup(as_server);
+		asn = as_setup(as_server, as_cache);
 		if (asn == NULL) {
 			Fprintf(stderr, "%s: as_setup failed, AS# lookups"
 			    " disabled\n", prog);
@@ -969,13 +1106,33 @@ main(int argc, char **argv)
 		errx(1, "%s", ipsec_strerror());
 #endif	/* defined(IPSEC) && defined(IPSEC_POLICY_IPSEC) */
 
-	Fprintf(stderr, "%s to %s (%s)",
-	    prog, hostname, inet_ntoa(to->sin_addr));
+	if (batchfile != NULL)
+		Fprintf(stderr, "%s: %d destinations from %s",
+		    prog, ntraces, batchfile);
+	else
+		Fprintf(stderr, "%s to %s (%s)",
+		    prog, hostname, inet_ntoa(to->sin_addr));
 	if (source)
 		Fprintf(stderr, " from %s", source);
 	Fprintf(stderr, ", %d hops max, %d byte packets\n", max_ttl, packlen);
 	(void)fflush(stderr);
 
+	if (window > 0) {
+		if (traces == NULL) {
+			if ((traces = calloc(1, sizeof(*traces))) == NULL) {
+				Fprintf(stderr, "%s: calloc: %s\n",
+				    prog, strerror(errno));
+				exit(1);
+			}
+			traces->t_dst = to->sin_addr;
+			ntraces = 1;
+		}
+		trace_parallel(from, traces, ntraces);
+		if (as_path)
+			as_shutdown(asn);
+		exit(0);
+	}
+
 	for (ttl = first_ttl; ttl <= max_ttl; ++ttl) {
 		u_int32_t lastaddr = 0;
 		int gotlastaddr = 0;
@@ -1009,9 +1166,6 @@ main(int argc, char **argv)
 
 			/* Wait for a reply */
 			while ((cc = wait_for_reply(s, from, &t1)) != 0) {
-				double T;
-				int precis;
-
 				(void)gettimeofday(&t2, &tz);
 				i = packet_ok(packet, cc, from, seq);
 				/* Skip short packet */
@@ -1024,18 +1178,7 @@ main(int argc, char **argv)
 					lastaddr = from->sin_addr.s_addr;
 					++gotlastaddr;
 				}
-				T = deltaT(&t1, &t2);
-#ifdef SANE_PRECISION
-				if (T >= 1000.0)
-					precis = 0;
-				else if (T >= 100.0)
-					precis = 1;
-				else if (T >= 10.0)
-					precis = 2;
-				else
-#endif
-					precis = 3;
-				Printf("  %.*f ms", precis, T);
+				pr_rtt(deltaT(&t1, &t2));
 				if (printdiff) {
 					Printf("\n");
 					Printf("%*.*s%s\n",
@@ -1046,110 +1189,9 @@ main(int argc, char **argv)
 					pkt_compare((void *)outip, packlen,
 					    (void *)hip, hiplen);
 				}
-				if (i == -2) {
-#ifndef ARCHAIC
-					ip = (struct ip *)packet;
-					if (ip->ip_ttl <= 1)
-						Printf(" !");
-#endif
-					++got_there;
-					break;
-				}
-				/* time exceeded in transit */
-				if (i == -1)
-					break;
-				code = i - 1;
-				switch (code) {
-
-				case ICMP_UNREACH_PORT:
-#ifndef ARCHAIC
-					ip = (struct ip *)packet;
-					if (ip->ip_ttl <= 1)
-						Printf(" !");
-#endif
-					++got_there;
-					break;
-
-				case ICMP_UNREACH_NET:
-					++unreachable;
-					Printf(" !N");
-					break;
-
-				case ICMP_UNREACH_HOST:
-					++unreachable;
-					Printf(" !H");
-					break;
-
-				case ICMP_UNREACH_PROTOCOL:
-					++got_there;
-					Printf(" !P");
-					break;
-
-				case ICMP_UNREACH_NEEDFRAG:
-					++unreachable;
-					Printf(" !F-%d", pmtu);
-					break;
-
-				case ICMP_UNREACH_SRCFAIL:
-					++unreachable;
-					Printf(" !S");
-					break;
-
-				case ICMP_UNREACH_NET_UNKNOWN:
-					++unreachable;
-					Printf(" !U");
-					break;
-
-				case ICMP_UNREACH_HOST_UNKNOWN:
-					++unreachable;
-					Printf(" !W");
-					break;
-
-				case ICMP_UNREACH_ISOLATED:
-					++unreachable;
-					Printf(" !I");
-					break;
-
-				case ICMP_UNREACH_NET_PROHIB:
-					++unreachable;
-					Printf(" !A");
-					break;
-
-				case ICMP_UNREACH_HOST_PROHIB:
-					++unreachable;
-					Printf(" !Z");
-					break;
-
-				case ICMP_UNREACH_TOSNET:
-					++unreachable;
-					Printf(" !Q");
-					break;
-
-				case ICMP_UNREACH_TOSHOST:
-					++unreachable;
-					Printf(" !T");
-					break;
-
-				case ICMP_UNREACH_FILTER_PROHIB:
-					++unreachable;
-					Printf(" !X");
-					break;
-
-				case ICMP_UNREACH_HOST_PRECEDENCE:
-					++unreachable;
-					Printf(" !V");
-					break;
-
-				case ICMP_UNREACH_PRECEDENCE_CUTOFF:
-					++unreachable;
-					Printf(" !C");
-					break;
-
-				default:
-					++unreachable;
-					Printf(" !<%d>", code);
-					break;
-				}
+				ip = (struct ip *)packet;
+				pr_status(i, ip->ip_ttl, pmtu,
+				    &got_there, &unreachable);
 				break;
 			}
 			if (cc == 0) {
@@ -1211,6 +1253,639 @@ wait_for_reply(register int sock, register struct sockaddr_in *fromp,
 	return(cc);
 }
 
+/*
+ * Parallel mode: keep up to window probes outstanding across all ttls
+ * and, in batch mode, across several destinations at once, pacing them
+ * pausemsecs apart.  Each hop is printed as soon as it and every hop
+ * before it has all of its probes answered or timed out.  A trace then
+ * costs about one round trip plus one waittime rather than one waittime
+ * for every silent probe.
+ */
+void
+trace_parallel(register struct sockaddr_in *from, struct trace *tl, int nt)
+{
+	register struct trace *tp;
+	register struct probe *pp;
+	register struct ip *ip;
+	register int cc, i, j;
+	struct sockaddr_in *to = (struct sockaddr_in *)&whereto;
+	struct trace **act;
+	int nhops, total, nact, maxact, ndone, wnext, rr, inflight, seq;
+	int sent, paced, pending, stop, rescan;
+	struct timeval now, due, wait, lastsend, nextsend;
+	struct timezone tz;
+	struct outdata outdata;
+	fd_set *fdsp;
+	size_t nfds;
+	socklen_t fromlen;
+
+	nhops = max_ttl - first_ttl + 1;
+	total = nhops * nprobes;
+	maxact = window / nprobes;
+	if (maxact < 1)
+		maxact = 1;
+	if (maxact > nt)
+		maxact = nt;
+	if ((act = calloc(maxact, sizeof(*act))) == NULL)
+		err(1, "calloc");
+
+	nfds = howmany(s + 1, NFDBITS);
+	if ((fdsp = malloc(nfds * sizeof(fd_set))) == NULL)
+		err(1, "malloc");
+
+	nact = ndone = wnext = rr = inflight = seq = 0;
+	rescan = 1;
+	timerclear(&lastsend);
+
+	while (ndone < nt) {
+		(void)gettimeofday(&now, &tz);
+
+		/*
+		 * Start waiting traces.  In batch mode one whose prefix is
+		 * already being traced is held back until that finishes,
+		 * so it can pick up the shared hops from the cache.
+		 */
+		for (i = wnext; rescan && i < nt && nact < maxact; ++i) {
+			tp = &tl[i];
+			if (tp->t_state != T_WAIT)
+				continue;
+			if (batchfile != NULL) {
+				tp->t_hc = hc_lookup(tp->t_dst);
+				if (tp->t_hc->hc_busy)
+					continue;
+			}
+			if ((tp->t_probes = calloc(total,
+			    sizeof(*tp->t_probes))) == NULL)
+				err(1, "calloc");
+			for (j = 0; j < total; ++j)
+				tp->t_probes[j].pr_trace = tp;
+			tp->t_lastttl = max_ttl;
+			if (tp->t_hc != NULL) {
+				tp->t_hc->hc_busy = 1;
+				if (tp->t_hc->hc_nhops > 0 &&
+				    now.tv_sec - tp->t_hc->hc_time < HC_LIFETIME) {
+					tp->t_cached = tp->t_hc->hc_nhops;
+					tp->t_next = tp->t_cached * nprobes;
+					memcpy(tp->t_probes, tp->t_hc->hc_probes,
+					    tp->t_next * sizeof(*tp->t_probes));
+					for (j = 0; j < tp->t_next; ++j)
+						tp->t_probes[j].pr_trace = tp;
+				}
+			}
+			tp->t_state = T_ACTIVE;
+			act[nact++] = tp;
+		}
+		while (wnext < nt && tl[wnext].t_state != T_WAIT)
+			++wnext;
+		rescan = 0;
+
+		/*
+		 * Send as much as the window and the pacing allow, taking
+		 * one probe from each active trace in turn.
+		 */
+		paced = 0;
+		for (sent = 1; sent && !paced && inflight < window; ) {
+			sent = 0;
+			for (i = 0; i < nact && inflight < window; ++i) {
+				tp = act[(rr + i) % nact];
+				if (tp->t_next >= total ||
+				    first_ttl + tp->t_next / nprobes >
+				    tp->t_lastttl)
+					continue;
+				if (pausemsecs > 0 && timerisset(&lastsend)) {
+					nextsend.tv_sec = lastsend.tv_sec +
+					    pausemsecs / 1000;
+					nextsend.tv_usec = lastsend.tv_usec +
+					    (pausemsecs % 1000) * 1000;
+					if (nextsend.tv_usec >= 1000000) {
+						++nextsend.tv_sec;
+						nextsend.tv_usec -= 1000000;
+					}
+					if (timercmp(&now, &nextsend, <)) {
+						paced = 1;
+						break;
+					}
+				}
+				do
+					seq = (seq + 1) & (NSEQ - 1);
+				while (seq == 0 || seqtab[seq] != NULL);
+
+				pp = &tp->t_probes[tp->t_next];
+				outdata.seq = seq;
+				outdata.ttl = first_ttl + tp->t_next / nprobes;
+				memcpy(&outdata.tv, &now, sizeof(outdata.tv));
+				if (batchfile != NULL) {
+					to->sin_addr = tp->t_dst;
+					outip->ip_dst = tp->t_dst;
+				}
+				(*proto->prepare)(&outdata);
+				send_probe(seq, outdata.ttl);
+
+				pp->pr_state = PR_SENT;
+				pp->pr_seq = seq;
+				pp->pr_sent = now;
+				seqtab[seq] = pp;
+				++tp->t_next;
+				++inflight;
+				lastsend = now;
+				(void)gettimeofday(&now, &tz);
+				sent = 1;
+			}
+			if (nact > 0)
+				rr = (rr + 1) % nact;
+		}
+
+		/*
+		 * Time out stale probes.  Within a trace they were sent in
+		 * index order, so the first one still inside its waittime
+		 * ends the scan.  Remember the earliest such deadline.
+		 */
+		pending = 0;
+		for (i = 0; i < nact; ++i) {
+			tp = act[i];
+			for (j = tp->t_hop * nprobes; j < tp->t_next; ++j) {
+				pp = &tp->t_probes[j];
+				if (pp->pr_state != PR_SENT)
+					continue;
+				due = pp->pr_sent;
+				due.tv_sec += waittime;
+				if (timercmp(&now, &due, <)) {
+					if (!pending || timercmp(&due, &wait, <))
+						wait = due;
+					pending = 1;
+					break;
+				}
+				pp->pr_state = PR_DONE;
+				seqtab[pp->pr_seq] = NULL;
+				--inflight;
+			}
+		}
+
+		/*
+		 * Print the leading complete hops of every active trace and
+		 * retire the traces that are finished.
+		 */
+		for (i = 0; i < nact; ) {
+			tp = act[i];
+			if (as_path)
+				as_prefetch_trace(tp);
+			while (tp->t_hop < nhops) {
+				pp = &tp->t_probes[tp->t_hop * nprobes];
+				for (j = 0; j < nprobes; ++j)
+					if (pp[j].pr_state != PR_DONE)
+						break;
+				if (j < nprobes)
+					break;
+				if (batchfile != NULL)
+					stop = pr_record(tp, first_ttl + tp->t_hop,
+					    pp, tp->t_hop < tp->t_cached);
+				else
+					stop = pr_hop(first_ttl + tp->t_hop, pp);
+				if (stop)
+					tp->t_hop = nhops;
+				else
+					++tp->t_hop;
+			}
+			if (tp->t_hop < nhops) {
+				++i;
+				continue;
+			}
+
+			/* Forget probes still out past the destination */
+			for (j = 0; j < tp->t_next; ++j) {
+				pp = &tp->t_probes[j];
+				if (pp->pr_state == PR_SENT) {
+					seqtab[pp->pr_seq] = NULL;
+					--inflight;
+				}
+			}
+			if (tp->t_hc != NULL) {
+				hc_store(tp);
+				tp->t_hc->hc_busy = 0;
+			}
+			free(tp->t_probes);
+			tp->t_probes = NULL;
+			tp->t_state = T_DONE;
+			act[i] = act[--nact];
+			++ndone;
+			rescan = 1;
+		}
+		if (ndone >= nt)
+			break;
+
+		/*
+		 * Sleep until a reply arrives, the oldest outstanding
+		 * probe expires or the next send is due.  Don't sleep at
+		 * all if a retired trace has made room for another.
+		 */
+		if (rescan && wnext < nt)
+			wait = now;
+		else if (paced && (!pending || timercmp(&nextsend, &wait, <)))
+			wait = nextsend;
+		else if (!pending)
+			wait = now;
+		tvsub(&wait, &now);
+		if (wait.tv_sec < 0) {
+			wait.tv_sec = 0;
+			wait.tv_usec = 0;
+		}
+
+		memset(fdsp, 0, nfds * sizeof(fd_set));
+		FD_SET(s, fdsp);
+		if (select(s + 1, fdsp, NULL, NULL, &wait) < 0) {
+			if (errno == EINTR)
+				continue;
+			Fprintf(stderr, "%s: select: %s\n",
+			    prog, strerror(errno));
+			exit(1);
+		}
+
+		/* Drain everything that has queued up */
+		for (;;) {
+			fromlen = sizeof(*from);
+			cc = recvfrom(s, (char *)packet, sizeof(packet),
+			    MSG_DONTWAIT, (struct sockaddr *)from, &fromlen);
+			if (cc <= 0)
+				break;
+			(void)gettimeofday(&now, &tz);
+			if ((i = packet_ok(packet, cc, from, 0)) == 0)
+				continue;
+
+			pp = seqtab[rseq];
+			tp = pp->pr_trace;
+			ip = (struct ip *)packet;
+			pp->pr_state = PR_DONE;
+			pp->pr_code = i;
+			pp->pr_rttl = ip->ip_ttl;
+			pp->pr_cc = cc - (ip->ip_hl << 2);
+			pp->pr_mtu = pmtu;
+			pp->pr_from = *from;
+			pp->pr_dst = ip->ip_dst;
+			pp->pr_rtt = deltaT(&pp->pr_sent, &now);
+			j = first_ttl + (pp - tp->t_probes) / nprobes;
+			if ((i == -2 || i - 1 == ICMP_UNREACH_PORT ||
+			    i - 1 == ICMP_UNREACH_PROTOCOL) &&
+			    j < tp->t_lastttl)
+				tp->t_lastttl = j;
+			seqtab[rseq] = NULL;
+			--inflight;
+		}
+	}
+
+	free(fdsp);
+	free(act);
+}
+
+/*
+ * Before the leading hops of a trace are printed, look up the AS
+ * numbers of every hop that has answered so far in one pipelined
+ * batch, rather than one round trip per address as they are printed.
+ */
+void
+as_prefetch_trace(register struct trace *tp)
+{
+	register struct probe *pp;
+	register int i, n;
+	struct in_addr addrs[NSEQ];
+
+	pp = &tp->t_probes[tp->t_hop * nprobes];
+	for (i = 0; i < nprobes; ++i)
+		if (pp[i].pr_state != PR_DONE)
+			return;
+	for (n = 0; pp < &tp->t_probes[tp->t_next] && n < NSEQ; ++pp)
+		if (pp->pr_state == PR_DONE && pp->pr_code != 0)
+			addrs[n++] = pp->pr_from.sin_addr;
+	as_prefetch(asn, addrs, n);
+}
+
+/*
+ * Print one completed hop of a parallel trace in the same form the
+ * serial loop in main() uses.  Returns nonzero if tracing should stop.
+ */
+int
+pr_hop(int ttl, register struct probe *pp)
+{
+	u_int32_t lastaddr = 0;
+	int gotlastaddr = 0;
+	int got_there = 0;
+	int unreachable = 0;
+	int probe, loss;
+
+	Printf("%2d ", ttl);
+	for (probe = 0, loss = 0; probe < nprobes; ++probe, ++pp) {
+		if (pp->pr_code == 0) {
+			loss++;
+			Printf(" *");
+			continue;
+		}
+		if (!gotlastaddr ||
+		    pp->pr_from.sin_addr.s_addr != lastaddr) {
+			if (gotlastaddr) printf("\n   ");
+			print_from(&pp->pr_from, pp->pr_dst, pp->pr_cc);
+			lastaddr = pp->pr_from.sin_addr.s_addr;
+			++gotlastaddr;
+		}
+		pr_rtt(pp->pr_rtt);
+		pr_status(pp->pr_code, pp->pr_rttl, pp->pr_mtu,
+		    &got_there, &unreachable);
+	}
+	if (sump) {
+		Printf(" (%d%% loss)", (loss * 100) / nprobes);
+	}
+	putchar('\n');
+	return (got_there ||
+	    (unreachable > 0 && unreachable >= nprobes - 1));
+}
+
+/*
+ * Print one completed hop of a batch trace as a single record: the
+ * destination, the ttl, 'p' if the hop was probed or 'c' if it came
+ * from the hop cache, then for each probe either "*" or the replying
+ * address and the round trip time in milliseconds, followed by any
+ * annotation.  Returns nonzero if tracing should stop.
+ */
+int
+pr_record(struct trace *tp, int ttl, register struct probe *pp, int cached)
+{
+	int got_there = 0;
+	int unreachable = 0;
+	int probe;
+
+	Printf("%s %d %c", inet_ntoa(tp->t_dst), ttl, cached ? 'c' : 'p');
+	for (probe = 0; probe < nprobes; ++probe, ++pp) {
+		if (pp->pr_code == 0) {
+			Printf(" *");
+			continue;
+		}
+		Printf(" %s", inet_ntoa(pp->pr_from.sin_addr));
+		if (as_path)
+			Printf(" [AS%d]",
+			    as_lookup(asn, &pp->pr_from.sin_addr));
+		Printf(" %.3f", pp->pr_rtt);
+		pr_status(pp->pr_code, pp->pr_rttl, pp->pr_mtu,
+		    &got_there, &unreachable);
+	}
+	putchar('\n');
+	return (got_there ||
+	    (unreachable > 0 && unreachable >= nprobes - 1));
+}
+
+/*
+ * Read the batch mode destination list: one host name or address per
+ * line, with '#' starting a comment.  Names that do not resolve are
+ * reported and skipped.
+ */
+struct trace *
+read_batch(char *path, int *ntp)
+{
+	register FILE *fp;
+	register char *cp, *name;
+	register struct hostent *hp;
+	struct trace *tl = NULL;
+	struct in_addr addr;
+	char line[1024];
+	int n = 0, max = 0;
+
+	if ((fp = fopen(path, "r")) == NULL) {
+		Fprintf(stderr, "%s: %s: %s\n", prog, path, strerror(errno));
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if ((cp = strchr(line, '#')) != NULL)
+			*cp = '\0';
+		if ((name = strtok(line, " \t\r\n")) == NULL)
+			continue;
+		if (inet_aton(name, &addr) == 0) {
+			hp = gethostbyname(name);
+			if (hp == NULL || hp->h_addrtype != AF_INET ||
+			    hp->h_length != 4) {
+				Fprintf(stderr, "%s: unknown host %s\n",
+				    prog, name);
+				continue;
+			}
+			memcpy(&addr, hp->h_addr, sizeof(addr));
+		}
+		if (n == max) {
+			max = max ? max * 2 : 64;
+			if ((tl = realloc(tl, max * sizeof(*tl))) == NULL)
+				err(1, "realloc");
+		}
+		memset(&tl[n], 0, sizeof(tl[n]));
+		tl[n].t_dst = addr;
+		++n;
+	}
+	(void)fclose(fp);
+	if (n == 0) {
+		Fprintf(stderr, "%s: %s: no destinations\n", prog, path);
+		exit(1);
+	}
+	*ntp = n;
+	return (tl);
+}
+
+/*
+ * Find, or create, the hop cache entry for dst's prefix.
+ */
+struct hopcache *
+hc_lookup(struct in_addr dst)
+{
+	register struct hopcache *hc, **hcp;
+	u_int32_t prefix;
+
+	prefix = ntohl(dst.s_addr) & ~(0xffffffffU >> HC_PLEN);
+	hcp = &hctab[(prefix >> (32 - HC_PLEN)) % HC_NBUCKETS];
+	for (hc = *hcp; hc != NULL; hc = hc->hc_next)
+		if (hc->hc_prefix == prefix)
+			return (hc);
+	if ((hc = calloc(1, sizeof(*hc))) == NULL)
+		err(1, "calloc");
+	hc->hc_prefix = prefix;
+	hc->hc_next = *hcp;
+	*hcp = hc;
+	return (hc);
+}
+
+/*
+ * Record the leading transit hops of a finished trace in its prefix's
+ * cache entry: every hop up to the first one that drew anything but
+ * TIME_EXCEEDED, less any trailing hops where nothing answered.  A
+ * trace that itself started from the cache leaves the entry alone, so
+ * the shared hops are probed again once it expires.
+ */
+void
+hc_store(register struct trace *tp)
+{
+	register struct hopcache *hc = tp->t_hc;
+	register struct probe *pp;
+	register int hop, i;
+	int nhops, n;
+	struct timeval now;
+	struct timezone tz;
+
+	if (tp->t_cached > 0)
+		return;
+	nhops = max_ttl - first_ttl + 1;
+	for (hop = 0, n = 0; hop < nhops; ++hop) {
+		pp = &tp->t_probes[hop * nprobes];
+		for (i = 0; i < nprobes; ++i)
+			if (pp[i].pr_state != PR_DONE ||
+			    (pp[i].pr_code != 0 && pp[i].pr_code != -1))
+				break;
+		if (i < nprobes)
+			break;
+		for (i = 0; i < nprobes; ++i)
+			if (pp[i].pr_code != 0)
+				n = hop + 1;
+	}
+	/*
+	 * Leave the last transit hop to be probed afresh: it is often the
+	 * prefix's own gateway, which other destinations may stop at.
+	 */
+	if (n == hop)
+		--n;
+	if (n <= 0)
+		return;
+
+	free(hc->hc_probes);
+	if ((hc->hc_probes = malloc(n * nprobes * sizeof(*pp))) == NULL)
+		err(1, "malloc");
+	memcpy(hc->hc_probes, tp->t_probes, n * nprobes * sizeof(*pp));
+	hc->hc_nhops = n;
+	(void)gettimeofday(&now, &tz);
+	hc->hc_time = now.tv_sec;
+}
+
+void
+pr_rtt(double T)
+{
+	int precis;
+
+#ifdef SANE_PRECISION
+	if (T >= 1000.0)
+		precis = 0;
+	else if (T >= 100.0)
+		precis = 1;
+	else if (T >= 10.0)
+		precis = 2;
+	else
+#endif
+		precis = 3;
+	Printf("  %.*f ms", precis, T);
+}
+
+/*
+ * Annotate a reply given its packet_ok() result i and the ttl it
+ * arrived with, counting it towards got_there or unreachable.
+ */
+void
+pr_status(int i, int rttl, int mtu, int *got_there, int *unreachable)
+{
+	int code;
+
+	if (i == -2) {
+#ifndef ARCHAIC
+		if (rttl <= 1)
+			Printf(" !");
+#endif
+		++*got_there;
+		return;
+	}
+	/* time exceeded in transit */
+	if (i == -1)
+		return;
+	code = i - 1;
+	switch (code) {
+
+	case ICMP_UNREACH_PORT:
+#ifndef ARCHAIC
+		if (rttl <= 1)
+			Printf(" !");
+#endif
+		++*got_there;
+		break;
+
+	case ICMP_UNREACH_NET:
+		++*unreachable;
+		Printf(" !N");
+		break;
+
+	case ICMP_UNREACH_HOST:
+		++*unreachable;
+		Printf(" !H");
+		break;
+
+	case ICMP_UNREACH_PROTOCOL:
+		++*got_there;
+		Printf(" !P");
+		break;
+
+	case ICMP_UNREACH_NEEDFRAG:
+		++*unreachable;
+		Printf(" !F-%d", mtu);
+		break;
+
+	case ICMP_UNREACH_SRCFAIL:
+		++*unreachable;
+		Printf(" !S");
+		break;
+
+	case ICMP_UNREACH_NET_UNKNOWN:
+		++*unreachable;
+		Printf(" !U");
+		break;
+
+	case ICMP_UNREACH_HOST_UNKNOWN:
+		++*unreachable;
+		Printf(" !W");
+		break;
+
+	case ICMP_UNREACH_ISOLATED:
+		++*unreachable;
+		Printf(" !I");
+		break;
+
+	case ICMP_UNREACH_NET_PROHIB:
+		++*unreachable;
+		Printf(" !A");
+		break;
+
+	case ICMP_UNREACH_HOST_PROHIB:
+		++*unreachable;
+		Printf(" !Z");
+		break;
+
+	case ICMP_UNREACH_TOSNET:
+		++*unreachable;
+		Printf(" !Q");
+		break;
+
+	case ICMP_UNREACH_TOSHOST:
+		++*unreachable;
+		Printf(" !T");
+		break;
+
+	case ICMP_UNREACH_FILTER_PROHIB:
+		++*unreachable;
+		Printf(" !X");
+		break;
+
+	case ICMP_UNREACH_HOST_PRECEDENCE:
+		++*unreachable;
+		Printf(" !V");
+		break;
+
+	case ICMP_UNREACH_PRECEDENCE_CUTOFF:
+		++*unreachable;
+		Printf(" !C");
+		break;
+
+	default:
+		++*unreachable;
+		Printf(" !<%d>", code);
+		break;
+	}
+}
+
 void
 send_probe(int seq, int ttl)
 {
@@ -1314,6 +1989,32 @@ pr_type(register u_char t)
 	return(ttab[t]);
 }
 
+/*
+ * Check an incoming packet against probe seq.  A seq of 0 matches any
+ * outstanding parallel probe: hint, the seq as recovered from the reply
+ * itself, is tried first and seqtab[] is scanned if that fails.  The
+ * matching seq is left in rseq.
+ */
+int
+probe_check(const u_char *data, int seq, int hint)
+{
+	register int i;
+
+	if (seq != 0)
+		return ((*proto->check)(data, (u_char)seq));
+	hint &= NSEQ - 1;
+	if (hint != 0 && seqtab[hint] != NULL && (*proto->check)(data, hint)) {
+		rseq = hint;
+		return (1);
+	}
+	for (i = 1; i < NSEQ; ++i)
+		if (seqtab[i] != NULL && (*proto->check)(data, i)) {
+			rseq = i;
+			return (1);
+		}
+	return (0);
+}
+
 int
 packet_ok(register u_char *buf, int cc, register struct sockaddr_in *from,
     register int seq)
@@ -1351,7 +2052,7 @@ packet_ok(register u_char *buf, int cc, register struct sockaddr_in *from,
 	}
 	if (type == ICMP_ECHOREPLY
 	    && proto->num == IPPROTO_ICMP
-	    && (*proto->check)((u_char *)icp, (u_char)seq))
+	    && probe_check((u_char *)icp, seq, ntohs(icp->icmp_seq)))
 		return -2;
 	if ((type == ICMP_TIMXCEED && code == ICMP_TIMXCEED_INTRANS) ||
 	    type == ICMP_UNREACH) {
@@ -1363,7 +2064,7 @@ packet_ok(register u_char *buf, int cc, register struct sockaddr_in *from,
 		inner = (u_char *)((u_char *)hip + hlen);
 		if (hlen + 12 <= cc
 		    && hip->ip_p == proto->num
-		    && (*proto->check)(inner, (u_char)seq))
+		    && probe_check(inner, seq, ntohs(hip->ip_id) - ident))
 			return (type == ICMP_TIMXCEED ? -1 : code + 1);
 	}
 #ifndef ARCHAIC
@@ -1506,7 +2207,12 @@ print(register u_char *buf, register int cc, register struct sockaddr_in *from)
 
 	ip = (struct ip *) buf;
 	hlen = ip->ip_hl << 2;
-	cc -= hlen;
+	print_from(from, ip->ip_dst, cc - hlen);
+}
+
+void
+print_from(register struct sockaddr_in *from, struct in_addr dst, int cc)
+{
 
 	if (as_path)
 		Printf(" [AS%d]", as_lookup(asn, &from->sin_addr));
@@ -1518,7 +2224,7 @@ print(register u_char *buf, register int cc, register struct sockaddr_in *from)
 		    inet_ntoa(from->sin_addr));
 
 	if (verbose)
-		Printf(" %d bytes to %s", cc, inet_ntoa (ip->ip_dst));
+		Printf(" %d bytes to %s", cc, inet_ntoa(dst));
 }
 
 /*
@@ -1543,41 +2249,6 @@ p_cksum(struct ip *ip, u_short *data, int len)
 	return ~in_cksum((u_short*)&sumt, sizeof(sumt));
 }
 
-/*
- * Checksum routine for Internet Protocol family headers (C Version)
- */
-u_short
-in_cksum(register u_short *addr, register int len)
-{
-	register int nleft = len;
-	register u_short *w = addr;
-	register u_short answer;
-	register int sum = 0;
-
-	/*
-	 *  Our algorithm is simple, using a 32 bit accumulator (sum),
-	 *  we add sequential 16 bit words to it, and at the end, fold
-	 *  back all the carry bits from the top 16 bits into the lower
-	 *  16 bits.
-	 */
-	while (nleft > 1)  {
-		sum += *w++;
-		nleft -= 2;
-	}
-
-	/* mop up an odd byte, if necessary */
-	if (nleft == 1)
-		sum += *(u_char *)w;
-
-	/*
-	 * add back carry outs from top 16 bits to low 16 bits
-	 */
-	sum = (sum >> 16) + (sum & 0xffff);	/* add hi 16 to low 16 */
-	sum += (sum >> 16);			/* add carry */
-	answer = ~sum;				/* truncate to 16 bits */
-	return (answer);
-}
-
 /*
  * Subtract 2 timeval structs:  out = out - in.
  * Out is assumed to be within about LONG_MAX seconds of in.
@@ -1816,7 +2487,9 @@ usage(void)
 	Fprintf(stderr, "Version %s\n", version);
 	Fprintf(stderr,
 	    "Usage: %s [-adDeFInrSvx] [-A as_server] [-f first_ttl] [-g gateway] [-i iface]\n"
-	    "\t[-M first_ttl] [-m max_ttl] [-p port] [-P proto] [-q nqueries] [-s src_addr]\n"
-	    "\t[-t tos] [-w waittime] [-z pausemsecs] host [packetlen]\n", prog);
+	    "\t[-M first_ttl] [-m max_ttl] [-N nprobes] [-p port] [-P proto] [-q nqueries]\n"
+	    "\t[-s src_addr] [-t tos] [-w waittime] [-z pausemsecs] host [packetlen]\n"
+	    "       %s -B file [options] [packetlen]\n"
+	    "       %s -T\n", prog, prog, prog);
 	exit(1);
 }